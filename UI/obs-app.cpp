@@ -459,6 +459,11 @@ static bool MakeUserDirs()
 	if (!do_mkdir(path))
 		return false;
 
+	if (GetConfigPath(path, sizeof(path), "obs-studio/delay") <= 0)
+		return false;
+	if (!do_mkdir(path))
+		return false;
+
 #ifdef _WIN32
 	if (GetConfigPath(path, sizeof(path), "obs-studio/crashes") <= 0)
 		return false;
@@ -8,6 +8,20 @@
 
 using namespace std;
 
+/* long delays at high bitrates spill to disk past this */
+static void SetDelayMemoryLimit(obs_output_t *output, config_t *config)
+{
+	uint64_t maxMemoryMB = config_get_uint(config, "Output",
+			"DelayMaxMemoryMB");
+	char spillDir[512];
+
+	if (GetConfigPath(spillDir, sizeof(spillDir), "obs-studio/delay") <= 0)
+		spillDir[0] = 0;
+
+	obs_output_set_delay_memory_limit(output, maxMemoryMB * 1024 * 1024,
+			spillDir);
+}
+
 static void OBSStreamStarting(void *data, calldata_t *params)
 {
 	BasicOutputHandler *output = static_cast<BasicOutputHandler*>(data);
@@ -118,6 +132,13 @@ static void OBSReplayBufferStopping(void *data, calldata_t *params)
 	UNUSED_PARAMETER(params);
 }
 
+static void SetDedicatedVideoThread(OBSBasic *main, obs_output_t *output)
+{
+	bool dedicated = config_get_bool(main->Config(), "Output",
+			"DedicatedEncoderThreads");
+	obs_output_set_dedicated_video_thread(output, dedicated);
+}
+
 static void FindBestFilename(string &strPath, bool noSpace)
 {
 	int num = 2;
@@ -762,10 +783,13 @@ bool SimpleOutput::StartStreaming(obs_service_t *service)
 
 	obs_output_set_delay(streamOutput, useDelay ? delaySec : 0,
 			preserveDelay ? OBS_OUTPUT_DELAY_PRESERVE : 0);
+	SetDelayMemoryLimit(streamOutput, main->Config());
 
 	obs_output_set_reconnect_settings(streamOutput, maxRetries,
 			retryDelay);
 
+	SetDedicatedVideoThread(main, streamOutput);
+
 	if (obs_output_start(streamOutput)) {
 		return true;
 	}
@@ -930,6 +954,9 @@ bool SimpleOutput::StartRecording()
 	UpdateRecording();
 	if (!ConfigureRecording(false))
 		return false;
+
+	SetDedicatedVideoThread(main, fileOutput);
+
 	if (!obs_output_start(fileOutput))  {
 		QString error_reason;
 		const char *error = obs_output_get_last_error(fileOutput);
@@ -1538,10 +1565,13 @@ bool AdvancedOutput::StartStreaming(obs_service_t *service)
 
 	obs_output_set_delay(streamOutput, useDelay ? delaySec : 0,
 			preserveDelay ? OBS_OUTPUT_DELAY_PRESERVE : 0);
+	SetDelayMemoryLimit(streamOutput, main->Config());
 
 	obs_output_set_reconnect_settings(streamOutput, maxRetries,
 			retryDelay);
 
+	SetDedicatedVideoThread(main, streamOutput);
+
 	if (obs_output_start(streamOutput)) {
 		return true;
 	}
@@ -1629,6 +1659,8 @@ bool AdvancedOutput::StartRecording()
 		obs_data_release(settings);
 	}
 
+	SetDedicatedVideoThread(main, fileOutput);
+
 	if (!obs_output_start(fileOutput)) {
 		QString error_reason;
 		const char *error = obs_output_get_last_error(fileOutput);
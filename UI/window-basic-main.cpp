@@ -497,7 +497,13 @@ obs_data_array_t *OBSBasic::SaveMultiviewProjectors()
 	return saveProjector;
 }
 
-void OBSBasic::Save(const char *file)
+void OBSBasic::WaitForBackgroundSave()
+{
+	if (saveThread.joinable())
+		saveThread.join();
+}
+
+void OBSBasic::Save(const char *file, bool background)
 {
 	OBSScene scene = GetCurrentScene();
 	OBSSource curProgramScene = OBSGetStrongRef(programScene);
@@ -537,8 +543,29 @@ void OBSBasic::Save(const char *file)
 		obs_data_release(moduleObj);
 	}
 
-	if (!obs_data_save_json_safe(saveData, file, "tmp", "bak"))
+	WaitForBackgroundSave();
+
+	if (background) {
+		/* the save data still references the settings of the sources,
+		 * which keep changing while saving */
+		obs_data_t *snapshot = obs_data_snapshot(saveData);
+		std::string path = file;
+
+		saveThread = std::thread([snapshot, path] ()
+		{
+			os_set_thread_name("OBS: background save");
+
+			if (!obs_data_save_json_safe(snapshot, path.c_str(),
+						"tmp", "bak"))
+				blog(LOG_ERROR, "Could not save scene data "
+						"to %s", path.c_str());
+
+			obs_data_release(snapshot);
+		});
+
+	} else if (!obs_data_save_json_safe(saveData, file, "tmp", "bak")) {
 		blog(LOG_ERROR, "Could not save scene data to %s", file);
+	}
 
 	obs_data_release(saveData);
 	obs_data_array_release(sceneOrder);
@@ -1191,6 +1218,8 @@ bool OBSBasic::InitBasicConfigDefaults()
 	config_set_default_bool  (basicConfig, "Output", "DelayEnable", false);
 	config_set_default_uint  (basicConfig, "Output", "DelaySec", 20);
 	config_set_default_bool  (basicConfig, "Output", "DelayPreserve", true);
+	config_set_default_uint  (basicConfig, "Output", "DelayMaxMemoryMB",
+			1024);
 
 	config_set_default_bool  (basicConfig, "Output", "Reconnect", true);
 	config_set_default_uint  (basicConfig, "Output", "RetryDelay", 10);
@@ -1201,6 +1230,8 @@ bool OBSBasic::InitBasicConfigDefaults()
 			false);
 	config_set_default_bool  (basicConfig, "Output", "LowLatencyEnable",
 			false);
+	config_set_default_bool  (basicConfig, "Output",
+			"DedicatedEncoderThreads", false);
 
 	int i = 0;
 	uint32_t scale_cx = cx;
@@ -1247,6 +1278,7 @@ bool OBSBasic::InitBasicConfigDefaults()
 			"Stereo");
 	config_set_default_double(basicConfig, "Audio", "MeterDecayRate",
 			VOLUME_METER_DECAY_FAST);
+	config_set_default_uint  (basicConfig, "Audio", "RenderThreads", 0);
 
 	return true;
 }
@@ -1877,6 +1909,8 @@ OBSBasic::~OBSBasic()
 	if (updateCheckThread && updateCheckThread->isRunning())
 		updateCheckThread->wait();
 
+	WaitForBackgroundSave();
+
 	delete programOptions;
 	delete program;
 
@@ -1970,7 +2004,7 @@ void OBSBasic::SaveProjectNow()
 		return;
 
 	projectChanged = true;
-	SaveProjectDeferred();
+	SaveProjectInternal(false);
 }
 
 void OBSBasic::SaveProject()
@@ -1984,6 +2018,11 @@ void OBSBasic::SaveProject()
 }
 
 void OBSBasic::SaveProjectDeferred()
+{
+	SaveProjectInternal(true);
+}
+
+void OBSBasic::SaveProjectInternal(bool background)
 {
 	if (disableSaving)
 		return;
@@ -2011,7 +2050,7 @@ void OBSBasic::SaveProjectDeferred()
 	if (ret <= 0)
 		return;
 
-	Save(savePath);
+	Save(savePath, background);
 }
 
 OBSSource OBSBasic::GetProgramSource()
@@ -3138,6 +3177,9 @@ int OBSBasic::ResetVideo()
 	ovi.gpu_conversion = true;
 	ovi.scale_type     = GetScaleType(basicConfig);
 
+	obs_set_video_readback_depth((uint32_t)config_get_uint(basicConfig,
+			"Video", "ReadbackDepth"));
+
 	if (ovi.base_width == 0 || ovi.base_height == 0) {
 		ovi.base_width = 1920;
 		ovi.base_height = 1080;
@@ -3210,6 +3252,9 @@ bool OBSBasic::ResetAudio()
 	else
 		ai.speakers = SPEAKERS_STEREO;
 
+	obs_set_audio_render_threads((uint32_t)config_get_uint(basicConfig,
+			"Audio", "RenderThreads"));
+
 	return obs_reset_audio(&ai);
 }
 
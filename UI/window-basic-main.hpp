@@ -23,6 +23,7 @@
 #include <obs.hpp>
 #include <vector>
 #include <memory>
+#include <thread>
 #include "window-main.hpp"
 #include "window-basic-interaction.hpp"
 #include "window-basic-properties.hpp"
@@ -137,6 +138,7 @@ private:
 
 	QPointer<QThread> updateCheckThread;
 	QPointer<QThread> logUploadThread;
+	std::thread saveThread;
 
 	QPointer<OBSBasicInteraction> interaction;
 	QPointer<OBSBasicProperties> properties;
@@ -198,7 +200,9 @@ private:
 
 	void          UploadLog(const char *file);
 
-	void          Save(const char *file);
+	void          Save(const char *file, bool background = false);
+	void          WaitForBackgroundSave();
+	void          SaveProjectInternal(bool background);
 	void          Load(const char *file);
 
 	void          InitHotkeys();
@@ -1737,6 +1737,11 @@ void device_projection_pop(gs_device_t *device)
 	device->projStack.pop_back();
 }
 
+void device_get_projection(const gs_device_t *device, matrix4 *projection)
+{
+	matrix4_copy(projection, &device->curProjMatrix);
+}
+
 void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 {
 	if (swapchain->device->curSwapChain == swapchain)
@@ -1893,6 +1898,19 @@ enum gs_color_format gs_stagesurface_get_color_format(
 	return stagesurf->format;
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	D3D11_MAPPED_SUBRESOURCE map;
+	HRESULT hr = stagesurf->device->context->Map(stagesurf->texture, 0,
+			D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &map);
+
+	if (hr == DXGI_ERROR_WAS_STILL_DRAWING)
+		return false;
+	if (SUCCEEDED(hr))
+		stagesurf->device->context->Unmap(stagesurf->texture, 0);
+	return true;
+}
+
 bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize)
 {
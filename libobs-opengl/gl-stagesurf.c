@@ -32,9 +32,26 @@ static bool create_pixel_pack_buffer(struct gs_stage_surface *surf)
 	size  = (size+3) & 0xFFFFFFFC; /* align width to 4-byte boundary */
 	size *= surf->height;
 
-	glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_DYNAMIC_READ);
-	if (!gl_success("glBufferData"))
-		success = false;
+	if (surf->device->has_buffer_storage) {
+		const GLbitfield flags = GL_MAP_READ_BIT |
+			GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_PIXEL_PACK_BUFFER, size, 0, flags);
+		if (!gl_success("glBufferStorage"))
+			success = false;
+
+		if (success) {
+			surf->persistent_data = glMapBufferRange(
+					GL_PIXEL_PACK_BUFFER, 0, size, flags);
+			if (!gl_success("glMapBufferRange") ||
+			    !surf->persistent_data)
+				success = false;
+		}
+	} else {
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_DYNAMIC_READ);
+		if (!gl_success("glBufferData"))
+			success = false;
+	}
 
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0))
 		success = false;
@@ -65,9 +82,39 @@ gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
 	return surf;
 }
 
+static void delete_fence(struct gs_stage_surface *surf)
+{
+	if (surf->fence) {
+		glDeleteSync(surf->fence);
+		surf->fence = NULL;
+	}
+}
+
+/* called after each staging copy, so the surface can be polled instead of
+ * blocking in glMapBuffer */
+static void insert_fence(struct gs_stage_surface *surf)
+{
+	if (!surf->device->has_sync)
+		return;
+
+	delete_fence(surf);
+	surf->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	gl_success("glFenceSync");
+}
+
 void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
 {
 	if (stagesurf) {
+		delete_fence(stagesurf);
+
+		if (stagesurf->persistent_data &&
+		    gl_bind_buffer(GL_PIXEL_PACK_BUFFER,
+			    stagesurf->pack_buffer)) {
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			gl_success("glUnmapBuffer");
+			gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
+		}
+
 		if (stagesurf->pack_buffer)
 			gl_delete_buffers(1, &stagesurf->pack_buffer);
 
@@ -141,6 +188,7 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glReadPixels"))
 		goto failed_unbind_all;
 
+	insert_fence(dst);
 	success = true;
 
 failed_unbind_all:
@@ -172,6 +220,8 @@ void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
 	if (!gl_success("glGetTexImage"))
 		goto failed;
 
+	insert_fence(dst);
+
 	gl_bind_texture(GL_TEXTURE_2D, 0);
 	gl_bind_buffer(GL_PIXEL_PACK_BUFFER, 0);
 	return;
@@ -202,9 +252,49 @@ enum gs_color_format gs_stagesurface_get_color_format(
 	return stagesurf->format;
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	GLenum ret;
+
+	if (!stagesurf->fence)
+		return true;
+
+	/* only polls, the flush makes sure the fence is eventually reached */
+	ret = glClientWaitSync(stagesurf->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (ret == GL_ALREADY_SIGNALED || ret == GL_CONDITION_SATISFIED) {
+		delete_fence(stagesurf);
+		return true;
+	}
+
+	if (ret == GL_WAIT_FAILED) {
+		gl_success("glClientWaitSync");
+		delete_fence(stagesurf);
+		return true;
+	}
+
+	return false;
+}
+
 bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize)
 {
+	if (stagesurf->persistent_data) {
+		/* still waits if the copy has not finished yet, callers that
+		 * must not stall check gs_stagesurface_ready first */
+		if (stagesurf->fence) {
+			glClientWaitSync(stagesurf->fence,
+					GL_SYNC_FLUSH_COMMANDS_BIT,
+					GL_TIMEOUT_IGNORED);
+			delete_fence(stagesurf);
+		}
+
+		*data = stagesurf->persistent_data;
+		*linesize = stagesurf->bytes_per_pixel * stagesurf->width;
+		return true;
+	}
+
+	delete_fence(stagesurf);
+
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
 		goto fail;
 
@@ -224,6 +314,9 @@ fail:
 
 void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 {
+	if (stagesurf->persistent_data)
+		return;
+
 	if (!gl_bind_buffer(GL_PIXEL_PACK_BUFFER, stagesurf->pack_buffer))
 		return;
 
@@ -142,6 +142,10 @@ static bool gl_init_extensions(struct gs_device* device)
 	else
 		device->copy_type = COPY_TYPE_FBO_BLIT;
 
+	device->has_sync = GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+	device->has_buffer_storage = device->has_sync &&
+		(GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage);
+
 	return true;
 }
 
@@ -1357,6 +1361,12 @@ void device_projection_pop(gs_device_t *device)
 	da_pop_back(device->proj_stack);
 }
 
+void device_get_projection(const gs_device_t *device,
+		struct matrix4 *projection)
+{
+	matrix4_copy(projection, &device->cur_proj);
+}
+
 void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 {
 	if (!swapchain)
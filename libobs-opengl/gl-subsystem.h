@@ -438,6 +438,13 @@ struct gs_stage_surface {
 	GLint                gl_internal_format;
 	GLenum               gl_type;
 	GLuint               pack_buffer;
+
+	/* signaled once the last staged copy has landed in the pack buffer */
+	GLsync               fence;
+
+	/* pack buffers created with glBufferStorage stay mapped for their
+	 * whole lifetime, map/unmap only wait for the copy */
+	uint8_t              *persistent_data;
 };
 
 struct gs_zstencil_buffer {
@@ -477,6 +484,8 @@ static inline void fbo_info_destroy(struct fbo_info *fbo)
 struct gs_device {
 	struct gl_platform   *plat;
 	enum copy_type       copy_type;
+	bool                 has_sync;
+	bool                 has_buffer_storage;
 
 	gs_texture_t         *cur_render_target;
 	gs_zstencil_t        *cur_zstencil_buffer;
@@ -14,45 +14,344 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
-#include "../util/darray.h"
+#include "../util/bmem.h"
+#include "../util/platform.h"
+#include "../util/profiler.h"
 #include "../util/threading.h"
 
 #include "decl.h"
 #include "signal.h"
 
-struct signal_callback {
-	signal_callback_t callback;
-	void              *data;
-	bool              remove;
+/* ------------------------------------------------------------------------- */
+/* Callback lists
+ *
+ *   Emitting a signal never takes a lock.  The callbacks connected to a
+ * signal are kept in an array that is never modified once published;
+ * connecting or disconnecting replaces the whole array.  Emitters take a
+ * reference to the array they call, and replaced arrays are freed once
+ * nothing references them anymore.
+ *
+ *   Every entry counts the calls of it that are in progress, and disconnect
+ * waits for the calls of the removed callback in the current list and in
+ * every replaced list still being called, so once disconnect returns the
+ * callback is not being called anymore (except further up the stack of the
+ * thread that disconnected it, like with the recursive mutex before). */
+
+struct callback_entry {
+	signal_callback_t        callback;
+	global_signal_callback_t global_callback;
+	void                     *data;
+	volatile bool            remove;
+	volatile long            calls;
 };
 
-struct signal_info {
-	struct decl_info               func;
-	DARRAY(struct signal_callback) callbacks;
-	pthread_mutex_t                mutex;
-	bool                           signalling;
+struct callback_list {
+	volatile long            refs;
 
-	struct signal_info             *next;
+	/* disconnects waiting for calls of entries of this list */
+	long                     waiters;
+
+	struct callback_list     *next_retired;
+	size_t                   num;
+	struct callback_entry    entries[];
 };
 
-static inline struct signal_info *signal_info_create(struct decl_info *info)
+struct callback_set {
+	struct callback_list     *volatile list;
+
+	/* emitters that loaded the list but did not reference it yet */
+	volatile long            pinning;
+
+	/* serializes replacing the list */
+	pthread_mutex_t          mutex;
+
+	/* replaced lists that were still referenced when they were replaced */
+	struct callback_list     *retired;
+};
+
+/* the lists and callbacks the thread is calling, innermost first */
+struct emission {
+	struct callback_list     *list;
+	struct callback_entry    *cb;
+	struct emission          *prev;
+};
+
+static THREAD_LOCAL struct emission *cur_emission = NULL;
+
+/* an entry of a list whose calls a disconnect waits for */
+struct call_wait {
+	struct callback_list     *list;
+	struct callback_entry    *entry;
+};
+
+static inline struct callback_list *load_list(struct callback_set *set)
+{
+	return os_atomic_load_ptr((void *const volatile *)&set->list);
+}
+
+static bool callback_set_init(struct callback_set *set)
 {
 	pthread_mutexattr_t attr;
-	struct signal_info *si;
+
+	memset(set, 0, sizeof(*set));
 
 	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
+		return false;
 	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
+		return false;
+
+	return pthread_mutex_init(&set->mutex, &attr) == 0;
+}
+
+static void callback_set_free(struct callback_set *set)
+{
+	struct callback_list *retired = set->retired;
+
+	while (retired) {
+		struct callback_list *next = retired->next_retired;
+		bfree(retired);
+		retired = next;
+	}
+
+	bfree(set->list);
+	pthread_mutex_destroy(&set->mutex);
+}
+
+static struct callback_list *callback_set_acquire(struct callback_set *set,
+		struct emission *emission)
+{
+	struct callback_list *list;
+
+	if (!load_list(set))
 		return NULL;
 
-	si = bmalloc(sizeof(struct signal_info));
+	os_atomic_inc_long(&set->pinning);
+	list = load_list(set);
+	if (list)
+		os_atomic_inc_long(&list->refs);
+	os_atomic_dec_long(&set->pinning);
+
+	if (list) {
+		emission->list = list;
+		emission->cb   = NULL;
+		emission->prev = cur_emission;
+		cur_emission   = emission;
+	}
+
+	return list;
+}
+
+static inline void callback_set_release(struct emission *emission)
+{
+	cur_emission = emission->prev;
+	os_atomic_dec_long(&emission->list->refs);
+}
+
+/* calls of the entry further up the stack of this thread */
+static long thread_entry_calls(const struct callback_entry *entry)
+{
+	long calls = 0;
+
+	for (struct emission *e = cur_emission; e; e = e->prev) {
+		if (e->cb == entry)
+			calls++;
+	}
+
+	return calls;
+}
+
+static inline bool entry_matches(const struct callback_entry *a,
+		const struct callback_entry *b)
+{
+	return a->callback == b->callback &&
+	       a->global_callback == b->global_callback &&
+	       a->data == b->data;
+}
+
+/* the remove mark and call count of the source are left behind, they are
+ * updated by other threads */
+static inline void copy_entry(struct callback_entry *dst,
+		const struct callback_entry *src)
+{
+	dst->callback        = src->callback;
+	dst->global_callback = src->global_callback;
+	dst->data            = src->data;
+	dst->remove          = false;
+	dst->calls           = 0;
+}
+
+/* set->mutex must be locked.  if waits is given, the matching entries are
+ * added to it and the list is kept from being freed until they are waited
+ * for */
+static void mark_removed(struct callback_list *list,
+		const struct callback_entry *entry, struct darray *waits)
+{
+	DARRAY(struct call_wait) w;
+
+	if (!list)
+		return;
+
+	if (waits)
+		w.da = *waits;
 
-	si->func       = *info;
-	si->next       = NULL;
-	si->signalling = false;
-	da_init(si->callbacks);
+	for (size_t i = 0; i < list->num; i++) {
+		struct callback_entry *cur = list->entries + i;
 
-	if (pthread_mutex_init(&si->mutex, &attr) != 0) {
+		if (!entry_matches(cur, entry))
+			continue;
+
+		os_atomic_set_bool(&cur->remove, true);
+
+		if (waits) {
+			struct call_wait *wait = da_push_back_new(w);
+			wait->list  = list;
+			wait->entry = cur;
+			list->waiters++;
+		}
+	}
+
+	if (waits)
+		*waits = w.da;
+}
+
+/* set->mutex must be locked */
+static void free_retired_lists(struct callback_set *set)
+{
+	struct callback_list **p_list = &set->retired;
+
+	while (*p_list) {
+		struct callback_list *list = *p_list;
+
+		if (!list->waiters && os_atomic_load_long(&list->refs) == 0) {
+			*p_list = list->next_retired;
+			bfree(list);
+		} else {
+			p_list = &list->next_retired;
+		}
+	}
+}
+
+/* waits for the calls of the removed callback made by other threads.  the
+ * entry is marked as removed first, and emitters count a call before they
+ * check the mark, so no new call can start once this sees no calls */
+static void wait_for_calls(struct darray *array)
+{
+	DARRAY(struct call_wait) waits;
+	waits.da = *array;
+
+	for (size_t i = 0; i < waits.num; i++) {
+		struct callback_entry *entry = waits.array[i].entry;
+		long own_calls = thread_entry_calls(entry);
+
+		while (os_atomic_load_long(&entry->calls) > own_calls)
+			os_sleep_ms(1);
+	}
+}
+
+/* replaces the list with a copy that has add appended and remove (as well
+ * as anything marked as removed) left out.  calls of the removed callback
+ * are waited for unless wait is false */
+static void callback_set_update(struct callback_set *set,
+		const struct callback_entry *add,
+		const struct callback_entry *remove, bool wait)
+{
+	DARRAY(struct call_wait) waits;
+	struct callback_list *old, *list = NULL;
+	size_t num = 0;
+
+	da_init(waits);
+
+	pthread_mutex_lock(&set->mutex);
+	old = set->list;
+
+	if (add && old) {
+		for (size_t i = 0; i < old->num; i++) {
+			struct callback_entry *entry = old->entries + i;
+			if (entry_matches(entry, add) &&
+			    !os_atomic_load_bool(&entry->remove)) {
+				pthread_mutex_unlock(&set->mutex);
+				return;
+			}
+		}
+	}
+
+	if (remove) {
+		struct callback_list *retired = set->retired;
+		struct darray *p_waits = wait ? &waits.da : NULL;
+
+		mark_removed(old, remove, p_waits);
+		for (; retired; retired = retired->next_retired)
+			mark_removed(retired, remove, p_waits);
+	}
+
+	if (old || add) {
+		size_t max = (old ? old->num : 0) + (add ? 1 : 0);
+
+		list = bmalloc(sizeof(struct callback_list) +
+				max * sizeof(struct callback_entry));
+		list->refs = 0;
+		list->waiters = 0;
+		list->next_retired = NULL;
+
+		for (size_t i = 0; old && i < old->num; i++) {
+			if (!os_atomic_load_bool(&old->entries[i].remove))
+				copy_entry(list->entries + num++,
+						old->entries + i);
+		}
+
+		if (add)
+			copy_entry(list->entries + num++, add);
+
+		list->num = num;
+		if (!num) {
+			bfree(list);
+			list = NULL;
+		}
+	}
+
+	os_atomic_set_ptr((void *volatile *)&set->list, list);
+	pthread_mutex_unlock(&set->mutex);
+
+	wait_for_calls(&waits.da);
+
+	/* once nothing is between loading and referencing the list, the old
+	 * one can't gain any new references */
+	while (old && os_atomic_load_long(&set->pinning) > 0)
+		os_sleep_ms(0);
+
+	pthread_mutex_lock(&set->mutex);
+
+	for (size_t i = 0; i < waits.num; i++)
+		waits.array[i].list->waiters--;
+
+	/* lists still being called are freed once the calls are done */
+	if (old) {
+		old->next_retired = set->retired;
+		set->retired = old;
+	}
+
+	free_retired_lists(set);
+	pthread_mutex_unlock(&set->mutex);
+
+	da_free(waits);
+}
+
+/* ------------------------------------------------------------------------- */
+
+struct signal_info {
+	struct decl_info               func;
+	struct callback_set            callbacks;
+
+	struct signal_info             *volatile next;
+};
+
+static inline struct signal_info *signal_info_create(struct decl_info *info)
+{
+	struct signal_info *si = bzalloc(sizeof(struct signal_info));
+
+	si->func = *info;
+
+	if (!callback_set_init(&si->callbacks)) {
 		blog(LOG_ERROR, "Could not create signal");
 
 		decl_info_free(&si->func);
@@ -66,53 +365,39 @@ static inline struct signal_info *signal_info_create(struct decl_info *info)
 static inline void signal_info_destroy(struct signal_info *si)
 {
 	if (si) {
-		pthread_mutex_destroy(&si->mutex);
+		callback_set_free(&si->callbacks);
 		decl_info_free(&si->func);
-		da_free(si->callbacks);
 		bfree(si);
 	}
 }
 
-static inline size_t signal_get_callback_idx(struct signal_info *si,
-		signal_callback_t callback, void *data)
-{
-	for (size_t i = 0; i < si->callbacks.num; i++) {
-		struct signal_callback *sc = si->callbacks.array+i;
-
-		if (sc->callback == callback && sc->data == data)
-			return i;
-	}
-
-	return DARRAY_INVALID;
-}
-
-struct global_callback_info {
-	global_signal_callback_t callback;
-	void                     *data;
-	long                     signaling;
-	bool                     remove;
-};
-
 struct signal_handler {
-	struct signal_info *first;
-	pthread_mutex_t    mutex;
+	/* signals are only ever appended, so they can be looked up without
+	 * locking */
+	struct signal_info  *volatile first;
+	pthread_mutex_t     mutex;
 
-	DARRAY(struct global_callback_info) global_callbacks;
-	pthread_mutex_t                     global_callbacks_mutex;
+	struct callback_set global_callbacks;
 };
 
+static inline struct signal_info *next_signal(struct signal_info *const
+		volatile *p_signal)
+{
+	return os_atomic_load_ptr((void *const volatile *)p_signal);
+}
+
 static struct signal_info *getsignal(signal_handler_t *handler,
 		const char *name, struct signal_info **p_last)
 {
 	struct signal_info *signal, *last= NULL;
 
-	signal = handler->first;
+	signal = next_signal(&handler->first);
 	while (signal != NULL) {
 		if (strcmp(signal->func.name, name) == 0)
 			break;
 
 		last = signal;
-		signal = signal->next;
+		signal = next_signal(&signal->next);
 	}
 
 	if (p_last)
@@ -127,18 +412,12 @@ signal_handler_t *signal_handler_create(void)
 	struct signal_handler *handler = bzalloc(sizeof(struct signal_handler));
 	handler->first = NULL;
 
-	pthread_mutexattr_t attr;
-	if (pthread_mutexattr_init(&attr) != 0)
-		return NULL;
-	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
-		return NULL;
-
 	if (pthread_mutex_init(&handler->mutex, NULL) != 0) {
 		blog(LOG_ERROR, "Couldn't create signal handler mutex!");
 		bfree(handler);
 		return NULL;
 	}
-	if (pthread_mutex_init(&handler->global_callbacks_mutex, &attr) != 0) {
+	if (!callback_set_init(&handler->global_callbacks)) {
 		blog(LOG_ERROR, "Couldn't create signal handler global "
 				"callbacks mutex!");
 		pthread_mutex_destroy(&handler->mutex);
@@ -159,8 +438,7 @@ void signal_handler_destroy(signal_handler_t *handler)
 			sig = next;
 		}
 
-		da_free(handler->global_callbacks);
-		pthread_mutex_destroy(&handler->global_callbacks_mutex);
+		callback_set_free(&handler->global_callbacks);
 		pthread_mutex_destroy(&handler->mutex);
 		bfree(handler);
 	}
@@ -187,9 +465,10 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 	} else {
 		sig = signal_info_create(&func);
 		if (!last)
-			handler->first = sig;
+			os_atomic_set_ptr((void *volatile *)&handler->first,
+					sig);
 		else
-			last->next = sig;
+			os_atomic_set_ptr((void *volatile *)&last->next, sig);
 	}
 
 	pthread_mutex_unlock(&handler->mutex);
@@ -200,178 +479,126 @@ bool signal_handler_add(signal_handler_t *handler, const char *signal_decl)
 void signal_handler_connect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig, *last;
-	struct signal_callback cb_data = {callback, data, false};
-	size_t idx;
+	struct callback_entry entry = {callback, NULL, data, false, 0};
+	struct signal_info *sig;
 
 	if (!handler)
 		return;
 
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, signal, &last);
-	pthread_mutex_unlock(&handler->mutex);
-
+	sig = getsignal(handler, signal, NULL);
 	if (!sig) {
 		blog(LOG_WARNING, "signal_handler_connect: "
 		                  "signal '%s' not found", signal);
 		return;
 	}
 
-	/* -------------- */
-
-	pthread_mutex_lock(&sig->mutex);
-
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx == DARRAY_INVALID)
-		da_push_back(sig->callbacks, &cb_data);
-
-	pthread_mutex_unlock(&sig->mutex);
-}
-
-static inline struct signal_info *getsignal_locked(signal_handler_t *handler,
-		const char *name)
-{
-	struct signal_info *sig;
-
-	if (!handler)
-		return NULL;
-
-	pthread_mutex_lock(&handler->mutex);
-	sig = getsignal(handler, name, NULL);
-	pthread_mutex_unlock(&handler->mutex);
-
-	return sig;
+	callback_set_update(&sig->callbacks, &entry, NULL, false);
 }
 
 void signal_handler_disconnect(signal_handler_t *handler, const char *signal,
 		signal_callback_t callback, void *data)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
-	size_t idx;
+	struct callback_entry entry = {callback, NULL, data, false, 0};
+	struct signal_info *sig;
 
-	if (!sig)
+	if (!handler)
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
-
-	idx = signal_get_callback_idx(sig, callback, data);
-	if (idx != DARRAY_INVALID) {
-		if (sig->signalling)
-			sig->callbacks.array[idx].remove = true;
-		else
-			da_erase(sig->callbacks, idx);
-	}
-
-	pthread_mutex_unlock(&sig->mutex);
+	sig = getsignal(handler, signal, NULL);
+	if (sig)
+		callback_set_update(&sig->callbacks, NULL, &entry, true);
 }
 
-static THREAD_LOCAL struct signal_callback *current_signal_cb = NULL;
-static THREAD_LOCAL struct global_callback_info *current_global_cb = NULL;
-
 void signal_handler_remove_current(void)
 {
-	if (current_signal_cb)
-		current_signal_cb->remove = true;
-	else if (current_global_cb)
-		current_global_cb->remove = true;
+	if (cur_emission && cur_emission->cb)
+		os_atomic_set_bool(&cur_emission->cb->remove, true);
 }
 
-void signal_handler_signal(signal_handler_t *handler, const char *signal,
+static void call_callbacks(struct callback_set *set, const char *signal,
 		calldata_t *params)
 {
-	struct signal_info *sig = getsignal_locked(handler, signal);
+	struct emission emission;
+	struct callback_list *list = callback_set_acquire(set, &emission);
+	bool removed = false;
 
-	if (!sig)
+	if (!list)
 		return;
 
-	pthread_mutex_lock(&sig->mutex);
-	sig->signalling = true;
+	for (size_t i = 0; i < list->num; i++) {
+		struct callback_entry *cb = list->entries + i;
 
-	for (size_t i = 0; i < sig->callbacks.num; i++) {
-		struct signal_callback *cb = sig->callbacks.array+i;
-		if (!cb->remove) {
-			current_signal_cb = cb;
-			cb->callback(cb->data, params);
-			current_signal_cb = NULL;
+		/* counted before checking the mark, see wait_for_calls */
+		os_atomic_inc_long(&cb->calls);
+
+		if (!os_atomic_load_bool(&cb->remove)) {
+			emission.cb = cb;
+			if (cb->global_callback)
+				cb->global_callback(cb->data, signal, params);
+			else
+				cb->callback(cb->data, params);
+			emission.cb = NULL;
 		}
+
+		os_atomic_dec_long(&cb->calls);
+
+		if (os_atomic_load_bool(&cb->remove))
+			removed = true;
 	}
 
-	for (size_t i = sig->callbacks.num; i > 0; i--) {
-		struct signal_callback *cb = sig->callbacks.array+i-1;
-		if (cb->remove)
-			da_erase(sig->callbacks, i-1);
+	/* callbacks that removed themselves or were disconnected meanwhile,
+	 * whoever disconnected them already waited for their calls */
+	for (size_t i = 0; removed && i < list->num; i++) {
+		if (os_atomic_load_bool(&list->entries[i].remove))
+			callback_set_update(set, NULL, list->entries + i,
+					false);
 	}
 
-	sig->signalling = false;
-	pthread_mutex_unlock(&sig->mutex);
+	callback_set_release(&emission);
+}
 
-	pthread_mutex_lock(&handler->global_callbacks_mutex);
+static const char *signal_handler_signal_name = "signal_handler_signal";
 
-	if (handler->global_callbacks.num) {
-		for (size_t i = 0; i < handler->global_callbacks.num; i++) {
-			struct global_callback_info *cb =
-				handler->global_callbacks.array + i;
+void signal_handler_signal(signal_handler_t *handler, const char *signal,
+		calldata_t *params)
+{
+	struct signal_info *sig;
 
-			if (!cb->remove) {
-				cb->signaling++;
-				current_global_cb = cb;
-				cb->callback(cb->data, signal, params);
-				current_global_cb = NULL;
-				cb->signaling--;
-			}
-		}
+	if (!handler)
+		return;
 
-		for (size_t i = handler->global_callbacks.num; i > 0; i--) {
-			struct global_callback_info *cb =
-				handler->global_callbacks.array + (i - 1);
+	sig = getsignal(handler, signal, NULL);
+	if (!sig)
+		return;
 
-			if (cb->remove && !cb->signaling)
-				da_erase(handler->global_callbacks, i - 1);
-		}	
-	}
+	profile_start(signal_handler_signal_name);
 
-	pthread_mutex_unlock(&handler->global_callbacks_mutex);
+	call_callbacks(&sig->callbacks, signal, params);
+	call_callbacks(&handler->global_callbacks, signal, params);
+
+	profile_end(signal_handler_signal_name);
 }
 
 void signal_handler_connect_global(signal_handler_t *handler,
 		global_signal_callback_t callback, void *data)
 {
-	struct global_callback_info cb_data = {callback, data, 0, false};
-	size_t idx;
+	struct callback_entry entry = {NULL, callback, data, false, 0};
 
 	if (!handler || !callback)
 		return;
 
-	pthread_mutex_lock(&handler->global_callbacks_mutex);
-
-	idx = da_find(handler->global_callbacks, &cb_data, 0);
-	if (idx == DARRAY_INVALID)
-		da_push_back(handler->global_callbacks, &cb_data);
-
-	pthread_mutex_unlock(&handler->global_callbacks_mutex);
+	callback_set_update(&handler->global_callbacks, &entry, NULL,
+			false);
 }
 
 void signal_handler_disconnect_global(signal_handler_t *handler,
 		global_signal_callback_t callback, void *data)
 {
-	struct global_callback_info cb_data = {callback, data, false};
-	size_t idx;
+	struct callback_entry entry = {NULL, callback, data, false, 0};
 
 	if (!handler || !callback)
 		return;
 
-	pthread_mutex_lock(&handler->global_callbacks_mutex);
-
-	idx = da_find(handler->global_callbacks, &cb_data, 0);
-	if (idx != DARRAY_INVALID) {
-		struct global_callback_info *cb =
-			handler->global_callbacks.array + idx;
-
-		if (cb->signaling)
-			cb->remove = true;
-		else
-			da_erase(handler->global_callbacks, idx);
-	}
-
-	pthread_mutex_unlock(&handler->global_callbacks_mutex);
+	callback_set_update(&handler->global_callbacks, NULL, &entry,
+			true);
 }
@@ -142,6 +142,8 @@ EXPORT void device_frustum(gs_device_t *device, float left, float right,
 		float top, float bottom, float znear, float zfar);
 EXPORT void device_projection_push(gs_device_t *device);
 EXPORT void device_projection_pop(gs_device_t *device);
+EXPORT void device_get_projection(const gs_device_t *device,
+		struct matrix4 *projection);
 
 #ifdef __cplusplus
 }
@@ -148,6 +148,8 @@ struct gs_exports {
 			float top, float bottom, float znear, float zfar);
 	void (*device_projection_push)(gs_device_t *device);
 	void (*device_projection_pop)(gs_device_t *device);
+	void (*device_get_projection)(const gs_device_t *device,
+			struct matrix4 *projection);
 
 	void     (*gs_swapchain_destroy)(gs_swapchain_t *swapchain);
 
@@ -182,6 +184,7 @@ struct gs_exports {
 	bool     (*gs_stagesurface_map)(gs_stagesurf_t *stagesurf,
 			uint8_t **data, uint32_t *linesize);
 	void     (*gs_stagesurface_unmap)(gs_stagesurf_t *stagesurf);
+	bool     (*gs_stagesurface_ready)(gs_stagesurf_t *stagesurf);
 
 	void (*gs_zstencil_destroy)(gs_zstencil_t *zstencil);
 
@@ -1246,6 +1246,20 @@ void gs_reset_blend_state(void)
 				GS_BLEND_ONE, GS_BLEND_ONE);
 }
 
+bool gs_blend_state_is_default(void)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_blend_state_is_default"))
+		return false;
+
+	return graphics->cur_blend_state.enabled &&
+	       graphics->cur_blend_state.src_c  == GS_BLEND_SRCALPHA &&
+	       graphics->cur_blend_state.dest_c == GS_BLEND_INVSRCALPHA &&
+	       graphics->cur_blend_state.src_a  == GS_BLEND_ONE &&
+	       graphics->cur_blend_state.dest_a == GS_BLEND_ONE;
+}
+
 /* ------------------------------------------------------------------------- */
 
 const char *gs_preprocessor_name(void)
@@ -1887,6 +1901,21 @@ void gs_blend_function_separate(
 			src_c, dest_c, src_a, dest_a);
 }
 
+void gs_get_blend_function_separate(
+		enum gs_blend_type *src_c, enum gs_blend_type *dest_c,
+		enum gs_blend_type *src_a, enum gs_blend_type *dest_a)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid("gs_get_blend_function_separate"))
+		return;
+
+	*src_c  = graphics->cur_blend_state.src_c;
+	*dest_c = graphics->cur_blend_state.dest_c;
+	*src_a  = graphics->cur_blend_state.src_a;
+	*dest_a = graphics->cur_blend_state.dest_a;
+}
+
 void gs_depth_function(enum gs_depth_test test)
 {
 	graphics_t *graphics = thread_graphics;
@@ -1984,6 +2013,16 @@ void gs_projection_push(void)
 	graphics->exports.device_projection_push(graphics->device);
 }
 
+void gs_get_projection(struct matrix4 *projection)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_get_projection", projection))
+		return;
+
+	graphics->exports.device_get_projection(graphics->device, projection);
+}
+
 void gs_projection_pop(void)
 {
 	graphics_t *graphics = thread_graphics;
@@ -2423,6 +2462,19 @@ bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 	return graphics->exports.gs_stagesurface_map(stagesurf, data, linesize);
 }
 
+bool gs_stagesurface_ready(gs_stagesurf_t *stagesurf)
+{
+	graphics_t *graphics = thread_graphics;
+
+	if (!gs_valid_p("gs_stagesurface_ready", stagesurf))
+		return false;
+
+	if (graphics->exports.gs_stagesurface_ready)
+		return graphics->exports.gs_stagesurface_ready(stagesurf);
+	else
+		return true;
+}
+
 void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
 {
 	graphics_t *graphics = thread_graphics;
@@ -563,6 +563,7 @@ EXPORT void gs_perspective(float fovy, float aspect, float znear, float zfar);
 EXPORT void gs_blend_state_push(void);
 EXPORT void gs_blend_state_pop(void);
 EXPORT void gs_reset_blend_state(void);
+EXPORT bool gs_blend_state_is_default(void);
 
 /* -------------------------- */
 /* library-specific functions */
@@ -659,6 +660,9 @@ EXPORT void gs_blend_function(enum gs_blend_type src, enum gs_blend_type dest);
 EXPORT void gs_blend_function_separate(
 		enum gs_blend_type src_c, enum gs_blend_type dest_c,
 		enum gs_blend_type src_a, enum gs_blend_type dest_a);
+EXPORT void gs_get_blend_function_separate(
+		enum gs_blend_type *src_c, enum gs_blend_type *dest_c,
+		enum gs_blend_type *src_a, enum gs_blend_type *dest_a);
 EXPORT void gs_depth_function(enum gs_depth_test test);
 
 EXPORT void gs_stencil_function(enum gs_stencil_side side,
@@ -679,6 +683,7 @@ EXPORT void gs_frustum(float left, float right, float top, float bottom,
 
 EXPORT void gs_projection_push(void);
 EXPORT void gs_projection_pop(void);
+EXPORT void gs_get_projection(struct matrix4 *projection);
 
 EXPORT void     gs_swapchain_destroy(gs_swapchain_t *swapchain);
 
@@ -721,6 +726,12 @@ EXPORT bool     gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
 		uint32_t *linesize);
 EXPORT void     gs_stagesurface_unmap(gs_stagesurf_t *stagesurf);
 
+/**
+ * Returns whether the last copy staged to the surface has completed, so
+ * mapping it will not stall.  Always true if the backend can't tell.
+ */
+EXPORT bool     gs_stagesurface_ready(gs_stagesurf_t *stagesurf);
+
 EXPORT void     gs_zstencil_destroy(gs_zstencil_t *zstencil);
 
 EXPORT void     gs_samplerstate_destroy(gs_samplerstate_t *samplerstate);
@@ -54,16 +54,249 @@ static void bi_def_bitmap_modified(void *bitmap)
 	UNUSED_PARAMETER(bitmap);
 }
 
-static inline int get_full_decoded_gif_size(gs_image_file_t *image)
+static inline size_t get_frame_size(gs_image_file_t *image)
 {
-	return image->gif.width * image->gif.height * 4 * image->gif.frame_count;
+	return (size_t)image->gif.width * (size_t)image->gif.height * 4;
 }
 
-static bool init_animated_gif(gs_image_file_t *image, const char *path)
+/* ------------------------------------------------------------------------- */
+/* animated gif frame cache
+ *
+ *   Decoding every frame of a gif up front costs width * height * 4 bytes per
+ * frame, which for a long high resolution gif easily runs into gigabytes.
+ * Instead, frames are decoded a few frames ahead of playback by a thread of
+ * their own into a fixed number of slots, and the least recently shown frames
+ * are evicted to make room.  The gif state itself is only ever touched by the
+ * decode thread once it's running. */
+
+/* frames decoded ahead of the one being shown */
+#define GIF_DECODE_AHEAD 8
+
+static inline int get_decode_ahead(gs_image_file_t *image)
+{
+	/* the shown frame and the frames ahead of it must fit in the cache at
+	 * the same time */
+	int ahead = (int)image->frame_cache_slots - 2;
+
+	if (ahead > GIF_DECODE_AHEAD)
+		ahead = GIF_DECODE_AHEAD;
+	if (ahead > (int)image->gif.frame_count - 1)
+		ahead = (int)image->gif.frame_count - 1;
+	return ahead;
+}
+
+/* decode_mutex must be held */
+static inline bool frame_wanted(gs_image_file_t *image, int frame)
+{
+	int count = (int)image->gif.frame_count;
+	int distance = (frame - image->decode_want + count) % count;
+
+	return frame == image->texture_frame ||
+	       distance <= get_decode_ahead(image);
+}
+
+/* decode_mutex must be held.  returns an unused slot, evicting the least
+ * recently used frame that isn't shown or about to be if necessary */
+static int get_free_slot(gs_image_file_t *image)
+{
+	uint64_t oldest = UINT64_MAX;
+	int slot = -1;
+
+	for (size_t i = 0; i < image->frame_cache_slots; i++) {
+		int frame = image->slot_frames[i];
+
+		if (frame == -1)
+			return (int)i;
+		if (frame_wanted(image, frame))
+			continue;
+
+		if (image->slot_last_used[i] < oldest) {
+			oldest = image->slot_last_used[i];
+			slot = (int)i;
+		}
+	}
+
+	if (slot != -1) {
+		image->frame_slots[image->slot_frames[slot]] = -1;
+		image->slot_frames[slot] = -1;
+	}
+
+	return slot;
+}
+
+static void cache_decoded_frame(gs_image_file_t *image, int frame)
+{
+	size_t frame_size = get_frame_size(image);
+	int slot = -1;
+
+	pthread_mutex_lock(&image->decode_mutex);
+	if (image->frame_slots[frame] == -1 && frame_wanted(image, frame))
+		slot = get_free_slot(image);
+	pthread_mutex_unlock(&image->decode_mutex);
+
+	if (slot == -1)
+		return;
+
+	/* the slot isn't mapped to any frame while it's being filled, so
+	 * nothing reads it */
+	memcpy(image->animation_frame_data + (size_t)slot * frame_size,
+			image->gif.frame_image, frame_size);
+
+	pthread_mutex_lock(&image->decode_mutex);
+	image->frame_slots[frame] = slot;
+	image->slot_frames[slot] = frame;
+	image->slot_last_used[slot] = ++image->slot_use_count;
+	pthread_mutex_unlock(&image->decode_mutex);
+}
+
+static bool decode_frame(gs_image_file_t *image, int frame)
+{
+	int first;
+
+	if (frame == image->last_decoded_frame) {
+		cache_decoded_frame(image, frame);
+		return true;
+	}
+
+	/* each frame is drawn over the previous one (that's what the disposal
+	 * methods are relative to), so decoding has to go in order and start
+	 * over from the first frame when going back */
+	first = (frame > image->last_decoded_frame) ?
+		image->last_decoded_frame + 1 : 0;
+
+	for (int i = first; i <= frame; i++) {
+		if (os_atomic_load_bool(&image->decode_stop))
+			return false;
+
+		if (gif_decode_frame(&image->gif, (unsigned int)i) != GIF_OK) {
+			image->last_decoded_frame = -1;
+			return false;
+		}
+
+		image->last_decoded_frame = i;
+		cache_decoded_frame(image, i);
+	}
+
+	return true;
+}
+
+static void decode_ahead(gs_image_file_t *image)
+{
+	int count = (int)image->gif.frame_count;
+	int ahead = get_decode_ahead(image);
+	int want;
+
+	pthread_mutex_lock(&image->decode_mutex);
+	want = image->decode_want;
+	pthread_mutex_unlock(&image->decode_mutex);
+
+	for (int i = 0; i <= ahead; i++) {
+		int frame = (want + i) % count;
+		bool cached, moved;
+
+		pthread_mutex_lock(&image->decode_mutex);
+		cached = image->frame_slots[frame] != -1;
+		moved = image->decode_want != want;
+		pthread_mutex_unlock(&image->decode_mutex);
+
+		/* the event was signaled again, so this starts over from the
+		 * new frame right away */
+		if (moved)
+			break;
+		if (!cached && !decode_frame(image, frame))
+			break;
+	}
+}
+
+static void *gif_decode_thread(void *param)
+{
+	gs_image_file_t *image = param;
+
+	os_set_thread_name("image-file: gif decode thread");
+
+	while (os_event_wait(image->decode_event) == 0) {
+		if (os_atomic_load_bool(&image->decode_stop))
+			break;
+
+		decode_ahead(image);
+	}
+
+	return NULL;
+}
+
+/* decode_mutex must be held */
+static inline void request_frame(gs_image_file_t *image)
+{
+	if (image->decode_want != image->cur_frame) {
+		image->decode_want = image->cur_frame;
+		os_event_signal(image->decode_event);
+	}
+}
+
+static bool init_frame_cache(gs_image_file_t *image, uint64_t limit)
+{
+	size_t frame_size = get_frame_size(image);
+	size_t count = image->gif.frame_count;
+	uint64_t slots;
+
+	if (!limit)
+		limit = GS_IMAGE_FILE_GIF_CACHE_DEFAULT;
+
+	slots = limit / frame_size;
+	if (slots < 2)
+		slots = 2;
+	if (slots > count)
+		slots = count;
+
+	image->frame_cache_slots = (size_t)slots;
+	image->animation_frame_data = bmalloc(frame_size * (size_t)slots);
+	image->frame_slots = bmalloc(count * sizeof(int));
+	image->slot_frames = bmalloc((size_t)slots * sizeof(int));
+	image->slot_last_used = bzalloc((size_t)slots * sizeof(uint64_t));
+
+	for (size_t i = 0; i < count; i++)
+		image->frame_slots[i] = -1;
+	for (size_t i = 0; i < (size_t)slots; i++)
+		image->slot_frames[i] = -1;
+
+	image->texture_frame = -1;
+	image->last_decoded_frame = -1;
+
+	if (pthread_mutex_init(&image->decode_mutex, NULL) != 0)
+		return false;
+	if (os_event_init(&image->decode_event, OS_EVENT_TYPE_AUTO) != 0) {
+		pthread_mutex_destroy(&image->decode_mutex);
+		return false;
+	}
+
+	return true;
+}
+
+static void free_frame_cache(gs_image_file_t *image)
+{
+	if (image->decode_thread_active) {
+		os_atomic_set_bool(&image->decode_stop, true);
+		os_event_signal(image->decode_event);
+		pthread_join(image->decode_thread, NULL);
+		image->decode_thread_active = false;
+	}
+
+	if (image->decode_event) {
+		os_event_destroy(image->decode_event);
+		pthread_mutex_destroy(&image->decode_mutex);
+	}
+
+	bfree(image->animation_frame_data);
+	bfree(image->frame_slots);
+	bfree(image->slot_frames);
+	bfree(image->slot_last_used);
+}
+
+static bool init_animated_gif(gs_image_file_t *image, const char *path,
+		uint64_t frame_cache_limit)
 {
 	bool is_animated_gif = true;
 	gif_result result;
-	uint64_t max_size;
 	size_t size, size_read;
 	FILE *file;
 
@@ -108,35 +341,33 @@ static bool init_animated_gif(gs_image_file_t *image, const char *path)
 		goto fail;
 	}
 
-	max_size = (uint64_t)image->gif.width * (uint64_t)image->gif.height *
-		(uint64_t)image->gif.frame_count * 4LLU;
-
-	if ((uint64_t)get_full_decoded_gif_size(image) != max_size) {
-		blog(LOG_WARNING, "Gif '%s' overflowed maximum pointer size",
-				path);
-		goto fail;
-	}
-
 	image->is_animated_gif = (image->gif.frame_count > 1 && result >= 0);
 	if (image->is_animated_gif) {
-		gif_decode_frame(&image->gif, 0);
-
-		image->animation_frame_cache = bzalloc(
-				image->gif.frame_count * sizeof(uint8_t*));
-		image->animation_frame_data = bzalloc(
-				get_full_decoded_gif_size(image));
+		image->cx = (uint32_t)image->gif.width;
+		image->cy = (uint32_t)image->gif.height;
+		image->format = GS_RGBA;
 
-		for (unsigned int i = 0; i < image->gif.frame_count; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				blog(LOG_WARNING, "Couldn't decode frame %u "
-						"of '%s'", i, path);
+		if (!init_frame_cache(image, frame_cache_limit)) {
+			blog(LOG_WARNING, "Failed to create the frame cache "
+					"of '%s'", path);
+			goto fail;
 		}
 
-		gif_decode_frame(&image->gif, 0);
+		/* the first frame is needed for the texture right away, the
+		 * rest is decoded by the decode thread */
+		if (!decode_frame(image, 0))
+			blog(LOG_WARNING, "Couldn't decode frame 0 of '%s'",
+					path);
 
-		image->cx = (uint32_t)image->gif.width;
-		image->cy = (uint32_t)image->gif.height;
-		image->format = GS_RGBA;
+		if (pthread_create(&image->decode_thread, NULL,
+					gif_decode_thread, image) != 0) {
+			blog(LOG_WARNING, "Failed to create the decode "
+					"thread of '%s'", path);
+			goto fail;
+		}
+
+		image->decode_thread_active = true;
+		os_event_signal(image->decode_event);
 	} else {
 		gif_finalise(&image->gif);
 		bfree(image->gif_data);
@@ -157,7 +388,8 @@ not_animated:
 	return is_animated_gif;
 }
 
-void gs_image_file_init(gs_image_file_t *image, const char *file)
+void gs_image_file_init_limit(gs_image_file_t *image, const char *file,
+		uint64_t frame_cache_limit)
 {
 	size_t len;
 
@@ -172,7 +404,7 @@ void gs_image_file_init(gs_image_file_t *image, const char *file)
 	len = strlen(file);
 
 	if (len > 4 && strcmp(file + len - 4, ".gif") == 0) {
-		if (init_animated_gif(image, file))
+		if (init_animated_gif(image, file, frame_cache_limit))
 			return;
 	}
 
@@ -186,17 +418,22 @@ void gs_image_file_init(gs_image_file_t *image, const char *file)
 	}
 }
 
+void gs_image_file_init(gs_image_file_t *image, const char *file)
+{
+	gs_image_file_init_limit(image, file, 0);
+}
+
 void gs_image_file_free(gs_image_file_t *image)
 {
 	if (!image)
 		return;
 
+	/* stops the decode thread before the gif state goes away */
+	free_frame_cache(image);
+
 	if (image->loaded) {
-		if (image->is_animated_gif) {
+		if (image->is_animated_gif)
 			gif_finalise(&image->gif);
-			bfree(image->animation_frame_cache);
-			bfree(image->animation_frame_data);
-		}
 
 		gs_texture_destroy(image->texture);
 	}
@@ -212,10 +449,23 @@ void gs_image_file_init_texture(gs_image_file_t *image)
 		return;
 
 	if (image->is_animated_gif) {
+		const uint8_t *data = NULL;
+		int slot;
+
+		pthread_mutex_lock(&image->decode_mutex);
+
+		slot = image->frame_slots[image->cur_frame];
+		if (slot != -1) {
+			data = image->animation_frame_data +
+				(size_t)slot * get_frame_size(image);
+			image->texture_frame = image->cur_frame;
+		}
+
 		image->texture = gs_texture_create(
 				image->cx, image->cy, image->format, 1,
-				(const uint8_t**)&image->gif.frame_image,
-				GS_DYNAMIC);
+				data ? &data : NULL, GS_DYNAMIC);
+
+		pthread_mutex_unlock(&image->decode_mutex);
 
 	} else {
 		image->texture = gs_texture_create(
@@ -259,42 +509,9 @@ static inline int calculate_new_frame(gs_image_file_t *image,
 	return new_frame;
 }
 
-static void decode_new_frame(gs_image_file_t *image, int new_frame)
-{
-	if (!image->animation_frame_cache[new_frame]) {
-		int last_frame;
-
-		/* if looped, decode frame 0 */
-		last_frame = (new_frame < image->last_decoded_frame) ?
-			0 : image->last_decoded_frame + 1;
-
-		/* decode missed frames */
-		for (int i = last_frame; i < new_frame; i++) {
-			if (gif_decode_frame(&image->gif, i) != GIF_OK)
-				return;
-		}
-
-		/* decode actual desired frame */
-		if (gif_decode_frame(&image->gif, new_frame) == GIF_OK) {
-			size_t pos = new_frame * image->gif.width *
-				image->gif.height * 4;
-			image->animation_frame_cache[new_frame] =
-				image->animation_frame_data + pos;
-
-			memcpy(image->animation_frame_cache[new_frame],
-					image->gif.frame_image,
-					image->gif.width *
-					image->gif.height * 4);
-
-			image->last_decoded_frame = new_frame;
-		}
-	}
-
-	image->cur_frame = new_frame;
-}
-
 bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
 {
+	bool ready;
 	int loops;
 
 	if (!image->is_animated_gif || !image->loaded)
@@ -304,28 +521,43 @@ bool gs_image_file_tick(gs_image_file_t *image, uint64_t elapsed_time_ns)
 	if (loops >= 0xFFFF)
 		loops = 0;
 
-	if (!loops || image->cur_loop < loops) {
-		int new_frame = calculate_new_frame(image, elapsed_time_ns,
+	if (!loops || image->cur_loop < loops)
+		image->cur_frame = calculate_new_frame(image, elapsed_time_ns,
 				loops);
 
-		if (new_frame != image->cur_frame) {
-			decode_new_frame(image, new_frame);
-			return true;
-		}
-	}
+	/* if the decode thread fell behind, the last frame stays up until
+	 * the current one is ready */
+	pthread_mutex_lock(&image->decode_mutex);
+	request_frame(image);
+	ready = image->cur_frame != image->texture_frame &&
+		image->frame_slots[image->cur_frame] != -1;
+	pthread_mutex_unlock(&image->decode_mutex);
 
-	return false;
+	return ready;
 }
 
 void gs_image_file_update_texture(gs_image_file_t *image)
 {
-	if (!image->is_animated_gif || !image->loaded)
+	int slot;
+
+	/* the texture may not have been created yet */
+	if (!image->is_animated_gif || !image->loaded || !image->texture)
 		return;
 
-	if (!image->animation_frame_cache[image->cur_frame])
-		decode_new_frame(image, image->cur_frame);
+	pthread_mutex_lock(&image->decode_mutex);
+
+	request_frame(image);
+
+	slot = image->frame_slots[image->cur_frame];
+	if (slot != -1) {
+		gs_texture_set_image(image->texture,
+				image->animation_frame_data +
+				(size_t)slot * get_frame_size(image),
+				image->gif.width * 4, false);
+
+		image->texture_frame = image->cur_frame;
+		image->slot_last_used[slot] = ++image->slot_use_count;
+	}
 
-	gs_texture_set_image(image->texture,
-			image->animation_frame_cache[image->cur_frame],
-			image->gif.width * 4, false);
+	pthread_mutex_unlock(&image->decode_mutex);
 }
@@ -19,6 +19,10 @@
 
 #include "graphics.h"
 #include "libnsgif/libnsgif.h"
+#include "../util/threading.h"
+
+/* default memory limit for the decoded frames of an animated gif */
+#define GS_IMAGE_FILE_GIF_CACHE_DEFAULT (128ULL * 1024ULL * 1024ULL)
 
 struct gs_image_file {
 	gs_texture_t *texture;
@@ -31,13 +35,30 @@ struct gs_image_file {
 
 	gif_animation gif;
 	uint8_t *gif_data;
-	uint8_t **animation_frame_cache;
-	uint8_t *animation_frame_data;
 	uint64_t cur_time;
 	int cur_frame;
 	int cur_loop;
 	int last_decoded_frame;
 
+	/* animated gifs are decoded ahead of playback by their own thread into
+	 * a bounded LRU of frame slots.  frame_slots maps frames to slots and
+	 * slot_frames slots to frames (-1 if unused), both protected by
+	 * decode_mutex */
+	uint8_t *animation_frame_data;
+	size_t frame_cache_slots;
+	int *frame_slots;
+	int *slot_frames;
+	uint64_t *slot_last_used;
+	uint64_t slot_use_count;
+	int texture_frame;
+	int decode_want;
+
+	pthread_mutex_t decode_mutex;
+	os_event_t *decode_event;
+	pthread_t decode_thread;
+	bool decode_thread_active;
+	volatile bool decode_stop;
+
 	uint8_t *texture_data;
 	gif_bitmap_callback_vt bitmap_callbacks;
 };
@@ -45,6 +66,14 @@ struct gs_image_file {
 typedef struct gs_image_file gs_image_file_t;
 
 EXPORT void gs_image_file_init(gs_image_file_t *image, const char *file);
+
+/**
+ * Same as gs_image_file_init, but limits the memory used for the decoded
+ * frames of an animated gif to frame_cache_limit bytes (0 for the default).
+ * At least two frames are always kept.
+ */
+EXPORT void gs_image_file_init_limit(gs_image_file_t *image, const char *file,
+		uint64_t frame_cache_limit);
 EXPORT void gs_image_file_free(gs_image_file_t *image);
 
 EXPORT void gs_image_file_init_texture(gs_image_file_t *image);
@@ -25,6 +25,7 @@
 #include "../util/profiler.h"
 
 #include "audio-io.h"
+#include "audio-kernels.h"
 #include "audio-resampler.h"
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
@@ -66,6 +67,11 @@ struct audio_output {
 	void                       *input_param;
 	pthread_mutex_t            input_mutex;
 	struct audio_mix           mixes[MAX_AUDIO_MIXES];
+
+	pthread_mutex_t            timing_mutex;
+	struct audio_output_timing timing;
+	uint64_t                   wakeups;
+	uint64_t                   total_jitter_ns;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -175,17 +181,8 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		if (!mix->inputs.num)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
-
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val >  1.0f) ?  1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			audio_clamp(mix->buffer[plane], float_size);
 	}
 }
 
@@ -238,6 +235,44 @@ static void input_and_output(struct audio_output *audio,
 		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
 }
 
+static void update_timing(struct audio_output *audio, uint64_t jitter,
+		uint64_t ticks)
+{
+	struct audio_output_timing *timing = &audio->timing;
+
+	pthread_mutex_lock(&audio->timing_mutex);
+
+	audio->wakeups++;
+	audio->total_jitter_ns += jitter;
+
+	timing->ticks += ticks;
+	if (ticks > 1)
+		timing->late_ticks += ticks - 1;
+
+	timing->last_jitter_ns = jitter;
+	timing->avg_jitter_ns = audio->total_jitter_ns / audio->wakeups;
+	if (jitter > timing->max_jitter_ns)
+		timing->max_jitter_ns = jitter;
+
+	pthread_mutex_unlock(&audio->timing_mutex);
+}
+
+static void log_timing(struct audio_output *audio)
+{
+	struct audio_output_timing timing;
+
+	audio_output_get_timing(audio, &timing);
+	if (!timing.ticks)
+		return;
+
+	blog(LOG_INFO, "audio_thread(%s): %"PRIu64" ticks of %d frames, "
+			"jitter avg %.3f ms, max %.3f ms, %"PRIu64" late",
+			audio->info.name, timing.ticks, AUDIO_OUTPUT_FRAMES,
+			(double)timing.avg_jitter_ns / 1000000.0,
+			(double)timing.max_jitter_ns / 1000000.0,
+			timing.late_ticks);
+}
+
 static void *audio_thread(void *param)
 {
 	struct audio_output *audio = param;
@@ -246,9 +281,6 @@ static void *audio_thread(void *param)
 	uint64_t start_time = os_gettime_ns();
 	uint64_t prev_time = start_time;
 	uint64_t audio_time = prev_time;
-	uint32_t audio_wait_time =
-		(uint32_t)(audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) /
-				1000000);
 
 	os_set_thread_name("audio-io: audio thread");
 
@@ -257,13 +289,21 @@ static void *audio_thread(void *param)
 				"audio_thread(%s)", audio->info.name);
 
 	while (os_event_try(audio->stop_event) == EAGAIN) {
+		uint64_t deadline = audio_time;
 		uint64_t cur_time;
+		uint64_t ticks = 0;
 
-		os_sleep_ms(audio_wait_time);
+		/* wake up at the exact time the next tick is due.  sleeping a
+		 * whole number of milliseconds instead would drift early every
+		 * tick and then have to catch up in bursts */
+		os_sleepto_ns(deadline);
+
+		cur_time = os_gettime_ns();
+		if (cur_time < deadline)
+			continue;
 
 		profile_start(audio_thread_name);
 
-		cur_time = os_gettime_ns();
 		while (audio_time <= cur_time) {
 			samples += AUDIO_OUTPUT_FRAMES;
 			audio_time = start_time +
@@ -271,13 +311,17 @@ static void *audio_thread(void *param)
 
 			input_and_output(audio, audio_time, prev_time);
 			prev_time = audio_time;
+			ticks++;
 		}
 
 		profile_end(audio_thread_name);
 
+		update_timing(audio, cur_time - deadline, ticks);
+
 		profile_reenable_thread();
 	}
 
+	log_timing(audio);
 	return NULL;
 }
 
@@ -416,12 +460,16 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 	out->block_size = (planar ? 1 : out->channels) *
 	                  get_audio_bytes_per_channel(info->format);
 
+	pthread_mutex_init_value(&out->timing_mutex);
+
 	if (pthread_mutexattr_init(&attr) != 0)
 		goto fail;
 	if (pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE) != 0)
 		goto fail;
 	if (pthread_mutex_init(&out->input_mutex, &attr) != 0)
 		goto fail;
+	if (pthread_mutex_init(&out->timing_mutex, NULL) != 0)
+		goto fail;
 	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail;
 	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
@@ -458,6 +506,7 @@ void audio_output_close(audio_t *audio)
 	}
 
 	os_event_destroy(audio->stop_event);
+	pthread_mutex_destroy(&audio->timing_mutex);
 	bfree(audio);
 }
 
@@ -466,6 +515,17 @@ const struct audio_output_info *audio_output_get_info(const audio_t *audio)
 	return audio ? &audio->info : NULL;
 }
 
+void audio_output_get_timing(const audio_t *audio,
+		struct audio_output_timing *timing)
+{
+	if (!audio || !timing)
+		return;
+
+	pthread_mutex_lock((pthread_mutex_t*)&audio->timing_mutex);
+	*timing = audio->timing;
+	pthread_mutex_unlock((pthread_mutex_t*)&audio->timing_mutex);
+}
+
 bool audio_output_active(const audio_t *audio)
 {
 	if (!audio) return false;
@@ -27,7 +27,13 @@ extern "C" {
 
 #define MAX_AUDIO_MIXES     6
 #define MAX_AUDIO_CHANNELS  8
+
+/* frames per audio tick.  low latency builds can lower this to e.g. 256 or
+ * 480 with the AUDIO_OUTPUT_FRAMES cmake option, which defines it for libobs
+ * and everything linking to it */
+#ifndef AUDIO_OUTPUT_FRAMES
 #define AUDIO_OUTPUT_FRAMES 1024
+#endif
 
 #define TOTAL_AUDIO_SIZE \
 	(MAX_AUDIO_MIXES * MAX_AUDIO_CHANNELS * \
@@ -227,6 +233,20 @@ EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
 EXPORT const struct audio_output_info *audio_output_get_info(
 		const audio_t *audio);
 
+/** How closely the audio thread keeps to its tick deadlines.  Jitter is how
+ * late the thread woke up for a tick; a tick is counted as late when the
+ * thread only got to it after the next one was already due. */
+struct audio_output_timing {
+	uint64_t            ticks;
+	uint64_t            late_ticks;
+	uint64_t            last_jitter_ns;
+	uint64_t            avg_jitter_ns;
+	uint64_t            max_jitter_ns;
+};
+
+EXPORT void audio_output_get_timing(const audio_t *audio,
+		struct audio_output_timing *timing);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,458 @@
+#include "audio-kernels.h"
+#include "../util/base.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || \
+    defined(__i386__) || defined(__x86_64__)
+#define AUDIO_KERNELS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIO_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+/* MSVC allows AVX2 intrinsics anywhere, GCC and clang need them enabled per
+ * function so the rest of libobs can still run on older CPUs */
+#if defined(AUDIO_KERNELS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+struct audio_kernels {
+	void (*mix)(float *dst, const float *src, size_t count);
+	void (*mix_mul)(float *dst, const float *src, const float *mul,
+			size_t count);
+	void (*scale)(float *data, float mul, size_t count);
+	void (*mul)(float *data, const float *mul, size_t count);
+	void (*clamp)(float *data, size_t count);
+};
+
+/* ------------------------------------------------------------------------- */
+/* Scalar */
+
+static void mix_scalar(float *dst, const float *src, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i];
+}
+
+static void mix_mul_scalar(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * mul[i];
+}
+
+static void scale_scalar(float *data, float mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= mul;
+}
+
+static void mul_scalar(float *data, const float *mul, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] *= mul[i];
+}
+
+static void clamp_scalar(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = data[i];
+		val = (val >  1.0f) ?  1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		data[i] = val;
+	}
+}
+
+static const struct audio_kernels kernels_scalar = {
+	mix_scalar,
+	mix_mul_scalar,
+	scale_scalar,
+	mul_scalar,
+	clamp_scalar
+};
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 */
+
+#ifdef AUDIO_KERNELS_X86
+
+static void mix_sse2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 s = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, s));
+	}
+
+	mix_scalar(dst + i, src + i, count - i);
+}
+
+static void mix_mul_sse2(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 m = _mm_loadu_ps(mul + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, m)));
+	}
+
+	mix_mul_scalar(dst + i, src + i, mul + i, count - i);
+}
+
+static void scale_sse2(float *data, float mul, size_t count)
+{
+	__m128 m = _mm_set1_ps(mul);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), m));
+
+	scale_scalar(data + i, mul, count - i);
+}
+
+static void mul_sse2(float *data, const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(data + i);
+		__m128 m = _mm_loadu_ps(mul + i);
+		_mm_storeu_ps(data + i, _mm_mul_ps(d, m));
+	}
+
+	mul_scalar(data + i, mul + i, count - i);
+}
+
+static void clamp_sse2(float *data, size_t count)
+{
+	__m128 max = _mm_set1_ps(1.0f);
+	__m128 min = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(data + i);
+		_mm_storeu_ps(data + i, _mm_max_ps(_mm_min_ps(d, max), min));
+	}
+
+	clamp_scalar(data + i, count - i);
+}
+
+static const struct audio_kernels kernels_sse2 = {
+	mix_sse2,
+	mix_mul_sse2,
+	scale_sse2,
+	mul_sse2,
+	clamp_sse2
+};
+
+/* ------------------------------------------------------------------------- */
+/* AVX2 */
+
+TARGET_AVX2 static void mix_avx2(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		__m256 s = _mm256_loadu_ps(src + i);
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(d, s));
+	}
+
+	mix_scalar(dst + i, src + i, count - i);
+}
+
+TARGET_AVX2 static void mix_mul_avx2(float *dst, const float *src,
+		const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		__m256 s = _mm256_loadu_ps(src + i);
+		__m256 m = _mm256_loadu_ps(mul + i);
+		_mm256_storeu_ps(dst + i,
+				_mm256_add_ps(d, _mm256_mul_ps(s, m)));
+	}
+
+	mix_mul_scalar(dst + i, src + i, mul + i, count - i);
+}
+
+TARGET_AVX2 static void scale_avx2(float *data, float mul, size_t count)
+{
+	__m256 m = _mm256_set1_ps(mul);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(data + i,
+				_mm256_mul_ps(_mm256_loadu_ps(data + i), m));
+
+	scale_scalar(data + i, mul, count - i);
+}
+
+TARGET_AVX2 static void mul_avx2(float *data, const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(data + i);
+		__m256 m = _mm256_loadu_ps(mul + i);
+		_mm256_storeu_ps(data + i, _mm256_mul_ps(d, m));
+	}
+
+	mul_scalar(data + i, mul + i, count - i);
+}
+
+TARGET_AVX2 static void clamp_avx2(float *data, size_t count)
+{
+	__m256 max = _mm256_set1_ps(1.0f);
+	__m256 min = _mm256_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(data + i);
+		_mm256_storeu_ps(data + i,
+				_mm256_max_ps(_mm256_min_ps(d, max), min));
+	}
+
+	clamp_scalar(data + i, count - i);
+}
+
+static const struct audio_kernels kernels_avx2 = {
+	mix_avx2,
+	mix_mul_avx2,
+	scale_avx2,
+	mul_avx2,
+	clamp_avx2
+};
+
+#ifdef _MSC_VER
+static bool cpu_has_avx2(void)
+{
+	int regs[4];
+
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return false;
+
+	/* OSXSAVE and AVX, and the OS saving the YMM registers */
+	__cpuid(regs, 1);
+	if ((regs[2] & 0x18000000) != 0x18000000)
+		return false;
+	if ((_xgetbv(0) & 0x6) != 0x6)
+		return false;
+
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+}
+#else
+static bool cpu_has_avx2(void)
+{
+	/* also checks whether the OS saves the YMM registers */
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* NEON */
+
+#ifdef AUDIO_KERNELS_NEON
+
+static void mix_neon(float *dst, const float *src, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i),
+					vld1q_f32(src + i)));
+
+	mix_scalar(dst + i, src + i, count - i);
+}
+
+static void mix_mul_neon(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i),
+					vmulq_f32(vld1q_f32(src + i),
+						vld1q_f32(mul + i))));
+
+	mix_mul_scalar(dst + i, src + i, mul + i, count - i);
+}
+
+static void scale_neon(float *data, float mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(data + i, vmulq_n_f32(vld1q_f32(data + i), mul));
+
+	scale_scalar(data + i, mul, count - i);
+}
+
+static void mul_neon(float *data, const float *mul, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(data + i, vmulq_f32(vld1q_f32(data + i),
+					vld1q_f32(mul + i)));
+
+	mul_scalar(data + i, mul + i, count - i);
+}
+
+static void clamp_neon(float *data, size_t count)
+{
+	float32x4_t max = vdupq_n_f32(1.0f);
+	float32x4_t min = vdupq_n_f32(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		vst1q_f32(data + i, vmaxq_f32(vminq_f32(vld1q_f32(data + i),
+						max), min));
+
+	clamp_scalar(data + i, count - i);
+}
+
+static const struct audio_kernels kernels_neon = {
+	mix_neon,
+	mix_mul_neon,
+	scale_neon,
+	mul_neon,
+	clamp_neon
+};
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Dispatch */
+
+static const char *impl_names[AUDIO_KERNEL_IMPL_COUNT] = {
+	"scalar",
+	"sse2",
+	"avx2",
+	"neon"
+};
+
+static const struct audio_kernels *impl_kernels(enum audio_kernel_impl impl)
+{
+	switch (impl) {
+	case AUDIO_KERNEL_SCALAR:
+		return &kernels_scalar;
+#ifdef AUDIO_KERNELS_X86
+	case AUDIO_KERNEL_SSE2:
+		return &kernels_sse2;
+	case AUDIO_KERNEL_AVX2:
+		return cpu_has_avx2() ? &kernels_avx2 : NULL;
+#endif
+#ifdef AUDIO_KERNELS_NEON
+	case AUDIO_KERNEL_NEON:
+		return &kernels_neon;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/* the selection is the same no matter which thread makes it first, so it
+ * doesn't matter if several threads race to set these */
+static const struct audio_kernels *kernels = NULL;
+static enum audio_kernel_impl cur_impl = AUDIO_KERNEL_SCALAR;
+
+static const struct audio_kernels *select_kernels(void)
+{
+	static const enum audio_kernel_impl preferred[] = {
+		AUDIO_KERNEL_AVX2,
+		AUDIO_KERNEL_NEON,
+		AUDIO_KERNEL_SSE2,
+		AUDIO_KERNEL_SCALAR
+	};
+
+	for (size_t i = 0; i < sizeof(preferred) / sizeof(preferred[0]); i++) {
+		const struct audio_kernels *impl = impl_kernels(preferred[i]);
+		if (impl) {
+			cur_impl = preferred[i];
+			kernels = impl;
+			blog(LOG_INFO, "Using %s audio kernels",
+					impl_names[preferred[i]]);
+			break;
+		}
+	}
+
+	return kernels;
+}
+
+static inline const struct audio_kernels *get_kernels(void)
+{
+	const struct audio_kernels *k = kernels;
+	return k ? k : select_kernels();
+}
+
+bool audio_kernels_supported(enum audio_kernel_impl impl)
+{
+	return impl_kernels(impl) != NULL;
+}
+
+const char *audio_kernels_impl_name(enum audio_kernel_impl impl)
+{
+	return (impl >= 0 && impl < AUDIO_KERNEL_IMPL_COUNT) ?
+		impl_names[impl] : "unknown";
+}
+
+enum audio_kernel_impl audio_kernels_get_impl(void)
+{
+	get_kernels();
+	return cur_impl;
+}
+
+bool audio_kernels_set_impl(enum audio_kernel_impl impl)
+{
+	const struct audio_kernels *k = impl_kernels(impl);
+	if (!k)
+		return false;
+
+	cur_impl = impl;
+	kernels = k;
+	return true;
+}
+
+void audio_mix(float *dst, const float *src, size_t count)
+{
+	get_kernels()->mix(dst, src, count);
+}
+
+void audio_mix_mul(float *dst, const float *src, const float *mul,
+		size_t count)
+{
+	get_kernels()->mix_mul(dst, src, mul, count);
+}
+
+void audio_scale(float *data, float mul, size_t count)
+{
+	get_kernels()->scale(data, mul, count);
+}
+
+void audio_mul(float *data, const float *mul, size_t count)
+{
+	get_kernels()->mul(data, mul, count);
+}
+
+void audio_clamp(float *data, size_t count)
+{
+	get_kernels()->clamp(data, count);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "../util/c99defs.h"
+
+/*
+ * Float audio kernels
+ *
+ *   Mixing, volume and clamping loops used on every audio tick.  Each kernel
+ * has a scalar version and SSE2/AVX2/NEON versions where the platform has
+ * them; the fastest one the CPU supports is picked the first time any kernel
+ * is called.  None of the pointers need to be aligned.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum audio_kernel_impl {
+	AUDIO_KERNEL_SCALAR,
+	AUDIO_KERNEL_SSE2,
+	AUDIO_KERNEL_AVX2,
+	AUDIO_KERNEL_NEON,
+
+	AUDIO_KERNEL_IMPL_COUNT
+};
+
+EXPORT bool audio_kernels_supported(enum audio_kernel_impl impl);
+EXPORT const char *audio_kernels_impl_name(enum audio_kernel_impl impl);
+EXPORT enum audio_kernel_impl audio_kernels_get_impl(void);
+
+/** Overrides the automatically chosen implementation, mainly for testing.
+ * Returns false if the CPU does not support it. */
+EXPORT bool audio_kernels_set_impl(enum audio_kernel_impl impl);
+
+/** dst[i] += src[i] */
+EXPORT void audio_mix(float *dst, const float *src, size_t count);
+
+/** dst[i] += src[i] * mul[i] */
+EXPORT void audio_mix_mul(float *dst, const float *src, const float *mul,
+		size_t count);
+
+/** data[i] *= mul */
+EXPORT void audio_scale(float *data, float mul, size_t count);
+
+/** data[i] *= mul[i] */
+EXPORT void audio_mul(float *data, const float *mul, size_t count);
+
+/** Clamps data[i] to [-1.0, 1.0] */
+EXPORT void audio_clamp(float *data, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
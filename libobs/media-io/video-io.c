@@ -22,6 +22,7 @@
 #include "../util/profiler.h"
 #include "../util/threading.h"
 #include "../util/darray.h"
+#include "../util/circlebuf.h"
 
 #include "format-conversion.h"
 #include "video-io.h"
@@ -37,8 +38,20 @@ struct cached_frame_info {
 	struct video_data frame;
 	int skipped;
 	int count;
+
+	/* number of threaded inputs still holding this frame */
+	volatile long refs;
+
+	/* set while the frame points to data submitted by the caller instead
+	 * of the cache's own buffers */
+	void (*release)(void *param);
+	void *release_param;
+	uint8_t *own_data[MAX_AV_PLANES];
+	uint32_t own_linesize[MAX_AV_PLANES];
 };
 
+struct video_input_thread;
+
 struct video_input {
 	struct video_scale_info   conversion;
 	video_scaler_t            *scaler;
@@ -47,10 +60,41 @@ struct video_input {
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
+
+	/* if set, frames are queued to a dedicated thread for this input
+	 * instead of being sent inline from the video thread */
+	struct video_input_thread *thread;
+};
+
+struct queued_frame {
+	struct video_data         frame;
+	size_t                    cache_idx;
+};
+
+struct video_input_thread {
+	struct video_output       *video;
+	struct video_input        input;
+
+	pthread_t                 thread;
+	pthread_mutex_t           mutex;
+	os_sem_t                  *sem;
+	struct circlebuf          queue;
+	size_t                    max_queued;
+	volatile bool             stop;
+	volatile bool             detached;
+	volatile long             skipped_frames;
 };
 
+static void video_input_thread_destroy(struct video_input_thread *thread);
+
 static inline void video_input_free(struct video_input *input)
 {
+	if (input->thread) {
+		video_input_thread_destroy(input->thread);
+		input->thread = NULL;
+		return;
+	}
+
 	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
 		video_frame_free(&input->frame[i]);
 	video_scaler_destroy(input->scaler);
@@ -77,6 +121,11 @@ struct video_output {
 	size_t                     first_added;
 	size_t                     last_added;
 	struct cached_frame_info   cache[MAX_CACHE_SIZE];
+
+	/* frames that have been output but are still referenced by threaded
+	 * inputs, starting from first_held */
+	size_t                     first_held;
+	size_t                     held_frames;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -112,9 +161,78 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
+/* hands submitted frame data back to its owner */
+static inline void restore_cached_frame(struct cached_frame_info *cfi)
+{
+	if (!cfi->release)
+		return;
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		cfi->frame.data[i]     = cfi->own_data[i];
+		cfi->frame.linesize[i] = cfi->own_linesize[i];
+	}
+
+	cfi->release(cfi->release_param);
+	cfi->release = NULL;
+	cfi->release_param = NULL;
+}
+
+/* must be called with data_mutex locked.  cache frames are only made
+ * available again in order, once no threaded input references them */
+static inline void release_held_frames(struct video_output *video)
+{
+	while (video->held_frames &&
+	       os_atomic_load_long(&video->cache[video->first_held].refs) == 0) {
+		restore_cached_frame(&video->cache[video->first_held]);
+
+		if (++video->first_held == video->info.cache_size)
+			video->first_held = 0;
+		video->held_frames--;
+
+		if (++video->available_frames == video->info.cache_size)
+			video->last_added = video->first_held;
+	}
+}
+
+static inline void release_cached_frame(struct video_output *video,
+		size_t cache_idx)
+{
+	struct cached_frame_info *cfi = &video->cache[cache_idx];
+
+	if (os_atomic_dec_long(&cfi->refs) == 0) {
+		pthread_mutex_lock(&video->data_mutex);
+		release_held_frames(video);
+		pthread_mutex_unlock(&video->data_mutex);
+	}
+}
+
+static void queue_threaded_frame(struct video_output *video,
+		struct video_input_thread *thread,
+		const struct video_data *frame, size_t cache_idx)
+{
+	struct queued_frame qf = {*frame, cache_idx};
+	bool queued = false;
+
+	pthread_mutex_lock(&thread->mutex);
+
+	if (thread->queue.size / sizeof(qf) < thread->max_queued) {
+		os_atomic_inc_long(&video->cache[cache_idx].refs);
+		circlebuf_push_back(&thread->queue, &qf, sizeof(qf));
+		queued = true;
+	}
+
+	pthread_mutex_unlock(&thread->mutex);
+
+	if (queued)
+		os_sem_post(thread->sem);
+	else
+		os_atomic_inc_long(&thread->skipped_frames);
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
+	size_t cache_idx;
 	bool complete;
 	bool skipped;
 
@@ -122,7 +240,8 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	frame_info = &video->cache[video->first_added];
+	cache_idx = video->first_added;
+	frame_info = &video->cache[cache_idx];
 
 	pthread_mutex_unlock(&video->data_mutex);
 
@@ -134,7 +253,10 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		struct video_input *input = video->inputs.array+i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
+		if (input->thread)
+			queue_threaded_frame(video, input->thread, &frame,
+					cache_idx);
+		else if (scale_video_output(input, &frame))
 			input->callback(input->param, &frame);
 	}
 
@@ -152,8 +274,8 @@ static inline bool video_output_cur_frame(struct video_output *video)
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		video->held_frames++;
+		release_held_frames(video);
 	} else if (skipped) {
 		--frame_info->skipped;
 		++video->skipped_frames;
@@ -194,6 +316,123 @@ static void *video_thread(void *param)
 	return NULL;
 }
 
+static void *video_input_thread_loop(void *param)
+{
+	struct video_input_thread *thread = param;
+	struct video_output *video = thread->video;
+	struct video_input *input = &thread->input;
+	struct queued_frame qf;
+
+	os_set_thread_name("video-io: input thread");
+
+	const char *input_thread_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				"video_input_thread(%s)", video->info.name);
+
+	while (os_sem_wait(thread->sem) == 0) {
+		if (os_atomic_load_bool(&thread->stop))
+			break;
+
+		pthread_mutex_lock(&thread->mutex);
+		circlebuf_pop_front(&thread->queue, &qf, sizeof(qf));
+		pthread_mutex_unlock(&thread->mutex);
+
+		profile_start(input_thread_name);
+		if (scale_video_output(input, &qf.frame))
+			input->callback(input->param, &qf.frame);
+		profile_end(input_thread_name);
+
+		release_cached_frame(video, qf.cache_idx);
+
+		profile_reenable_thread();
+	}
+
+	/* release any frames still queued when stopping */
+	pthread_mutex_lock(&thread->mutex);
+	while (thread->queue.size) {
+		circlebuf_pop_front(&thread->queue, &qf, sizeof(qf));
+		release_cached_frame(video, qf.cache_idx);
+	}
+	pthread_mutex_unlock(&thread->mutex);
+
+	/* the input was disconnected from within its own callback, so
+	 * nothing else is going to join and free this thread */
+	if (os_atomic_load_bool(&thread->detached)) {
+		thread->input.thread = NULL;
+		video_input_free(&thread->input);
+		circlebuf_free(&thread->queue);
+		pthread_mutex_destroy(&thread->mutex);
+		os_sem_destroy(thread->sem);
+		bfree(thread);
+	}
+
+	return NULL;
+}
+
+static bool video_input_thread_create(struct video_input *input,
+		struct video_output *video)
+{
+	struct video_input_thread *thread;
+
+	thread = bzalloc(sizeof(struct video_input_thread));
+	thread->video = video;
+	thread->input = *input;
+	thread->max_queued = video->info.cache_size / 2;
+	if (!thread->max_queued)
+		thread->max_queued = 1;
+
+	pthread_mutex_init_value(&thread->mutex);
+
+	if (pthread_mutex_init(&thread->mutex, NULL) != 0)
+		goto fail;
+	if (os_sem_init(&thread->sem, 0) != 0)
+		goto fail;
+	if (pthread_create(&thread->thread, NULL, video_input_thread_loop,
+				thread) != 0)
+		goto fail;
+
+	input->thread = thread;
+	return true;
+
+fail:
+	blog(LOG_ERROR, "video_input_thread_create: Failed to create "
+	                "input thread");
+	os_sem_destroy(thread->sem);
+	pthread_mutex_destroy(&thread->mutex);
+	bfree(thread);
+	return false;
+}
+
+static void video_input_thread_destroy(struct video_input_thread *thread)
+{
+	long skipped = os_atomic_load_long(&thread->skipped_frames);
+	if (skipped)
+		blog(LOG_INFO, "Video input thread stopped, number of "
+				"frames skipped due to input lag: %ld",
+				skipped);
+
+	os_atomic_set_bool(&thread->stop, true);
+
+	/* disconnecting from within the input's own callback (for example
+	 * an encoder stopping itself on error) cannot join its own thread */
+	if (pthread_equal(pthread_self(), thread->thread)) {
+		os_atomic_set_bool(&thread->detached, true);
+		pthread_detach(thread->thread);
+		os_sem_post(thread->sem);
+		return;
+	}
+
+	os_sem_post(thread->sem);
+	pthread_join(thread->thread, NULL);
+
+	thread->input.thread = NULL;
+	video_input_free(&thread->input);
+	circlebuf_free(&thread->queue);
+	pthread_mutex_destroy(&thread->mutex);
+	os_sem_destroy(thread->sem);
+	bfree(thread);
+}
+
 /* ------------------------------------------------------------------------- */
 
 static inline bool valid_video_params(const struct video_output_info *info)
@@ -270,8 +509,10 @@ void video_output_close(video_t *video)
 		video_input_free(&video->inputs.array[i]);
 	da_free(video->inputs);
 
-	for (size_t i = 0; i < video->info.cache_size; i++)
+	for (size_t i = 0; i < video->info.cache_size; i++) {
+		restore_cached_frame(&video->cache[i]);
 		video_frame_free((struct video_frame*)&video->cache[i]);
+	}
 
 	os_sem_destroy(video->update_semaphore);
 	pthread_mutex_destroy(&video->data_mutex);
@@ -330,10 +571,10 @@ static inline bool video_input_init(struct video_input *input,
 	return true;
 }
 
-bool video_output_connect(video_t *video,
+static bool video_output_connect_internal(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
-		void *param)
+		void *param, bool threaded)
 {
 	bool success = false;
 
@@ -368,6 +609,11 @@ bool video_output_connect(video_t *video,
 			input.conversion.height = video->info.height;
 
 		success = video_input_init(&input, video);
+		if (success && threaded) {
+			success = video_input_thread_create(&input, video);
+			if (!success)
+				video_input_free(&input);
+		}
 		if (success)
 			da_push_back(video->inputs, &input);
 	}
@@ -377,6 +623,24 @@ bool video_output_connect(video_t *video,
 	return success;
 }
 
+bool video_output_connect(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	return video_output_connect_internal(video, conversion, callback,
+			param, false);
+}
+
+bool video_output_connect_threaded(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	return video_output_connect_internal(video, conversion, callback,
+			param, true);
+}
+
 void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param)
@@ -388,8 +652,9 @@ void video_output_disconnect(video_t *video,
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array+idx);
+		struct video_input input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
+		video_input_free(&input);
 	}
 
 	if (video->inputs.num == 0) {
@@ -456,6 +721,36 @@ bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 	return locked;
 }
 
+bool video_output_submit_frame(video_t *video,
+		const struct video_frame *frame, int count, uint64_t timestamp,
+		void (*release)(void *param), void *param)
+{
+	struct cached_frame_info *cfi;
+	struct video_frame cache_frame;
+
+	if (!video || !frame || !release)
+		return false;
+	if (!video_output_lock_frame(video, &cache_frame, count, timestamp))
+		return false;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	cfi = &video->cache[video->last_added];
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		cfi->own_data[i]       = cfi->frame.data[i];
+		cfi->own_linesize[i]   = cfi->frame.linesize[i];
+		cfi->frame.data[i]     = frame->data[i];
+		cfi->frame.linesize[i] = frame->linesize[i];
+	}
+	cfi->release = release;
+	cfi->release_param = param;
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	video_output_unlock_frame(video);
+	return true;
+}
+
 void video_output_unlock_frame(video_t *video)
 {
 	if (!video) return;
@@ -528,3 +823,72 @@ uint32_t video_output_get_total_frames(const video_t *video)
 {
 	return video->total_frames;
 }
+
+static inline size_t find_cached_frame(const video_t *video,
+		const struct video_data *frame)
+{
+	for (size_t i = 0; i < video->info.cache_size; i++) {
+		if (video->cache[i].frame.data[0] == frame->data[0])
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+bool video_output_ref_frame(video_t *video, const struct video_data *frame)
+{
+	size_t idx;
+
+	if (!video || !frame)
+		return false;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	idx = find_cached_frame(video, frame);
+	if (idx != DARRAY_INVALID)
+		os_atomic_inc_long(&video->cache[idx].refs);
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	return idx != DARRAY_INVALID;
+}
+
+void video_output_release_frame(video_t *video, const struct video_data *frame)
+{
+	size_t idx;
+
+	if (!video || !frame)
+		return;
+
+	pthread_mutex_lock(&video->data_mutex);
+	idx = find_cached_frame(video, frame);
+	pthread_mutex_unlock(&video->data_mutex);
+
+	if (idx != DARRAY_INVALID)
+		release_cached_frame(video, idx);
+}
+
+uint32_t video_output_get_input_skipped_frames(video_t *video,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	uint32_t skipped = 0;
+
+	if (!video)
+		return 0;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID) {
+		struct video_input_thread *thread =
+			video->inputs.array[idx].thread;
+		if (thread)
+			skipped = (uint32_t)os_atomic_load_long(
+					&thread->skipped_frames);
+	}
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return skipped;
+}
@@ -179,6 +179,17 @@ EXPORT bool video_output_connect(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
+
+/**
+ * Connects an input that receives frames on its own thread instead of inline
+ * on the video thread.  Frames are queued by reference from the frame cache,
+ * and if the input's queue is full the frame is skipped for that input only,
+ * so a slow input does not stall the other inputs.
+ */
+EXPORT bool video_output_connect_threaded(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param);
 EXPORT void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
@@ -190,6 +201,17 @@ EXPORT const struct video_output_info *video_output_get_info(
 EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 		int count, uint64_t timestamp);
 EXPORT void video_output_unlock_frame(video_t *video);
+
+/**
+ * Outputs a frame without copying it into the frame cache.  The cache frame
+ * points to the given data until every input is done with it, after which
+ * release is called (from any thread, possibly before this returns).  Only
+ * the data pointers and linesizes of the frame are used.  Returns false if
+ * no cache frame was available, in which case release is not called.
+ */
+EXPORT bool video_output_submit_frame(video_t *video,
+		const struct video_frame *frame, int count, uint64_t timestamp,
+		void (*release)(void *param), void *param);
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
 EXPORT void video_output_stop(video_t *video);
 EXPORT bool video_output_stopped(video_t *video);
@@ -202,6 +224,24 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+/**
+ * Holds a reference to a frame received in a video callback, so its data stays
+ * valid after the callback returns.  Only frames that are passed straight from
+ * the frame cache can be held; returns false for frames that were scaled or
+ * converted for the input, in which case the data must be copied instead.
+ * Held frames cannot be reused for new video, so they should be released as
+ * soon as possible with video_output_release_frame.
+ */
+EXPORT bool video_output_ref_frame(video_t *video,
+		const struct video_data *frame);
+EXPORT void video_output_release_frame(video_t *video,
+		const struct video_data *frame);
+
+/** Gets the number of frames skipped for a threaded input */
+EXPORT uint32_t video_output_get_input_skipped_frames(video_t *video,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param);
+
 
 #ifdef __cplusplus
 }
@@ -17,6 +17,7 @@
 
 #include <inttypes.h>
 #include "obs-internal.h"
+#include "media-io/audio-kernels.h"
 
 struct ts_info {
 	uint64_t start;
@@ -24,7 +25,8 @@ struct ts_info {
 };
 
 #define DEBUG_AUDIO 0
-#define MAX_BUFFERING_TICKS 45
+/* about a second at the default tick size */
+#define MAX_BUFFERING_TICKS (45 * 1024 / AUDIO_OUTPUT_FRAMES)
 
 static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 {
@@ -63,18 +65,10 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	}
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
-
-			mix += start_point;
-			end = aud + total_floats;
-
-			while (aud < end)
-				*(mix++) += *(aud++);
-		}
+		for (size_t ch = 0; ch < channels; ch++)
+			audio_mix(mixes[mix_idx].data[ch] + start_point,
+					source->audio_output_buf[mix_idx][ch],
+					total_floats);
 	}
 }
 
@@ -358,6 +352,157 @@ static inline void calc_min_ts(struct obs_core_data *data,
 		find_min_ts(data, min_ts);
 }
 
+/* ------------------------------------------------------------------------- */
+/* parallel audio render */
+
+static void render_batch_jobs(struct obs_audio_render_pool *pool)
+{
+	for (;;) {
+		long idx = os_atomic_inc_long(&pool->next_job) - 1;
+		if (idx >= (long)pool->batch_size)
+			break;
+
+		obs_source_audio_render(pool->batch[idx], pool->mixers,
+				pool->channels, pool->sample_rate,
+				pool->audio_size);
+	}
+}
+
+static void *audio_render_thread(void *param)
+{
+	struct obs_audio_render_pool *pool = param;
+
+	os_set_thread_name("libobs: audio render thread");
+
+	while (os_sem_wait(pool->start_sem) == 0) {
+		if (os_atomic_load_bool(&pool->stop))
+			break;
+
+		render_batch_jobs(pool);
+		os_sem_post(pool->done_sem);
+	}
+
+	return NULL;
+}
+
+bool obs_audio_render_pool_init(struct obs_audio_render_pool *pool,
+		uint32_t threads)
+{
+	int max_threads = os_get_logical_cores() - 1;
+
+	if (threads > MAX_AUDIO_RENDER_THREADS)
+		threads = MAX_AUDIO_RENDER_THREADS;
+	if ((int)threads > max_threads)
+		threads = max_threads > 0 ? (uint32_t)max_threads : 0;
+	if (!threads)
+		return true;
+
+	if (os_sem_init(&pool->start_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&pool->done_sem, 0) != 0) {
+		os_sem_destroy(pool->start_sem);
+		pool->start_sem = NULL;
+		return false;
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+					audio_render_thread, pool) != 0) {
+			blog(LOG_WARNING, "Failed to create audio render "
+					"thread %d", (int)i);
+			break;
+		}
+
+		pool->num_threads++;
+	}
+
+	blog(LOG_INFO, "Rendering audio sources with %d extra threads",
+			(int)pool->num_threads);
+	return true;
+}
+
+void obs_audio_render_pool_free(struct obs_audio_render_pool *pool)
+{
+	os_atomic_set_bool(&pool->stop, true);
+
+	for (size_t i = 0; i < pool->num_threads; i++)
+		os_sem_post(pool->start_sem);
+	for (size_t i = 0; i < pool->num_threads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	os_sem_destroy(pool->start_sem);
+	os_sem_destroy(pool->done_sem);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/* plain sources only use their own data, so any number of them can render at
+ * the same time, with the audio thread doing its share of the work */
+static void render_batch(struct obs_audio_render_pool *pool,
+		struct obs_source **batch, size_t batch_size)
+{
+	size_t workers = pool->num_threads;
+
+	if (batch_size < 2 || !workers) {
+		for (size_t i = 0; i < batch_size; i++)
+			obs_source_audio_render(batch[i], pool->mixers,
+					pool->channels, pool->sample_rate,
+					pool->audio_size);
+		return;
+	}
+
+	if (workers > batch_size - 1)
+		workers = batch_size - 1;
+
+	pool->batch = batch;
+	pool->batch_size = batch_size;
+	os_atomic_set_long(&pool->next_job, 0);
+
+	for (size_t i = 0; i < workers; i++)
+		os_sem_post(pool->start_sem);
+
+	render_batch_jobs(pool);
+
+	for (size_t i = 0; i < workers; i++)
+		os_sem_wait(pool->done_sem);
+}
+
+static void render_audio_sources(struct obs_core_audio *audio,
+		uint32_t mixers, size_t channels, size_t sample_rate,
+		size_t audio_size)
+{
+	struct obs_audio_render_pool *pool = &audio->render_pool;
+	struct obs_source **sources = audio->render_order.array;
+	size_t batch_start = 0;
+
+	if (!pool->num_threads) {
+		for (size_t i = 0; i < audio->render_order.num; i++)
+			obs_source_audio_render(sources[i], mixers, channels,
+					sample_rate, audio_size);
+		return;
+	}
+
+	pool->mixers = mixers;
+	pool->channels = channels;
+	pool->sample_rate = sample_rate;
+	pool->audio_size = audio_size;
+
+	/* composite sources may read any source rendered before them, and
+	 * read stale data from any source rendered after them, so they have
+	 * to stay exactly where they are in the render order */
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		if (!sources[i]->info.audio_render)
+			continue;
+
+		render_batch(pool, sources + batch_start, i - batch_start);
+		obs_source_audio_render(sources[i], mixers, channels,
+				sample_rate, audio_size);
+		batch_start = i + 1;
+	}
+
+	render_batch(pool, sources + batch_start,
+			audio->render_order.num - batch_start);
+}
+
 static inline void release_audio_sources(struct obs_core_audio *audio)
 {
 	for (size_t i = 0; i < audio->render_order.num; i++)
@@ -416,11 +561,7 @@ bool audio_callback(void *param,
 
 	/* ------------------------------------------------ */
 	/* render audio data */
-	for (size_t i = 0; i < audio->render_order.num; i++) {
-		obs_source_t *source = audio->render_order.array[i];
-		obs_source_audio_render(source, mixers, channels, sample_rate,
-				audio_size);
-	}
+	render_audio_sources(audio, mixers, channels, sample_rate, audio_size);
 
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
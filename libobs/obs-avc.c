@@ -15,7 +15,7 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-avc.h"
 #include "util/array-serializer.h"
 
@@ -132,18 +132,23 @@ void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 {
 	struct array_output_data output;
 	struct serializer s;
-	long ref = 1;
+	size_t header_size = obs_encoder_packet_header_size();
 
 	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
-	serialize(&s, &ref, sizeof(ref));
+	/* leave room for the packet header so the parsed data can be handed
+	 * out as a refcounted packet without another copy */
+	da_resize(output.bytes, header_size);
 	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
 			&avc_packet->priority);
 
-	avc_packet->data          = output.bytes.array + sizeof(ref);
-	avc_packet->size          = output.bytes.num - sizeof(ref);
+	avc_packet->size          = output.bytes.num - header_size;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+	obs_encoder_packet_wrap(avc_packet, output.bytes.array + header_size,
+			bfree, output.bytes.array);
+	obs_encoder_packet_set_trace_id(avc_packet,
+			obs_encoder_packet_get_trace_id(src));
 }
 
 static inline bool has_start_code(const uint8_t *data)
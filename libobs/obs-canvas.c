@@ -0,0 +1,221 @@
+/******************************************************************************
+    Copyright (C) 2014 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <inttypes.h>
+#include "obs.h"
+#include "obs-internal.h"
+
+#define CANVAS_SIZE_MIN 2
+#define CANVAS_SIZE_MAX (32 * 1024)
+
+static inline bool canvas_size_valid(uint32_t width, uint32_t height)
+{
+	return (width >= CANVAS_SIZE_MIN && height >= CANVAS_SIZE_MIN &&
+	        width <= CANVAS_SIZE_MAX && height <= CANVAS_SIZE_MAX);
+}
+
+/* must be called within the graphics context */
+static bool init_canvas_textures(struct obs_canvas *canvas)
+{
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		canvas->render_textures[i] = gs_texture_create(
+				canvas->base_width, canvas->base_height,
+				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
+
+		if (!canvas->render_textures[i])
+			return false;
+	}
+
+	return true;
+}
+
+static void free_canvas(struct obs_canvas *canvas)
+{
+	/* closed first, so no frame still points into a readback surface */
+	video_output_close(canvas->rendition.video);
+
+	obs_enter_graphics();
+
+	obs_free_rendition(&canvas->rendition);
+	for (size_t i = 0; i < NUM_TEXTURES; i++)
+		gs_texture_destroy(canvas->render_textures[i]);
+
+	obs_leave_graphics();
+
+	obs_view_free(&canvas->view);
+	circlebuf_free(&canvas->vframe_info_buffer);
+	bfree(canvas->name);
+	bfree(canvas);
+}
+
+obs_canvas_t *obs_canvas_create(const char *name,
+		const struct obs_canvas_info *info)
+{
+	struct obs_core_video *video;
+	struct obs_canvas *canvas;
+	struct video_output_info vi;
+	bool success;
+
+	if (!obs || !obs->video.video || !obs->video.graphics)
+		return NULL;
+	if (!obs_ptr_valid(info, "obs_canvas_create"))
+		return NULL;
+
+	video = &obs->video;
+
+	if (!canvas_size_valid(info->base_width, info->base_height) ||
+	    !canvas_size_valid(info->output_width, info->output_height)) {
+		blog(LOG_WARNING, "obs_canvas_create: Invalid canvas size");
+		return NULL;
+	}
+	if (!obs_rendition_format_supported(info->output_format)) {
+		blog(LOG_WARNING, "obs_canvas_create: Unsupported output "
+		                  "format: %s",
+		                  get_video_format_name(info->output_format));
+		return NULL;
+	}
+
+	canvas = bzalloc(sizeof(struct obs_canvas));
+	canvas->name        = bstrdup(name && *name ? name : "canvas");
+	canvas->base_width  = info->base_width;
+	canvas->base_height = info->base_height;
+	canvas->fps_divider = info->fps_divider ? info->fps_divider : 1;
+	canvas->frame_time  = video_output_get_frame_time(video->video) *
+		(uint64_t)canvas->fps_divider;
+
+	if (!obs_view_init(&canvas->view)) {
+		bfree(canvas->name);
+		bfree(canvas);
+		return NULL;
+	}
+
+	/* rendered to an output the same way as the main view */
+	canvas->view.type = MAIN_VIEW;
+
+	/* same alignment as the main output */
+	canvas->rendition.info.format     = info->output_format;
+	canvas->rendition.info.width      = info->output_width & 0xFFFFFFFC;
+	canvas->rendition.info.height     = info->output_height & 0xFFFFFFFE;
+	canvas->rendition.info.range      = video->ovi.range;
+	canvas->rendition.info.colorspace = video->ovi.colorspace;
+
+	vi = *video_output_get_info(video->video);
+	vi.name       = canvas->name;
+	vi.format     = canvas->rendition.info.format;
+	vi.width      = canvas->rendition.info.width;
+	vi.height     = canvas->rendition.info.height;
+	vi.range      = canvas->rendition.info.range;
+	vi.colorspace = canvas->rendition.info.colorspace;
+	vi.fps_den   *= canvas->fps_divider;
+
+	if (video_output_open(&canvas->rendition.video, &vi) !=
+			VIDEO_OUTPUT_SUCCESS)
+		goto fail;
+
+	obs_enter_graphics();
+	success = init_canvas_textures(canvas) &&
+		obs_init_rendition(&canvas->rendition, true);
+	obs_leave_graphics();
+
+	if (!success)
+		goto fail;
+
+	pthread_mutex_lock(&video->canvases_mutex);
+	da_push_back(video->canvases, &canvas);
+	pthread_mutex_unlock(&video->canvases_mutex);
+
+	blog(LOG_INFO, "canvas '%s' created: %"PRIu32"x%"PRIu32", output "
+	               "%"PRIu32"x%"PRIu32" %s at 1/%"PRIu32" of the frame rate",
+	               canvas->name, canvas->base_width, canvas->base_height,
+	               vi.width, vi.height, get_video_format_name(vi.format),
+	               canvas->fps_divider);
+	return canvas;
+
+fail:
+	blog(LOG_WARNING, "obs_canvas_create: Failed to create canvas '%s'",
+			canvas->name);
+	free_canvas(canvas);
+	return NULL;
+}
+
+void obs_canvas_destroy(obs_canvas_t *canvas)
+{
+	struct obs_core_video *video;
+
+	if (!canvas)
+		return;
+
+	video = &obs->video;
+
+	/* the graphics thread keeps the list locked while rendering, so the
+	 * canvas isn't in use once removed */
+	pthread_mutex_lock(&video->canvases_mutex);
+	da_erase_item(video->canvases, &canvas);
+	pthread_mutex_unlock(&video->canvases_mutex);
+
+	blog(LOG_DEBUG, "canvas '%s' destroyed", canvas->name);
+
+	free_canvas(canvas);
+}
+
+void obs_free_canvases(void)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (video->canvases.num)
+		blog(LOG_INFO, "\t%d canvas(es) were remaining",
+				(int)video->canvases.num);
+
+	while (video->canvases.num)
+		obs_canvas_destroy(video->canvases.array[0]);
+
+	da_free(video->canvases);
+}
+
+const char *obs_canvas_get_name(const obs_canvas_t *canvas)
+{
+	return obs_ptr_valid(canvas, "obs_canvas_get_name") ?
+		canvas->name : NULL;
+}
+
+void obs_canvas_get_info(const obs_canvas_t *canvas,
+		struct obs_canvas_info *info)
+{
+	if (!obs_ptr_valid(canvas, "obs_canvas_get_info"))
+		return;
+	if (!obs_ptr_valid(info, "obs_canvas_get_info"))
+		return;
+
+	info->base_width    = canvas->base_width;
+	info->base_height   = canvas->base_height;
+	info->output_width  = canvas->rendition.info.width;
+	info->output_height = canvas->rendition.info.height;
+	info->output_format = canvas->rendition.info.format;
+	info->fps_divider   = canvas->fps_divider;
+}
+
+obs_view_t *obs_canvas_get_view(obs_canvas_t *canvas)
+{
+	return obs_ptr_valid(canvas, "obs_canvas_get_view") ?
+		&canvas->view : NULL;
+}
+
+video_t *obs_canvas_get_video(const obs_canvas_t *canvas)
+{
+	return obs_ptr_valid(canvas, "obs_canvas_get_video") ?
+		canvas->rendition.video : NULL;
+}
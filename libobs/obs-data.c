@@ -26,12 +26,16 @@
 #include "graphics/quat.h"
 #include "obs-data.h"
 
-#include <jansson.h>
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
 
 struct obs_data_item {
 	volatile long        ref;
 	struct obs_data      *parent;
 	struct obs_data_item *next;
+	uint32_t             hash;
 	enum obs_data_type   type;
 	size_t               name_len;
 	size_t               data_len;
@@ -46,6 +50,15 @@ struct obs_data {
 	volatile long        ref;
 	char                 *json;
 	struct obs_data_item *first_item;
+	struct obs_data_item *last_item;
+	size_t               num_items;
+
+	/* open addressing hash table of the items by name, only created once
+	 * there are more than INDEX_MIN_ITEMS items.  the list above still
+	 * defines the order of the items */
+	struct obs_data_item **index;
+	size_t               index_size;
+	size_t               index_used;
 };
 
 struct obs_data_array {
@@ -61,6 +74,139 @@ struct obs_data_number {
 	};
 };
 
+/* ------------------------------------------------------------------------- */
+/* Name index */
+
+#define INDEX_MIN_ITEMS 8
+#define INDEX_MIN_SIZE  32
+
+/* marks a removed item so probing continues past it */
+static struct obs_data_item index_tombstone;
+
+static inline uint32_t hash_name(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static inline char *get_item_name(struct obs_data_item *item);
+
+static void index_insert(struct obs_data *data, struct obs_data_item *item)
+{
+	size_t mask = data->index_size - 1;
+	size_t i = item->hash & mask;
+
+	while (data->index[i] && data->index[i] != &index_tombstone)
+		i = (i + 1) & mask;
+
+	if (!data->index[i])
+		data->index_used++;
+	data->index[i] = item;
+}
+
+static void index_rebuild(struct obs_data *data, size_t size)
+{
+	struct obs_data_item *item = data->first_item;
+
+	bfree(data->index);
+	data->index = bzalloc(size * sizeof(struct obs_data_item*));
+	data->index_size = size;
+	data->index_used = 0;
+
+	while (item) {
+		index_insert(data, item);
+		item = item->next;
+	}
+}
+
+/* called after an item was added to the list */
+static void index_add(struct obs_data *data, struct obs_data_item *item)
+{
+	size_t size = data->index_size;
+
+	if (!data->index) {
+		if (data->num_items > INDEX_MIN_ITEMS)
+			index_rebuild(data, INDEX_MIN_SIZE);
+		return;
+	}
+
+	/* keep the table (including removed slots) at most 3/4 full */
+	if ((data->index_used + 1) * 4 > size * 3) {
+		while (data->num_items * 2 > size)
+			size *= 2;
+		index_rebuild(data, size);
+		return;
+	}
+
+	index_insert(data, item);
+}
+
+static struct obs_data_item **index_find_slot(struct obs_data *data,
+		const char *name, uint32_t hash)
+{
+	size_t mask = data->index_size - 1;
+	size_t i = hash & mask;
+	struct obs_data_item *item;
+
+	while ((item = data->index[i]) != NULL) {
+		if (item != &index_tombstone && item->hash == hash &&
+		    strcmp(get_item_name(item), name) == 0)
+			return &data->index[i];
+
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+/* item is only compared, it may already have been reallocated */
+static inline struct obs_data_item **index_find_item(struct obs_data *data,
+		struct obs_data_item *item, uint32_t hash)
+{
+	size_t mask = data->index_size - 1;
+	size_t i = hash & mask;
+
+	while (data->index[i]) {
+		if (data->index[i] == item)
+			return &data->index[i];
+
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+static void index_remove(struct obs_data *data, struct obs_data_item *item)
+{
+	struct obs_data_item **slot;
+
+	if (!data->index)
+		return;
+
+	slot = index_find_item(data, item, item->hash);
+	if (slot)
+		*slot = &index_tombstone;
+}
+
+static void index_replace(struct obs_data *data, struct obs_data_item *old_ptr,
+		struct obs_data_item *new_ptr)
+{
+	struct obs_data_item **slot;
+
+	if (!data->index)
+		return;
+
+	slot = index_find_item(data, old_ptr, new_ptr->hash);
+	if (slot)
+		*slot = new_ptr;
+}
+
 /* ------------------------------------------------------------------------- */
 /* Item structure, designed to be one allocation only */
 
@@ -279,6 +425,7 @@ static struct obs_data_item *obs_data_item_create(const char *name,
 	item->capacity = total_size;
 	item->type     = type;
 	item->name_len = name_size;
+	item->hash     = hash_name(name);
 	item->ref      = 1;
 
 	if (default_data) {
@@ -320,12 +467,28 @@ static struct obs_data_item **get_item_prev_next(struct obs_data *data,
 	return NULL;
 }
 
+static inline struct obs_data_item *get_prev_item(struct obs_data *data,
+		struct obs_data_item **prev_next)
+{
+	if (prev_next == &data->first_item)
+		return NULL;
+
+	return (struct obs_data_item*)((uint8_t*)prev_next -
+			offsetof(struct obs_data_item, next));
+}
+
 static inline void obs_data_item_detach(struct obs_data_item *item)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(item->parent,
-			item);
+	struct obs_data *data = item->parent;
+	struct obs_data_item **prev_next = get_item_prev_next(data, item);
 
 	if (prev_next) {
+		if (data->last_item == item)
+			data->last_item = get_prev_item(data, prev_next);
+
+		index_remove(data, item);
+		data->num_items--;
+
 		*prev_next = item->next;
 		item->next = NULL;
 	}
@@ -334,11 +497,16 @@ static inline void obs_data_item_detach(struct obs_data_item *item)
 static inline void obs_data_item_reattach(struct obs_data_item *old_ptr,
 		struct obs_data_item *new_ptr)
 {
-	struct obs_data_item **prev_next = get_item_prev_next(new_ptr->parent,
-			old_ptr);
+	struct obs_data *data = new_ptr->parent;
+	struct obs_data_item **prev_next = get_item_prev_next(data, old_ptr);
 
-	if (prev_next)
+	if (prev_next) {
 		*prev_next = new_ptr;
+
+		if (data->last_item == old_ptr)
+			data->last_item = new_ptr;
+		index_replace(data, old_ptr, new_ptr);
+	}
 }
 
 static struct obs_data_item *obs_data_item_ensure_capacity(
@@ -467,156 +635,770 @@ static inline void obs_data_item_set_autoselect_data(
 	*p_item = item;
 }
 
+static struct obs_data_item *get_item(struct obs_data *data, const char *name);
+
 /* ------------------------------------------------------------------------- */
+/* JSON reader
+ *
+ *   Builds obs_data directly from the JSON text instead of going through a
+ * jansson tree first.  Files are read in chunks, so loading a file never
+ * holds more than one chunk of its text in memory.  Accepts the same input
+ * jansson does with JSON_REJECT_DUPLICATES: the root has to be an object (or
+ * an array, which is ignored), null values and array elements that are not
+ * objects are skipped. */
+
+#define JSON_READ_CHUNK (64 * 1024)
+#define JSON_MAX_DEPTH  2048
+
+struct json_reader {
+	FILE        *file;
+	char        *chunk;
+	const char  *text;
+	size_t      len;
+	size_t      pos;
+	int         line;
+
+	/* keys of all objects currently being read, each one terminated */
+	struct dstr keys;
+	struct dstr str;
+
+	bool        failed;
+	int         error_line;
+	char        error[128];
+};
+
+static bool json_error(struct json_reader *r, const char *format, ...)
+{
+	va_list args;
+
+	if (r->failed)
+		return false;
+
+	va_start(args, format);
+	vsnprintf(r->error, sizeof(r->error), format, args);
+	va_end(args);
 
-static void obs_data_add_json_item(obs_data_t *data, const char *key,
-		json_t *json);
+	r->failed     = true;
+	r->error_line = r->line;
+	return false;
+}
 
-static inline void obs_data_add_json_object_data(obs_data_t *data, json_t *jobj)
+static bool json_fill(struct json_reader *r)
 {
-	const char *item_key;
-	json_t *jitem;
+	if (!r->file)
+		return false;
+
+	r->len = fread(r->chunk, 1, JSON_READ_CHUNK, r->file);
+	r->pos = 0;
+	return r->len != 0;
+}
 
-	json_object_foreach (jobj, item_key, jitem) {
-		obs_data_add_json_item(data, item_key, jitem);
+static inline int json_peek(struct json_reader *r)
+{
+	if (r->pos == r->len && !json_fill(r))
+		return EOF;
+	return (uint8_t)r->text[r->pos];
+}
+
+static inline int json_get(struct json_reader *r)
+{
+	int c = json_peek(r);
+	if (c != EOF) {
+		r->pos++;
+		if (c == '\n')
+			r->line++;
 	}
+	return c;
 }
 
-static inline void obs_data_add_json_object(obs_data_t *data, const char *key,
-		json_t *jobj)
+static inline void json_skip_whitespace(struct json_reader *r)
 {
-	obs_data_t *sub_obj = obs_data_create();
+	for (;;) {
+		int c = json_peek(r);
+		if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+			break;
+		json_get(r);
+	}
+}
+
+static bool json_valid_utf8(const char *str, size_t len)
+{
+	const uint8_t *s   = (const uint8_t*)str;
+	const uint8_t *end = s + len;
+
+	while (s < end) {
+		uint32_t cp;
+		size_t   count;
+
+		if (*s < 0x80) {
+			s++;
+			continue;
+		} else if (*s >= 0xC2 && *s <= 0xDF) {
+			cp = *s & 0x1F;
+			count = 1;
+		} else if (*s >= 0xE0 && *s <= 0xEF) {
+			cp = *s & 0x0F;
+			count = 2;
+		} else if (*s >= 0xF0 && *s <= 0xF4) {
+			cp = *s & 0x07;
+			count = 3;
+		} else {
+			return false;
+		}
+
+		if ((size_t)(end - s) <= count)
+			return false;
+
+		for (size_t i = 1; i <= count; i++) {
+			if ((s[i] & 0xC0) != 0x80)
+				return false;
+			cp = (cp << 6) | (s[i] & 0x3F);
+		}
+
+		/* overlong sequences, surrogates and out of range */
+		if ((count == 2 && cp < 0x800) ||
+		    (count == 3 && cp < 0x10000) ||
+		    (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+			return false;
 
-	obs_data_add_json_object_data(sub_obj, jobj);
-	obs_data_set_obj(data, key, sub_obj);
-	obs_data_release(sub_obj);
+		s += count + 1;
+	}
+
+	return true;
 }
 
-static void obs_data_add_json_array(obs_data_t *data, const char *key,
-		json_t *jarray)
+static void json_cat_utf8(struct dstr *out, uint32_t cp)
 {
-	obs_data_array_t *array = obs_data_array_create();
-	size_t idx;
-	json_t *jitem;
+	char buf[4];
+	size_t len;
+
+	if (cp < 0x80) {
+		buf[0] = (char)cp;
+		len = 1;
+	} else if (cp < 0x800) {
+		buf[0] = (char)(0xC0 | (cp >> 6));
+		buf[1] = (char)(0x80 | (cp & 0x3F));
+		len = 2;
+	} else if (cp < 0x10000) {
+		buf[0] = (char)(0xE0 | (cp >> 12));
+		buf[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[2] = (char)(0x80 | (cp & 0x3F));
+		len = 3;
+	} else {
+		buf[0] = (char)(0xF0 | (cp >> 18));
+		buf[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+		buf[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		buf[3] = (char)(0x80 | (cp & 0x3F));
+		len = 4;
+	}
+
+	dstr_ncat(out, buf, len);
+}
+
+static bool json_read_hex4(struct json_reader *r, uint32_t *val)
+{
+	*val = 0;
+
+	for (int i = 0; i < 4; i++) {
+		int c = json_get(r);
+
+		if (c >= '0' && c <= '9')
+			*val = (*val << 4) | (uint32_t)(c - '0');
+		else if (c >= 'a' && c <= 'f')
+			*val = (*val << 4) | (uint32_t)(c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F')
+			*val = (*val << 4) | (uint32_t)(c - 'A' + 10);
+		else
+			return json_error(r, "invalid escape");
+	}
+
+	return true;
+}
 
-	json_array_foreach (jarray, idx, jitem) {
-		obs_data_t *item;
+static bool json_read_escape(struct json_reader *r, struct dstr *out)
+{
+	uint32_t cp, low;
+	int c = json_get(r);
+
+	switch (c) {
+	case '"':
+	case '\\':
+	case '/': dstr_cat_ch(out, (char)c); return true;
+	case 'b': dstr_cat_ch(out, '\b'); return true;
+	case 'f': dstr_cat_ch(out, '\f'); return true;
+	case 'n': dstr_cat_ch(out, '\n'); return true;
+	case 'r': dstr_cat_ch(out, '\r'); return true;
+	case 't': dstr_cat_ch(out, '\t'); return true;
+	case 'u': break;
+	default:  return json_error(r, "invalid escape");
+	}
 
-		if (!json_is_object(jitem))
+	if (!json_read_hex4(r, &cp))
+		return false;
+
+	if (cp >= 0xD800 && cp <= 0xDBFF) {
+		if (json_get(r) != '\\' || json_get(r) != 'u' ||
+		    !json_read_hex4(r, &low) || low < 0xDC00 || low > 0xDFFF)
+			return json_error(r, "invalid Unicode '\\u%04X'", cp);
+
+		cp = 0x10000 + (((cp & 0x3FF) << 10) | (low & 0x3FF));
+
+	} else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+		return json_error(r, "invalid Unicode '\\u%04X'", cp);
+
+	} else if (cp == 0) {
+		return json_error(r, "\\u0000 is not allowed");
+	}
+
+	json_cat_utf8(out, cp);
+	return true;
+}
+
+/* appends the string to out, the opening quote was already read */
+static bool json_read_string(struct json_reader *r, struct dstr *out)
+{
+	size_t start = out->len;
+
+	for (;;) {
+		const char *run = r->text + r->pos;
+		const char *end = r->text + r->len;
+		const char *p   = run;
+		int c;
+
+		while (p < end && *p != '"' && *p != '\\' && (uint8_t)*p >= 0x20)
+			p++;
+		if (p != run) {
+			dstr_ncat(out, run, (size_t)(p - run));
+			r->pos += (size_t)(p - run);
 			continue;
+		}
 
-		item = obs_data_create();
-		obs_data_add_json_object_data(item, jitem);
-		obs_data_array_push_back(array, item);
-		obs_data_release(item);
+		c = json_get(r);
+		if (c == '"')
+			break;
+		else if (c == EOF)
+			return json_error(r, "premature end of input");
+		else if (c == '\\') {
+			if (!json_read_escape(r, out))
+				return false;
+		} else {
+			return json_error(r, "control character 0x%x", c);
+		}
 	}
 
-	obs_data_set_array(data, key, array);
-	obs_data_array_release(array);
+	if (!json_valid_utf8(out->array + start, out->len - start))
+		return json_error(r, "invalid UTF-8");
+
+	if (!out->array)
+		dstr_copy(out, "");
+	return true;
 }
 
-static void obs_data_add_json_item(obs_data_t *data, const char *key,
-		json_t *json)
+static inline void json_reset_str(struct dstr *str)
 {
-	if (json_is_object(json))
-		obs_data_add_json_object(data, key, json);
-	else if (json_is_array(json))
-		obs_data_add_json_array(data, key, json);
-	else if (json_is_string(json))
-		obs_data_set_string(data, key, json_string_value(json));
-	else if (json_is_integer(json))
-		obs_data_set_int(data, key, json_integer_value(json));
-	else if (json_is_real(json))
-		obs_data_set_double(data, key, json_real_value(json));
-	else if (json_is_true(json))
-		obs_data_set_bool(data, key, true);
-	else if (json_is_false(json))
-		obs_data_set_bool(data, key, false);
+	if (str->array) {
+		str->len = 0;
+		str->array[0] = 0;
+	}
 }
 
-/* ------------------------------------------------------------------------- */
+static inline bool is_digit(int c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static bool json_read_number(struct json_reader *r, obs_data_t *obj,
+		size_t key)
+{
+	struct dstr *str = &r->str;
+	const char *p;
+	bool real = false;
+
+	json_reset_str(str);
+	for (;;) {
+		int c = json_peek(r);
+		if (!is_digit(c) && c != '-' && c != '+' && c != '.' &&
+		    c != 'e' && c != 'E')
+			break;
+		dstr_cat_ch(str, (char)json_get(r));
+	}
+
+	/* -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+	p = str->array;
+	if (*p == '-')
+		p++;
+	if (*p == '0')
+		p++;
+	else if (is_digit(*p))
+		while (is_digit(*p)) p++;
+	else
+		return json_error(r, "invalid number");
+
+	if (*p == '.') {
+		real = true;
+		if (!is_digit(*++p))
+			return json_error(r, "invalid number");
+		while (is_digit(*p)) p++;
+	}
+
+	if (*p == 'e' || *p == 'E') {
+		real = true;
+		if (*++p == '+' || *p == '-')
+			p++;
+		if (!is_digit(*p))
+			return json_error(r, "invalid number");
+		while (is_digit(*p)) p++;
+	}
+
+	if (*p)
+		return json_error(r, "invalid number");
+
+	if (real) {
+		double val = os_strtod(str->array);
+		if (isinf(val))
+			return json_error(r, "real number overflow");
+		if (obj)
+			obs_data_set_double(obj, r->keys.array + key, val);
+
+	} else {
+		long long val;
+
+		errno = 0;
+		val = strtoll(str->array, NULL, 10);
+		if (errno == ERANGE)
+			return json_error(r, "too big integer");
+		if (obj)
+			obs_data_set_int(obj, r->keys.array + key, val);
+	}
+
+	return true;
+}
 
-static inline void set_json_string(json_t *json, const char *name,
-		obs_data_item_t *item)
+static bool json_read_literal(struct json_reader *r, const char *literal)
 {
-	const char *val = obs_data_item_get_string(item);
-	json_object_set_new(json, name, json_string(val));
+	for (const char *p = literal; *p; p++) {
+		if (json_get(r) != *p)
+			return json_error(r, "invalid token");
+	}
+
+	return true;
+}
+
+static bool json_read_object(struct json_reader *r, obs_data_t *obj,
+		int depth);
+static bool json_read_array(struct json_reader *r, obs_data_array_t *array,
+		int depth);
+
+/* reads the value of a member into obj, or skips it if obj is NULL */
+static bool json_read_member(struct json_reader *r, obs_data_t *obj,
+		size_t key, int depth)
+{
+	int c = json_peek(r);
+
+	if (c == '{') {
+		obs_data_t *sub_obj = obs_data_create();
+		bool success = json_read_object(r, sub_obj, depth + 1);
+		if (success && obj)
+			obs_data_set_obj(obj, r->keys.array + key, sub_obj);
+		obs_data_release(sub_obj);
+		return success;
+
+	} else if (c == '[') {
+		obs_data_array_t *array = obs_data_array_create();
+		bool success = json_read_array(r, array, depth + 1);
+		if (success && obj)
+			obs_data_set_array(obj, r->keys.array + key, array);
+		obs_data_array_release(array);
+		return success;
+
+	} else if (c == '"') {
+		json_get(r);
+		json_reset_str(&r->str);
+		if (!json_read_string(r, &r->str))
+			return false;
+		if (obj)
+			obs_data_set_string(obj, r->keys.array + key,
+					r->str.array);
+		return true;
+
+	} else if (c == '-' || is_digit(c)) {
+		return json_read_number(r, obj, key);
+
+	} else if (c == 't') {
+		if (!json_read_literal(r, "true"))
+			return false;
+		if (obj)
+			obs_data_set_bool(obj, r->keys.array + key, true);
+		return true;
+
+	} else if (c == 'f') {
+		if (!json_read_literal(r, "false"))
+			return false;
+		if (obj)
+			obs_data_set_bool(obj, r->keys.array + key, false);
+		return true;
+
+	} else if (c == 'n') {
+		return json_read_literal(r, "null");
+	}
+
+	return c == EOF ?
+		json_error(r, "premature end of input") :
+		json_error(r, "invalid token");
 }
 
-static inline void set_json_number(json_t *json, const char *name,
-		obs_data_item_t *item)
+static bool json_read_object(struct json_reader *r, obs_data_t *obj,
+		int depth)
 {
-	enum obs_data_number_type type = obs_data_item_numtype(item);
+	json_get(r);
+
+	if (depth > JSON_MAX_DEPTH)
+		return json_error(r, "maximum parsing depth reached");
+
+	json_skip_whitespace(r);
+	if (json_peek(r) == '}') {
+		json_get(r);
+		return true;
+	}
+
+	for (;;) {
+		size_t key = r->keys.len;
+		bool success;
+		int c;
+
+		json_skip_whitespace(r);
+		if (json_get(r) != '"')
+			return json_error(r, "string or '}' expected");
+		if (!json_read_string(r, &r->keys))
+			return false;
+
+		if (get_item(obj, r->keys.array + key))
+			return json_error(r, "duplicate object key");
+
+		/* keep the terminator, the next key goes after it */
+		dstr_cat_ch(&r->keys, 0);
+
+		json_skip_whitespace(r);
+		if (json_get(r) != ':')
+			return json_error(r, "':' expected");
+
+		json_skip_whitespace(r);
+		success = json_read_member(r, obj, key, depth);
+
+		r->keys.len = key;
+		r->keys.array[key] = 0;
+		if (!success)
+			return false;
+
+		json_skip_whitespace(r);
+		c = json_get(r);
+		if (c == '}')
+			return true;
+		if (c != ',')
+			return json_error(r, "'}' expected");
+	}
+}
+
+static bool json_read_array(struct json_reader *r, obs_data_array_t *array,
+		int depth)
+{
+	json_get(r);
+
+	if (depth > JSON_MAX_DEPTH)
+		return json_error(r, "maximum parsing depth reached");
+
+	json_skip_whitespace(r);
+	if (json_peek(r) == ']') {
+		json_get(r);
+		return true;
+	}
+
+	for (;;) {
+		int c;
+
+		json_skip_whitespace(r);
+		if (json_peek(r) == '{') {
+			obs_data_t *obj = obs_data_create();
+			bool success = json_read_object(r, obj, depth + 1);
+			if (success)
+				obs_data_array_push_back(array, obj);
+			obs_data_release(obj);
+			if (!success)
+				return false;
+
+		} else if (!json_read_member(r, NULL, 0, depth)) {
+			return false;
+		}
+
+		json_skip_whitespace(r);
+		c = json_get(r);
+		if (c == ']')
+			return true;
+		if (c != ',')
+			return json_error(r, "']' expected");
+	}
+}
+
+static bool json_read(struct json_reader *r, obs_data_t *data)
+{
+	bool success;
+
+	json_skip_whitespace(r);
+
+	if (json_peek(r) == '{') {
+		success = json_read_object(r, data, 1);
+
+	} else if (json_peek(r) == '[') {
+		obs_data_array_t *array = obs_data_array_create();
+		success = json_read_array(r, array, 1);
+		obs_data_array_release(array);
 
-	if (type == OBS_DATA_NUM_INT) {
-		long long val = obs_data_item_get_int(item);
-		json_object_set_new(json, name, json_integer(val));
 	} else {
-		double val = obs_data_item_get_double(item);
-		json_object_set_new(json, name, json_real(val));
+		return json_error(r, "'[' or '{' expected");
 	}
+
+	if (!success)
+		return false;
+
+	json_skip_whitespace(r);
+	if (json_peek(r) != EOF)
+		return json_error(r, "end of file expected");
+
+	return true;
 }
 
-static inline void set_json_bool(json_t *json, const char *name,
-		obs_data_item_t *item)
+static void json_reader_free(struct json_reader *r)
 {
-	bool val = obs_data_item_get_bool(item);
-	json_object_set_new(json, name, val ? json_true() : json_false());
+	dstr_free(&r->keys);
+	dstr_free(&r->str);
+	bfree(r->chunk);
 }
 
-static json_t *obs_data_to_json(obs_data_t *data);
+/* ------------------------------------------------------------------------- */
+/* JSON writer
+ *
+ *   Writes the user values of obs_data the same way json_dumps did with
+ * JSON_PRESERVE_ORDER | JSON_INDENT(4), either into a string or straight to
+ * a file. */
+
+#define JSON_WRITE_CHUNK (64 * 1024)
+#define JSON_INDENT      4
+
+struct json_writer {
+	struct dstr buf;
+	FILE        *file;
+	bool        failed;
+};
 
-static inline void set_json_obj(json_t *json, const char *name,
-		obs_data_item_t *item)
+static void json_flush(struct json_writer *w)
 {
-	obs_data_t *obj = obs_data_item_get_obj(item);
-	json_object_set_new(json, name, obs_data_to_json(obj));
-	obs_data_release(obj);
+	if (w->file && w->buf.len) {
+		if (fwrite(w->buf.array, 1, w->buf.len, w->file) != w->buf.len)
+			w->failed = true;
+		w->buf.len = 0;
+		w->buf.array[0] = 0;
+	}
+}
+
+static inline void json_write(struct json_writer *w, const char *str,
+		size_t len)
+{
+	dstr_ncat(&w->buf, str, len);
+	if (w->file && w->buf.len >= JSON_WRITE_CHUNK)
+		json_flush(w);
 }
 
-static inline void set_json_array(json_t *json, const char *name,
-		obs_data_item_t *item)
+static inline void json_write_indent(struct json_writer *w, int depth)
 {
-	json_t           *jarray = json_array();
-	obs_data_array_t *array   = obs_data_item_get_array(item);
-	size_t           count   = obs_data_array_count(array);
+	static const char spaces[] = "                                ";
+	size_t count = (size_t)depth * JSON_INDENT;
 
-	for (size_t idx = 0; idx < count; idx++) {
-		obs_data_t *sub_item = obs_data_array_item(array, idx);
-		json_t     *jitem   = obs_data_to_json(sub_item);
-		json_array_append_new(jarray, jitem);
-		obs_data_release(sub_item);
+	json_write(w, "\n", 1);
+	while (count) {
+		size_t len = count < sizeof(spaces) - 1 ?
+			count : sizeof(spaces) - 1;
+		json_write(w, spaces, len);
+		count -= len;
 	}
+}
 
-	json_object_set_new(json, name, jarray);
-	obs_data_array_release(array);
+static void json_write_string(struct json_writer *w, const char *str)
+{
+	const char *run = str;
+	const char *p;
+
+	json_write(w, "\"", 1);
+
+	for (p = str; *p; p++) {
+		uint8_t c = (uint8_t)*p;
+		char seq[8];
+		const char *esc;
+
+		if (c != '"' && c != '\\' && c >= 0x20)
+			continue;
+
+		if (p != run)
+			json_write(w, run, (size_t)(p - run));
+		run = p + 1;
+
+		switch (c) {
+		case '"':  esc = "\\\""; break;
+		case '\\': esc = "\\\\"; break;
+		case '\b': esc = "\\b";  break;
+		case '\f': esc = "\\f";  break;
+		case '\n': esc = "\\n";  break;
+		case '\r': esc = "\\r";  break;
+		case '\t': esc = "\\t";  break;
+		default:
+			snprintf(seq, sizeof(seq), "\\u%04X", (unsigned)c);
+			esc = seq;
+		}
+
+		json_write(w, esc, strlen(esc));
+	}
+
+	if (p != run)
+		json_write(w, run, (size_t)(p - run));
+
+	json_write(w, "\"", 1);
 }
 
-static json_t *obs_data_to_json(obs_data_t *data)
+/* values jansson would have refused to store were left out of the output */
+static bool json_item_writable(struct obs_data_item *item)
 {
-	json_t *json = json_object();
-	obs_data_item_t *item = NULL;
+	const char *name = get_item_name(item);
 
-	for (item = obs_data_first(data); item; obs_data_item_next(&item)) {
-		enum obs_data_type type = obs_data_item_gettype(item);
-		const char *name        = get_item_name(item);
+	if (!obs_data_item_has_user_value(item))
+		return false;
+	if (!json_valid_utf8(name, strlen(name)))
+		return false;
+
+	switch (item->type) {
+	case OBS_DATA_STRING: {
+		const char *str = obs_data_item_get_string(item);
+		return json_valid_utf8(str, strlen(str));
+	}
+	case OBS_DATA_NUMBER:
+		return obs_data_item_numtype(item) == OBS_DATA_NUM_INT ||
+			isfinite(obs_data_item_get_double(item));
+	case OBS_DATA_BOOLEAN:
+	case OBS_DATA_OBJECT:
+	case OBS_DATA_ARRAY:
+		return true;
+	case OBS_DATA_NULL:
+		break;
+	}
 
-		if (!obs_data_item_has_user_value(item))
+	return false;
+}
+
+static void json_write_obj(struct json_writer *w, obs_data_t *data,
+		int depth);
+
+static void json_write_array(struct json_writer *w, obs_data_array_t *array,
+		int depth)
+{
+	size_t count = obs_data_array_count(array);
+
+	json_write(w, "[", 1);
+
+	for (size_t i = 0; i < count; i++) {
+		json_write_indent(w, depth + 1);
+		json_write_obj(w, array->objects.array[i], depth + 1);
+		if (i + 1 < count)
+			json_write(w, ",", 1);
+	}
+
+	if (count)
+		json_write_indent(w, depth);
+	json_write(w, "]", 1);
+}
+
+static void json_write_item(struct json_writer *w,
+		struct obs_data_item *item, int depth)
+{
+	char buf[64];
+	int len;
+
+	json_write_string(w, get_item_name(item));
+	json_write(w, ": ", 2);
+
+	switch (item->type) {
+	case OBS_DATA_STRING:
+		json_write_string(w, obs_data_item_get_string(item));
+		break;
+
+	case OBS_DATA_NUMBER:
+		if (obs_data_item_numtype(item) == OBS_DATA_NUM_INT)
+			len = snprintf(buf, sizeof(buf), "%lld",
+					obs_data_item_get_int(item));
+		else
+			len = os_dtostr(obs_data_item_get_double(item),
+					buf, sizeof(buf));
+		json_write(w, buf, len > 0 ? (size_t)len : 0);
+		break;
+
+	case OBS_DATA_BOOLEAN:
+		if (obs_data_item_get_bool(item))
+			json_write(w, "true", 4);
+		else
+			json_write(w, "false", 5);
+		break;
+
+	case OBS_DATA_OBJECT:
+		json_write_obj(w, get_item_obj(item), depth);
+		break;
+
+	case OBS_DATA_ARRAY:
+		json_write_array(w, get_item_array(item), depth);
+		break;
+
+	case OBS_DATA_NULL:
+		break;
+	}
+}
+
+static void json_write_obj(struct json_writer *w, obs_data_t *data,
+		int depth)
+{
+	struct obs_data_item *item = data ? data->first_item : NULL;
+	bool empty = true;
+
+	json_write(w, "{", 1);
+
+	for (; item; item = item->next) {
+		if (!json_item_writable(item))
 			continue;
 
-		if (type == OBS_DATA_STRING)
-			set_json_string(json, name, item);
-		else if (type == OBS_DATA_NUMBER)
-			set_json_number(json, name, item);
-		else if (type == OBS_DATA_BOOLEAN)
-			set_json_bool(json, name, item);
-		else if (type == OBS_DATA_OBJECT)
-			set_json_obj(json, name, item);
-		else if (type == OBS_DATA_ARRAY)
-			set_json_array(json, name, item);
+		if (!empty)
+			json_write(w, ",", 1);
+		json_write_indent(w, depth + 1);
+		json_write_item(w, item, depth + 1);
+		empty = false;
 	}
 
-	return json;
+	if (!empty)
+		json_write_indent(w, depth);
+	json_write(w, "}", 1);
+}
+
+static bool json_write_file(obs_data_t *data, const char *file)
+{
+	struct json_writer w = {0};
+	bool success;
+
+	w.file = os_fopen(file, "wb");
+	if (!w.file)
+		return false;
+
+	json_write_obj(&w, data, 0);
+	json_flush(&w);
+
+	success = !w.failed && fflush(w.file) == 0;
+	success = fclose(w.file) == 0 && success;
+
+	dstr_free(&w.buf);
+	return success;
 }
 
 /* ------------------------------------------------------------------------- */
@@ -631,35 +1413,54 @@ obs_data_t *obs_data_create()
 
 obs_data_t *obs_data_create_from_json(const char *json_string)
 {
+	struct json_reader reader = {0};
 	obs_data_t *data = obs_data_create();
 
-	json_error_t error;
-	json_t *root = json_loads(json_string, JSON_REJECT_DUPLICATES, &error);
+	reader.text = json_string;
+	reader.len  = json_string ? strlen(json_string) : 0;
+	reader.line = 1;
 
-	if (root) {
-		obs_data_add_json_object_data(data, root);
-		json_decref(root);
-	} else {
+	if (!json_read(&reader, data)) {
 		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_json] "
 		                "Failed reading json string (%d): %s",
-		                error.line, error.text);
+		                reader.error_line, reader.error);
 		obs_data_release(data);
 		data = NULL;
 	}
 
+	json_reader_free(&reader);
 	return data;
 }
 
 obs_data_t *obs_data_create_from_json_file(const char *json_file)
 {
-	char *file_data = os_quick_read_utf8_file(json_file);
-	obs_data_t *data = NULL;
+	struct json_reader reader = {0};
+	obs_data_t *data;
+
+	reader.file = json_file ? os_fopen(json_file, "rb") : NULL;
+	if (!reader.file)
+		return NULL;
 
-	if (file_data) {
-		data = obs_data_create_from_json(file_data);
-		bfree(file_data);
+	reader.chunk = bmalloc(JSON_READ_CHUNK);
+	reader.text  = reader.chunk;
+	reader.line  = 1;
+
+	/* skip the byte order mark */
+	if (json_fill(&reader) && reader.len >= 3 &&
+	    memcmp(reader.text, "\xEF\xBB\xBF", 3) == 0)
+		reader.pos = 3;
+
+	data = obs_data_create();
+	if (!json_read(&reader, data)) {
+		blog(LOG_ERROR, "obs-data.c: [obs_data_create_from_json_file] "
+		                "Failed reading json file '%s' (%d): %s",
+		                json_file, reader.error_line, reader.error);
+		obs_data_release(data);
+		data = NULL;
 	}
 
+	fclose(reader.file);
+	json_reader_free(&reader);
 	return data;
 }
 
@@ -709,8 +1510,8 @@ static inline void obs_data_destroy(struct obs_data *data)
 		item = next;
 	}
 
-	/* NOTE: don't use bfree for json text, allocated by json */
-	free(data->json);
+	bfree(data->json);
+	bfree(data->index);
 	bfree(data);
 }
 
@@ -724,48 +1525,141 @@ void obs_data_release(obs_data_t *data)
 
 const char *obs_data_get_json(obs_data_t *data)
 {
-	if (!data) return NULL;
+	struct json_writer writer = {0};
 
-	/* NOTE: don't use libobs bfree for json text */
-	free(data->json);
-	data->json = NULL;
+	if (!data) return NULL;
 
-	json_t *root = obs_data_to_json(data);
-	data->json = json_dumps(root, JSON_PRESERVE_ORDER | JSON_INDENT(4));
-	json_decref(root);
+	json_write_obj(&writer, data, 0);
 
+	bfree(data->json);
+	data->json = writer.buf.array;
 	return data->json;
 }
 
 bool obs_data_save_json(obs_data_t *data, const char *file)
 {
-	const char *json = obs_data_get_json(data);
-
-	if (json && *json) {
-		return os_quick_write_utf8_file(file, json, strlen(json),
-				false);
-	}
+	if (!data || !file)
+		return false;
 
-	return false;
+	return json_write_file(data, file);
 }
 
 bool obs_data_save_json_safe(obs_data_t *data, const char *file,
 		const char *temp_ext, const char *backup_ext)
 {
-	const char *json = obs_data_get_json(data);
+	struct dstr backup_path = {0};
+	struct dstr temp_path = {0};
+	bool success = false;
+
+	if (!data || !file)
+		return false;
 
-	if (json && *json) {
-		return os_quick_write_utf8_file_safe(file, json, strlen(json),
-				false, temp_ext, backup_ext);
+	if (!temp_ext || !*temp_ext) {
+		blog(LOG_ERROR, "obs_data_save_json_safe: invalid "
+		                "temporary extension specified");
+		return false;
 	}
 
-	return false;
+	dstr_copy(&temp_path, file);
+	if (*temp_ext != '.')
+		dstr_cat(&temp_path, ".");
+	dstr_cat(&temp_path, temp_ext);
+
+	if (!json_write_file(data, temp_path.array))
+		goto cleanup;
+
+	if (backup_ext && *backup_ext) {
+		dstr_copy(&backup_path, file);
+		if (*backup_ext != '.')
+			dstr_cat(&backup_path, ".");
+		dstr_cat(&backup_path, backup_ext);
+	}
+
+	if (os_safe_replace(file, temp_path.array, backup_path.array) == 0)
+		success = true;
+
+cleanup:
+	dstr_free(&backup_path);
+	dstr_free(&temp_path);
+	return success;
+}
+
+static void snapshot_array(obs_data_t *dst, const char *name,
+		obs_data_array_t *src)
+{
+	obs_data_array_t *array = obs_data_array_create();
+	size_t count = obs_data_array_count(src);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *obj = obs_data_snapshot(src->objects.array[i]);
+		obs_data_array_push_back(array, obj);
+		obs_data_release(obj);
+	}
+
+	obs_data_set_array(dst, name, array);
+	obs_data_array_release(array);
+}
+
+obs_data_t *obs_data_snapshot(obs_data_t *data)
+{
+	obs_data_t *snapshot = obs_data_create();
+	struct obs_data_item *item = data ? data->first_item : NULL;
+
+	for (; item; item = item->next) {
+		const char *name = get_item_name(item);
+
+		if (!obs_data_item_has_user_value(item))
+			continue;
+
+		switch (item->type) {
+		case OBS_DATA_STRING:
+			obs_data_set_string(snapshot, name,
+					obs_data_item_get_string(item));
+			break;
+
+		case OBS_DATA_NUMBER:
+			if (obs_data_item_numtype(item) == OBS_DATA_NUM_INT)
+				obs_data_set_int(snapshot, name,
+						obs_data_item_get_int(item));
+			else
+				obs_data_set_double(snapshot, name,
+						obs_data_item_get_double(item));
+			break;
+
+		case OBS_DATA_BOOLEAN:
+			obs_data_set_bool(snapshot, name,
+					obs_data_item_get_bool(item));
+			break;
+
+		case OBS_DATA_OBJECT: {
+			obs_data_t *obj = obs_data_snapshot(get_item_obj(item));
+			obs_data_set_obj(snapshot, name, obj);
+			obs_data_release(obj);
+			break;
+		}
+
+		case OBS_DATA_ARRAY:
+			snapshot_array(snapshot, name, get_item_array(item));
+			break;
+
+		case OBS_DATA_NULL:
+			break;
+		}
+	}
+
+	return snapshot;
 }
 
 static struct obs_data_item *get_item(struct obs_data *data, const char *name)
 {
 	if (!data) return NULL;
 
+	if (data->index) {
+		struct obs_data_item **slot = index_find_slot(data, name,
+				hash_name(name));
+		return slot ? *slot : NULL;
+	}
+
 	struct obs_data_item *item = data->first_item;
 
 	while (item) {
@@ -789,13 +1683,19 @@ static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 		new_item = obs_data_item_create(name, ptr, size, type,
 				default_data, autoselect_data);
 
-		obs_data_item_t *prev = obs_data_first(data);
-		obs_data_item_t *next = obs_data_first(data);
-		obs_data_item_next(&next);
-		for (; prev && next; obs_data_item_next(&prev),
-				obs_data_item_next(&next)) {
-			if (strcmp(get_item_name(next), name) > 0)
-				break;
+		/* items are kept sorted by name.  saved data is loaded in
+		 * order, so check the end of the list first */
+		obs_data_item_t *prev = data->last_item;
+		obs_data_item_t *next = NULL;
+
+		if (!prev || strcmp(get_item_name(prev), name) > 0) {
+			prev = data->first_item;
+			next = prev ? prev->next : NULL;
+
+			for (; prev && next; prev = next, next = next->next) {
+				if (strcmp(get_item_name(next), name) > 0)
+					break;
+			}
 		}
 
 		new_item->parent = data;
@@ -808,11 +1708,11 @@ static void set_item_data(struct obs_data *data, struct obs_data_item **item,
 			new_item->next   = prev;
 		}
 
-		if (!prev)
-			data->first_item = new_item;
+		if (!new_item->next)
+			data->last_item = new_item;
 
-		obs_data_item_release(&prev);
-		obs_data_item_release(&next);
+		data->num_items++;
+		index_add(data, new_item);
 
 	} else if (default_data) {
 		obs_data_item_set_default_data(item, ptr, size, type);
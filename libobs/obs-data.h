@@ -74,6 +74,10 @@ EXPORT bool obs_data_save_json(obs_data_t *data, const char *file);
 EXPORT bool obs_data_save_json_safe(obs_data_t *data, const char *file,
 		const char *temp_ext, const char *backup_ext);
 
+/** Creates a deep copy of the user values of data, for example to save it
+ * from another thread while the original keeps being changed */
+EXPORT obs_data_t *obs_data_snapshot(obs_data_t *data);
+
 EXPORT void obs_data_apply(obs_data_t *target, obs_data_t *apply_data);
 
 EXPORT void obs_data_erase(obs_data_t *data, const char *name);
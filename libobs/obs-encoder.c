@@ -23,6 +23,18 @@
 #define set_encoder_active(encoder, val) \
 	os_atomic_set_bool(&encoder->active, val)
 
+struct packet_pool;
+struct packet_header;
+
+static struct packet_pool *packet_pool_create(void);
+static void packet_pool_destroy(struct packet_pool *pool);
+static void packet_pool_set_bitrate(struct packet_pool *pool, int64_t kbps);
+static void packet_create_pooled_instance(struct obs_encoder *encoder,
+		struct encoder_packet *dst, const struct encoder_packet *src);
+static inline uint8_t *get_packet_data(struct packet_header *header);
+static struct packet_header *packet_pool_alloc(struct packet_pool *pool,
+		size_t size);
+
 struct obs_encoder_info *find_encoder(const char *id)
 {
 	for (size_t i = 0; i < obs->encoder_types.num; i++) {
@@ -64,6 +76,10 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
 
+	encoder->packet_pool = packet_pool_create();
+	if (!encoder->packet_pool)
+		return false;
+
 	if (encoder->info.get_defaults)
 		encoder->info.get_defaults(encoder->context.settings);
 
@@ -167,14 +183,21 @@ static inline void get_video_info(struct obs_encoder *encoder,
 		obs_encoder_set_scaled_size(encoder, info->width, info->height);
 }
 
-static inline bool has_scaling(const struct obs_encoder *encoder)
+static inline bool needs_conversion(const struct obs_encoder *encoder,
+		const struct video_scale_info *info)
 {
-	uint32_t video_width  = video_output_get_width(encoder->media);
-	uint32_t video_height = video_output_get_height(encoder->media);
+	const struct video_output_info *voi;
+	voi = video_output_get_info(encoder->media);
 
-	return encoder->scaled_width && encoder->scaled_height &&
-		(video_width  != encoder->scaled_width ||
-		 video_height != encoder->scaled_height);
+	return info->width  != voi->width ||
+	       info->height != voi->height ||
+	       info->format != voi->format;
+}
+
+/* the output the encoder actually receives its frames from */
+static inline video_t *get_video_source(const struct obs_encoder *encoder)
+{
+	return encoder->rendition ? encoder->rendition : encoder->media;
 }
 
 static void add_connection(struct obs_encoder *encoder)
@@ -187,10 +210,23 @@ static void add_connection(struct obs_encoder *encoder)
 				&audio_info, receive_audio, encoder);
 	} else {
 		struct video_scale_info info = {0};
+		video_t *video;
 		get_video_info(encoder, &info);
 
-		video_output_connect(encoder->media, &info, receive_video,
-			encoder);
+		/* have the graphics thread scale and convert the frames
+		 * instead of video-io, falls back to video-io if the
+		 * rendition can't be created */
+		if (needs_conversion(encoder, &info))
+			encoder->rendition = obs_video_rendition_acquire(
+					encoder->media, &info);
+
+		video = get_video_source(encoder);
+		if (encoder->dedicated_thread)
+			video_output_connect_threaded(video, &info,
+					receive_video, encoder);
+		else
+			video_output_connect(video, &info,
+					receive_video, encoder);
 	}
 
 	set_encoder_active(encoder, true);
@@ -202,8 +238,13 @@ static void remove_connection(struct obs_encoder *encoder)
 		audio_output_disconnect(encoder->media, encoder->mixer_idx,
 				receive_audio, encoder);
 	else
-		video_output_disconnect(encoder->media, receive_video,
-				encoder);
+		video_output_disconnect(get_video_source(encoder),
+				receive_video, encoder);
+
+	if (encoder->rendition) {
+		obs_video_rendition_release(encoder->rendition);
+		encoder->rendition = NULL;
+	}
 
 	obs_encoder_shutdown(encoder);
 	set_encoder_active(encoder, false);
@@ -239,6 +280,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		packet_pool_destroy(encoder->packet_pool);
 		obs_context_data_free(&encoder->context);
 		if (encoder->owns_info_id)
 			bfree((void*)encoder->info.id);
@@ -400,6 +442,9 @@ static inline bool obs_encoder_initialize_internal(obs_encoder_t *encoder)
 	if (encoder->info.type == OBS_ENCODER_AUDIO)
 		intitialize_audio_encoder(encoder);
 
+	packet_pool_set_bitrate(encoder->packet_pool, obs_data_get_int(
+				encoder->context.settings, "bitrate"));
+
 	encoder->initialized = true;
 	return true;
 }
@@ -468,6 +513,8 @@ static inline void obs_encoder_start_internal(obs_encoder_t *encoder,
 
 	if (first) {
 		encoder->cur_pts = 0;
+		encoder->last_frame_ts = 0;
+		memset(encoder->trace_ts, 0, sizeof(encoder->trace_ts));
 		add_connection(encoder);
 	}
 }
@@ -580,6 +627,45 @@ void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 	encoder->scaled_height = height;
 }
 
+void obs_encoder_set_dedicated_thread(obs_encoder_t *encoder, bool dedicated)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_set_dedicated_thread"))
+		return;
+	if (encoder->info.type != OBS_ENCODER_VIDEO) {
+		blog(LOG_WARNING, "obs_encoder_set_dedicated_thread: "
+				"encoder '%s' is not a video encoder",
+				obs_encoder_get_name(encoder));
+		return;
+	}
+	if (encoder->dedicated_thread == dedicated)
+		return;
+	if (encoder_active(encoder)) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change the thread "
+		                  "mode while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->dedicated_thread = dedicated;
+}
+
+bool obs_encoder_dedicated_thread(const obs_encoder_t *encoder)
+{
+	return obs_encoder_valid(encoder, "obs_encoder_dedicated_thread") ?
+		encoder->dedicated_thread : false;
+}
+
+uint32_t obs_encoder_get_skipped_frames(const obs_encoder_t *encoder)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_get_skipped_frames"))
+		return 0;
+	if (encoder->info.type != OBS_ENCODER_VIDEO || !encoder->media)
+		return 0;
+
+	return video_output_get_input_skipped_frames(get_video_source(encoder),
+			receive_video, (void*)encoder);
+}
+
 uint32_t obs_encoder_get_width(const obs_encoder_t *encoder)
 {
 	if (!obs_encoder_valid(encoder, "obs_encoder_get_width"))
@@ -721,7 +807,6 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
 	struct encoder_packet first_packet;
-	DARRAY(uint8_t)       data;
 	uint8_t               *sei;
 	size_t                size;
 
@@ -729,25 +814,23 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	if (!packet->keyframe)
 		return;
 
-	da_init(data);
-
 	if (!get_sei(encoder, &sei, &size) || !sei || !size) {
 		cb->new_packet(cb->param, packet);
 		cb->sent_first_packet = true;
 		return;
 	}
 
-	da_push_back_array(data, sei, size);
-	da_push_back_array(data, packet->data, packet->size);
-
 	first_packet      = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	first_packet.size = size + packet->size;
+	first_packet.data = get_packet_data(packet_pool_alloc(
+				encoder->packet_pool, first_packet.size));
+	memcpy(first_packet.data, sei, size);
+	memcpy(first_packet.data + size, packet->data, packet->size);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
-	da_free(data);
+	obs_encoder_packet_release(&first_packet);
 }
 
 static inline void send_packet(struct obs_encoder *encoder,
@@ -770,6 +853,26 @@ static void full_stop(struct obs_encoder *encoder)
 	}
 }
 
+static inline size_t trace_idx(struct obs_encoder *encoder, int64_t pts)
+{
+	return (size_t)((uint64_t)pts / encoder->timebase_num) %
+		ENCODER_TRACE_FRAMES;
+}
+
+static inline void set_trace_id(struct obs_encoder *encoder,
+		int64_t pts, uint64_t timestamp)
+{
+	size_t idx = trace_idx(encoder, pts);
+	encoder->trace_pts[idx] = pts;
+	encoder->trace_ts[idx] = timestamp;
+}
+
+static inline uint64_t get_trace_id(struct obs_encoder *encoder, int64_t pts)
+{
+	size_t idx = trace_idx(encoder, pts);
+	return encoder->trace_pts[idx] == pts ? encoder->trace_ts[idx] : 0;
+}
+
 static const char *do_encode_name = "do_encode";
 static inline void do_encode(struct obs_encoder *encoder,
 		struct encoder_frame *frame)
@@ -792,6 +895,10 @@ static inline void do_encode(struct obs_encoder *encoder,
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 			&received);
 	profile_end(encoder->profile_encoder_encode_name);
+	if (!received && (encoder->info.caps &
+				OBS_ENCODER_CAP_REFCOUNTED_PACKETS))
+		obs_encoder_packet_release(&pkt);
+
 	if (!success) {
 		full_stop(encoder);
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
@@ -800,6 +907,8 @@ static inline void do_encode(struct obs_encoder *encoder,
 	}
 
 	if (received) {
+		struct encoder_packet out;
+
 		if (!encoder->first_received) {
 			encoder->offset_usec = packet_dts_usec(&pkt);
 			encoder->first_received = true;
@@ -811,15 +920,32 @@ static inline void do_encode(struct obs_encoder *encoder,
 			packet_dts_usec(&pkt) - encoder->offset_usec;
 		pkt.sys_dts_usec = pkt.dts_usec;
 
+		/* encoders that allocate from the packet pool hand over their
+		 * reference, otherwise the packet is copied once here and all
+		 * outputs share that copy */
+		if (encoder->info.caps & OBS_ENCODER_CAP_REFCOUNTED_PACKETS)
+			out = pkt;
+		else
+			packet_create_pooled_instance(encoder, &out, &pkt);
+
+		if (encoder->info.type == OBS_ENCODER_VIDEO && out.pts >= 0) {
+			uint64_t trace_id = get_trace_id(encoder, out.pts);
+
+			obs_encoder_packet_set_trace_id(&out, trace_id);
+			frame_trace_record(trace_id, FRAME_TRACE_ENCODE_END);
+		}
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = encoder->callbacks.num; i > 0; i--) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array+(i-1);
-			send_packet(encoder, cb, &pkt);
+			send_packet(encoder, cb, &out);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&out);
 	}
 
 error:
@@ -852,9 +978,26 @@ static void receive_video(void *param, struct video_data *frame)
 	if (!encoder->start_ts)
 		encoder->start_ts = frame->timestamp;
 
+	/* frames skipped for this encoder's input thread must still advance
+	 * the pts, otherwise video drifts away from audio */
+	if (encoder->dedicated_thread && encoder->last_frame_ts) {
+		uint64_t frame_time = video_output_get_frame_time(
+				encoder->media);
+		uint64_t elapsed = frame->timestamp - encoder->last_frame_ts;
+		uint64_t frames = (elapsed + frame_time / 2) / frame_time;
+
+		if (frames > 1)
+			encoder->cur_pts += (int64_t)(frames - 1) *
+				encoder->timebase_num;
+	}
+	encoder->last_frame_ts = frame->timestamp;
+
 	enc_frame.frames = 1;
 	enc_frame.pts    = encoder->cur_pts;
 
+	set_trace_id(encoder, enc_frame.pts, frame->timestamp);
+	frame_trace_record(frame->timestamp, FRAME_TRACE_ENCODE_START);
+
 	do_encode(encoder, &enc_frame);
 
 	encoder->cur_pts += encoder->timebase_num;
@@ -1033,18 +1176,314 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 	pthread_mutex_unlock(&encoder->outputs_mutex);
 }
 
+/* ------------------------------------------------------------------------- */
+/* packet buffers
+ *
+ * packet data is reference counted, with a small header stored directly in
+ * front of the data.  buffers allocated for an encoder come from a pool of
+ * power-of-two size classes so that steady-state encoding does not allocate
+ * or free anything, and outputs can hold references to packets instead of
+ * copying them. */
+
+#define PACKET_POOL_MIN_SHIFT 10
+#define PACKET_POOL_MAX_SHIFT 24
+#define PACKET_POOL_CLASSES (PACKET_POOL_MAX_SHIFT - PACKET_POOL_MIN_SHIFT + 1)
+
+#define PACKET_POOL_MIN_BUDGET (1024 * 1024)
+#define PACKET_POOL_MAX_BUDGET (64 * 1024 * 1024)
+
+/* seconds worth of packets at the encoder bitrate kept cached */
+#define PACKET_POOL_SECONDS 2
+
+struct packet_pool;
+
+struct packet_header {
+	struct packet_pool   *pool;
+	struct packet_header *next;
+	size_t               capacity;
+	volatile long        refs;
+
+	/* set for packet data stored somewhere else, see
+	 * obs_encoder_packet_wrap */
+	void                 (*release)(void *param);
+	void                 *release_param;
+
+	/* frame trace id of video packets, kept out of encoder_packet so the
+	 * struct plugins see does not change */
+	uint64_t             trace_id;
+};
+
+#define PACKET_HEADER_SIZE \
+	((sizeof(struct packet_header) + 15) & ~(size_t)15)
+
+struct packet_pool {
+	pthread_mutex_t      mutex;
+	volatile long        refs;
+	bool                 shutdown;
+	size_t               budget;
+	size_t               cached;
+	struct packet_header *free_list[PACKET_POOL_CLASSES];
+};
+
+static inline struct packet_header *get_packet_header(const uint8_t *data)
+{
+	return (struct packet_header*)(data - PACKET_HEADER_SIZE);
+}
+
+static inline uint8_t *get_packet_data(struct packet_header *header)
+{
+	return (uint8_t*)header + PACKET_HEADER_SIZE;
+}
+
+static inline int get_packet_class(size_t size)
+{
+	int shift = PACKET_POOL_MIN_SHIFT;
+
+	while (((size_t)1 << shift) < size) {
+		if (++shift > PACKET_POOL_MAX_SHIFT)
+			return -1;
+	}
+
+	return shift - PACKET_POOL_MIN_SHIFT;
+}
+
+static struct packet_header *packet_alloc_unpooled(size_t size)
+{
+	struct packet_header *header = bmalloc(PACKET_HEADER_SIZE + size);
+	header->pool     = NULL;
+	header->next     = NULL;
+	header->capacity = size;
+	header->refs     = 1;
+	header->release  = NULL;
+	header->trace_id = 0;
+	return header;
+}
+
+static struct packet_pool *packet_pool_create(void)
+{
+	struct packet_pool *pool = bzalloc(sizeof(struct packet_pool));
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		bfree(pool);
+		return NULL;
+	}
+
+	pool->refs   = 1;
+	pool->budget = PACKET_POOL_MIN_BUDGET;
+	return pool;
+}
+
+static void packet_pool_free_cached(struct packet_pool *pool)
+{
+	for (size_t i = 0; i < PACKET_POOL_CLASSES; i++) {
+		struct packet_header *header = pool->free_list[i];
+
+		while (header) {
+			struct packet_header *next = header->next;
+			bfree(header);
+			header = next;
+		}
+
+		pool->free_list[i] = NULL;
+	}
+
+	pool->cached = 0;
+}
+
+static void packet_pool_release(struct packet_pool *pool)
+{
+	if (os_atomic_dec_long(&pool->refs) == 0) {
+		packet_pool_free_cached(pool);
+		pthread_mutex_destroy(&pool->mutex);
+		bfree(pool);
+	}
+}
+
+/* the pool itself stays alive until every packet allocated from it has been
+ * released, since outputs can hold packets after the encoder is destroyed */
+static void packet_pool_destroy(struct packet_pool *pool)
+{
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->shutdown = true;
+	packet_pool_free_cached(pool);
+	pthread_mutex_unlock(&pool->mutex);
+
+	packet_pool_release(pool);
+}
+
+static void packet_pool_set_bitrate(struct packet_pool *pool, int64_t kbps)
+{
+	size_t budget = PACKET_POOL_MIN_BUDGET;
+
+	if (kbps > 0)
+		budget = (size_t)kbps * 1000 / 8 * PACKET_POOL_SECONDS;
+	if (budget < PACKET_POOL_MIN_BUDGET)
+		budget = PACKET_POOL_MIN_BUDGET;
+	if (budget > PACKET_POOL_MAX_BUDGET)
+		budget = PACKET_POOL_MAX_BUDGET;
+
+	pthread_mutex_lock(&pool->mutex);
+	pool->budget = budget;
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+static struct packet_header *packet_pool_alloc(struct packet_pool *pool,
+		size_t size)
+{
+	struct packet_header *header = NULL;
+	int idx = get_packet_class(size);
+
+	if (!pool || idx == -1)
+		return packet_alloc_unpooled(size);
+
+	pthread_mutex_lock(&pool->mutex);
+
+	header = pool->free_list[idx];
+	if (header) {
+		pool->free_list[idx] = header->next;
+		pool->cached -= header->capacity;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	if (!header) {
+		size_t capacity = (size_t)1 << (idx + PACKET_POOL_MIN_SHIFT);
+		header = bmalloc(PACKET_HEADER_SIZE + capacity);
+		header->capacity = capacity;
+	}
+
+	os_atomic_inc_long(&pool->refs);
+	header->pool    = pool;
+	header->next    = NULL;
+	header->refs     = 1;
+	header->release  = NULL;
+	header->trace_id = 0;
+	return header;
+}
+
+static void packet_free(struct packet_header *header)
+{
+	struct packet_pool *pool = header->pool;
+
+	if (header->release) {
+		header->release(header->release_param);
+		return;
+	}
+
+	if (!pool) {
+		bfree(header);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (!pool->shutdown &&
+	    pool->cached + header->capacity <= pool->budget) {
+		int idx = get_packet_class(header->capacity);
+
+		header->next = pool->free_list[idx];
+		pool->free_list[idx] = header;
+		pool->cached += header->capacity;
+		header = NULL;
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	bfree(header);
+	packet_pool_release(pool);
+}
+
+uint8_t *obs_encoder_packet_alloc(obs_encoder_t *encoder, size_t size)
+{
+	if (!obs_encoder_valid(encoder, "obs_encoder_packet_alloc"))
+		return NULL;
+
+	return get_packet_data(packet_pool_alloc(encoder->packet_pool, size));
+}
+
+static void packet_create_pooled_instance(struct obs_encoder *encoder,
+		struct encoder_packet *dst, const struct encoder_packet *src)
+{
+	struct packet_header *header;
+
+	header = packet_pool_alloc(encoder->packet_pool, src->size);
+
+	*dst = *src;
+	dst->data = get_packet_data(header);
+	memcpy(dst->data, src->data, src->size);
+}
+
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
-	long *p_refs;
+	struct packet_header *header = packet_alloc_unpooled(src->size);
 
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void*)(p_refs + 1);
-	*p_refs = 1;
+	dst->data = get_packet_data(header);
 	memcpy(dst->data, src->data, src->size);
 }
 
+void obs_encoder_packet_append(struct encoder_packet *packet,
+		const uint8_t *data, size_t size)
+{
+	struct packet_header *header = get_packet_header(packet->data);
+	struct packet_header *new_header;
+	struct encoder_packet old;
+
+	if (!header->release && header->capacity >= packet->size + size &&
+	    os_atomic_load_long(&header->refs) == 1) {
+		memcpy(packet->data + packet->size, data, size);
+		packet->size += size;
+		return;
+	}
+
+	new_header = packet_alloc_unpooled(packet->size + size);
+	memcpy(get_packet_data(new_header), packet->data, packet->size);
+	memcpy(get_packet_data(new_header) + packet->size, data, size);
+	new_header->trace_id = header->trace_id;
+
+	old = *packet;
+	obs_encoder_packet_release(&old);
+	packet->data  = get_packet_data(new_header);
+	packet->size += size;
+}
+
+uint64_t obs_encoder_packet_get_trace_id(const struct encoder_packet *packet)
+{
+	return packet->data ? get_packet_header(packet->data)->trace_id : 0;
+}
+
+void obs_encoder_packet_set_trace_id(struct encoder_packet *packet,
+		uint64_t trace_id)
+{
+	if (packet->data)
+		get_packet_header(packet->data)->trace_id = trace_id;
+}
+
+size_t obs_encoder_packet_header_size(void)
+{
+	return PACKET_HEADER_SIZE;
+}
+
+void obs_encoder_packet_wrap(struct encoder_packet *packet, uint8_t *data,
+		void (*release)(void *param), void *param)
+{
+	struct packet_header *header = get_packet_header(data);
+
+	header->pool          = NULL;
+	header->next          = NULL;
+	header->capacity      = packet->size;
+	header->refs          = 1;
+	header->release       = release;
+	header->release_param = param;
+	header->trace_id      = 0;
+
+	packet->data = data;
+}
+
 void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src)
 {
@@ -1063,8 +1502,8 @@ void obs_encoder_packet_ref(struct encoder_packet *dst,
 		return;
 
 	if (src->data) {
-		long *p_refs = ((long*)src->data) - 1;
-		os_atomic_inc_long(p_refs);
+		struct packet_header *header = get_packet_header(src->data);
+		os_atomic_inc_long(&header->refs);
 	}
 
 	*dst = *src;
@@ -1076,9 +1515,9 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 		return;
 
 	if (pkt->data) {
-		long *p_refs = ((long*)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+		struct packet_header *header = get_packet_header(pkt->data);
+		if (os_atomic_dec_long(&header->refs) == 0)
+			packet_free(header);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
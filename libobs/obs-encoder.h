@@ -31,6 +31,14 @@ extern "C" {
 
 #define OBS_ENCODER_CAP_DEPRECATED             (1<<0)
 
+/**
+ * The encoder allocates packet data with obs_encoder_packet_alloc, and
+ * libobs takes ownership of that reference when the packet is returned,
+ * so packets reach outputs without being copied.  Packet data that was
+ * allocated is released by libobs even if no packet was received.
+ */
+#define OBS_ENCODER_CAP_REFCOUNTED_PACKETS     (1<<1)
+
 /** Specifies the encoder type */
 enum obs_encoder_type {
 	OBS_ENCODER_AUDIO, /**< The encoder provides an audio codec */
@@ -24,6 +24,7 @@
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/profiler.h"
+#include "util/frame-trace.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
 
@@ -37,6 +38,9 @@
 #include "obs.h"
 
 #define NUM_TEXTURES 2
+#define MIN_READBACK_DEPTH 2
+#define MAX_READBACK_DEPTH 8
+#define DEFAULT_READBACK_DEPTH 4
 #define MICROSECOND_DEN 1000000
 
 static inline int64_t packet_dts_usec(struct encoder_packet *packet)
@@ -186,9 +190,17 @@ void obs_hotkey_name_map_free(void);
 /* ------------------------------------------------------------------------- */
 /* views */
 
+enum view_type {
+	MAIN_VIEW,
+	AUX_VIEW
+};
+
 struct obs_view {
 	pthread_mutex_t                 channels_mutex;
 	obs_source_t                    *channels[MAX_CHANNELS];
+
+	/* how sources set on the view are activated */
+	enum view_type                  type;
 };
 
 extern bool obs_view_init(struct obs_view *view);
@@ -225,17 +237,137 @@ struct obs_vframe_info {
 	int count;
 };
 
-struct obs_core_video {
-	graphics_t                      *graphics;
-	gs_stagesurf_t                  *copy_surfaces[NUM_TEXTURES];
-	gs_texture_t                    *render_textures[NUM_TEXTURES];
+struct obs_video_rendition;
+
+/* a staging surface of the readback ring */
+struct obs_readback {
+	struct obs_video_rendition      *rendition;
+	gs_stagesurf_t                  *surface;
+	struct obs_vframe_info          info;
+
+	/* copied to, waiting for the GPU to finish */
+	bool                            staged;
+
+	bool                            mapped;
+	uint8_t                         *data;
+	uint32_t                        linesize;
+
+	/* mapped data handed straight to video-io, until it releases it */
+	volatile bool                   in_use;
+};
+
+/* the main texture scaled and converted to one output resolution/format,
+ * read back through its own staging ring into its own video-io output.
+ * besides the main output, one is created for each distinct size/format
+ * that encoders ask for, so they don't have to be scaled on the CPU */
+struct obs_video_rendition {
+	video_t                         *video;
+	struct video_scale_info         info;
+
 	gs_texture_t                    *output_textures[NUM_TEXTURES];
 	gs_texture_t                    *convert_textures[NUM_TEXTURES];
-	bool                            textures_rendered[NUM_TEXTURES];
 	bool                            textures_output[NUM_TEXTURES];
-	bool                            textures_copied[NUM_TEXTURES];
 	bool                            textures_converted[NUM_TEXTURES];
+	float                           color_matrix[16];
+
+	bool                            gpu_conversion;
+	const char                      *conversion_tech;
+	uint32_t                        conversion_height;
+	uint32_t                        plane_offsets[3];
+	uint32_t                        plane_sizes[3];
+	uint32_t                        plane_linewidth[3];
+
+	/* staged frames are downloaded once the GPU is done with them instead
+	 * of stalling the graphics thread, oldest first */
+	struct obs_readback             readbacks[MAX_READBACK_DEPTH];
+	uint32_t                        readback_depth;
+	size_t                          readback_write;
+	size_t                          readback_read;
+	size_t                          readback_pending;
+	volatile long                   readbacks_in_use;
+	int                             readback_skipped_count;
+
+	/* mapped this frame, output once out of the graphics context */
+	struct obs_readback             *downloaded[MAX_READBACK_DEPTH];
+	size_t                          num_downloaded;
+
+	/* encoders using an extra rendition, it's destroyed by the graphics
+	 * thread once this drops to 0 */
+	long                            refs;
+};
+
+/* an additional mix with its own view and video output, rendered by the
+ * graphics thread along with the main output */
+struct obs_canvas {
+	char                            *name;
+	struct obs_view                 view;
+	uint32_t                        base_width;
+	uint32_t                        base_height;
+	uint32_t                        fps_divider;
+
+	gs_texture_t                    *render_textures[NUM_TEXTURES];
+	bool                            textures_rendered[NUM_TEXTURES];
+	struct obs_video_rendition      rendition;
+
+	/* frames rendered but not staged yet */
+	struct circlebuf                vframe_info_buffer;
+	uint64_t                        frame_time;
+	uint64_t                        next_frame_time;
+};
+
+/* content rendered into a texture that's drawn later with premultiplied "over"
+ * (GS_BLEND_ONE, GS_BLEND_INVSRCALPHA) is blended with "over" for alpha as well.
+ * the default alpha blending (ONE, ONE) saturates where translucent content
+ * overlaps, which would hide more of what's behind the texture than drawing
+ * the content directly does */
+static inline void obs_set_render_cache_blend(void)
+{
+	gs_blend_function_separate(GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+}
+
+static inline bool obs_render_cache_blend_set(void)
+{
+	enum gs_blend_type src_c, dest_c, src_a, dest_a;
+
+	gs_get_blend_function_separate(&src_c, &dest_c, &src_a, &dest_a);
+	return src_c  == GS_BLEND_SRCALPHA &&
+	       dest_c == GS_BLEND_INVSRCALPHA &&
+	       src_a  == GS_BLEND_ONE &&
+	       dest_a == GS_BLEND_INVSRCALPHA;
+}
+
+/* pooled texture a source is rendered into the first time it's rendered in a
+ * frame, see obs_source_video_render */
+struct source_render_cache {
+	gs_texrender_t                  *texrender;
+	uint32_t                        cx;
+	uint32_t                        cy;
+	uint64_t                        last_used_frame;
+	bool                            in_use;
+};
+
+struct obs_core_video {
+	graphics_t                      *graphics;
+	gs_texture_t                    *render_textures[NUM_TEXTURES];
+	bool                            textures_rendered[NUM_TEXTURES];
 	struct circlebuf                vframe_info_buffer;
+
+	struct obs_video_rendition      main_rendition;
+	uint32_t                        readback_setting;
+
+	pthread_mutex_t                 renditions_mutex;
+	DARRAY(struct obs_video_rendition*) renditions;
+
+	pthread_mutex_t                 canvases_mutex;
+	DARRAY(struct obs_canvas*)      canvases;
+
+	/* only touched by the graphics thread */
+	DARRAY(struct source_render_cache) render_cache;
+	uint64_t                        render_cache_frame;
+	uint32_t                        render_cache_hits;
+	uint32_t                        render_cache_misses;
+
 	gs_effect_t                     *default_effect;
 	gs_effect_t                     *default_rect_effect;
 	gs_effect_t                     *opaque_effect;
@@ -246,7 +378,6 @@ struct obs_core_video {
 	gs_effect_t                     *bilinear_lowres_effect;
 	gs_effect_t                     *premultiplied_alpha_effect;
 	gs_samplerstate_t               *point_sampler;
-	gs_stagesurf_t                  *mapped_surface;
 	int                             cur_texture;
 
 	uint64_t                        video_time;
@@ -259,17 +390,10 @@ struct obs_core_video {
 	bool                            thread_initialized;
 
 	bool                            gpu_conversion;
-	const char                      *conversion_tech;
-	uint32_t                        conversion_height;
-	uint32_t                        plane_offsets[3];
-	uint32_t                        plane_sizes[3];
-	uint32_t                        plane_linewidth[3];
-
 	uint32_t                        output_width;
 	uint32_t                        output_height;
 	uint32_t                        base_width;
 	uint32_t                        base_height;
-	float                           color_matrix[16];
 	enum obs_scale_type             scale_type;
 
 	gs_texture_t                    *transparent_texture;
@@ -288,12 +412,39 @@ struct obs_core_video {
 
 struct audio_monitor;
 
+#define MAX_AUDIO_RENDER_THREADS 8
+
+/* renders the sources of an audio tick in parallel.  composite sources mix
+ * the output of other sources, so they are rendered on the audio thread
+ * after everything before them in the render order, which keeps the result
+ * identical to rendering everything in order. */
+struct obs_audio_render_pool {
+	pthread_t                       threads[MAX_AUDIO_RENDER_THREADS];
+	size_t                          num_threads;
+	os_sem_t                        *start_sem;
+	os_sem_t                        *done_sem;
+	volatile bool                   stop;
+
+	/* the batch currently being rendered, only changed while the workers
+	 * are waiting */
+	struct obs_source               **batch;
+	size_t                          batch_size;
+	volatile long                   next_job;
+	uint32_t                        mixers;
+	size_t                          channels;
+	size_t                          sample_rate;
+	size_t                          audio_size;
+};
+
 struct obs_core_audio {
 	audio_t                         *audio;
 
 	DARRAY(struct obs_source*)      render_order;
 	DARRAY(struct obs_source*)      root_nodes;
 
+	struct obs_audio_render_pool    render_pool;
+	uint32_t                        render_threads_setting;
+
 	uint64_t                        buffered_ts;
 	struct circlebuf                buffered_timestamps;
 	int                             buffering_wait_ticks;
@@ -402,8 +553,42 @@ extern struct obs_core *obs;
 
 extern void *obs_graphics_thread(void *param);
 
+/* gets the video output of a GPU rendition matching the given size/format,
+ * creating it if needed.  returns NULL if the format can't be rendered, in
+ * which case the main output has to be scaled instead */
+extern video_t *obs_video_rendition_acquire(video_t *source,
+		const struct video_scale_info *info);
+extern void obs_video_rendition_release(video_t *video);
+extern void obs_video_rendition_destroy(struct obs_video_rendition *rendition);
+
+/* creates and frees the textures and staging surfaces of a rendition, must
+ * be called within the graphics context */
+extern bool obs_init_rendition(struct obs_video_rendition *rendition,
+		bool gpu_conversion);
+extern void obs_free_rendition(struct obs_video_rendition *rendition);
+
+static inline bool obs_rendition_format_supported(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_RGBA:
+		return true;
+	default:;
+	}
+
+	return false;
+}
+
+extern void obs_free_canvases(void);
+
 extern gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file);
 
+extern bool obs_audio_render_pool_init(struct obs_audio_render_pool *pool,
+		uint32_t threads);
+extern void obs_audio_render_pool_free(struct obs_audio_render_pool *pool);
+
 extern bool audio_callback(void *param,
 		uint64_t start_ts_in, uint64_t end_ts_in, uint64_t *out_ts,
 		uint32_t mixers, struct audio_output_data *mixes);
@@ -543,6 +728,10 @@ struct obs_source {
 	/* signals to call the source update in the video thread */
 	bool                            defer_update;
 
+	/* incremented whenever the video of the source may have changed, used
+	 * by scenes to tell when cached video has to be rendered again */
+	volatile long                   video_changes;
+
 	/* ensures show/hide are only called once */
 	volatile long                   show_refs;
 
@@ -649,6 +838,12 @@ struct obs_source {
 	enum obs_allow_direct_render    allow_direct;
 	bool                            rendering_filter;
 
+	/* per-frame render cache, only touched by the graphics thread */
+	uint64_t                        render_cache_frame;
+	uint32_t                        render_count;
+	uint32_t                        prev_render_count;
+	size_t                          render_cache_idx;
+
 	/* sources specific hotkeys */
 	obs_hotkey_pair_id              mute_unmute_key;
 	obs_hotkey_id                   push_to_mute_key;
@@ -713,11 +908,6 @@ extern void audio_monitor_destroy(struct audio_monitor *monitor);
 
 extern void obs_source_destroy(struct obs_source *source);
 
-enum view_type {
-	MAIN_VIEW,
-	AUX_VIEW
-};
-
 static inline void obs_source_dosignal(struct obs_source *source,
 		const char *signal_obs, const char *signal_source)
 {
@@ -758,6 +948,8 @@ static inline enum gs_color_format convert_video_format(
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_render_cache_begin_frame(void);
+extern void obs_free_render_cache(void);
 extern float obs_source_get_target_volume(obs_source_t *source,
 		obs_source_t *target);
 
@@ -792,10 +984,18 @@ enum delay_msg {
 	DELAY_MSG_STOP,
 };
 
+struct delay_segment;
+
 struct delay_data {
 	enum delay_msg msg;
 	uint64_t ts;
 	struct encoder_packet packet;
+
+	/* set if the packet data was spilled to disk, packet.data is NULL
+	 * until it is read back */
+	struct delay_segment *segment;
+	size_t offset;
+	uint64_t trace_id;
 };
 
 typedef void (*encoded_callback_t)(void *data, struct encoder_packet *packet);
@@ -849,6 +1049,9 @@ struct obs_output {
 
 	int                             total_frames;
 
+	/* time from rendering a frame to the output sending it */
+	struct frame_trace_histogram    glass_to_wire;
+
 	volatile bool                   active;
 	video_t                         *video;
 	audio_t                         *audio;
@@ -860,6 +1063,9 @@ struct obs_output {
 	uint32_t                        scaled_width;
 	uint32_t                        scaled_height;
 
+	/* receive raw frames on a dedicated video-io input thread */
+	bool                            dedicated_video_thread;
+
 	bool                            video_conversion_set;
 	bool                            audio_conversion_set;
 	struct video_scale_info         video_conversion;
@@ -883,6 +1089,22 @@ struct obs_output {
 	volatile bool                   delay_active;
 	volatile bool                   delay_capturing;
 
+	/* packet data past delay_max_memory is spilled to disk */
+	uint64_t                        delay_max_memory;
+	char                            *delay_spill_dir;
+	uint64_t                        delay_memory;
+	struct delay_segment            *delay_segment;
+	bool                            delay_spill_failed;
+
+	/* the next segment is created ahead of time on its own thread, so the
+	 * encoder thread never waits for the disk */
+	struct delay_segment            *delay_next_segment;
+	pthread_t                       delay_alloc_thread;
+	os_sem_t                        *delay_alloc_sem;
+	bool                            delay_alloc_thread_active;
+	bool                            delay_alloc_pending;
+	volatile bool                   delay_alloc_exit;
+
 	char                            *last_error_message;
 };
 
@@ -897,6 +1119,7 @@ static inline void do_output_signal(struct obs_output *output,
 
 extern void process_delay(void *data, struct encoder_packet *packet);
 extern void obs_output_cleanup_delay(obs_output_t *output);
+extern void obs_output_free_delay_spill(obs_output_t *output);
 extern bool obs_output_delay_start(obs_output_t *output);
 extern void obs_output_delay_stop(obs_output_t *output);
 extern bool obs_output_actual_start(obs_output_t *output);
@@ -910,6 +1133,26 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 
 extern void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 		const struct encoder_packet *src);
+
+/* appends data to the packet, in place if nothing else references the
+ * packet and it has room for the data, otherwise the packet is replaced by
+ * a copy */
+extern void obs_encoder_packet_append(struct encoder_packet *packet,
+		const uint8_t *data, size_t size);
+
+/* frame trace id of a packet allocated by libobs, 0 if unknown */
+extern uint64_t obs_encoder_packet_get_trace_id(
+		const struct encoder_packet *packet);
+extern void obs_encoder_packet_set_trace_id(struct encoder_packet *packet,
+		uint64_t trace_id);
+
+/* makes packet refer to data stored in memory the encoder did not allocate.
+ * obs_encoder_packet_header_size() bytes in front of data are used for the
+ * packet header, and release is called once the last reference to the
+ * packet is released */
+extern size_t obs_encoder_packet_header_size(void);
+extern void obs_encoder_packet_wrap(struct encoder_packet *packet,
+		uint8_t *data, void (*release)(void *param), void *param);
 void obs_output_destroy(obs_output_t *output);
 
 
@@ -927,6 +1170,9 @@ struct encoder_callback {
 	void *param;
 };
 
+/* frames an encoder may delay before it outputs their packets */
+#define ENCODER_TRACE_FRAMES 64
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -946,6 +1192,14 @@ struct obs_encoder {
 	uint32_t                        scaled_height;
 	enum video_format               preferred_format;
 
+	/* GPU rendition the encoder receives frames from instead of media,
+	 * while connected */
+	video_t                         *rendition;
+
+	/* receive raw frames on a dedicated video-io input thread */
+	bool                            dedicated_thread;
+	uint64_t                        last_frame_ts;
+
 	volatile bool                   active;
 	bool                            initialized;
 
@@ -957,6 +1211,11 @@ struct obs_encoder {
 
 	int64_t                         cur_pts;
 
+	/* video timestamps of the frames still in the encoder, by pts, so
+	 * packets can carry them as trace id */
+	int64_t                         trace_pts[ENCODER_TRACE_FRAMES];
+	uint64_t                        trace_ts[ENCODER_TRACE_FRAMES];
+
 	struct circlebuf                audio_input_buffer[MAX_AV_PLANES];
 	uint8_t                         *audio_output_buffer[MAX_AV_PLANES];
 
@@ -983,6 +1242,8 @@ struct obs_encoder {
 	DARRAY(struct encoder_callback) callbacks;
 
 	const char                      *profile_encoder_encode_name;
+
+	struct packet_pool              *packet_pool;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
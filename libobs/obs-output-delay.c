@@ -18,6 +18,257 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 
+/* ------------------------------------------------------------------------- */
+/* Spilling to disk
+ *
+ *   Long delays at high bitrates can hold gigabytes of packets.  Once the
+ * packets held in memory reach the output's memory limit, the data of new
+ * packets is appended to a memory-mapped segment file instead, and only the
+ * packet info stays in the delay buffer.  When a spilled packet comes due it
+ * is sent straight from the mapping, and the segment is deleted once every
+ * packet in it was released. */
+
+#define DELAY_SEGMENT_SIZE (64 * 1024 * 1024)
+
+struct delay_segment {
+	os_mapped_file_t *file;
+	uint8_t          *data;
+	size_t           size;
+	size_t           used;
+
+	/* one for the output while it writes to the segment, and one for every
+	 * packet stored in it */
+	volatile long    refs;
+};
+
+static void delay_segment_release(void *param)
+{
+	struct delay_segment *segment = param;
+
+	if (os_atomic_dec_long(&segment->refs) == 0) {
+		os_mapped_file_destroy(segment->file);
+		bfree(segment);
+	}
+}
+
+static struct delay_segment *delay_segment_create(const char *spill_dir)
+{
+	struct delay_segment *segment;
+	os_mapped_file_t *file;
+	struct dstr path = {0};
+
+	dstr_printf(&path, "%s/obs-delay-%"PRIx64".tmp", spill_dir,
+			os_gettime_ns());
+	file = os_mapped_file_create_temp(path.array, DELAY_SEGMENT_SIZE);
+	dstr_free(&path);
+
+	if (!file)
+		return NULL;
+
+	segment = bzalloc(sizeof(struct delay_segment));
+	segment->file = file;
+	segment->data = os_mapped_file_data(file);
+	segment->size = DELAY_SEGMENT_SIZE;
+	segment->refs = 1;
+	return segment;
+}
+
+/* creating a segment allocates all of its disk space, which can take a
+ * while, so it is done here rather than on the encoder thread.  after a
+ * failure no more segments are created until the memory limit is set again */
+static void *delay_alloc_thread(void *data)
+{
+	struct obs_output *output = data;
+
+	os_set_thread_name("obs-delay-alloc");
+
+	while (os_sem_wait(output->delay_alloc_sem) == 0) {
+		struct delay_segment *segment = NULL;
+		char *spill_dir;
+
+		if (os_atomic_load_bool(&output->delay_alloc_exit))
+			break;
+
+		pthread_mutex_lock(&output->delay_mutex);
+		spill_dir = bstrdup(output->delay_spill_dir);
+		pthread_mutex_unlock(&output->delay_mutex);
+
+		if (spill_dir)
+			segment = delay_segment_create(spill_dir);
+
+		pthread_mutex_lock(&output->delay_mutex);
+
+		/* the directory was changed in the meantime */
+		if (!spill_dir || !output->delay_spill_dir ||
+		    strcmp(spill_dir, output->delay_spill_dir) != 0) {
+			if (segment)
+				delay_segment_release(segment);
+
+		} else if (!segment) {
+			blog(LOG_WARNING, "Output '%s': Failed to create delay "
+			                  "buffer file in '%s', keeping packets "
+			                  "in memory",
+			                  output->context.name, spill_dir);
+			output->delay_spill_failed = true;
+
+		} else {
+			output->delay_next_segment = segment;
+		}
+
+		output->delay_alloc_pending = false;
+		pthread_mutex_unlock(&output->delay_mutex);
+
+		bfree(spill_dir);
+	}
+
+	return NULL;
+}
+
+/* delay_mutex must be locked */
+static void request_delay_segment(struct obs_output *output)
+{
+	if (output->delay_next_segment || output->delay_alloc_pending ||
+	    output->delay_spill_failed)
+		return;
+
+	if (!output->delay_alloc_thread_active) {
+		if (os_sem_init(&output->delay_alloc_sem, 0) != 0)
+			return;
+
+		output->delay_alloc_exit = false;
+		if (pthread_create(&output->delay_alloc_thread, NULL,
+					delay_alloc_thread, output) != 0) {
+			os_sem_destroy(output->delay_alloc_sem);
+			output->delay_alloc_sem = NULL;
+			return;
+		}
+
+		output->delay_alloc_thread_active = true;
+	}
+
+	output->delay_alloc_pending = true;
+	os_sem_post(output->delay_alloc_sem);
+}
+
+void obs_output_free_delay_spill(obs_output_t *output)
+{
+	if (output->delay_alloc_thread_active) {
+		os_atomic_set_bool(&output->delay_alloc_exit, true);
+		os_sem_post(output->delay_alloc_sem);
+		pthread_join(output->delay_alloc_thread, NULL);
+		os_sem_destroy(output->delay_alloc_sem);
+
+		output->delay_alloc_sem = NULL;
+		output->delay_alloc_thread_active = false;
+		output->delay_alloc_pending = false;
+	}
+
+	if (output->delay_next_segment) {
+		delay_segment_release(output->delay_next_segment);
+		output->delay_next_segment = NULL;
+	}
+}
+
+static void close_delay_segment(struct obs_output *output)
+{
+	if (output->delay_segment) {
+		os_mapped_file_flush(output->delay_segment->file);
+		delay_segment_release(output->delay_segment);
+		output->delay_segment = NULL;
+	}
+}
+
+/* delay_mutex must be locked.  packets stay in memory while the next
+ * segment is still being created, and packets larger than a segment always
+ * do */
+static bool spill_packet(struct obs_output *output, struct delay_data *dd,
+		struct encoder_packet *packet)
+{
+	size_t header_size = obs_encoder_packet_header_size();
+	size_t record_size = (header_size + packet->size + 15) & ~(size_t)15;
+	struct delay_segment *segment = output->delay_segment;
+
+	if (!segment || segment->size - segment->used < record_size) {
+		segment = output->delay_next_segment;
+		if (!segment || segment->size < record_size)
+			return false;
+
+		close_delay_segment(output);
+		output->delay_segment = segment;
+		output->delay_next_segment = NULL;
+		request_delay_segment(output);
+	}
+
+	/* the space in front of the data is left for the packet header */
+	memcpy(segment->data + segment->used + header_size, packet->data,
+			packet->size);
+
+	dd->packet      = *packet;
+	dd->packet.data = NULL;
+	dd->segment     = segment;
+	dd->offset      = segment->used;
+	dd->trace_id    = obs_encoder_packet_get_trace_id(packet);
+
+	segment->used += record_size;
+	os_atomic_inc_long(&segment->refs);
+	return true;
+}
+
+static inline bool spill_enabled(const struct obs_output *output)
+{
+	return output->delay_max_memory && output->delay_spill_dir &&
+	       !output->delay_spill_failed;
+}
+
+/* the first segment is prepared once half of the memory limit is used */
+static inline bool should_prepare_spill(const struct obs_output *output,
+		const struct encoder_packet *packet)
+{
+	return spill_enabled(output) && output->delay_memory + packet->size >
+		output->delay_max_memory / 2;
+}
+
+static inline bool should_spill(const struct obs_output *output,
+		const struct encoder_packet *packet)
+{
+	return spill_enabled(output) &&
+	       output->delay_memory + packet->size > output->delay_max_memory;
+}
+
+/* makes the packet of a popped delay_data refer to its data again */
+static void load_packet(struct obs_output *output, struct delay_data *dd)
+{
+	if (dd->segment) {
+		obs_encoder_packet_wrap(&dd->packet,
+				dd->segment->data + dd->offset +
+				obs_encoder_packet_header_size(),
+				delay_segment_release, dd->segment);
+		obs_encoder_packet_set_trace_id(&dd->packet, dd->trace_id);
+		dd->segment = NULL;
+	} else {
+		output->delay_memory -= dd->packet.size;
+	}
+}
+
+void obs_output_set_delay_memory_limit(obs_output_t *output,
+		uint64_t max_memory, const char *spill_dir)
+{
+	if (!obs_output_valid(output, "obs_output_set_delay_memory_limit"))
+		return;
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	output->delay_max_memory = max_memory;
+	bfree(output->delay_spill_dir);
+	output->delay_spill_dir = (spill_dir && *spill_dir) ?
+		bstrdup(spill_dir) : NULL;
+	output->delay_spill_failed = false;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static inline bool delay_active(const struct obs_output *output)
 {
 	return os_atomic_load_bool(&output->delay_active);
@@ -35,9 +286,18 @@ static inline void push_packet(struct obs_output *output,
 
 	dd.msg = DELAY_MSG_PACKET;
 	dd.ts  = t;
-	obs_encoder_packet_create_instance(&dd.packet, packet);
 
 	pthread_mutex_lock(&output->delay_mutex);
+
+	if (should_prepare_spill(output, packet))
+		request_delay_segment(output);
+
+	if (!should_spill(output, packet) ||
+	    !spill_packet(output, &dd, packet)) {
+		obs_encoder_packet_ref(&dd.packet, packet);
+		output->delay_memory += packet->size;
+	}
+
 	circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
 	pthread_mutex_unlock(&output->delay_mutex);
 }
@@ -65,13 +325,24 @@ void obs_output_cleanup_delay(obs_output_t *output)
 {
 	struct delay_data dd;
 
+	pthread_mutex_lock(&output->delay_mutex);
+
 	while (output->delay_data.size) {
 		circlebuf_pop_front(&output->delay_data, &dd, sizeof(dd));
 		if (dd.msg == DELAY_MSG_PACKET) {
+			load_packet(output, &dd);
 			obs_encoder_packet_release(&dd.packet);
 		}
 	}
 
+	close_delay_segment(output);
+	output->delay_memory = 0;
+	output->delay_spill_failed = false;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	obs_output_free_delay_spill(output);
+
 	output->active_delay_ns = 0;
 	os_atomic_set_long(&output->delay_restart_refs, 0);
 }
@@ -99,6 +370,8 @@ static inline bool pop_packet(struct obs_output *output, uint64_t t)
 		} else if (elapsed_time > output->active_delay_ns) {
 			circlebuf_pop_front(&output->delay_data, NULL,
 					sizeof(dd));
+			if (dd.msg == DELAY_MSG_PACKET)
+				load_packet(output, &dd);
 			popped = true;
 		}
 	}
@@ -189,6 +189,7 @@ void obs_output_destroy(obs_output_t *output)
 			output->info.destroy(output->context.data);
 
 		free_packets(output);
+		obs_output_free_delay_spill(output);
 
 		if (output->video_encoder) {
 			obs_encoder_remove_output(output->video_encoder,
@@ -210,6 +211,7 @@ void obs_output_destroy(obs_output_t *output)
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
 		circlebuf_free(&output->delay_data);
+		bfree(output->delay_spill_dir);
 		if (output->owns_info_id)
 			bfree((void*)output->info.id);
 		if (output->last_error_message)
@@ -325,6 +327,14 @@ static void log_frame_info(struct obs_output *output)
 				"%d (%0.1f%%)",
 				output->context.name,
 				dropped, percentage_dropped);
+
+	if (os_atomic_load_long(&output->glass_to_wire.count)) {
+		struct dstr name = {0};
+		dstr_printf(&name, "Output '%s': Glass to wire",
+				output->context.name);
+		frame_trace_histogram_log(&output->glass_to_wire, name.array);
+		dstr_free(&name);
+	}
 }
 
 static inline void signal_stop(struct obs_output *output);
@@ -722,6 +732,46 @@ void obs_output_set_preferred_size(obs_output_t *output, uint32_t width,
 	}
 }
 
+static void default_raw_video_callback(void *param, struct video_data *frame);
+
+void obs_output_set_dedicated_video_thread(obs_output_t *output,
+		bool dedicated)
+{
+	if (!obs_output_valid(output, "obs_output_set_dedicated_video_thread"))
+		return;
+	if ((output->info.flags & OBS_OUTPUT_VIDEO) == 0)
+		return;
+
+	if (active(output)) {
+		blog(LOG_WARNING, "output '%s': Cannot change the video thread "
+		                  "mode while the output is active",
+		                  obs_output_get_name(output));
+		return;
+	}
+
+	output->dedicated_video_thread = dedicated;
+
+	if (output->info.flags & OBS_OUTPUT_ENCODED) {
+		if (output->video_encoder)
+			obs_encoder_set_dedicated_thread(output->video_encoder,
+					dedicated);
+	}
+}
+
+uint32_t obs_output_get_skipped_frames(const obs_output_t *output)
+{
+	if (!obs_output_valid(output, "obs_output_get_skipped_frames"))
+		return 0;
+	if ((output->info.flags & OBS_OUTPUT_VIDEO) == 0)
+		return 0;
+
+	if (output->info.flags & OBS_OUTPUT_ENCODED)
+		return obs_encoder_get_skipped_frames(output->video_encoder);
+	else
+		return video_output_get_input_skipped_frames(output->video,
+				default_raw_video_callback, (void*)output);
+}
+
 uint32_t obs_output_get_width(const obs_output_t *output)
 {
 	if (!obs_output_valid(output, "obs_output_get_width"))
@@ -965,41 +1015,28 @@ static const uint8_t nal_start[4] = {0, 0, 0, 1};
 
 static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 {
-	struct encoder_packet backup = *out;
 	caption_frame_t cf;
 	sei_t sei;
 	uint8_t *data;
 	size_t size;
-	long ref = 1;
-
-	DARRAY(uint8_t) out_data;
 
 	if (out->priority > 1)
 		return false;
 
 	sei_init(&sei);
 
-	da_init(out_data);
-	da_push_back_array(out_data, &ref, sizeof(ref));
-	da_push_back_array(out_data, out->data, out->size);
-
 	caption_frame_init(&cf);
 	caption_frame_from_text(&cf, &output->caption_head->text[0]);
 
 	sei_from_caption_frame(&sei, &cf);
 
-	data = malloc(sei_render_size(&sei));
-	size = sei_render(&sei, data);
 	/* TODO SEI should come after AUD/SPS/PPS, but before any VCL */
-	da_push_back_array(out_data, nal_start, 4);
-	da_push_back_array(out_data, data, size);
-	free(data);
-
-	obs_encoder_packet_release(out);
+	data = malloc(sizeof(nal_start) + sei_render_size(&sei));
+	memcpy(data, nal_start, sizeof(nal_start));
+	size = sei_render(&sei, data + sizeof(nal_start));
 
-	*out = backup;
-	out->data = (uint8_t*)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	obs_encoder_packet_append(out, data, sizeof(nal_start) + size);
+	free(data);
 
 	sei_free(&sei);
 
@@ -1024,6 +1061,8 @@ static inline void send_interleaved(struct obs_output *output)
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
+		frame_trace_record(obs_encoder_packet_get_trace_id(&out),
+				FRAME_TRACE_INTERLEAVE);
 
 #if BUILD_CAPTIONS
 		pthread_mutex_lock(&output->caption_mutex);
@@ -1410,7 +1449,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
@@ -1445,6 +1484,10 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 	if (data_active(output)) {
 		if (packet->type == OBS_ENCODER_AUDIO)
 			packet->track_idx = get_track_index(output, packet);
+		else
+			frame_trace_record(
+					obs_encoder_packet_get_trace_id(packet),
+					FRAME_TRACE_INTERLEAVE);
 
 		output->info.encoded_packet(output->context.data, packet);
 
@@ -1540,7 +1583,11 @@ static void hook_data_capture(struct obs_output *output, bool encoded,
 			obs_encoder_start(output->video_encoder,
 					encoded_callback, output);
 	} else {
-		if (has_video)
+		if (has_video && output->dedicated_video_thread)
+			video_output_connect_threaded(output->video,
+					get_video_conversion(output),
+					default_raw_video_callback, output);
+		else if (has_video)
 			video_output_connect(output->video,
 					get_video_conversion(output),
 					default_raw_video_callback, output);
@@ -1732,6 +1779,7 @@ bool obs_output_begin_data_capture(obs_output_t *output, uint32_t flags)
 	if (active(output)) return false;
 
 	output->total_frames   = 0;
+	frame_trace_histogram_reset(&output->glass_to_wire);
 
 	convert_flags(output, flags, &encoded, &has_video, &has_audio,
 			&has_service);
@@ -1969,6 +2017,37 @@ void obs_output_signal_stop(obs_output_t *output, int code)
 	}
 }
 
+void obs_output_packet_sent(obs_output_t *output,
+		const struct encoder_packet *packet)
+{
+	uint64_t trace_id;
+	uint64_t now;
+
+	if (!obs_output_valid(output, "obs_output_packet_sent"))
+		return;
+	if (!packet || packet->type != OBS_ENCODER_VIDEO)
+		return;
+
+	trace_id = obs_encoder_packet_get_trace_id(packet);
+	if (!trace_id)
+		return;
+
+	frame_trace_record(trace_id, FRAME_TRACE_SEND);
+
+	now = os_gettime_ns();
+	if (now > trace_id)
+		frame_trace_histogram_add(&output->glass_to_wire,
+				now - trace_id);
+}
+
+uint64_t obs_output_get_frame_latency(const obs_output_t *output,
+		double percentile)
+{
+	return obs_output_valid(output, "obs_output_get_frame_latency") ?
+		frame_trace_histogram_percentile(&output->glass_to_wire,
+				percentile) : 0;
+}
+
 void obs_output_addref(obs_output_t *output)
 {
 	if (!output)
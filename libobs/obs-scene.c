@@ -17,7 +17,9 @@
 ******************************************************************************/
 
 #include "util/threading.h"
+#include "util/profiler.h"
 #include "graphics/math-defs.h"
+#include "media-io/audio-kernels.h"
 #include "obs-scene.h"
 
 /* NOTE: For proper mutex lock order (preventing mutual cross-locks), never
@@ -67,6 +69,8 @@ static void *scene_create(obs_data_t *settings, struct obs_source *source)
 	struct obs_scene *scene = bmalloc(sizeof(struct obs_scene));
 	scene->source     = source;
 	scene->first_item = NULL;
+	scene->changes    = 0;
+	da_init(scene->item_caches);
 
 	signal_handler_add_array(obs_source_get_signal_handler(source),
 			obs_scene_signals);
@@ -157,6 +161,12 @@ static void scene_destroy(void *data)
 
 	remove_all_items(scene);
 
+	obs_enter_graphics();
+	for (size_t i = 0; i < scene->item_caches.num; i++)
+		gs_texrender_destroy(scene->item_caches.array[i].texrender);
+	obs_leave_graphics();
+	da_free(scene->item_caches);
+
 	pthread_mutex_destroy(&scene->video_mutex);
 	pthread_mutex_destroy(&scene->audio_mutex);
 	bfree(scene);
@@ -203,6 +213,8 @@ static void scene_enum_all_sources(void *data,
 
 static inline void detach_sceneitem(struct obs_scene_item *item)
 {
+	os_atomic_inc_long(&item->parent->changes);
+
 	if (item->prev)
 		item->prev->next = item->next;
 	else
@@ -220,6 +232,8 @@ static inline void attach_sceneitem(struct obs_scene *parent,
 	item->prev   = prev;
 	item->parent = parent;
 
+	os_atomic_inc_long(&parent->changes);
+
 	if (prev) {
 		item->next = prev->next;
 		if (prev->next)
@@ -320,12 +334,17 @@ static void update_item_transform(struct obs_scene_item *item)
 	struct vec2     base_origin;
 	struct vec2     origin;
 	struct vec2     scale         = item->scale;
+	struct matrix4  old_draw_transform;
+	struct matrix4  old_box_transform;
 	struct calldata params;
 	uint8_t         stack[128];
 
 	if (os_atomic_load_long(&item->defer_update) > 0)
 		return;
 
+	old_draw_transform = item->draw_transform;
+	old_box_transform  = item->box_transform;
+
 	width = cx;
 	height = cy;
 
@@ -381,6 +400,14 @@ static void update_item_transform(struct obs_scene_item *item)
 	item->last_width  = width;
 	item->last_height = height;
 
+	/* this runs every frame for cropped items, which would otherwise
+	 * never be cached */
+	if (memcmp(&old_draw_transform, &item->draw_transform,
+				sizeof(struct matrix4)) != 0 ||
+	    memcmp(&old_box_transform, &item->box_transform,
+				sizeof(struct matrix4)) != 0)
+		os_atomic_inc_long(&item->changes);
+
 	calldata_init_fixed(&params, stack, sizeof(stack));
 	calldata_set_ptr(&params, "scene", item->parent);
 	calldata_set_ptr(&params, "item", item);
@@ -521,20 +548,405 @@ static void scene_video_tick(void *data, float seconds)
 	UNUSED_PARAMETER(seconds);
 }
 
+/* ------------------------------------------------------------------------- */
+/* static item caching */
+
+static bool scene_cacheable(struct obs_scene *scene, uint64_t *changes);
+static uint32_t scene_getwidth(void *data);
+static uint32_t scene_getheight(void *data);
+
+/* returns whether the source only changes when told to, and if so adds up
+ * the change counters of everything it renders */
+static bool source_cacheable(obs_source_t *source, uint64_t *changes)
+{
+	bool is_scene = source->info.type == OBS_SOURCE_TYPE_SCENE;
+	bool cacheable = true;
+
+	if (obs_source_removed(source))
+		return false;
+	if (!is_scene && (source->info.output_flags &
+				OBS_SOURCE_STATIC_VIDEO) == 0)
+		return false;
+
+	pthread_mutex_lock(&source->filter_mutex);
+	for (size_t i = 0; i < source->filters.num; i++) {
+		obs_source_t *filter = source->filters.array[i];
+
+		if (filter->enabled && (filter->info.output_flags &
+					OBS_SOURCE_STATIC_VIDEO) == 0) {
+			cacheable = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	if (!cacheable)
+		return false;
+
+	*changes += (uint64_t)os_atomic_load_long(&source->video_changes);
+
+	return is_scene ?
+		scene_cacheable(source->context.data, changes) : true;
+}
+
+static bool scene_cacheable(struct obs_scene *scene, uint64_t *changes)
+{
+	struct obs_scene_item *item;
+	bool cacheable = true;
+
+	if (!scene)
+		return false;
+
+	video_lock(scene);
+
+	*changes += (uint64_t)os_atomic_load_long(&scene->changes);
+
+	for (item = scene->first_item; item; item = item->next) {
+		if (!item->user_visible)
+			continue;
+
+		if (!source_cacheable(item->source, changes)) {
+			cacheable = false;
+			break;
+		}
+
+		*changes += (uint64_t)os_atomic_load_long(&item->changes);
+	}
+
+	video_unlock(scene);
+	return cacheable;
+}
+
+static void render_items(struct obs_scene_item *first,
+		struct obs_scene_item *last)
+{
+	struct obs_scene_item *item = first;
+
+	for (;;) {
+		if (item->user_visible)
+			render_item(item);
+		if (item == last)
+			break;
+		item = item->next;
+	}
+}
+
+static bool render_item_cache(struct scene_item_cache *cache)
+{
+	struct vec4 clear_color;
+
+	gs_texrender_reset(cache->texrender);
+	if (!gs_texrender_begin(cache->texrender, cache->cx, cache->cy))
+		return false;
+
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, (float)cache->cx, 0.0f, (float)cache->cy,
+			-100.0f, 100.0f);
+
+	/* blending onto a transparent target leaves the texture with
+	 * premultiplied alpha */
+	gs_blend_state_push();
+	gs_enable_blending(true);
+	obs_set_render_cache_blend();
+	render_items(cache->first, cache->last);
+	gs_blend_state_pop();
+
+	gs_texrender_end(cache->texrender);
+	return true;
+}
+
+static void draw_item_cache(struct scene_item_cache *cache)
+{
+	gs_texture_t *tex = gs_texrender_get_texture(cache->texrender);
+	gs_effect_t *effect = obs->video.default_effect;
+
+	/* premultiplied "over", the same result as drawing the items one by
+	 * one since the cache was filled with "over" for alpha too */
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	while (gs_effect_loop(effect, "Draw"))
+		obs_source_draw(tex, 0, 0, 0, 0, false);
+
+	gs_blend_state_pop();
+}
+
+/* textures can't get much larger than this on most hardware */
+#define ITEM_CACHE_MAX_SIZE 8192
+
+struct item_rect {
+	float left, top, right, bottom;
+};
+
+/* gets the part of the scene that ends up in the current render target.
+ * views can have a base size other than the main one (canvases), so this
+ * can reach past the scene size */
+static void get_render_area(struct obs_scene *scene, struct item_rect *area)
+{
+	struct matrix4 world, proj, transform, inv;
+	struct vec4 corner;
+
+	area->left   = 0.0f;
+	area->top    = 0.0f;
+	area->right  = (float)scene_getwidth(scene);
+	area->bottom = (float)scene_getheight(scene);
+
+	gs_matrix_get(&world);
+	gs_get_projection(&proj);
+
+	/* no single area for perspective projections */
+	if (proj.x.w != 0.0f || proj.y.w != 0.0f || proj.z.w != 0.0f)
+		return;
+
+	matrix4_mul(&transform, &world, &proj);
+	if (!matrix4_inv(&inv, &transform))
+		return;
+
+	for (int i = 0; i < 4; i++) {
+		vec4_set(&corner, (i & 1) ? 1.0f : -1.0f,
+				(i & 2) ? 1.0f : -1.0f, 0.0f, 1.0f);
+		vec4_transform(&corner, &corner, &inv);
+
+		if (i == 0) {
+			area->left  = area->right  = corner.x;
+			area->top   = area->bottom = corner.y;
+			continue;
+		}
+
+		area->left   = fminf(area->left, corner.x);
+		area->right  = fmaxf(area->right, corner.x);
+		area->top    = fminf(area->top, corner.y);
+		area->bottom = fmaxf(area->bottom, corner.y);
+	}
+}
+
+struct static_run {
+	struct obs_scene_item *first;
+	struct obs_scene_item *last;
+	uint64_t              changes;
+	size_t                visible_items;
+	bool                  textured;
+};
+
+/* a run is cached once it has looked the same for two renders in a row, so
+ * items that are being changed continuously (e.g. dragged around) are not
+ * rendered twice every frame */
+static void render_static_run(struct obs_scene *scene, size_t idx,
+		struct static_run *run, const struct item_rect *area)
+{
+	struct scene_item_cache *cache;
+	float right = ceilf(area->right);
+	float bottom = ceilf(area->bottom);
+	uint32_t cx, cy;
+
+	if (!run->first)
+		return;
+
+	/* a single plain sprite is cheaper to draw than a whole canvas, and
+	 * the cache starts at the scene origin so it can only hold what is
+	 * shown right and below of it */
+	if ((run->visible_items < 2 && !run->textured) ||
+	    right < 1.0f || bottom < 1.0f ||
+	    right > (float)ITEM_CACHE_MAX_SIZE ||
+	    bottom > (float)ITEM_CACHE_MAX_SIZE) {
+		render_items(run->first, run->last);
+		return;
+	}
+
+	cx = (uint32_t)right;
+	cy = (uint32_t)bottom;
+
+	if (idx >= scene->item_caches.num) {
+		cache = da_push_back_new(scene->item_caches);
+		cache->texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+	} else {
+		cache = scene->item_caches.array + idx;
+	}
+
+	if (cache->first != run->first || cache->last != run->last ||
+	    cache->changes != run->changes ||
+	    cache->cx != cx || cache->cy != cy) {
+		cache->first    = run->first;
+		cache->last     = run->last;
+		cache->changes  = run->changes;
+		cache->cx       = cx;
+		cache->cy       = cy;
+		cache->rendered = false;
+
+		render_items(run->first, run->last);
+		return;
+	}
+
+	if (!cache->rendered)
+		cache->rendered = render_item_cache(cache);
+
+	if (cache->rendered)
+		draw_item_cache(cache);
+	else
+		render_items(run->first, run->last);
+}
+
+static void free_unused_item_caches(struct obs_scene *scene, size_t used)
+{
+	for (size_t i = used; i < scene->item_caches.num; i++)
+		gs_texrender_destroy(scene->item_caches.array[i].texrender);
+
+	if (used < scene->item_caches.num)
+		da_resize(scene->item_caches, used);
+}
+
+/* ------------------------------------------------------------------------- */
+/* occlusion culling */
+
+/* only the topmost few opaque items are checked against, that covers the
+ * usual full screen camera or capture */
+#define MAX_OCCLUDERS 4
+
+static const char *scene_item_culled_name = "scene_item_culled";
+
+static bool source_opaque(obs_source_t *source)
+{
+	bool opaque = true;
+
+	/* a disabled source draws nothing */
+	if (!source->enabled)
+		return false;
+	if ((source->info.output_flags & OBS_SOURCE_OPAQUE_VIDEO) == 0)
+		return false;
+
+	pthread_mutex_lock(&source->filter_mutex);
+	for (size_t i = 0; i < source->filters.num; i++) {
+		obs_source_t *filter = source->filters.array[i];
+
+		if (filter->enabled && (filter->info.output_flags &
+					OBS_SOURCE_OPAQUE_VIDEO) == 0) {
+			opaque = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	return opaque;
+}
+
+/* gets the area of the scene the item draws to, fails if the item is
+ * rotated to anything other than a multiple of 90 degrees */
+static bool item_screen_rect(const struct obs_scene_item *item,
+		struct item_rect *rect)
+{
+	const struct matrix4 *m = &item->draw_transform;
+	float cx = (float)item->last_width;
+	float cy = (float)item->last_height;
+	float x0, y0, x1, y1;
+
+	if (!item->last_width || !item->last_height)
+		return false;
+
+	if (!(close_float(m->x.y, 0.0f, EPSILON) &&
+	      close_float(m->y.x, 0.0f, EPSILON)) &&
+	    !(close_float(m->x.x, 0.0f, EPSILON) &&
+	      close_float(m->y.y, 0.0f, EPSILON)))
+		return false;
+
+	x0 = m->t.x;
+	y0 = m->t.y;
+	x1 = cx * m->x.x + cy * m->y.x + m->t.x;
+	y1 = cx * m->x.y + cy * m->y.y + m->t.y;
+
+	rect->left   = fminf(x0, x1);
+	rect->right  = fmaxf(x0, x1);
+	rect->top    = fminf(y0, y1);
+	rect->bottom = fmaxf(y0, y1);
+	return true;
+}
+
+static inline bool rect_covers(const struct item_rect *outer,
+		const struct item_rect *inner)
+{
+	return outer->left <= inner->left && outer->right  >= inner->right &&
+	       outer->top  <= inner->top  && outer->bottom >= inner->bottom;
+}
+
+/* marks items that are hidden behind opaque items above them.  occluders are
+ * shrunk to whole pixels and occluded items grown to whole pixels, so partly
+ * covered edge pixels still get drawn */
+static void cull_items(struct obs_scene *scene, const struct item_rect *area)
+{
+	struct item_rect occluders[MAX_OCCLUDERS];
+	size_t num_occluders = 0;
+	struct obs_scene_item *item = scene->first_item;
+
+	if (!item)
+		return;
+	while (item->next)
+		item = item->next;
+
+	for (; item; item = item->prev) {
+		struct item_rect rect;
+
+		item->culled = false;
+
+		if (!item->user_visible || !item_screen_rect(item, &rect))
+			continue;
+
+		if (num_occluders) {
+			struct item_rect outer = {
+				.left   = fmaxf(floorf(rect.left),
+						floorf(area->left)),
+				.top    = fmaxf(floorf(rect.top),
+						floorf(area->top)),
+				.right  = fminf(ceilf(rect.right),
+						ceilf(area->right)),
+				.bottom = fminf(ceilf(rect.bottom),
+						ceilf(area->bottom))
+			};
+
+			/* nothing of the item is shown, leave it alone rather
+			 * than compare against an inverted rect */
+			bool empty = outer.left >= outer.right ||
+			             outer.top  >= outer.bottom;
+
+			for (size_t i = 0; i < num_occluders && !empty; i++) {
+				if (rect_covers(&occluders[i], &outer)) {
+					item->culled = true;
+					break;
+				}
+			}
+
+			if (item->culled) {
+				profile_start(scene_item_culled_name);
+				profile_end(scene_item_culled_name);
+				continue;
+			}
+		}
+
+		if (num_occluders < MAX_OCCLUDERS && source_opaque(item->source)) {
+			struct item_rect *inner = &occluders[num_occluders++];
+			inner->left   = ceilf(rect.left);
+			inner->top    = ceilf(rect.top);
+			inner->right  = floorf(rect.right);
+			inner->bottom = floorf(rect.bottom);
+		}
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
 static void scene_video_render(void *data, gs_effect_t *effect)
 {
 	DARRAY(struct obs_scene_item*) remove_items;
 	struct obs_scene *scene = data;
 	struct obs_scene_item *item;
+	struct static_run run = {0};
+	struct item_rect area;
+	size_t run_idx = 0;
 
 	da_init(remove_items);
 
 	video_lock(scene);
 	item = scene->first_item;
 
-	gs_blend_state_push();
-	gs_reset_blend_state();
-
 	while (item) {
 		if (obs_source_removed(item->source)) {
 			struct obs_scene_item *del_item = item;
@@ -548,12 +960,69 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 		if (source_size_changed(item))
 			update_item_transform(item);
 
-		if (item->user_visible)
+		item = item->next;
+	}
+
+	get_render_area(scene, &area);
+	cull_items(scene, &area);
+
+	/* a scene rendered into a render cache keeps the cache's alpha
+	 * blending */
+	gs_blend_state_push();
+	if (obs_render_cache_blend_set())
+		gs_enable_blending(true);
+	else
+		gs_reset_blend_state();
+
+	item = scene->first_item;
+	while (item) {
+		uint64_t changes = 0;
+
+		if (item->culled) {
+			/* what is drawn changes with the culling, so a culled
+			 * item ends a run */
+			if (run.first) {
+				render_static_run(scene, run_idx++, &run,
+						&area);
+				memset(&run, 0, sizeof(run));
+			}
+
+		} else if (!item->user_visible) {
+			/* hidden items don't break up a run */
+			if (run.first)
+				run.last = item;
+
+		} else if (source_cacheable(item->source, &changes)) {
+			if (!run.first) {
+				run.first = item;
+				run.changes = (uint64_t)os_atomic_load_long(
+						&scene->changes);
+			}
+
+			run.last = item;
+			run.changes += changes +
+				(uint64_t)os_atomic_load_long(&item->changes);
+			run.visible_items++;
+			if (item->item_render)
+				run.textured = true;
+
+		} else {
+			if (run.first) {
+				render_static_run(scene, run_idx++, &run,
+						&area);
+				memset(&run, 0, sizeof(run));
+			}
+
 			render_item(item);
+		}
 
 		item = item->next;
 	}
 
+	if (run.first)
+		render_static_run(scene, run_idx++, &run, &area);
+	free_unused_item_caches(scene, run_idx);
+
 	gs_blend_state_pop();
 
 	video_unlock(scene);
@@ -582,6 +1051,7 @@ static void set_visibility(struct obs_scene_item *item, bool vis)
 	os_atomic_set_long(&item->active_refs, vis ? 1 : 0);
 	item->visible = vis;
 	item->user_visible = vis;
+	os_atomic_inc_long(&item->changes);
 
 	pthread_mutex_unlock(&item->actions_mutex);
 }
@@ -870,27 +1340,16 @@ static void process_all_audio_actions(struct obs_scene_item *item,
 	while (apply_scene_item_volume(item, NULL, 0, sample_rate));
 }
 
-static void mix_audio_with_buf(float *p_out, float *p_in, float *buf_in,
-		size_t pos, size_t count)
+static inline void mix_audio_with_buf(float *p_out, float *p_in,
+		float *buf_in, size_t pos, size_t count)
 {
-	register float *out = p_out;
-	register float *buf = buf_in + pos;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++) * *(buf++);
+	audio_mix_mul(p_out, p_in + pos, buf_in + pos, count);
 }
 
 static inline void mix_audio(float *p_out, float *p_in,
 		size_t pos, size_t count)
 {
-	register float *out = p_out;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++);
+	audio_mix(p_out, p_in + pos, count);
 }
 
 static bool scene_audio_render(void *data, uint64_t *ts_out,
@@ -1789,6 +2248,7 @@ bool obs_sceneitem_set_visible(obs_sceneitem_t *item, bool visible)
 	}
 
 	item->user_visible = visible;
+	os_atomic_inc_long(&item->changes);
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "scene", item->parent);
@@ -1876,6 +2336,7 @@ bool obs_scene_reorder_items(obs_scene_t *scene,
 	}
 
 	scene->first_item = item_order[0];
+	os_atomic_inc_long(&scene->changes);
 
 	obs_sceneitem_t *prev = NULL;
 	for (size_t i = 0; i < item_order_size; i++) {
@@ -1950,6 +2411,8 @@ void obs_sceneitem_set_crop(obs_sceneitem_t *item,
 	if (item->crop.bottom < 0) item->crop.bottom = 0;
 	obs_leave_graphics();
 
+	os_atomic_inc_long(&item->changes);
+
 	update_item_transform(item);
 }
 
@@ -1984,6 +2447,7 @@ void obs_sceneitem_set_scale_filter(obs_sceneitem_t *item,
 
 	obs_leave_graphics();
 
+	os_atomic_inc_long(&item->changes);
 	update_item_transform(item);
 }
 
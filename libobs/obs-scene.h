@@ -43,6 +43,12 @@ struct obs_scene_item {
 	bool                  selected;
 	bool                  locked;
 
+	/* incremented whenever the way the item is drawn changes */
+	volatile long         changes;
+
+	/* fully covered by opaque items above it, only used while rendering */
+	bool                  culled;
+
 	gs_texrender_t        *item_render;
 	struct obs_sceneitem_crop crop;
 
@@ -78,6 +84,21 @@ struct obs_scene_item {
 	struct obs_scene_item *next;
 };
 
+/* a run of consecutive items that only change when told to, composited into
+ * a texture once and drawn from there until something in it changes */
+struct scene_item_cache {
+	gs_texrender_t        *texrender;
+
+	/* what the texture was (or is about to be) rendered from */
+	struct obs_scene_item *first;
+	struct obs_scene_item *last;
+	uint64_t              changes;
+	uint32_t              cx;
+	uint32_t              cy;
+
+	bool                  rendered;
+};
+
 struct obs_scene {
 	struct obs_source     *source;
 
@@ -86,4 +107,9 @@ struct obs_scene {
 	pthread_mutex_t       video_mutex;
 	pthread_mutex_t       audio_mutex;
 	struct obs_scene_item *first_item;
+
+	/* incremented when items are added, removed or reordered */
+	volatile long         changes;
+
+	DARRAY(struct scene_item_cache) item_caches;
 };
@@ -20,11 +20,14 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-kernels.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "callback/calldata.h"
 #include "graphics/matrix3.h"
+#include "graphics/matrix4.h"
 #include "graphics/vec3.h"
+#include "graphics/vec4.h"
 
 #include "obs.h"
 #include "obs-internal.h"
@@ -786,6 +789,7 @@ static void obs_source_deferred_update(obs_source_t *source)
 				source->context.settings);
 
 	source->defer_update = false;
+	obs_source_video_changed(source);
 }
 
 void obs_source_update(obs_source_t *source, obs_data_t *settings)
@@ -801,9 +805,25 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				source->context.settings);
+		obs_source_video_changed(source);
 	}
 }
 
+void obs_source_video_changed(obs_source_t *source)
+{
+	obs_source_t *parent;
+
+	if (!obs_source_valid(source, "obs_source_video_changed"))
+		return;
+
+	os_atomic_inc_long(&source->video_changes);
+
+	/* the output of a filter is the video of the source it's on */
+	parent = source->filter_parent;
+	if (parent)
+		os_atomic_inc_long(&parent->video_changes);
+}
+
 void obs_source_update_properties(obs_source_t *source)
 {
 	if (!obs_source_valid(source, "obs_source_update_properties"))
@@ -1797,13 +1817,281 @@ static inline void render_video(obs_source_t *source)
 		obs_source_render_async_video(source);
 }
 
+/* ------------------------------------------------------------------------- */
+/* per-frame render cache
+ *
+ *   A source shown in several places at once (program, preview, multiview,
+ * projectors) would otherwise be rendered again for each of them.  Sources
+ * that were rendered more than once in the previous frame are rendered into a
+ * pooled texture the first time they're rendered in a frame, and every later
+ * render of that frame just draws the texture.  The cache is invalidated at
+ * the start of every frame by tick_sources. */
+
+/* pooled textures that weren't used for this many frames are freed */
+#define RENDER_CACHE_MAX_IDLE_FRAMES 60
+
+/* only the graphics thread starts frames, sources rendered from any other
+ * thread (screenshots and such) are never cached */
+static THREAD_LOCAL bool render_cache_thread = false;
+
+void obs_source_render_cache_begin_frame(void)
+{
+	struct obs_core_video *video = &obs->video;
+	bool expired = false;
+
+	render_cache_thread = true;
+	video->render_cache_frame++;
+
+	for (size_t i = 0; i < video->render_cache.num; i++) {
+		struct source_render_cache *cache = video->render_cache.array + i;
+
+		cache->in_use = false;
+		if (video->render_cache_frame - cache->last_used_frame >
+				RENDER_CACHE_MAX_IDLE_FRAMES)
+			expired = true;
+	}
+
+	if (!expired)
+		return;
+
+	obs_enter_graphics();
+
+	for (size_t i = video->render_cache.num; i > 0; i--) {
+		struct source_render_cache *cache =
+			video->render_cache.array + (i - 1);
+
+		if (video->render_cache_frame - cache->last_used_frame >
+				RENDER_CACHE_MAX_IDLE_FRAMES) {
+			gs_texrender_destroy(cache->texrender);
+			da_erase(video->render_cache, i - 1);
+		}
+	}
+
+	obs_leave_graphics();
+}
+
+/* must be called within the graphics context */
+void obs_free_render_cache(void)
+{
+	struct obs_core_video *video = &obs->video;
+
+	if (video->render_cache_hits || video->render_cache_misses)
+		blog(LOG_INFO, "Source render cache: %"PRIu32" hits, "
+		               "%"PRIu32" misses",
+		               video->render_cache_hits,
+		               video->render_cache_misses);
+
+	for (size_t i = 0; i < video->render_cache.num; i++)
+		gs_texrender_destroy(video->render_cache.array[i].texrender);
+	da_free(video->render_cache);
+
+	/* the frame counter is left as is, so no source can mistake an index
+	 * from before for one into the new pool */
+	video->render_cache_hits = 0;
+	video->render_cache_misses = 0;
+}
+
+static inline bool render_cache_usable(const obs_source_t *source)
+{
+	/* filters (and sources rendered by their own filter chain) are part of
+	 * another source's render, and anything not drawn with the default
+	 * blending wouldn't come out the same when drawn from the texture */
+	return render_cache_thread &&
+	       source->info.type != OBS_SOURCE_TYPE_FILTER &&
+	       !source->filter_parent &&
+	       !source->rendering_filter &&
+	       (source->info.output_flags & OBS_SOURCE_VIDEO) != 0 &&
+	       gs_blend_state_is_default();
+}
+
+#define RENDER_CACHE_MAX_SIZE 8192
+
+static inline uint32_t axis_pixel_size(const struct vec4 *axis,
+		const struct gs_rect *viewport)
+{
+	float size = hypotf(axis->x * (float)viewport->cx,
+			axis->y * (float)viewport->cy) * 0.5f;
+	return (uint32_t)ceilf(size);
+}
+
+/* gets the size in pixels that a cx x cy rect covers in the current render
+ * target, so the cache can be rasterized at the resolution it's shown at
+ * (projectors for example draw the base canvas into a larger viewport) */
+static void get_output_size(uint32_t cx, uint32_t cy,
+		uint32_t *out_cx, uint32_t *out_cy)
+{
+	struct matrix4 world, proj, transform;
+	struct gs_rect viewport;
+	struct vec4 axis;
+
+	gs_matrix_get(&world);
+	gs_get_projection(&proj);
+	gs_get_viewport(&viewport);
+
+	*out_cx = cx;
+	*out_cy = cy;
+
+	/* no single size for perspective projections */
+	if (proj.x.w != 0.0f || proj.y.w != 0.0f || proj.z.w != 0.0f)
+		return;
+
+	matrix4_mul(&transform, &world, &proj);
+
+	vec4_set(&axis, (float)cx, 0.0f, 0.0f, 0.0f);
+	vec4_transform(&axis, &axis, &transform);
+	*out_cx = axis_pixel_size(&axis, &viewport);
+
+	vec4_set(&axis, 0.0f, (float)cy, 0.0f, 0.0f);
+	vec4_transform(&axis, &axis, &transform);
+	*out_cy = axis_pixel_size(&axis, &viewport);
+}
+
+/* the texture is never rasterized below the base size, so sources shown
+ * scaled down are drawn from a downsampled texture */
+static inline uint32_t render_cache_size(uint32_t base, uint32_t output)
+{
+	uint32_t size = base > output ? base : output;
+	return size > RENDER_CACHE_MAX_SIZE ? RENDER_CACHE_MAX_SIZE : size;
+}
+
+/* returns the index of an unused pooled texture of the given size, marked as
+ * used for this frame */
+static size_t get_render_cache(uint32_t cx, uint32_t cy)
+{
+	struct obs_core_video *video = &obs->video;
+	struct source_render_cache *cache = NULL;
+	size_t idx;
+
+	for (idx = 0; idx < video->render_cache.num; idx++) {
+		struct source_render_cache *c = video->render_cache.array + idx;
+		if (!c->in_use && c->cx == cx && c->cy == cy) {
+			cache = c;
+			break;
+		}
+	}
+
+	if (!cache) {
+		cache = da_push_back_new(video->render_cache);
+		cache->texrender = gs_texrender_create(GS_RGBA, GS_ZS_NONE);
+		cache->cx = cx;
+		cache->cy = cy;
+	}
+
+	cache->in_use = true;
+	cache->last_used_frame = video->render_cache_frame;
+	return idx;
+}
+
+/* the texrender is passed on its own because sources rendered by this source
+ * may grow the pool, which moves its entries */
+static bool render_into_cache(obs_source_t *source, gs_texrender_t *texrender,
+		uint32_t tex_cx, uint32_t tex_cy, uint32_t cx, uint32_t cy)
+{
+	struct vec4 clear_color;
+
+	gs_texrender_reset(texrender);
+	if (!gs_texrender_begin(texrender, tex_cx, tex_cy))
+		return false;
+
+	vec4_zero(&clear_color);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+	gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+	/* blending onto a transparent target leaves the texture with
+	 * premultiplied alpha */
+	gs_blend_state_push();
+	gs_enable_blending(true);
+	obs_set_render_cache_blend();
+	render_video(source);
+	gs_blend_state_pop();
+
+	gs_texrender_end(texrender);
+	return true;
+}
+
+static void draw_render_cache(struct source_render_cache *cache,
+		uint32_t cx, uint32_t cy)
+{
+	gs_texture_t *tex = gs_texrender_get_texture(cache->texrender);
+	gs_effect_t *effect = obs->video.default_effect;
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	while (gs_effect_loop(effect, "Draw"))
+		obs_source_draw(tex, 0, 0, cx, cy, false);
+
+	gs_blend_state_pop();
+}
+
+/* returns false if the source has to be rendered directly */
+static bool render_cached(obs_source_t *source)
+{
+	struct obs_core_video *video = &obs->video;
+	struct source_render_cache *cache;
+	gs_texrender_t *texrender;
+	uint32_t cx, cy, out_cx, out_cy, tex_cx, tex_cy;
+	size_t idx;
+
+	if (source->render_cache_frame != video->render_cache_frame) {
+		source->prev_render_count =
+			source->render_cache_frame + 1 ==
+				video->render_cache_frame ?
+			source->render_count : 0;
+		source->render_count = 0;
+		source->render_cache_frame = video->render_cache_frame;
+		source->render_cache_idx = DARRAY_INVALID;
+	}
+
+	source->render_count++;
+
+	cx = obs_source_get_width(source);
+	cy = obs_source_get_height(source);
+	if (!cx || !cy)
+		return false;
+
+	get_output_size(cx, cy, &out_cx, &out_cy);
+	tex_cx = render_cache_size(cx, out_cx);
+	tex_cy = render_cache_size(cy, out_cy);
+
+	if (source->render_cache_idx != DARRAY_INVALID) {
+		cache = video->render_cache.array + source->render_cache_idx;
+
+		/* the first render of the frame picks the resolution, anything
+		 * shown larger than that is rendered directly rather than
+		 * upscaled */
+		if (cache->cx < tex_cx || cache->cy < tex_cy)
+			return false;
+
+		draw_render_cache(cache, cx, cy);
+		video->render_cache_hits++;
+		return true;
+	}
+
+	/* a source only shown once per frame gains nothing from it */
+	if (source->prev_render_count < 2)
+		return false;
+
+	idx = get_render_cache(tex_cx, tex_cy);
+	texrender = video->render_cache.array[idx].texrender;
+	if (!render_into_cache(source, texrender, tex_cx, tex_cy, cx, cy))
+		return false;
+
+	source->render_cache_idx = idx;
+
+	draw_render_cache(video->render_cache.array + idx, cx, cy);
+	video->render_cache_misses++;
+	return true;
+}
+
 void obs_source_video_render(obs_source_t *source)
 {
 	if (!obs_source_valid(source, "obs_source_video_render"))
 		return;
 
 	obs_source_addref(source);
-	render_video(source);
+	if (!render_cache_usable(source) || !render_cached(source))
+		render_video(source);
 	obs_source_release(source);
 }
 
@@ -1965,6 +2253,8 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_source_video_changed(source);
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -2000,6 +2290,8 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	obs_source_video_changed(source);
+
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
 	calldata_set_ptr(&cd, "filter", filter);
@@ -2126,8 +2418,10 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 	success = move_filter_dir(source, filter, movement);
 	pthread_mutex_unlock(&source->filter_mutex);
 
-	if (success)
+	if (success) {
+		obs_source_video_changed(source);
 		obs_source_dosignal(source, NULL, "reorder_filters");
+	}
 }
 
 obs_data_t *obs_source_get_settings(const obs_source_t *source)
@@ -2397,6 +2691,7 @@ void obs_source_output_video(obs_source_t *source,
 		da_push_back(source->async_frames, &output);
 		pthread_mutex_unlock(&source->async_mutex);
 		source->async_active = true;
+		os_atomic_inc_long(&source->video_changes);
 	}
 }
 
@@ -2436,6 +2731,7 @@ void obs_source_preload_video(obs_source_t *source,
 			source->async_texrender);
 
 	source->last_frame_ts = frame->timestamp;
+	os_atomic_inc_long(&source->video_changes);
 
 	obs_leave_graphics();
 }
@@ -2448,6 +2744,7 @@ void obs_source_show_preloaded_video(obs_source_t *source)
 		return;
 
 	source->async_active = true;
+	os_atomic_inc_long(&source->video_changes);
 
 	pthread_mutex_lock(&source->audio_buf_mutex);
 	sys_ts = os_gettime_ns();
@@ -3537,6 +3834,7 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	obs_source_video_changed(source);
 
 	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_set_ptr(&data, "source", source);
@@ -3755,24 +4053,16 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
 		size_t channels, float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
-
-	while (out < end)
-		*(out++) *= vol;
+	audio_scale(source->audio_output_buf[mix][0], vol,
+			AUDIO_OUTPUT_FRAMES * channels);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
 		size_t channels, float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_mul(source->audio_output_buf[mix][ch], vol_data,
+				AUDIO_OUTPUT_FRAMES);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
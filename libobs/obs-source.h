@@ -135,6 +135,30 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_CAP_DISABLED (1<<10)
 
+/**
+ * Source video only changes when told to
+ *
+ * The video of the source only changes when its settings are updated or its
+ * filters change, or when the source calls obs_source_video_changed.  Scenes
+ * may render the source once and reuse the result for as long as none of
+ * these happen.
+ *
+ * For filters, this means the output only depends on the input and the
+ * settings of the filter.
+ */
+#define OBS_SOURCE_STATIC_VIDEO (1<<11)
+
+/**
+ * Source video is fully opaque
+ *
+ * Every pixel within the width and height of the source is drawn fully
+ * opaque once the source has a size.  Scenes skip rendering items that are
+ * completely covered by such a source.
+ *
+ * For filters, this means opaque input stays opaque.
+ */
+#define OBS_SOURCE_OPAQUE_VIDEO (1<<12)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
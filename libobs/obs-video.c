@@ -38,6 +38,9 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
 
+	/* whatever was rendered last frame is out of date once sources tick */
+	obs_source_render_cache_begin_frame();
+
 	/* ------------------------------------- */
 	/* call tick callbacks                   */
 
@@ -102,14 +105,6 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 	gs_set_viewport(0, 0, width, height);
 }
 
-static inline void unmap_last_surface(struct obs_core_video *video)
-{
-	if (video->mapped_surface) {
-		gs_stagesurface_unmap(video->mapped_surface);
-		video->mapped_surface = NULL;
-	}
-}
-
 static const char *render_main_texture_name = "render_main_texture";
 static inline void render_main_texture(struct obs_core_video *video,
 		int cur_texture)
@@ -144,13 +139,15 @@ static inline void render_main_texture(struct obs_core_video *video,
 }
 
 static inline gs_effect_t *get_scale_effect_internal(
-		struct obs_core_video *video)
+		struct obs_core_video *video,
+		uint32_t base_width, uint32_t base_height,
+		uint32_t width, uint32_t height)
 {
 	/* if the dimension is under half the size of the original image,
 	 * bicubic/lanczos can't sample enough pixels to create an accurate
 	 * image, so use the bilinear low resolution effect instead */
-	if (video->output_width  < (video->base_width  / 2) &&
-	    video->output_height < (video->base_height / 2)) {
+	if (width  < (base_width  / 2) &&
+	    height < (base_height / 2)) {
 		return video->bilinear_lowres_effect;
 	}
 
@@ -164,24 +161,26 @@ static inline gs_effect_t *get_scale_effect_internal(
 	return video->bicubic_effect;
 }
 
-static inline bool resolution_close(struct obs_core_video *video,
+static inline bool resolution_close(uint32_t base_width, uint32_t base_height,
 		uint32_t width, uint32_t height)
 {
-	long width_cmp  = (long)video->base_width  - (long)width;
-	long height_cmp = (long)video->base_height - (long)height;
+	long width_cmp  = (long)base_width  - (long)width;
+	long height_cmp = (long)base_height - (long)height;
 
 	return labs(width_cmp) <= 16 && labs(height_cmp) <= 16;
 }
 
 static inline gs_effect_t *get_scale_effect(struct obs_core_video *video,
+		uint32_t base_width, uint32_t base_height,
 		uint32_t width, uint32_t height)
 {
-	if (resolution_close(video, width, height)) {
+	if (resolution_close(base_width, base_height, width, height)) {
 		return video->default_effect;
 	} else {
 		/* if the scale method couldn't be loaded, use either bicubic
 		 * or bilinear by default */
-		gs_effect_t *effect = get_scale_effect_internal(video);
+		gs_effect_t *effect = get_scale_effect_internal(video,
+				base_width, base_height, width, height);
 		if (!effect)
 			effect = !!video->bicubic_effect ?
 				video->bicubic_effect :
@@ -190,23 +189,58 @@ static inline gs_effect_t *get_scale_effect(struct obs_core_video *video,
 	}
 }
 
+/* the main rendition comes first, followed by the ones created for
+ * encoders, which are all rendered from the main texture, and then the
+ * ones of the canvases.  renditions_mutex and canvases_mutex must be
+ * locked */
+static inline size_t get_num_main_renditions(struct obs_core_video *video)
+{
+	return video->renditions.num + 1;
+}
+
+static inline size_t get_num_renditions(struct obs_core_video *video)
+{
+	return get_num_main_renditions(video) + video->canvases.num;
+}
+
+static inline struct obs_video_rendition *get_rendition(
+		struct obs_core_video *video, size_t idx)
+{
+	if (idx == 0)
+		return &video->main_rendition;
+	if (--idx < video->renditions.num)
+		return video->renditions.array[idx];
+
+	idx -= video->renditions.num;
+	return &video->canvases.array[idx]->rendition;
+}
+
+/* texture is the canvas rendered last frame, or NULL if none was rendered */
 static const char *render_output_texture_name = "render_output_texture";
 static inline void render_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+		struct obs_video_rendition *rendition, gs_texture_t *texture,
+		int cur_texture)
 {
+	rendition->textures_output[cur_texture] = false;
+
+	if (!texture)
+		return;
+
 	profile_start(render_output_texture_name);
 
-	gs_texture_t *texture = video->render_textures[prev_texture];
-	gs_texture_t *target  = video->output_textures[cur_texture];
+	gs_texture_t *target  = rendition->output_textures[cur_texture];
 	uint32_t     width   = gs_texture_get_width(target);
 	uint32_t     height  = gs_texture_get_height(target);
+	uint32_t     base_width  = gs_texture_get_width(texture);
+	uint32_t     base_height = gs_texture_get_height(texture);
 	struct vec2  base_i;
 
 	vec2_set(&base_i,
-		1.0f / (float)video->base_width,
-		1.0f / (float)video->base_height);
+		1.0f / (float)base_width,
+		1.0f / (float)base_height);
 
-	gs_effect_t    *effect  = get_scale_effect(video, width, height);
+	gs_effect_t    *effect  = get_scale_effect(video,
+			base_width, base_height, width, height);
 	gs_technique_t *tech    = gs_effect_get_technique(effect, "DrawMatrix");
 	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
 	gs_eparam_t    *matrix  = gs_effect_get_param_by_name(effect,
@@ -215,16 +249,13 @@ static inline void render_output_texture(struct obs_core_video *video,
 			"base_dimension_i");
 	size_t      passes, i;
 
-	if (!video->textures_rendered[prev_texture])
-		goto end;
-
 	gs_set_render_target(target, NULL);
 	set_render_size(width, height);
 
 	if (bres_i)
 		gs_effect_set_vec2(bres_i, &base_i);
 
-	gs_effect_set_val(matrix, video->color_matrix, sizeof(float) * 16);
+	gs_effect_set_val(matrix, rendition->color_matrix, sizeof(float) * 16);
 	gs_effect_set_texture(image, texture);
 
 	gs_enable_blending(false);
@@ -237,9 +268,8 @@ static inline void render_output_texture(struct obs_core_video *video,
 	gs_technique_end(tech);
 	gs_enable_blending(true);
 
-	video->textures_output[cur_texture] = true;
+	rendition->textures_output[cur_texture] = true;
 
-end:
 	profile_end(render_output_texture_name);
 }
 
@@ -251,26 +281,32 @@ static inline void set_eparam(gs_effect_t *effect, const char *name, float val)
 
 static const char *render_convert_texture_name = "render_convert_texture";
 static void render_convert_texture(struct obs_core_video *video,
+		struct obs_video_rendition *rendition,
 		int cur_texture, int prev_texture)
 {
 	profile_start(render_convert_texture_name);
 
-	gs_texture_t *texture = video->output_textures[prev_texture];
-	gs_texture_t *target  = video->convert_textures[cur_texture];
-	float        fwidth  = (float)video->output_width;
-	float        fheight = (float)video->output_height;
+	gs_texture_t *texture = rendition->output_textures[prev_texture];
+	gs_texture_t *target  = rendition->convert_textures[cur_texture];
+	uint32_t     width   = rendition->info.width;
+	float        fwidth  = (float)rendition->info.width;
+	float        fheight = (float)rendition->info.height;
 	size_t       passes, i;
 
 	gs_effect_t    *effect  = video->conversion_effect;
 	gs_eparam_t    *image   = gs_effect_get_param_by_name(effect, "image");
 	gs_technique_t *tech    = gs_effect_get_technique(effect,
-			video->conversion_tech);
+			rendition->conversion_tech);
 
-	if (!video->textures_output[prev_texture])
+	rendition->textures_converted[cur_texture] = false;
+
+	if (!rendition->textures_output[prev_texture])
 		goto end;
 
-	set_eparam(effect, "u_plane_offset", (float)video->plane_offsets[1]);
-	set_eparam(effect, "v_plane_offset", (float)video->plane_offsets[2]);
+	set_eparam(effect, "u_plane_offset",
+			(float)rendition->plane_offsets[1]);
+	set_eparam(effect, "v_plane_offset",
+			(float)rendition->plane_offsets[2]);
 	set_eparam(effect, "width",  fwidth);
 	set_eparam(effect, "height", fheight);
 	set_eparam(effect, "width_i",  1.0f / fwidth);
@@ -279,75 +315,235 @@ static void render_convert_texture(struct obs_core_video *video,
 	set_eparam(effect, "height_d2", fheight * 0.5f);
 	set_eparam(effect, "width_d2_i",  1.0f / (fwidth  * 0.5f));
 	set_eparam(effect, "height_d2_i", 1.0f / (fheight * 0.5f));
-	set_eparam(effect, "input_height", (float)video->conversion_height);
+	set_eparam(effect, "input_height",
+			(float)rendition->conversion_height);
 
 	gs_effect_set_texture(image, texture);
 
 	gs_set_render_target(target, NULL);
-	set_render_size(video->output_width, video->conversion_height);
+	set_render_size(width, rendition->conversion_height);
 
 	gs_enable_blending(false);
 	passes = gs_technique_begin(tech);
 	for (i = 0; i < passes; i++) {
 		gs_technique_begin_pass(tech, i);
-		gs_draw_sprite(texture, 0, video->output_width,
-				video->conversion_height);
+		gs_draw_sprite(texture, 0, width,
+				rendition->conversion_height);
 		gs_technique_end_pass(tech);
 	}
 	gs_technique_end(tech);
 	gs_enable_blending(true);
 
-	video->textures_converted[cur_texture] = true;
+	rendition->textures_converted[cur_texture] = true;
 
 end:
 	profile_end(render_convert_texture_name);
 }
 
+static void release_readback(void *param)
+{
+	struct obs_readback *rb = param;
+
+	os_atomic_set_bool(&rb->in_use, false);
+	os_atomic_dec_long(&rb->rendition->readbacks_in_use);
+}
+
+/* unmaps the surfaces that were copied from, or that video-io is done with,
+ * so they can be staged to again */
+static inline void reclaim_readbacks(struct obs_video_rendition *rendition)
+{
+	for (size_t i = 0; i < rendition->readback_depth; i++) {
+		struct obs_readback *rb = &rendition->readbacks[i];
+
+		if (rb->mapped && !os_atomic_load_bool(&rb->in_use)) {
+			gs_stagesurface_unmap(rb->surface);
+			rb->mapped = false;
+		}
+	}
+}
+
+static inline gs_texture_t *get_staging_texture(
+		struct obs_video_rendition *rendition, int prev_texture)
+{
+	if (rendition->gpu_conversion)
+		return rendition->textures_converted[prev_texture] ?
+			rendition->convert_textures[prev_texture] : NULL;
+	else
+		return rendition->textures_output[prev_texture] ?
+			rendition->output_textures[prev_texture] : NULL;
+}
+
+static inline void stage_rendition(struct obs_core_video *video,
+		struct obs_video_rendition *rendition, int prev_texture,
+		struct obs_vframe_info vframe_info)
+{
+	struct obs_readback *rb =
+		&rendition->readbacks[rendition->readback_write];
+	gs_texture_t *texture = get_staging_texture(rendition, prev_texture);
+
+	/* the rendition was only just created, nothing to stage yet */
+	if (!texture)
+		return;
+
+	/* the GPU or the outputs are so far behind that the oldest surface
+	 * is still in use.  skip the frame rather than wait, the next frame
+	 * makes up for its time */
+	if (rb->staged || rb->mapped) {
+		rendition->readback_skipped_count += vframe_info.count;
+		if (rendition == &video->main_rendition)
+			video->lagged_frames += vframe_info.count;
+		return;
+	}
+
+	vframe_info.count += rendition->readback_skipped_count;
+	rendition->readback_skipped_count = 0;
+
+	gs_stage_texture(rb->surface, texture);
+
+	rb->info = vframe_info;
+	rb->staged = true;
+	rendition->readback_pending++;
+
+	if (++rendition->readback_write == rendition->readback_depth)
+		rendition->readback_write = 0;
+}
+
 static const char *stage_output_texture_name = "stage_output_texture";
+/* canvas frames are staged as soon as they made it through conversion, each
+ * with the frame info recorded when it was rendered */
+static inline void stage_canvas(struct obs_core_video *video,
+		struct obs_canvas *canvas, int prev_texture)
+{
+	struct obs_vframe_info vframe_info;
+
+	if (!get_staging_texture(&canvas->rendition, prev_texture) ||
+	    !canvas->vframe_info_buffer.size)
+		return;
+
+	circlebuf_pop_front(&canvas->vframe_info_buffer, &vframe_info,
+			sizeof(vframe_info));
+	stage_rendition(video, &canvas->rendition, prev_texture, vframe_info);
+}
+
 static inline void stage_output_texture(struct obs_core_video *video,
-		int cur_texture, int prev_texture)
+		int prev_texture)
 {
 	profile_start(stage_output_texture_name);
 
-	gs_texture_t   *texture;
-	bool        texture_ready;
-	gs_stagesurf_t *copy = video->copy_surfaces[cur_texture];
-
-	if (video->gpu_conversion) {
-		texture = video->convert_textures[prev_texture];
-		texture_ready = video->textures_converted[prev_texture];
-	} else {
-		texture = video->output_textures[prev_texture];
-		texture_ready = video->textures_output[prev_texture];
-	}
+	struct obs_vframe_info vframe_info;
 
-	unmap_last_surface(video);
+	for (size_t i = 0; i < video->canvases.num; i++)
+		stage_canvas(video, video->canvases.array[i], prev_texture);
 
-	if (!texture_ready)
+	if (!get_staging_texture(&video->main_rendition, prev_texture) ||
+	    !video->vframe_info_buffer.size)
 		goto end;
 
-	gs_stage_texture(copy, texture);
+	circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
+			sizeof(vframe_info));
 
-	video->textures_copied[cur_texture] = true;
+	for (size_t i = 0; i < get_num_main_renditions(video); i++)
+		stage_rendition(video, get_rendition(video, i), prev_texture,
+				vframe_info);
 
 end:
 	profile_end(stage_output_texture_name);
 }
 
+/* a canvas is rendered once its next frame is due, which with a frame rate
+ * divider isn't every frame of the main video */
+static inline bool canvas_frame_due(struct obs_core_video *video,
+		struct obs_canvas *canvas, struct obs_vframe_info *vframe_info)
+{
+	uint64_t count;
+
+	if (!canvas->next_frame_time)
+		canvas->next_frame_time = video->video_time;
+	if (video->video_time < canvas->next_frame_time)
+		return false;
+
+	count = (video->video_time - canvas->next_frame_time) /
+		canvas->frame_time + 1;
+	canvas->next_frame_time += count * canvas->frame_time;
+
+	vframe_info->timestamp = video->video_time;
+	vframe_info->count = (int)count;
+	return true;
+}
+
+static const char *render_canvas_texture_name = "render_canvas_texture";
+static inline void render_canvas_texture(struct obs_core_video *video,
+		struct obs_canvas *canvas, int cur_texture)
+{
+	struct obs_vframe_info vframe_info;
+	struct vec4 clear_color;
+
+	canvas->textures_rendered[cur_texture] = false;
+
+	if (!canvas_frame_due(video, canvas, &vframe_info))
+		return;
+
+	profile_start(render_canvas_texture_name);
+
+	vec4_set(&clear_color, 0.0f, 0.0f, 0.0f, 1.0f);
+
+	gs_set_render_target(canvas->render_textures[cur_texture], NULL);
+	gs_clear(GS_CLEAR_COLOR, &clear_color, 1.0f, 0);
+
+	set_render_size(canvas->base_width, canvas->base_height);
+	obs_view_render(&canvas->view);
+
+	canvas->textures_rendered[cur_texture] = true;
+	circlebuf_push_back(&canvas->vframe_info_buffer, &vframe_info,
+			sizeof(vframe_info));
+
+	profile_end(render_canvas_texture_name);
+}
+
+static inline void render_rendition(struct obs_core_video *video,
+		struct obs_video_rendition *rendition, gs_texture_t *texture,
+		int cur_texture, int prev_texture)
+{
+	render_output_texture(video, rendition, texture, cur_texture);
+	if (rendition->gpu_conversion)
+		render_convert_texture(video, rendition, cur_texture,
+				prev_texture);
+}
+
 static inline void render_video(struct obs_core_video *video, int cur_texture,
 		int prev_texture)
 {
+	gs_texture_t *texture;
+
 	gs_begin_scene();
 
 	gs_enable_depth_test(false);
 	gs_set_cull_mode(GS_NEITHER);
 
+	frame_trace_record(video->video_time, FRAME_TRACE_RENDER);
 	render_main_texture(video, cur_texture);
-	render_output_texture(video, cur_texture, prev_texture);
-	if (video->gpu_conversion)
-		render_convert_texture(video, cur_texture, prev_texture);
 
-	stage_output_texture(video, cur_texture, prev_texture);
+	for (size_t i = 0; i < video->canvases.num; i++)
+		render_canvas_texture(video, video->canvases.array[i],
+				cur_texture);
+
+	frame_trace_record(video->video_time, FRAME_TRACE_GPU_CONVERT);
+
+	texture = video->textures_rendered[prev_texture] ?
+		video->render_textures[prev_texture] : NULL;
+
+	for (size_t i = 0; i < get_num_main_renditions(video); i++)
+		render_rendition(video, get_rendition(video, i), texture,
+				cur_texture, prev_texture);
+
+	for (size_t i = 0; i < video->canvases.num; i++) {
+		struct obs_canvas *canvas = video->canvases.array[i];
+
+		texture = canvas->textures_rendered[prev_texture] ?
+			canvas->render_textures[prev_texture] : NULL;
+		render_rendition(video, &canvas->rendition, texture,
+				cur_texture, prev_texture);
+	}
 
 	gs_set_render_target(NULL, NULL);
 	gs_enable_blending(true);
@@ -355,19 +551,32 @@ static inline void render_video(struct obs_core_video *video, int cur_texture,
 	gs_end_scene();
 }
 
-static inline bool download_frame(struct obs_core_video *video,
-		int prev_texture, struct video_data *frame)
+/* maps the staged frames that the GPU is done with, oldest first, without
+ * ever waiting for the GPU */
+static inline void download_frames(struct obs_video_rendition *rendition)
 {
-	gs_stagesurf_t *surface = video->copy_surfaces[prev_texture];
+	rendition->num_downloaded = 0;
 
-	if (!video->textures_copied[prev_texture])
-		return false;
+	while (rendition->readback_pending) {
+		struct obs_readback *rb =
+			&rendition->readbacks[rendition->readback_read];
 
-	if (!gs_stagesurface_map(surface, &frame->data[0], &frame->linesize[0]))
-		return false;
+		if (!gs_stagesurface_ready(rb->surface))
+			break;
 
-	video->mapped_surface = surface;
-	return true;
+		rb->staged = false;
+		rendition->readback_pending--;
+		if (++rendition->readback_read == rendition->readback_depth)
+			rendition->readback_read = 0;
+
+		if (!gs_stagesurface_map(rb->surface, &rb->data, &rb->linesize))
+			continue;
+
+		frame_trace_record(rb->info.timestamp, FRAME_TRACE_DOWNLOAD);
+
+		rb->mapped = true;
+		rendition->downloaded[rendition->num_downloaded++] = rb;
+	}
 }
 
 static inline uint32_t calc_linesize(uint32_t pos, uint32_t linesize)
@@ -407,7 +616,8 @@ static inline uint32_t make_aligned_linesize_offset(uint32_t offset,
 	return (offset / dst_linesize) * src_linesize + remainder;
 }
 
-static void fix_gpu_converted_alignment(struct obs_core_video *video,
+static void fix_gpu_converted_alignment(
+		struct obs_video_rendition *rendition,
 		struct video_frame *output, const struct video_data *input)
 {
 	uint32_t src_linesize = input->linesize[0];
@@ -415,38 +625,39 @@ static void fix_gpu_converted_alignment(struct obs_core_video *video,
 	uint32_t src_pos      = 0;
 
 	for (size_t i = 0; i < 3; i++) {
-		if (video->plane_linewidth[i] == 0)
+		if (rendition->plane_linewidth[i] == 0)
 			break;
 
-		src_pos = make_aligned_linesize_offset(video->plane_offsets[i],
+		src_pos = make_aligned_linesize_offset(
+				rendition->plane_offsets[i],
 				dst_linesize, src_linesize);
 
 		copy_dealign(output->data[i], 0, dst_linesize,
 				input->data[0], src_pos, src_linesize,
-				video->plane_sizes[i]);
+				rendition->plane_sizes[i]);
 	}
 }
 
-static void set_gpu_converted_data(struct obs_core_video *video,
+static void set_gpu_converted_data(struct obs_video_rendition *rendition,
 		struct video_frame *output, const struct video_data *input,
 		const struct video_output_info *info)
 {
-	if (input->linesize[0] == video->output_width*4) {
+	if (input->linesize[0] == info->width*4) {
 		struct video_frame frame;
 
 		for (size_t i = 0; i < 3; i++) {
-			if (video->plane_linewidth[i] == 0)
+			if (rendition->plane_linewidth[i] == 0)
 				break;
 
-			frame.linesize[i] = video->plane_linewidth[i];
+			frame.linesize[i] = rendition->plane_linewidth[i];
 			frame.data[i] =
-				input->data[0] + video->plane_offsets[i];
+				input->data[0] + rendition->plane_offsets[i];
 		}
 
 		video_frame_copy(output, &frame, info->format, info->height);
 
 	} else {
-		fix_gpu_converted_alignment(video, output, input);
+		fix_gpu_converted_alignment(rendition, output, input);
 	}
 }
 
@@ -496,29 +707,93 @@ static inline void copy_rgbx_frame(
 	}
 }
 
-static inline void output_video_data(struct obs_core_video *video,
-		struct video_data *input_frame, int count)
+/* the mapped data can be used as is when the surface has no row padding.
+ * a couple of surfaces are always left for staging and downloading, beyond
+ * that frames are copied so slow outputs can't stall the readbacks */
+static inline bool get_direct_frame(struct obs_video_rendition *rendition,
+		struct obs_readback *rb, const struct video_output_info *info,
+		struct video_frame *frame)
+{
+	long in_use = os_atomic_load_long(&rendition->readbacks_in_use);
+
+	if (in_use + 2 >= (long)rendition->readback_depth)
+		return false;
+
+	memset(frame, 0, sizeof(*frame));
+
+	if (rendition->gpu_conversion) {
+		if (rb->linesize != info->width * 4)
+			return false;
+
+		for (size_t i = 0; i < 3; i++) {
+			if (rendition->plane_linewidth[i] == 0)
+				break;
+
+			frame->linesize[i] = rendition->plane_linewidth[i];
+			frame->data[i] = rb->data +
+				rendition->plane_offsets[i];
+		}
+
+		return true;
+
+	} else if (!format_is_yuv(info->format) &&
+	           rb->linesize == info->width * 4) {
+		frame->data[0] = rb->data;
+		frame->linesize[0] = rb->linesize;
+		return true;
+	}
+
+	return false;
+}
+
+static inline void output_video_data(struct obs_video_rendition *rendition,
+		struct obs_readback *rb)
 {
 	const struct video_output_info *info;
 	struct video_frame output_frame;
+	struct video_data input;
 	bool locked;
 
-	info = video_output_get_info(video->video);
+	info = video_output_get_info(rendition->video);
+
+	if (get_direct_frame(rendition, rb, info, &output_frame)) {
+		os_atomic_set_bool(&rb->in_use, true);
+		os_atomic_inc_long(&rendition->readbacks_in_use);
 
-	locked = video_output_lock_frame(video->video, &output_frame, count,
-			input_frame->timestamp);
+		frame_trace_record(rb->info.timestamp,
+				FRAME_TRACE_VIDEO_OUTPUT);
+
+		if (!video_output_submit_frame(rendition->video, &output_frame,
+					rb->info.count, rb->info.timestamp,
+					release_readback, rb)) {
+			os_atomic_set_bool(&rb->in_use, false);
+			os_atomic_dec_long(&rendition->readbacks_in_use);
+		}
+		return;
+	}
+
+	memset(&input, 0, sizeof(input));
+	input.data[0] = rb->data;
+	input.linesize[0] = rb->linesize;
+	input.timestamp = rb->info.timestamp;
+
+	locked = video_output_lock_frame(rendition->video, &output_frame,
+			rb->info.count, input.timestamp);
 	if (locked) {
-		if (video->gpu_conversion) {
-			set_gpu_converted_data(video, &output_frame,
-					input_frame, info);
+		frame_trace_record(input.timestamp,
+				FRAME_TRACE_VIDEO_OUTPUT);
+
+		if (rendition->gpu_conversion) {
+			set_gpu_converted_data(rendition, &output_frame,
+					&input, info);
 
 		} else if (format_is_yuv(info->format)) {
-			convert_frame(&output_frame, input_frame, info);
+			convert_frame(&output_frame, &input, info);
 		} else {
-			copy_rgbx_frame(&output_frame, input_frame, info);
+			copy_rgbx_frame(&output_frame, &input, info);
 		}
 
-		video_output_unlock_frame(video->video);
+		video_output_unlock_frame(rendition->video);
 	}
 }
 
@@ -547,9 +822,35 @@ static inline void video_sleep(struct obs_core_video *video,
 			sizeof(vframe_info));
 }
 
+/* renditions are only ever destroyed here, as the last encoder using one may
+ * be released from within the rendition's own video thread */
+static void free_unused_renditions(struct obs_core_video *video)
+{
+	DARRAY(struct obs_video_rendition*) unused;
+	da_init(unused);
+
+	pthread_mutex_lock(&video->renditions_mutex);
+
+	for (size_t i = video->renditions.num; i > 0; i--) {
+		struct obs_video_rendition *rendition =
+			video->renditions.array[i - 1];
+
+		if (!rendition->refs) {
+			da_push_back(unused, &rendition);
+			da_erase(video->renditions, i - 1);
+		}
+	}
+
+	pthread_mutex_unlock(&video->renditions_mutex);
+
+	for (size_t i = 0; i < unused.num; i++)
+		obs_video_rendition_destroy(unused.array[i]);
+	da_free(unused);
+}
+
 static const char *output_frame_gs_context_name = "gs_context(video->graphics)";
 static const char *output_frame_render_video_name = "render_video";
-static const char *output_frame_download_frame_name = "download_frame";
+static const char *output_frame_download_frame_name = "download_frames";
 static const char *output_frame_gs_flush_name = "gs_flush";
 static const char *output_frame_output_video_data_name = "output_video_data";
 static inline void output_frame(void)
@@ -557,10 +858,11 @@ static inline void output_frame(void)
 	struct obs_core_video *video = &obs->video;
 	int cur_texture  = video->cur_texture;
 	int prev_texture = cur_texture == 0 ? NUM_TEXTURES-1 : cur_texture-1;
-	struct video_data frame;
-	bool frame_ready;
 
-	memset(&frame, 0, sizeof(struct video_data));
+	free_unused_renditions(video);
+
+	pthread_mutex_lock(&video->renditions_mutex);
+	pthread_mutex_lock(&video->canvases_mutex);
 
 	profile_start(output_frame_gs_context_name);
 	gs_enter_context(video->graphics);
@@ -569,10 +871,16 @@ static inline void output_frame(void)
 	render_video(video, cur_texture, prev_texture);
 	profile_end(output_frame_render_video_name);
 
+	for (size_t i = 0; i < get_num_renditions(video); i++)
+		reclaim_readbacks(get_rendition(video, i));
+
 	profile_start(output_frame_download_frame_name);
-	frame_ready = download_frame(video, prev_texture, &frame);
+	for (size_t i = 0; i < get_num_renditions(video); i++)
+		download_frames(get_rendition(video, i));
 	profile_end(output_frame_download_frame_name);
 
+	stage_output_texture(video, prev_texture);
+
 	profile_start(output_frame_gs_flush_name);
 	gs_flush();
 	profile_end(output_frame_gs_flush_name);
@@ -580,17 +888,19 @@ static inline void output_frame(void)
 	gs_leave_context();
 	profile_end(output_frame_gs_context_name);
 
-	if (frame_ready) {
-		struct obs_vframe_info vframe_info;
-		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
-				sizeof(vframe_info));
+	for (size_t i = 0; i < get_num_renditions(video); i++) {
+		struct obs_video_rendition *rendition = get_rendition(video, i);
 
-		frame.timestamp = vframe_info.timestamp;
-		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
-		profile_end(output_frame_output_video_data_name);
+		for (size_t j = 0; j < rendition->num_downloaded; j++) {
+			profile_start(output_frame_output_video_data_name);
+			output_video_data(rendition, rendition->downloaded[j]);
+			profile_end(output_frame_output_video_data_name);
+		}
 	}
 
+	pthread_mutex_unlock(&video->canvases_mutex);
+	pthread_mutex_unlock(&video->renditions_mutex);
+
 	if (++video->cur_texture == NUM_TEXTURES)
 		video->cur_texture = 0;
 }
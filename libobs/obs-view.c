@@ -23,6 +23,7 @@ bool obs_view_init(struct obs_view *view)
 	if (!view) return false;
 
 	pthread_mutex_init_value(&view->channels_mutex);
+	view->type = AUX_VIEW;
 
 	if (pthread_mutex_init(&view->channels_mutex, NULL) != 0) {
 		blog(LOG_ERROR, "obs_view_init: Failed to create mutex");
@@ -51,7 +52,7 @@ void obs_view_free(struct obs_view *view)
 	for (size_t i = 0; i < MAX_CHANNELS; i++) {
 		struct obs_source *source = view->channels[i];
 		if (source) {
-			obs_source_deactivate(source, AUX_VIEW);
+			obs_source_deactivate(source, view->type);
 			obs_source_release(source);
 		}
 	}
@@ -107,10 +108,10 @@ void obs_view_set_source(obs_view_t *view, uint32_t channel,
 	pthread_mutex_unlock(&view->channels_mutex);
 
 	if (source)
-		obs_source_activate(source, AUX_VIEW);
+		obs_source_activate(source, view->type);
 
 	if (prev_source) {
-		obs_source_deactivate(prev_source, AUX_VIEW);
+		obs_source_deactivate(prev_source, view->type);
 		obs_source_release(prev_source);
 	}
 }
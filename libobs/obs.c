@@ -47,168 +47,252 @@ static inline void make_video_info(struct video_output_info *vi,
 #define GET_ALIGN(val, align) \
 	(((val) + (align-1)) & ~(align-1))
 
-static inline void set_420p_sizes(const struct obs_video_info *ovi)
+static inline void set_420p_sizes(struct obs_video_rendition *rendition)
 {
-	struct obs_core_video *video = &obs->video;
+	uint32_t width  = rendition->info.width;
+	uint32_t height = rendition->info.height;
 	uint32_t chroma_pixels;
 	uint32_t total_bytes;
 
-	chroma_pixels = (ovi->output_width * ovi->output_height / 4);
+	chroma_pixels = (width * height / 4);
 	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = ovi->output_width * ovi->output_height;
-	video->plane_offsets[2] = video->plane_offsets[1] + chroma_pixels;
+	rendition->plane_offsets[0] = 0;
+	rendition->plane_offsets[1] = width * height;
+	rendition->plane_offsets[2] = rendition->plane_offsets[1] +
+		chroma_pixels;
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width/2;
-	video->plane_linewidth[2] = ovi->output_width/2;
+	rendition->plane_linewidth[0] = width;
+	rendition->plane_linewidth[1] = width/2;
+	rendition->plane_linewidth[2] = width/2;
 
-	video->plane_sizes[0] = video->plane_offsets[1];
-	video->plane_sizes[1] = video->plane_sizes[0]/4;
-	video->plane_sizes[2] = video->plane_sizes[1];
+	rendition->plane_sizes[0] = rendition->plane_offsets[1];
+	rendition->plane_sizes[1] = rendition->plane_sizes[0]/4;
+	rendition->plane_sizes[2] = rendition->plane_sizes[1];
 
-	total_bytes = video->plane_offsets[2] + chroma_pixels;
+	total_bytes = rendition->plane_offsets[2] + chroma_pixels;
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+	rendition->conversion_height =
+		(total_bytes/PIXEL_SIZE + width-1) / width;
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "Planar420";
+	rendition->conversion_height =
+		GET_ALIGN(rendition->conversion_height, 2);
+	rendition->conversion_tech = "Planar420";
 }
 
-static inline void set_nv12_sizes(const struct obs_video_info *ovi)
+static inline void set_nv12_sizes(struct obs_video_rendition *rendition)
 {
-	struct obs_core_video *video = &obs->video;
+	uint32_t width  = rendition->info.width;
+	uint32_t height = rendition->info.height;
 	uint32_t chroma_pixels;
 	uint32_t total_bytes;
 
-	chroma_pixels = (ovi->output_width * ovi->output_height / 2);
+	chroma_pixels = (width * height / 2);
 	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = ovi->output_width * ovi->output_height;
+	rendition->plane_offsets[0] = 0;
+	rendition->plane_offsets[1] = width * height;
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width;
+	rendition->plane_linewidth[0] = width;
+	rendition->plane_linewidth[1] = width;
 
-	video->plane_sizes[0] = video->plane_offsets[1];
-	video->plane_sizes[1] = video->plane_sizes[0]/2;
+	rendition->plane_sizes[0] = rendition->plane_offsets[1];
+	rendition->plane_sizes[1] = rendition->plane_sizes[0]/2;
 
-	total_bytes = video->plane_offsets[1] + chroma_pixels;
+	total_bytes = rendition->plane_offsets[1] + chroma_pixels;
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+	rendition->conversion_height =
+		(total_bytes/PIXEL_SIZE + width-1) / width;
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "NV12";
+	rendition->conversion_height =
+		GET_ALIGN(rendition->conversion_height, 2);
+	rendition->conversion_tech = "NV12";
 }
 
-static inline void set_444p_sizes(const struct obs_video_info *ovi)
+static inline void set_444p_sizes(struct obs_video_rendition *rendition)
 {
-	struct obs_core_video *video = &obs->video;
+	uint32_t width  = rendition->info.width;
+	uint32_t height = rendition->info.height;
 	uint32_t chroma_pixels;
 	uint32_t total_bytes;
 
-	chroma_pixels = (ovi->output_width * ovi->output_height);
+	chroma_pixels = (width * height);
 	chroma_pixels = GET_ALIGN(chroma_pixels, PIXEL_SIZE);
 
-	video->plane_offsets[0] = 0;
-	video->plane_offsets[1] = chroma_pixels;
-	video->plane_offsets[2] = chroma_pixels + chroma_pixels;
+	rendition->plane_offsets[0] = 0;
+	rendition->plane_offsets[1] = chroma_pixels;
+	rendition->plane_offsets[2] = chroma_pixels + chroma_pixels;
 
-	video->plane_linewidth[0] = ovi->output_width;
-	video->plane_linewidth[1] = ovi->output_width;
-	video->plane_linewidth[2] = ovi->output_width;
+	rendition->plane_linewidth[0] = width;
+	rendition->plane_linewidth[1] = width;
+	rendition->plane_linewidth[2] = width;
 
-	video->plane_sizes[0] = chroma_pixels;
-	video->plane_sizes[1] = chroma_pixels;
-	video->plane_sizes[2] = chroma_pixels;
+	rendition->plane_sizes[0] = chroma_pixels;
+	rendition->plane_sizes[1] = chroma_pixels;
+	rendition->plane_sizes[2] = chroma_pixels;
 
-	total_bytes = video->plane_offsets[2] + chroma_pixels;
+	total_bytes = rendition->plane_offsets[2] + chroma_pixels;
 
-	video->conversion_height =
-		(total_bytes/PIXEL_SIZE + ovi->output_width-1) /
-		ovi->output_width;
+	rendition->conversion_height =
+		(total_bytes/PIXEL_SIZE + width-1) / width;
 
-	video->conversion_height = GET_ALIGN(video->conversion_height, 2);
-	video->conversion_tech = "Planar444";
+	rendition->conversion_height =
+		GET_ALIGN(rendition->conversion_height, 2);
+	rendition->conversion_tech = "Planar444";
 }
 
-static inline void calc_gpu_conversion_sizes(const struct obs_video_info *ovi)
+static inline void calc_gpu_conversion_sizes(
+		struct obs_video_rendition *rendition)
 {
-	obs->video.conversion_height = 0;
-	memset(obs->video.plane_offsets, 0, sizeof(obs->video.plane_offsets));
-	memset(obs->video.plane_sizes, 0, sizeof(obs->video.plane_sizes));
-	memset(obs->video.plane_linewidth, 0,
-		sizeof(obs->video.plane_linewidth));
+	rendition->conversion_height = 0;
+	memset(rendition->plane_offsets, 0, sizeof(rendition->plane_offsets));
+	memset(rendition->plane_sizes, 0, sizeof(rendition->plane_sizes));
+	memset(rendition->plane_linewidth, 0,
+		sizeof(rendition->plane_linewidth));
 
-	switch ((uint32_t)ovi->output_format) {
+	switch ((uint32_t)rendition->info.format) {
 	case VIDEO_FORMAT_I420:
-		set_420p_sizes(ovi);
+		set_420p_sizes(rendition);
 		break;
 	case VIDEO_FORMAT_NV12:
-		set_nv12_sizes(ovi);
+		set_nv12_sizes(rendition);
 		break;
 	case VIDEO_FORMAT_I444:
-		set_444p_sizes(ovi);
+		set_444p_sizes(rendition);
 		break;
 	}
 }
 
-static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
+static bool obs_init_gpu_conversion(struct obs_video_rendition *rendition)
 {
-	struct obs_core_video *video = &obs->video;
-
-	calc_gpu_conversion_sizes(ovi);
+	calc_gpu_conversion_sizes(rendition);
 
-	if (!video->conversion_height) {
+	if (!rendition->conversion_height) {
 		blog(LOG_INFO, "GPU conversion not available for format: %u",
-				(unsigned int)ovi->output_format);
-		video->gpu_conversion = false;
+				(unsigned int)rendition->info.format);
+		rendition->gpu_conversion = false;
 		return true;
 	}
 
 	for (size_t i = 0; i < NUM_TEXTURES; i++) {
-		video->convert_textures[i] = gs_texture_create(
-				ovi->output_width, video->conversion_height,
+		rendition->convert_textures[i] = gs_texture_create(
+				rendition->info.width,
+				rendition->conversion_height,
 				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
 
-		if (!video->convert_textures[i])
+		if (!rendition->convert_textures[i])
 			return false;
 	}
 
 	return true;
 }
 
-static bool obs_init_textures(struct obs_video_info *ovi)
+static inline void set_video_matrix(struct obs_video_rendition *rendition)
+{
+	const struct video_scale_info *info = &rendition->info;
+	struct matrix4 mat;
+	struct vec4 r_row;
+
+	if (format_is_yuv(info->format)) {
+		video_format_get_parameters(info->colorspace, info->range,
+				(float*)&mat, NULL, NULL);
+		matrix4_inv(&mat, &mat);
+
+		/* swap R and G */
+		r_row = mat.x;
+		mat.x = mat.y;
+		mat.y = r_row;
+	} else {
+		matrix4_identity(&mat);
+	}
+
+	memcpy(rendition->color_matrix, &mat, sizeof(float) * 16);
+}
+
+static inline uint32_t get_readback_depth(struct obs_core_video *video)
+{
+	uint32_t depth = video->readback_setting ?
+		video->readback_setting : DEFAULT_READBACK_DEPTH;
+
+	if (depth < MIN_READBACK_DEPTH)
+		depth = MIN_READBACK_DEPTH;
+	else if (depth > MAX_READBACK_DEPTH)
+		depth = MAX_READBACK_DEPTH;
+	return depth;
+}
+
+bool obs_init_rendition(struct obs_video_rendition *rendition,
+		bool gpu_conversion)
 {
 	struct obs_core_video *video = &obs->video;
-	uint32_t output_height = video->gpu_conversion ?
-		video->conversion_height : ovi->output_height;
+	uint32_t output_height;
 	size_t i;
 
-	for (i = 0; i < NUM_TEXTURES; i++) {
-		video->copy_surfaces[i] = gs_stagesurface_create(
-				ovi->output_width, output_height, GS_RGBA);
+	set_video_matrix(rendition);
+
+	rendition->gpu_conversion = gpu_conversion;
+	if (gpu_conversion && !obs_init_gpu_conversion(rendition))
+		return false;
+
+	output_height = rendition->gpu_conversion ?
+		rendition->conversion_height : rendition->info.height;
+
+	rendition->readback_depth = get_readback_depth(video);
 
-		if (!video->copy_surfaces[i])
+	for (i = 0; i < rendition->readback_depth; i++) {
+		struct obs_readback *rb = &rendition->readbacks[i];
+
+		rb->rendition = rendition;
+		rb->surface = gs_stagesurface_create(rendition->info.width,
+				output_height, GS_RGBA);
+
+		if (!rb->surface)
 			return false;
+	}
 
-		video->render_textures[i] = gs_texture_create(
-				ovi->base_width, ovi->base_height,
+	for (i = 0; i < NUM_TEXTURES; i++) {
+		rendition->output_textures[i] = gs_texture_create(
+				rendition->info.width, rendition->info.height,
 				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
 
-		if (!video->render_textures[i])
+		if (!rendition->output_textures[i])
 			return false;
+	}
 
-		video->output_textures[i] = gs_texture_create(
-				ovi->output_width, ovi->output_height,
+	return true;
+}
+
+/* its video output must be closed first, so no frame still points into a
+ * readback surface */
+void obs_free_rendition(struct obs_video_rendition *rendition)
+{
+	for (size_t i = 0; i < MAX_READBACK_DEPTH; i++) {
+		struct obs_readback *rb = &rendition->readbacks[i];
+
+		if (rb->mapped)
+			gs_stagesurface_unmap(rb->surface);
+		if (rb->surface)
+			gs_stagesurface_destroy(rb->surface);
+	}
+
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		gs_texture_destroy(rendition->convert_textures[i]);
+		gs_texture_destroy(rendition->output_textures[i]);
+	}
+
+	memset(rendition, 0, sizeof(*rendition));
+}
+
+static bool obs_init_textures(struct obs_video_info *ovi)
+{
+	struct obs_core_video *video = &obs->video;
+
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		video->render_textures[i] = gs_texture_create(
+				ovi->base_width, ovi->base_height,
 				GS_RGBA, 1, NULL, GS_RENDER_TARGET);
 
-		if (!video->output_textures[i])
+		if (!video->render_textures[i])
 			return false;
 	}
 
@@ -325,28 +409,6 @@ static int obs_init_graphics(struct obs_video_info *ovi)
 	return success ? OBS_VIDEO_SUCCESS : OBS_VIDEO_FAIL;
 }
 
-static inline void set_video_matrix(struct obs_core_video *video,
-		struct obs_video_info *ovi)
-{
-	struct matrix4 mat;
-	struct vec4 r_row;
-
-	if (format_is_yuv(ovi->output_format)) {
-		video_format_get_parameters(ovi->colorspace, ovi->range,
-				(float*)&mat, NULL, NULL);
-		matrix4_inv(&mat, &mat);
-
-		/* swap R and G */
-		r_row = mat.x;
-		mat.x = mat.y;
-		mat.y = r_row;
-	} else {
-		matrix4_identity(&mat);
-	}
-
-	memcpy(video->color_matrix, &mat, sizeof(float) * 16);
-}
-
 static int obs_init_video(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -361,8 +423,6 @@ static int obs_init_video(struct obs_video_info *ovi)
 	video->gpu_conversion = ovi->gpu_conversion;
 	video->scale_type     = ovi->scale_type;
 
-	set_video_matrix(video, ovi);
-
 	errorcode = video_output_open(&video->video, &vi);
 
 	if (errorcode != VIDEO_OUTPUT_SUCCESS) {
@@ -375,9 +435,16 @@ static int obs_init_video(struct obs_video_info *ovi)
 		return OBS_VIDEO_FAIL;
 	}
 
+	video->main_rendition.video           = video->video;
+	video->main_rendition.info.format     = vi.format;
+	video->main_rendition.info.width      = vi.width;
+	video->main_rendition.info.height     = vi.height;
+	video->main_rendition.info.range      = vi.range;
+	video->main_rendition.info.colorspace = vi.colorspace;
+
 	gs_enter_context(video->graphics);
 
-	if (ovi->gpu_conversion && !obs_init_gpu_conversion(ovi))
+	if (!obs_init_rendition(&video->main_rendition, ovi->gpu_conversion))
 		return OBS_VIDEO_FAIL;
 	if (!obs_init_textures(ovi))
 		return OBS_VIDEO_FAIL;
@@ -414,6 +481,10 @@ static void obs_free_video(void)
 	struct obs_core_video *video = &obs->video;
 
 	if (video->video) {
+		for (size_t i = 0; i < video->renditions.num; i++)
+			obs_video_rendition_destroy(video->renditions.array[i]);
+		da_free(video->renditions);
+
 		video_output_close(video->video);
 		video->video = NULL;
 
@@ -422,21 +493,14 @@ static void obs_free_video(void)
 
 		gs_enter_context(video->graphics);
 
-		if (video->mapped_surface) {
-			gs_stagesurface_unmap(video->mapped_surface);
-			video->mapped_surface = NULL;
-		}
+		/* video-io was closed above, so no frame still points
+		 * into a readback surface */
+		obs_free_rendition(&video->main_rendition);
+		obs_free_render_cache();
 
 		for (size_t i = 0; i < NUM_TEXTURES; i++) {
-			gs_stagesurface_destroy(video->copy_surfaces[i]);
 			gs_texture_destroy(video->render_textures[i]);
-			gs_texture_destroy(video->convert_textures[i]);
-			gs_texture_destroy(video->output_textures[i]);
-
-			video->copy_surfaces[i]    = NULL;
-			video->render_textures[i]  = NULL;
-			video->convert_textures[i] = NULL;
-			video->output_textures[i]  = NULL;
+			video->render_textures[i] = NULL;
 		}
 
 		gs_leave_context();
@@ -445,17 +509,165 @@ static void obs_free_video(void)
 
 		memset(&video->textures_rendered, 0,
 				sizeof(video->textures_rendered));
-		memset(&video->textures_output, 0,
-				sizeof(video->textures_output));
-		memset(&video->textures_copied, 0,
-				sizeof(video->textures_copied));
-		memset(&video->textures_converted, 0,
-				sizeof(video->textures_converted));
 
 		video->cur_texture = 0;
 	}
 }
 
+static inline bool rendition_matches(
+		const struct obs_video_rendition *rendition,
+		const struct video_scale_info *info)
+{
+	return rendition->info.format     == info->format &&
+	       rendition->info.width      == info->width &&
+	       rendition->info.height     == info->height &&
+	       rendition->info.range      == info->range &&
+	       rendition->info.colorspace == info->colorspace;
+}
+
+static struct obs_video_rendition *create_rendition(
+		const struct video_scale_info *info)
+{
+	struct obs_core_video *video = &obs->video;
+	struct obs_video_rendition *rendition;
+	struct video_output_info vi;
+	bool success;
+
+	rendition = bzalloc(sizeof(struct obs_video_rendition));
+	rendition->info = *info;
+
+	vi = *video_output_get_info(video->video);
+	vi.name       = "rendition";
+	vi.format     = info->format;
+	vi.width      = info->width;
+	vi.height     = info->height;
+	vi.range      = info->range;
+	vi.colorspace = info->colorspace;
+
+	if (video_output_open(&rendition->video, &vi) != VIDEO_OUTPUT_SUCCESS)
+		goto fail;
+
+	gs_enter_context(video->graphics);
+	success = obs_init_rendition(rendition, true);
+	gs_leave_context();
+
+	if (!success)
+		goto fail;
+
+	blog(LOG_INFO, "Created %"PRIu32"x%"PRIu32" %s video rendition",
+			info->width, info->height,
+			get_video_format_name(info->format));
+	return rendition;
+
+fail:
+	blog(LOG_WARNING, "Failed to create %"PRIu32"x%"PRIu32" %s video "
+	                  "rendition", info->width, info->height,
+	                  get_video_format_name(info->format));
+	obs_video_rendition_destroy(rendition);
+	return NULL;
+}
+
+video_t *obs_video_rendition_acquire(video_t *source,
+		const struct video_scale_info *info)
+{
+	struct obs_core_video *video = &obs->video;
+	struct obs_video_rendition *rendition = NULL;
+
+	/* only the main output has extra renditions */
+	if (!video->video || !video->graphics || source != video->video)
+		return NULL;
+	if (!obs_rendition_format_supported(info->format))
+		return NULL;
+	/* same alignment as the main output */
+	if (!info->width || !info->height ||
+	    (info->width & 3) || (info->height & 1))
+		return NULL;
+
+	pthread_mutex_lock(&video->renditions_mutex);
+
+	for (size_t i = 0; i < video->renditions.num; i++) {
+		if (rendition_matches(video->renditions.array[i], info)) {
+			rendition = video->renditions.array[i];
+			break;
+		}
+	}
+
+	if (!rendition) {
+		rendition = create_rendition(info);
+		if (rendition)
+			da_push_back(video->renditions, &rendition);
+	}
+
+	if (rendition)
+		rendition->refs++;
+
+	pthread_mutex_unlock(&video->renditions_mutex);
+
+	return rendition ? rendition->video : NULL;
+}
+
+void obs_video_rendition_release(video_t *output)
+{
+	struct obs_core_video *video = &obs->video;
+
+	pthread_mutex_lock(&video->renditions_mutex);
+
+	for (size_t i = 0; i < video->renditions.num; i++) {
+		struct obs_video_rendition *rendition =
+			video->renditions.array[i];
+
+		if (rendition->video == output) {
+			rendition->refs--;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&video->renditions_mutex);
+}
+
+void obs_video_rendition_destroy(struct obs_video_rendition *rendition)
+{
+	if (!rendition)
+		return;
+
+	video_output_close(rendition->video);
+
+	gs_enter_context(obs->video.graphics);
+	obs_free_rendition(rendition);
+	gs_leave_context();
+
+	bfree(rendition);
+}
+
+static bool video_outputs_active(void)
+{
+	struct obs_core_video *video = &obs->video;
+	bool active = false;
+
+	if (!video->video)
+		return false;
+	if (video_output_active(video->video))
+		return true;
+
+	pthread_mutex_lock(&video->renditions_mutex);
+	for (size_t i = 0; i < video->renditions.num; i++) {
+		if (video->renditions.array[i]->refs) {
+			active = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&video->renditions_mutex);
+
+	pthread_mutex_lock(&video->canvases_mutex);
+	for (size_t i = 0; !active && i < video->canvases.num; i++) {
+		struct obs_canvas *canvas = video->canvases.array[i];
+		active = video_output_active(canvas->rendition.video);
+	}
+	pthread_mutex_unlock(&video->canvases_mutex);
+
+	return active;
+}
+
 static void obs_free_graphics(void)
 {
 	struct obs_core_video *video = &obs->video;
@@ -505,6 +717,10 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
+	if (!obs_audio_render_pool_init(&audio->render_pool,
+				audio->render_threads_setting))
+		return false;
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -519,9 +735,13 @@ static bool obs_init_audio(struct audio_output_info *ai)
 static void obs_free_audio(void)
 {
 	struct obs_core_audio *audio = &obs->audio;
+	uint32_t render_threads = audio->render_threads_setting;
+
 	if (audio->audio)
 		audio_output_close(audio->audio);
 
+	obs_audio_render_pool_free(&audio->render_pool);
+
 	circlebuf_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
@@ -532,6 +752,7 @@ static void obs_free_audio(void)
 	pthread_mutex_destroy(&audio->monitoring_mutex);
 
 	memset(audio, 0, sizeof(struct obs_core_audio));
+	audio->render_threads_setting = render_threads;
 }
 
 static bool obs_init_data(void)
@@ -565,6 +786,8 @@ static bool obs_init_data(void)
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
+	data->main_view.type = MAIN_VIEW;
+
 	data->valid = true;
 
 fail:
@@ -750,6 +973,8 @@ static bool obs_init(const char *locale, const char *module_config_path,
 	obs = bzalloc(sizeof(struct obs_core));
 
 	pthread_mutex_init_value(&obs->audio.monitoring_mutex);
+	pthread_mutex_init_value(&obs->video.renditions_mutex);
+	pthread_mutex_init_value(&obs->video.canvases_mutex);
 
 	obs->name_store_owned = !store;
 	obs->name_store = store ? store : profiler_name_store_create();
@@ -766,6 +991,10 @@ static bool obs_init(const char *locale, const char *module_config_path,
 		return false;
 	if (!obs_init_hotkeys())
 		return false;
+	if (pthread_mutex_init(&obs->video.renditions_mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&obs->video.canvases_mutex, NULL) != 0)
+		return false;
 
 	if (module_config_path)
 		obs->module_config_path = bstrdup(module_config_path);
@@ -801,6 +1030,12 @@ bool obs_startup(const char *locale, const char *module_config_path,
 
 	success = obs_init(locale, module_config_path, store);
 	profile_end(obs_startup_name);
+
+	/* OBS_FRAME_TRACE=<file> traces every frame through the pipeline and
+	 * writes the trace as Chrome trace JSON to <file> on shutdown */
+	if (success && getenv("OBS_FRAME_TRACE") && *getenv("OBS_FRAME_TRACE"))
+		frame_trace_enable(true);
+
 	if (!success)
 		obs_shutdown();
 
@@ -841,11 +1076,19 @@ void obs_shutdown(void)
 	stop_video();
 	stop_hotkeys();
 
+	if (frame_trace_enabled()) {
+		frame_trace_dump_json(getenv("OBS_FRAME_TRACE"));
+		frame_trace_free();
+	}
+
 	obs_free_audio();
+	obs_free_canvases();
 	obs_free_data();
 	obs_free_video();
 	obs_free_hotkeys();
 	obs_free_graphics();
+	pthread_mutex_destroy(&obs->video.renditions_mutex);
+	pthread_mutex_destroy(&obs->video.canvases_mutex);
 	proc_handler_destroy(obs->procs);
 	signal_handler_destroy(obs->signals);
 	obs->procs = NULL;
@@ -931,7 +1174,7 @@ int obs_reset_video(struct obs_video_info *ovi)
 	if (!obs) return OBS_VIDEO_FAIL;
 
 	/* don't allow changing of video settings if active. */
-	if (obs->video.video && video_output_active(obs->video.video))
+	if (video_outputs_active())
 		return OBS_VIDEO_CURRENTLY_ACTIVE;
 
 	if (!size_valid(ovi->output_width, ovi->output_height) ||
@@ -1028,6 +1271,18 @@ bool obs_reset_audio(const struct obs_audio_info *oai)
 	return obs_init_audio(&ai);
 }
 
+void obs_set_video_readback_depth(uint32_t depth)
+{
+	if (!obs) return;
+	obs->video.readback_setting = depth;
+}
+
+void obs_set_audio_render_threads(uint32_t threads)
+{
+	if (!obs) return;
+	obs->audio.render_threads_setting = threads;
+}
+
 bool obs_get_video_info(struct obs_video_info *ovi)
 {
 	struct obs_core_video *video = &obs->video;
@@ -2054,3 +2309,13 @@ uint32_t obs_get_lagged_frames(void)
 {
 	return obs ? obs->video.lagged_frames : 0;
 }
+
+uint32_t obs_get_render_cache_hits(void)
+{
+	return obs ? obs->video.render_cache_hits : 0;
+}
+
+uint32_t obs_get_render_cache_misses(void)
+{
+	return obs ? obs->video.render_cache_misses : 0;
+}
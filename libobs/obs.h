@@ -41,6 +41,7 @@ struct matrix4;
 /* opaque types */
 struct obs_display;
 struct obs_view;
+struct obs_canvas;
 struct obs_source;
 struct obs_scene;
 struct obs_scene_item;
@@ -53,6 +54,7 @@ struct obs_volmeter;
 
 typedef struct obs_display    obs_display_t;
 typedef struct obs_view       obs_view_t;
+typedef struct obs_canvas     obs_canvas_t;
 typedef struct obs_source     obs_source_t;
 typedef struct obs_scene      obs_scene_t;
 typedef struct obs_scene_item obs_sceneitem_t;
@@ -308,6 +310,24 @@ EXPORT int obs_reset_video(struct obs_video_info *ovi);
  */
 EXPORT bool obs_reset_audio(const struct obs_audio_info *oai);
 
+/**
+ * Sets the number of frames that can be waiting to be downloaded from the
+ * GPU.  More frames add latency, but make it less likely that the graphics
+ * thread has to wait for a download.  0 for the default, takes effect on the
+ * next call to obs_reset_video.
+ */
+EXPORT void obs_set_video_readback_depth(uint32_t depth);
+
+/**
+ * Sets the number of extra threads used to render the audio of sources each
+ * audio tick.  The output is identical either way.  Only buffer copies,
+ * volume and fades run on the extra threads, which is usually less work than
+ * waking them, so this is off by default and only worth enabling where it
+ * was measured to help.  0 (the default) renders all sources on the audio
+ * thread, takes effect on the next call to obs_reset_audio.
+ */
+EXPORT void obs_set_audio_render_threads(uint32_t threads);
+
 /** Gets the current video settings, returns false if no video */
 EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
 
@@ -650,6 +670,61 @@ EXPORT obs_source_t *obs_view_get_source(obs_view_t *view,
 /** Renders the sources of this view context */
 EXPORT void obs_view_render(obs_view_t *view);
 
+
+/* ------------------------------------------------------------------------- */
+/* Canvases */
+
+struct obs_canvas_info {
+	uint32_t            base_width;   /**< Canvas resolution */
+	uint32_t            base_height;  /**< Canvas resolution */
+
+	uint32_t            output_width;  /**< Output resolution */
+	uint32_t            output_height; /**< Output resolution */
+	enum video_format   output_format; /**< Output format */
+
+	/** Renders only every Nth frame of the main video, 0 for every frame */
+	uint32_t            fps_divider;
+};
+
+/**
+ * Creates an additional canvas.
+ *
+ *   A canvas is a separate mix (for example a vertical or clean feed version
+ * of the program) with its own view, resolution and video output.  It is
+ * rendered by the graphics thread along with the main output, from the same
+ * source textures.  Encoders are attached to it by creating them with the
+ * canvas video output.
+ *
+ *   Uses the frame rate, color space and range of the current video settings,
+ * so canvases should be recreated after resetting the video.  Must not be
+ * called within the graphics context.
+ *
+ * @return  The new canvas, or NULL if the format can't be rendered or the
+ *          video isn't initialized
+ */
+EXPORT obs_canvas_t *obs_canvas_create(const char *name,
+		const struct obs_canvas_info *info);
+
+/**
+ * Destroys a canvas.  Encoders and outputs using its video output must be
+ * stopped first.  Must not be called within the graphics context.
+ */
+EXPORT void obs_canvas_destroy(obs_canvas_t *canvas);
+
+EXPORT const char *obs_canvas_get_name(const obs_canvas_t *canvas);
+EXPORT void obs_canvas_get_info(const obs_canvas_t *canvas,
+		struct obs_canvas_info *info);
+
+/**
+ * Gets the view of a canvas.  Unlike other views, sources set on it are
+ * activated the same way as sources of the main output.  Must not be
+ * destroyed.
+ */
+EXPORT obs_view_t *obs_canvas_get_view(obs_canvas_t *canvas);
+
+/** Gets the video output of a canvas, to create encoders with */
+EXPORT video_t *obs_canvas_get_video(const obs_canvas_t *canvas);
+
 EXPORT uint64_t obs_get_video_frame_time(void);
 
 EXPORT double obs_get_active_fps(void);
@@ -658,6 +733,14 @@ EXPORT uint64_t obs_get_average_frame_time_ns(void);
 EXPORT uint32_t obs_get_total_frames(void);
 EXPORT uint32_t obs_get_lagged_frames(void);
 
+/**
+ * Sources shown in more than one place per frame (preview, multiview,
+ * projectors) are rendered once into a texture that the other places draw.
+ * Misses are renders that filled the cache, hits are renders drawn from it.
+ */
+EXPORT uint32_t obs_get_render_cache_hits(void);
+EXPORT uint32_t obs_get_render_cache_misses(void);
+
 
 /* ------------------------------------------------------------------------- */
 /* Display context */
@@ -774,6 +857,13 @@ EXPORT obs_properties_t *obs_source_properties(const obs_source_t *source);
 /** Updates settings for this source */
 EXPORT void obs_source_update(obs_source_t *source, obs_data_t *settings);
 
+/**
+ * Tells scenes that the video of the source changed and has to be rendered
+ * again.  Only needed for sources with the OBS_SOURCE_STATIC_VIDEO flag,
+ * when their video changes without their settings being updated.
+ */
+EXPORT void obs_source_video_changed(obs_source_t *source);
+
 /** Renders a video source. */
 EXPORT void obs_source_video_render(obs_source_t *source);
 
@@ -1434,6 +1524,15 @@ EXPORT uint32_t obs_output_get_delay(const obs_output_t *output);
 /** If delay is active, gets the currently active delay value, in seconds. */
 EXPORT uint32_t obs_output_get_active_delay(const obs_output_t *output);
 
+/**
+ * Limits the memory used by the delay buffer.  Once the delayed packets use
+ * more than max_memory bytes, the data of further packets is written to
+ * memory-mapped files in spill_dir and sent from there when it comes due.
+ * A max_memory of 0 (the default) keeps all delayed packets in memory.
+ */
+EXPORT void obs_output_set_delay_memory_limit(obs_output_t *output,
+		uint64_t max_memory, const char *spill_dir);
+
 /** Forces the output to stop.  Usually only used with delay. */
 EXPORT void obs_output_force_stop(obs_output_t *output);
 
@@ -1549,6 +1648,21 @@ EXPORT int obs_output_get_total_frames(const obs_output_t *output);
 EXPORT void obs_output_set_preferred_size(obs_output_t *output, uint32_t width,
 		uint32_t height);
 
+/**
+ * Sets whether raw video for this output is received on a dedicated thread
+ * rather than inline on the video-io thread, so that a slow output does not
+ * stall other outputs and encoders.  For encoded outputs this is applied to
+ * the video encoder.  Cannot be changed while the output is active.
+ */
+EXPORT void obs_output_set_dedicated_video_thread(obs_output_t *output,
+		bool dedicated);
+
+/**
+ * Returns the number of frames skipped for this output because its dedicated
+ * video thread could not keep up
+ */
+EXPORT uint32_t obs_output_get_skipped_frames(const obs_output_t *output);
+
 /** For video outputs, returns the width of the encoded image */
 EXPORT uint32_t obs_output_get_width(const obs_output_t *output);
 
@@ -1623,6 +1737,22 @@ EXPORT void obs_output_end_data_capture(obs_output_t *output);
  */
 EXPORT void obs_output_signal_stop(obs_output_t *output, int code);
 
+/**
+ * Notifies that a packet was handed to the network/disk.  Records the send
+ * stage of the frame trace and the glass to wire latency of video packets.
+ * The packet must be one the output received from libobs, or one made from
+ * it with obs_parse_avc_packet.  Safe to call from any thread.
+ */
+EXPORT void obs_output_packet_sent(obs_output_t *output,
+		const struct encoder_packet *packet);
+
+/**
+ * Returns the glass to wire latency percentile (0.0 - 1.0) of the packets
+ * sent since the output started, in microseconds
+ */
+EXPORT uint64_t obs_output_get_frame_latency(const obs_output_t *output,
+		double percentile);
+
 
 /* ------------------------------------------------------------------------- */
 /* Encoders */
@@ -1693,6 +1823,19 @@ EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 		uint32_t height);
 
+/**
+ * Sets whether a video encoder receives frames on its own thread rather than
+ * inline on the video-io thread.  If the encoder falls behind, frames are
+ * skipped for this encoder only.  If the encoder is active, this function will
+ * trigger a warning, and do nothing.
+ */
+EXPORT void obs_encoder_set_dedicated_thread(obs_encoder_t *encoder,
+		bool dedicated);
+EXPORT bool obs_encoder_dedicated_thread(const obs_encoder_t *encoder);
+
+/** For video encoders, returns the number of frames skipped on its thread */
+EXPORT uint32_t obs_encoder_get_skipped_frames(const obs_encoder_t *encoder);
+
 /** For video encoders, returns the width of the encoded image */
 EXPORT uint32_t obs_encoder_get_width(const obs_encoder_t *encoder);
 
@@ -1781,6 +1924,13 @@ EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
 		struct encoder_packet *src);
 EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
 
+/**
+ * Allocates reference counted packet data from the encoder's packet pool.
+ * Used by encoders with OBS_ENCODER_CAP_REFCOUNTED_PACKETS, which must only
+ * allocate the data when the packet is actually returned from encode.
+ */
+EXPORT uint8_t *obs_encoder_packet_alloc(obs_encoder_t *encoder, size_t size);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
@@ -0,0 +1,331 @@
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "frame-trace.h"
+#include "darray.h"
+#include "platform.h"
+#include "threading.h"
+#include "base.h"
+#include "bmem.h"
+#include "thread-buffer.h"
+
+/* records per thread, about 10 seconds of every stage at 60 fps with a few
+ * outputs active.  must be a power of two */
+#define TRACE_RING_SIZE 16384
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+
+struct trace_record {
+	uint64_t               trace_id;
+	uint64_t               ts;
+	enum frame_trace_stage stage;
+	long                   thread_idx;
+};
+
+struct trace_ring {
+	struct thread_buffer   buf;
+
+	struct trace_record records[TRACE_RING_SIZE];
+
+	/* total records written, only ever written by the owning thread */
+	volatile long          pos;
+	long                   thread_idx;
+};
+
+static volatile bool trace_enabled = false;
+
+/* once a thread exited, the next thread to record takes its ring over */
+static struct thread_buffer_list rings;
+static volatile long next_thread_idx = 0;
+
+/* bumped when the rings are freed, so threads still holding on to a ring
+ * create a new one next time they record */
+static volatile long ring_generation = 0;
+
+static THREAD_LOCAL struct trace_ring *thread_ring = NULL;
+static THREAD_LOCAL long thread_ring_generation = 0;
+
+static const char *stage_names[FRAME_TRACE_STAGE_COUNT] = {
+	"render",
+	"gpu_convert",
+	"download",
+	"video_output",
+	"encode_start",
+	"encode_end",
+	"interleave",
+	"send"
+};
+
+void frame_trace_enable(bool enable)
+{
+	os_atomic_set_bool(&trace_enabled, enable);
+}
+
+bool frame_trace_enabled(void)
+{
+	return os_atomic_load_bool(&trace_enabled);
+}
+
+const char *frame_trace_stage_name(enum frame_trace_stage stage)
+{
+	return (stage >= 0 && stage < FRAME_TRACE_STAGE_COUNT) ?
+		stage_names[stage] : "unknown";
+}
+
+/* rings of exited threads are reused rather than freed, so what they
+ * recorded stays in the dump until the new owner writes over it */
+static struct trace_ring *create_thread_ring(void)
+{
+	struct trace_ring *ring =
+		(struct trace_ring*)thread_buffer_reuse(&rings);
+
+	if (!ring) {
+		ring = bzalloc(sizeof(struct trace_ring));
+		thread_buffer_add(&rings, &ring->buf);
+	}
+
+	ring->thread_idx = os_atomic_inc_long(&next_thread_idx) - 1;
+	return ring;
+}
+
+void frame_trace_record(uint64_t trace_id, enum frame_trace_stage stage)
+{
+	struct trace_record *record;
+	long pos;
+
+	if (!trace_id || !os_atomic_load_bool(&trace_enabled))
+		return;
+
+	if (!thread_ring || thread_ring_generation !=
+			os_atomic_load_long(&ring_generation)) {
+		thread_ring_generation = os_atomic_load_long(&ring_generation);
+		thread_ring = create_thread_ring();
+	}
+
+	pos = thread_ring->pos;
+	record = &thread_ring->records[(unsigned long)pos & TRACE_RING_MASK];
+	record->trace_id   = trace_id;
+	record->ts         = os_gettime_ns();
+	record->stage      = stage;
+	record->thread_idx = thread_ring->thread_idx;
+
+	/* publish the record only after it was written */
+	os_atomic_set_long(&thread_ring->pos, pos + 1);
+}
+
+/* copies the records of a ring that were not overwritten while copying */
+static void collect_ring(struct trace_ring *ring, struct darray *out)
+{
+	unsigned long end = (unsigned long)os_atomic_load_long(&ring->pos);
+	unsigned long start = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+	size_t first = out->num;
+
+	for (unsigned long i = start; i < end; i++)
+		darray_push_back(sizeof(struct trace_record), out,
+				&ring->records[i & TRACE_RING_MASK]);
+
+	/* the owning thread may have kept writing, drop whatever it wrapped
+	 * around onto */
+	end = (unsigned long)os_atomic_load_long(&ring->pos);
+	if (end > TRACE_RING_SIZE && end - TRACE_RING_SIZE > start) {
+		size_t overwritten = end - TRACE_RING_SIZE - start;
+		if (overwritten > out->num - first)
+			overwritten = out->num - first;
+		darray_erase_range(sizeof(struct trace_record), out,
+				first, first + overwritten);
+	}
+}
+
+static int compare_records(const void *a_p, const void *b_p)
+{
+	const struct trace_record *a = a_p;
+	const struct trace_record *b = b_p;
+
+	if (a->trace_id != b->trace_id)
+		return a->trace_id < b->trace_id ? -1 : 1;
+	if (a->ts != b->ts)
+		return a->ts < b->ts ? -1 : 1;
+	return (int)a->stage - (int)b->stage;
+}
+
+bool frame_trace_dump_json(const char *path)
+{
+	DARRAY(struct trace_record) records;
+	uint64_t first_ts = UINT64_MAX;
+	bool first_event = true;
+	FILE *f;
+
+	da_init(records);
+
+	thread_buffer_lock();
+	for (size_t i = 0; i < rings.buffers.num; i++)
+		collect_ring((struct trace_ring*)rings.buffers.array[i],
+				&records.da);
+	thread_buffer_unlock();
+
+	if (records.num)
+		qsort(records.array, records.num, sizeof(struct trace_record),
+				compare_records);
+
+	for (size_t i = 0; i < records.num; i++) {
+		if (records.array[i].ts < first_ts)
+			first_ts = records.array[i].ts;
+	}
+
+	f = os_fopen(path, "wb");
+	if (!f) {
+		blog(LOG_WARNING, "frame_trace_dump_json: Failed to open "
+				"'%s'", path);
+		da_free(records);
+		return false;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	for (size_t i = 0; i < records.num; i++) {
+		struct trace_record *rec = records.array + i;
+		struct trace_record *next = i + 1 < records.num ?
+			rec + 1 : NULL;
+		double ts = (double)(rec->ts - first_ts) / 1000.0;
+
+		if (next && next->trace_id != rec->trace_id)
+			next = NULL;
+
+		fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"frame\","
+				"\"pid\":0,\"tid\":%ld,\"ts\":%.3f,",
+				first_event ? "" : ",",
+				stage_names[rec->stage], rec->thread_idx, ts);
+
+		/* the last stage of a frame has nothing to last until */
+		if (next)
+			fprintf(f, "\"ph\":\"X\",\"dur\":%.3f,",
+					(double)(next->ts - rec->ts) / 1000.0);
+		else
+			fprintf(f, "\"ph\":\"i\",\"s\":\"t\",");
+
+		fprintf(f, "\"args\":{\"frame\":%"PRIu64"}}", rec->trace_id);
+		first_event = false;
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	blog(LOG_INFO, "frame_trace_dump_json: Wrote %zu records to '%s'",
+			records.num, path);
+
+	da_free(records);
+	return true;
+}
+
+void frame_trace_free(void)
+{
+	struct thread_buffer_list old_rings = {0};
+
+	os_atomic_set_bool(&trace_enabled, false);
+
+	thread_buffer_lock();
+	da_move(old_rings.buffers, rings.buffers);
+	os_atomic_set_long(&next_thread_idx, 0);
+	os_atomic_inc_long(&ring_generation);
+	thread_buffer_unlock();
+
+	/* threads still recording keep their ring until they exit */
+	thread_buffer_list_free(&old_rings);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Latency histograms */
+
+void frame_trace_histogram_reset(struct frame_trace_histogram *hist)
+{
+	for (size_t i = 0; i < FRAME_TRACE_HISTOGRAM_BUCKETS; i++)
+		os_atomic_set_long(&hist->buckets[i], 0);
+	os_atomic_set_long(&hist->count, 0);
+	os_atomic_set_long(&hist->max_usec, 0);
+}
+
+void frame_trace_histogram_add(struct frame_trace_histogram *hist,
+		uint64_t latency_ns)
+{
+	uint64_t usec = latency_ns / 1000;
+	size_t bucket = 0;
+	long max_usec;
+
+	while (bucket < FRAME_TRACE_HISTOGRAM_BUCKETS - 1 &&
+	       usec >= (1ULL << (bucket + 1)))
+		bucket++;
+
+	if (usec > LONG_MAX)
+		usec = LONG_MAX;
+
+	os_atomic_inc_long(&hist->buckets[bucket]);
+	os_atomic_inc_long(&hist->count);
+
+	max_usec = os_atomic_load_long(&hist->max_usec);
+	while ((long)usec > max_usec) {
+		if (os_atomic_compare_swap_long(&hist->max_usec, max_usec,
+					(long)usec))
+			break;
+		max_usec = os_atomic_load_long(&hist->max_usec);
+	}
+}
+
+uint64_t frame_trace_histogram_percentile(
+		const struct frame_trace_histogram *hist, double percentile)
+{
+	long count = os_atomic_load_long(&hist->count);
+	long target;
+	long sum = 0;
+
+	if (!count)
+		return 0;
+
+	target = (long)((double)count * percentile + 0.5);
+	if (target < 1)
+		target = 1;
+
+	for (size_t i = 0; i < FRAME_TRACE_HISTOGRAM_BUCKETS - 1; i++) {
+		sum += os_atomic_load_long(&hist->buckets[i]);
+		if (sum >= target)
+			return 1ULL << (i + 1);
+	}
+
+	return (uint64_t)os_atomic_load_long(&hist->max_usec);
+}
+
+void frame_trace_histogram_log(const struct frame_trace_histogram *hist,
+		const char *name)
+{
+	long count = os_atomic_load_long(&hist->count);
+
+	if (!count)
+		return;
+
+	blog(LOG_INFO, "%s: %ld frames, latency p50 < %.1f ms, "
+			"p90 < %.1f ms, p99 < %.1f ms, max %.1f ms",
+			name, count,
+			(double)frame_trace_histogram_percentile(hist, 0.5)
+				/ 1000.0,
+			(double)frame_trace_histogram_percentile(hist, 0.9)
+				/ 1000.0,
+			(double)frame_trace_histogram_percentile(hist, 0.99)
+				/ 1000.0,
+			(double)os_atomic_load_long(&hist->max_usec) / 1000.0);
+
+	for (size_t i = 0; i < FRAME_TRACE_HISTOGRAM_BUCKETS; i++) {
+		long bucket = os_atomic_load_long(&hist->buckets[i]);
+		if (!bucket)
+			continue;
+
+		if (i == FRAME_TRACE_HISTOGRAM_BUCKETS - 1)
+			blog(LOG_INFO, "%s:   >= %.3f ms: %ld (%.1f%%)", name,
+					(double)(1ULL << i) / 1000.0, bucket,
+					(double)bucket / (double)count * 100.0);
+		else
+			blog(LOG_INFO, "%s:   < %.3f ms: %ld (%.1f%%)", name,
+					(double)(1ULL << (i + 1)) / 1000.0,
+					bucket,
+					(double)bucket / (double)count * 100.0);
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ * Per-frame pipeline tracing
+ *
+ *   Follows individual video frames from rendering to the network.  Every
+ * frame is identified by a trace id (its video timestamp, which encoder
+ * packets carry along in their packet header), and each pipeline stage
+ * records the time the frame reached it.  Records go into a per-thread ring
+ * buffer without taking any locks, and can be dumped as Chrome trace JSON
+ * (chrome://tracing) once done.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum frame_trace_stage {
+	FRAME_TRACE_RENDER,
+	FRAME_TRACE_GPU_CONVERT,
+	FRAME_TRACE_DOWNLOAD,
+	FRAME_TRACE_VIDEO_OUTPUT,
+	FRAME_TRACE_ENCODE_START,
+	FRAME_TRACE_ENCODE_END,
+	FRAME_TRACE_INTERLEAVE,
+	FRAME_TRACE_SEND,
+
+	FRAME_TRACE_STAGE_COUNT
+};
+
+EXPORT void frame_trace_enable(bool enable);
+EXPORT bool frame_trace_enabled(void);
+
+/** Records the current time for the given frame and stage.  Does nothing
+ * unless tracing is enabled or if trace_id is 0. */
+EXPORT void frame_trace_record(uint64_t trace_id,
+		enum frame_trace_stage stage);
+
+EXPORT const char *frame_trace_stage_name(enum frame_trace_stage stage);
+
+/** Writes all records still held in the ring buffers to a Chrome trace JSON
+ * file.  Each record becomes an event lasting until the next stage of the
+ * same frame. */
+EXPORT bool frame_trace_dump_json(const char *path);
+
+/** Frees the ring buffers.  Rings of threads that are still recording are
+ * freed once those threads exit. */
+EXPORT void frame_trace_free(void);
+
+/* ------------------------------------------------------------------------- */
+/* Latency histograms */
+
+/* power of two buckets in microseconds, the last one is open ended */
+#define FRAME_TRACE_HISTOGRAM_BUCKETS 24
+
+struct frame_trace_histogram {
+	volatile long buckets[FRAME_TRACE_HISTOGRAM_BUCKETS];
+	volatile long count;
+	volatile long max_usec;
+};
+
+EXPORT void frame_trace_histogram_reset(struct frame_trace_histogram *hist);
+EXPORT void frame_trace_histogram_add(struct frame_trace_histogram *hist,
+		uint64_t latency_ns);
+
+/** Returns the upper bound of the bucket containing the given percentile
+ * (0.0 - 1.0), in microseconds */
+EXPORT uint64_t frame_trace_histogram_percentile(
+		const struct frame_trace_histogram *hist, double percentile);
+
+EXPORT void frame_trace_histogram_log(const struct frame_trace_histogram *hist,
+		const char *name);
+
+#ifdef __cplusplus
+}
+#endif
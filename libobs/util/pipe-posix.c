@@ -15,6 +15,9 @@
  */
 
 #include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #include "bmem.h"
@@ -85,3 +88,58 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return fwrite(data, 1, len, pp->file);
 }
+
+#define MAX_PIPE_BUFS 16
+
+size_t os_process_pipe_write_bufs(os_process_pipe_t *pp,
+		const struct os_pipe_buf *bufs, size_t count)
+{
+	struct iovec iov[MAX_PIPE_BUFS];
+	size_t total = 0;
+	size_t written = 0;
+	size_t idx = 0;
+	int fd;
+
+	if (!pp || !bufs || count > MAX_PIPE_BUFS) {
+		return 0;
+	}
+	if (pp->read_pipe) {
+		return 0;
+	}
+
+	/* anything written with os_process_pipe_write must go out first */
+	if (fflush(pp->file) != 0) {
+		return 0;
+	}
+
+	fd = fileno(pp->file);
+
+	for (size_t i = 0; i < count; i++) {
+		iov[i].iov_base = (void*)bufs[i].data;
+		iov[i].iov_len = bufs[i].len;
+		total += bufs[i].len;
+	}
+
+	while (written < total) {
+		ssize_t ret = writev(fd, iov + idx, (int)(count - idx));
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		written += (size_t)ret;
+
+		/* skip what was written, resume partial writes mid buffer */
+		while (idx < count && (size_t)ret >= iov[idx].iov_len) {
+			ret -= (ssize_t)iov[idx].iov_len;
+			idx++;
+		}
+		if (idx < count) {
+			iov[idx].iov_base = (uint8_t*)iov[idx].iov_base + ret;
+			iov[idx].iov_len -= (size_t)ret;
+		}
+	}
+
+	return written;
+}
@@ -179,3 +179,24 @@ size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 
 	return 0;
 }
+
+size_t os_process_pipe_write_bufs(os_process_pipe_t *pp,
+		const struct os_pipe_buf *bufs, size_t count)
+{
+	size_t written = 0;
+
+	if (!bufs) {
+		return 0;
+	}
+
+	/* anonymous pipes don't support gather writes */
+	for (size_t i = 0; i < count; i++) {
+		size_t ret = os_process_pipe_write(pp, bufs[i].data,
+				bufs[i].len);
+		written += ret;
+		if (ret != bufs[i].len)
+			break;
+	}
+
+	return written;
+}
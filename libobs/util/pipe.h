@@ -29,3 +29,13 @@ EXPORT size_t os_process_pipe_read(os_process_pipe_t *pp, uint8_t *data,
 		size_t len);
 EXPORT size_t os_process_pipe_write(os_process_pipe_t *pp, const uint8_t *data,
 		size_t len);
+
+struct os_pipe_buf {
+	const uint8_t *data;
+	size_t len;
+};
+
+/* Writes several buffers in one go (a single writev where supported), and
+ * returns the total number of bytes written */
+EXPORT size_t os_process_pipe_write_bufs(os_process_pipe_t *pp,
+		const struct os_pipe_buf *bufs, size_t count);
@@ -19,6 +19,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <dirent.h>
 #include <stdlib.h>
 #include <limits.h>
@@ -146,6 +148,19 @@ bool os_sleepto_ns(uint64_t time_target)
 	if (time_target < current)
 		return false;
 
+#if !defined(__APPLE__)
+	/* os_gettime_ns uses the same clock, so sleep until the absolute
+	 * target instead of for a duration that is already stale by the time
+	 * the thread actually goes to sleep */
+	struct timespec target;
+	target.tv_sec = (time_t)(time_target / 1000000000);
+	target.tv_nsec = (long)(time_target % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target,
+				NULL) == EINTR);
+
+	return true;
+#else
 	time_target -= current;
 
 	struct timespec req, remain;
@@ -160,6 +175,7 @@ bool os_sleepto_ns(uint64_t time_target)
 	}
 
 	return true;
+#endif
 }
 
 void os_sleep_ms(uint32_t duration)
@@ -449,6 +465,72 @@ int os_safe_replace(const char *target, const char *from, const char *backup)
 	return rename(from, target);
 }
 
+struct os_mapped_file {
+	uint8_t *data;
+	size_t  size;
+};
+
+os_mapped_file_t *os_mapped_file_create_temp(const char *path, size_t size)
+{
+	struct os_mapped_file *file;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd == -1)
+		return NULL;
+
+	/* the mapping keeps the file alive, and nothing is left behind if
+	 * the process dies */
+	unlink(path);
+
+#if defined(__APPLE__)
+	if (ftruncate(fd, (off_t)size) != 0) {
+#else
+	/* writing to a mapped sparse file can't report a full disk other
+	 * than with SIGBUS, so allocate everything now */
+	if (posix_fallocate(fd, 0, (off_t)size) != 0) {
+#endif
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return NULL;
+
+	file = bmalloc(sizeof(struct os_mapped_file));
+	file->data = data;
+	file->size = size;
+	return file;
+}
+
+void os_mapped_file_destroy(os_mapped_file_t *file)
+{
+	if (file) {
+		munmap(file->data, file->size);
+		bfree(file);
+	}
+}
+
+uint8_t *os_mapped_file_data(os_mapped_file_t *file)
+{
+	return file ? file->data : NULL;
+}
+
+size_t os_mapped_file_size(os_mapped_file_t *file)
+{
+	return file ? file->size : 0;
+}
+
+void os_mapped_file_flush(os_mapped_file_t *file)
+{
+	if (file)
+		msync(file->data, file->size, MS_ASYNC);
+}
+
 #if !defined(__APPLE__)
 os_performance_token_t *os_request_high_performance(const char *reason)
 {
@@ -594,6 +594,84 @@ fail:
 	return code;
 }
 
+struct os_mapped_file {
+	HANDLE  file;
+	HANDLE  mapping;
+	uint8_t *data;
+	size_t  size;
+};
+
+os_mapped_file_t *os_mapped_file_create_temp(const char *path, size_t size)
+{
+	struct os_mapped_file *file;
+	wchar_t *w_path = NULL;
+	uint64_t size64 = size;
+
+	if (!os_utf8_to_wcs_ptr(path, 0, &w_path))
+		return NULL;
+
+	file = bzalloc(sizeof(struct os_mapped_file));
+	file->size = size;
+
+	/* not FILE_ATTRIBUTE_TEMPORARY, which keeps the data in memory for as
+	 * long as possible, while the file is there to take data out of it */
+	file->file = CreateFileW(w_path, GENERIC_READ | GENERIC_WRITE, 0, NULL,
+			CREATE_NEW,
+			FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE,
+			NULL);
+	bfree(w_path);
+
+	if (file->file == INVALID_HANDLE_VALUE)
+		goto fail;
+
+	/* extends the file to the full size, fails if the disk is full */
+	file->mapping = CreateFileMappingW(file->file, NULL, PAGE_READWRITE,
+			(DWORD)(size64 >> 32), (DWORD)size64, NULL);
+	if (!file->mapping)
+		goto fail;
+
+	file->data = MapViewOfFile(file->mapping, FILE_MAP_ALL_ACCESS, 0, 0,
+			size);
+	if (!file->data)
+		goto fail;
+
+	return file;
+
+fail:
+	os_mapped_file_destroy(file);
+	return NULL;
+}
+
+void os_mapped_file_destroy(os_mapped_file_t *file)
+{
+	if (!file)
+		return;
+
+	if (file->data)
+		UnmapViewOfFile(file->data);
+	if (file->mapping)
+		CloseHandle(file->mapping);
+	if (file->file && file->file != INVALID_HANDLE_VALUE)
+		CloseHandle(file->file);
+	bfree(file);
+}
+
+uint8_t *os_mapped_file_data(os_mapped_file_t *file)
+{
+	return file ? file->data : NULL;
+}
+
+size_t os_mapped_file_size(os_mapped_file_t *file)
+{
+	return file ? file->size : 0;
+}
+
+void os_mapped_file_flush(os_mapped_file_t *file)
+{
+	if (file)
+		FlushViewOfFile(file->data, file->size);
+}
+
 BOOL WINAPI DllMain(HINSTANCE hinst_dll, DWORD reason, LPVOID reserved)
 {
 	switch (reason) {
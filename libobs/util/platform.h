@@ -169,6 +169,27 @@ EXPORT int os_safe_replace(const char *target_path, const char *from_path,
 EXPORT char *os_generate_formatted_filename(const char *extension, bool space,
 		const char *format);
 
+struct os_mapped_file;
+typedef struct os_mapped_file os_mapped_file_t;
+
+/**
+ * Creates a new file of the given size and maps it into memory for reading
+ * and writing.  The file only backs the mapping: it is deleted once the
+ * mapping is destroyed (on some systems as soon as it is created), and it is
+ * never reused if it already exists.  Disk space for the whole file is
+ * allocated up front where the system allows it.
+ */
+EXPORT os_mapped_file_t *os_mapped_file_create_temp(const char *path,
+		size_t size);
+EXPORT void os_mapped_file_destroy(os_mapped_file_t *file);
+
+EXPORT uint8_t *os_mapped_file_data(os_mapped_file_t *file);
+EXPORT size_t os_mapped_file_size(os_mapped_file_t *file);
+
+/** Starts writing the mapped data back to disk without waiting for it, so
+ * the memory can be reclaimed sooner. */
+EXPORT void os_mapped_file_flush(os_mapped_file_t *file);
+
 struct os_inhibit_info;
 typedef struct os_inhibit_info os_inhibit_t;
 
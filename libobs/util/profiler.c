@@ -5,13 +5,12 @@
 #include "dstr.h"
 #include "platform.h"
 #include "threading.h"
+#include "thread-buffer.h"
 
 #include <math.h>
 
 #include <zlib.h>
 
-//#define TRACK_OVERHEAD
-
 struct profiler_snapshot {
 	DARRAY(profiler_snapshot_entry_t) roots;
 };
@@ -34,16 +33,9 @@ typedef struct profiler_time_entry profiler_time_entry;
 
 typedef struct profile_call profile_call;
 struct profile_call {
-	const char *name;
-#ifdef TRACK_OVERHEAD
-	uint64_t overhead_start;
-#endif
+	uint32_t id;
 	uint64_t start_time;
 	uint64_t end_time;
-#ifdef TRACK_OVERHEAD
-	uint64_t overhead_end;
-#endif
-	uint64_t expected_time_between_calls;
 	DARRAY(profile_call) children;
 	profile_call *parent;
 };
@@ -68,11 +60,9 @@ struct profile_times_table {
 
 typedef struct profile_entry profile_entry;
 struct profile_entry {
+	uint32_t id;
 	const char *name;
 	profile_times_table times;
-#ifdef TRACK_OVERHEAD
-	profile_times_table overhead;
-#endif
 	uint64_t expected_time_between_calls;
 	profile_times_table times_between_calls;
 	DARRAY(profile_entry) children;
@@ -80,10 +70,9 @@ struct profile_entry {
 
 typedef struct profile_root_entry profile_root_entry;
 struct profile_root_entry {
-	pthread_mutex_t *mutex;
-	const char *name;
+	uint32_t id;
 	profile_entry *entry;
-	profile_call *prev_call;
+	uint64_t prev_start_time;
 };
 
 static inline uint64_t diff_ns_to_usec(uint64_t prev, uint64_t next)
@@ -204,42 +193,42 @@ static void grow_hashmap(profile_times_table *map,
 	add_hashmap_entry(map, usec, count);
 }
 
-static profile_entry *init_entry(profile_entry *entry, const char *name)
+static const char *get_name(uint32_t id);
+
+static profile_entry *init_entry(profile_entry *entry, uint32_t id)
 {
-	entry->name = name;
+	entry->id = id;
+	entry->name = get_name(id);
 	init_hashmap(&entry->times, 1);
-#ifdef TRACK_OVERHEAD
-	init_hashmap(&entry->overhead, 1);
-#endif
 	entry->expected_time_between_calls = 0;
 	init_hashmap(&entry->times_between_calls, 1);
 	return entry;
 }
 
-static profile_entry *get_child(profile_entry *parent, const char *name)
+static profile_entry *get_child(profile_entry *parent, uint32_t id)
 {
 	const size_t num = parent->children.num;
 	for (size_t i = 0; i < num; i++) {
 		profile_entry *child = &parent->children.array[i];
-		if (child->name == name)
+		if (child->id == id)
 			return child;
 	}
 
-	return init_entry(da_push_back_new(parent->children), name);
+	return init_entry(da_push_back_new(parent->children), id);
 }
 
 static void merge_call(profile_entry *entry, profile_call *call,
-		profile_call *prev_call)
+		uint64_t prev_start_time)
 {
 	const size_t num = call->children.num;
 	for (size_t i = 0; i < num; i++) {
 		profile_call *child = &call->children.array[i];
-		merge_call(get_child(entry, child->name), child, NULL);
+		merge_call(get_child(entry, child->id), child, 0);
 	}
 
-	if (entry->expected_time_between_calls != 0 && prev_call) {
+	if (entry->expected_time_between_calls != 0 && prev_start_time) {
 		migrate_old_entries(&entry->times_between_calls, true);
-		uint64_t usec = diff_ns_to_usec(prev_call->start_time,
+		uint64_t usec = diff_ns_to_usec(prev_start_time,
 				call->start_time);
 		add_hashmap_entry(&entry->times_between_calls, usec, 1);
 	}
@@ -247,122 +236,453 @@ static void merge_call(profile_entry *entry, profile_call *call,
 	migrate_old_entries(&entry->times, true);
 	uint64_t usec = diff_ns_to_usec(call->start_time, call->end_time);
 	add_hashmap_entry(&entry->times, usec, 1);
-
-#ifdef TRACK_OVERHEAD
-	migrate_old_entries(&entry->overhead, true);
-	usec  = diff_ns_to_usec(call->overhead_start, call->start_time);
-	usec += diff_ns_to_usec(call->end_time, call->overhead_end);
-	add_hashmap_entry(&entry->overhead, usec, 1);
-#endif
 }
 
-static bool enabled = false;
+/* protects the merged results */
 static pthread_mutex_t root_mutex = PTHREAD_MUTEX_INITIALIZER;
 static DARRAY(profile_root_entry) root_entries;
 
-static THREAD_LOCAL profile_call *thread_context = NULL;
-static THREAD_LOCAL bool thread_enabled = true;
+static profile_root_entry *get_root_entry(uint32_t id)
+{
+	profile_root_entry *r_entry = NULL;
 
-void profiler_start(void)
+	for (size_t i = 0; i < root_entries.num; i++) {
+		if (root_entries.array[i].id == id) {
+			r_entry = &root_entries.array[i];
+			break;
+		}
+	}
+
+	if (!r_entry) {
+		r_entry = da_push_back_new(root_entries);
+		r_entry->id = id;
+		r_entry->entry = bzalloc(sizeof(profile_entry));
+		init_entry(r_entry->entry, id);
+	}
+
+	return r_entry;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Name interning
+ *
+ *   Events refer to names by a small id instead of the name pointer.  Every
+ * thread caches the ids of the names it used last, so only the first call
+ * with a name takes the lock. */
+
+#define PROFILE_NAME_CACHE_SIZE 256
+
+struct profile_name_cache_entry {
+	const char *name;
+	uint32_t id;
+};
+
+static pthread_mutex_t names_mutex = PTHREAD_MUTEX_INITIALIZER;
+static DARRAY(const char*) names;
+static uint32_t *name_table = NULL;
+static size_t name_table_size = 0;
+
+/* bumped by profiler_free, invalidates the per-thread caches and buffers */
+static volatile long profiler_generation = 0;
+
+static THREAD_LOCAL struct profile_name_cache_entry
+	thread_names[PROFILE_NAME_CACHE_SIZE];
+static THREAD_LOCAL long thread_names_generation = 0;
+
+static inline size_t hash_name(const char *name)
 {
-	pthread_mutex_lock(&root_mutex);
-	enabled = true;
-	pthread_mutex_unlock(&root_mutex);
+	uintptr_t val = (uintptr_t)name;
+	return (size_t)(val ^ (val >> 9) ^ (val >> 17));
 }
 
-void profiler_stop(void)
+static void grow_name_table(void)
 {
-	pthread_mutex_lock(&root_mutex);
-	enabled = false;
-	pthread_mutex_unlock(&root_mutex);
+	size_t size = name_table_size ? name_table_size * 2 : 64;
+	size_t mask = size - 1;
+
+	bfree(name_table);
+	name_table = bzalloc(size * sizeof(uint32_t));
+	name_table_size = size;
+
+	for (size_t id = 0; id < names.num; id++) {
+		size_t idx = hash_name(names.array[id]) & mask;
+		while (name_table[idx])
+			idx = (idx + 1) & mask;
+		name_table[idx] = (uint32_t)id + 1;
+	}
 }
 
-void profile_reenable_thread(void)
+static uint32_t intern_name(const char *name)
 {
-	if (thread_enabled)
-		return;
+	size_t mask, idx;
+	uint32_t id;
 
-	pthread_mutex_lock(&root_mutex);
-	thread_enabled = enabled;
-	pthread_mutex_unlock(&root_mutex);
+	pthread_mutex_lock(&names_mutex);
+
+	if ((names.num + 1) * 2 > name_table_size)
+		grow_name_table();
+
+	mask = name_table_size - 1;
+	idx = hash_name(name) & mask;
+
+	for (; name_table[idx]; idx = (idx + 1) & mask) {
+		id = name_table[idx] - 1;
+		if (names.array[id] == name)
+			goto done;
+	}
+
+	id = (uint32_t)names.num;
+	da_push_back(names, &name);
+	name_table[idx] = id + 1;
+
+done:
+	pthread_mutex_unlock(&names_mutex);
+	return id;
 }
 
-static bool lock_root(void)
+static uint32_t get_name_id(const char *name)
 {
-	pthread_mutex_lock(&root_mutex);
-	if (!enabled) {
-		pthread_mutex_unlock(&root_mutex);
-		thread_enabled = false;
-		return false;
+	long generation = os_atomic_load_long(&profiler_generation);
+	struct profile_name_cache_entry *entry;
+
+	if (thread_names_generation != generation) {
+		memset(thread_names, 0, sizeof(thread_names));
+		thread_names_generation = generation;
 	}
 
-	return true;
+	entry = &thread_names[hash_name(name) & (PROFILE_NAME_CACHE_SIZE - 1)];
+	if (!entry->name || entry->name != name) {
+		entry->id = intern_name(name);
+		entry->name = name;
+	}
+
+	return entry->id;
 }
 
-static profile_root_entry *get_root_entry(const char *name)
+static const char *get_name(uint32_t id)
 {
-	profile_root_entry *r_entry = NULL;
+	const char *name;
 
-	for (size_t i = 0; i < root_entries.num; i++) {
-		if (root_entries.array[i].name == name) {
-			r_entry = &root_entries.array[i];
-			break;
-		}
-	}
+	pthread_mutex_lock(&names_mutex);
+	name = id < names.num ? names.array[id] : NULL;
+	pthread_mutex_unlock(&names_mutex);
 
-	if (!r_entry) {
-		r_entry = da_push_back_new(root_entries);
-		r_entry->mutex = bmalloc(sizeof(pthread_mutex_t));
-		pthread_mutex_init(r_entry->mutex, NULL);
+	return name;
+}
 
-		r_entry->name = name;
-		r_entry->entry = bzalloc(sizeof(profile_entry));
-		init_entry(r_entry->entry, name);
+static void free_names(void)
+{
+	pthread_mutex_lock(&names_mutex);
+	da_free(names);
+	bfree(name_table);
+	name_table = NULL;
+	name_table_size = 0;
+	pthread_mutex_unlock(&names_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Per-thread event buffers
+ *
+ *   profile_start/profile_end only append an event to a ring buffer owned by
+ * the calling thread.  The aggregator (a background thread, or whoever
+ * creates a snapshot) replays the events into call trees and merges them
+ * into the results, so profiling never takes a lock or allocates on the
+ * profiled thread.  The aggregator runs every few milliseconds, or as soon
+ * as a buffer is half full.  If it still falls behind, the thread drops its
+ * events up to the end of the current root call and tells the aggregator to
+ * throw away what it has of that call. */
+
+/* must be a power of two */
+#define PROFILE_EVENTS_SIZE 8192
+#define PROFILE_EVENTS_MASK (PROFILE_EVENTS_SIZE - 1)
+
+/* nested calls deeper than this are not recorded */
+#define PROFILE_MAX_DEPTH 64
+
+#define PROFILE_AGGREGATE_INTERVAL_MS 10
+
+enum profile_event_type {
+	PROFILE_EVENT_START,
+	PROFILE_EVENT_END,
+	PROFILE_EVENT_DISCARD,
+};
+
+struct profile_event {
+	uint64_t time;
+	uint32_t id;
+	uint32_t type;
+};
+
+typedef struct profile_thread profile_thread;
+struct profile_thread {
+	struct thread_buffer buf;
+
+	struct profile_event events[PROFILE_EVENTS_SIZE];
+
+	/* events written, only written by the owning thread */
+	volatile long head;
+
+	/* events replayed, only written by the aggregator */
+	volatile long tail;
+
+	/* call currently being replayed */
+	profile_call *context;
+};
+
+static volatile bool enabled = false;
+
+/* once a thread exited, the aggregator frees its buffer after replaying what
+ * is left in it */
+static struct thread_buffer_list threads;
+
+static os_event_t *aggregate_event = NULL;
+
+static THREAD_LOCAL profile_thread *thread_events = NULL;
+static THREAD_LOCAL long thread_events_generation = 0;
+static THREAD_LOCAL const char *thread_stack[PROFILE_MAX_DEPTH];
+static THREAD_LOCAL size_t thread_depth = 0;
+static THREAD_LOCAL bool thread_dropping = false;
+static THREAD_LOCAL bool thread_enabled = true;
+
+static profile_thread *get_thread_events(void)
+{
+	long generation = os_atomic_load_long(&profiler_generation);
+
+	if (!thread_events || thread_events_generation != generation) {
+		profile_thread *thread = bzalloc(sizeof(profile_thread));
+		thread_buffer_add(&threads, &thread->buf);
+
+		thread_events = thread;
+		thread_events_generation = generation;
+		thread_dropping = false;
 	}
 
-	return r_entry;
+	return thread_events;
 }
 
-void profile_register_root(const char *name,
-		uint64_t expected_time_between_calls)
+static bool push_event(enum profile_event_type type, uint32_t id,
+		uint64_t time)
 {
-	if (!lock_root())
-		return;
+	profile_thread *thread = thread_events;
+	unsigned long head = (unsigned long)thread->head;
+	unsigned long tail = (unsigned long)os_atomic_load_long(&thread->tail);
+	struct profile_event *event;
 
-	get_root_entry(name)->entry->expected_time_between_calls =
-		(expected_time_between_calls + 500) / 1000;
-	pthread_mutex_unlock(&root_mutex);
+	if (head - tail >= PROFILE_EVENTS_SIZE)
+		return false;
+	if (head - tail == PROFILE_EVENTS_SIZE / 2 && aggregate_event)
+		os_event_signal(aggregate_event);
+
+	event = &thread->events[head & PROFILE_EVENTS_MASK];
+	event->time = time;
+	event->id   = id;
+	event->type = type;
+
+	/* publish the event only after it was written */
+	os_atomic_set_long(&thread->head, (long)(head + 1));
+	return true;
 }
 
+/* ------------------------------------------------------------------------- */
+/* Aggregation */
+
 static void free_call_context(profile_call *context);
 
 static void merge_context(profile_call *context)
 {
-	pthread_mutex_t *mutex = NULL;
-	profile_entry *entry = NULL;
-	profile_call *prev_call = NULL;
+	profile_root_entry *r_entry = get_root_entry(context->id);
 
-	if (!lock_root()) {
-		free_call_context(context);
+	merge_call(r_entry->entry, context, r_entry->prev_start_time);
+	r_entry->prev_start_time = context->start_time;
+
+	free_call_context(context);
+}
+
+static void discard_context(profile_thread *thread)
+{
+	profile_call *call = thread->context;
+	if (!call)
 		return;
+
+	while (call->parent)
+		call = call->parent;
+
+	free_call_context(call);
+	thread->context = NULL;
+}
+
+static void replay_event(profile_thread *thread,
+		const struct profile_event *event)
+{
+	profile_call *call = NULL;
+
+	switch ((enum profile_event_type)event->type) {
+	case PROFILE_EVENT_START:
+		if (thread->context)
+			call = da_push_back_new(thread->context->children);
+		else
+			call = bzalloc(sizeof(profile_call));
+
+		call->id = event->id;
+		call->start_time = event->time;
+		call->parent = thread->context;
+		thread->context = call;
+		break;
+
+	case PROFILE_EVENT_END:
+		call = thread->context;
+		if (!call)
+			break;
+
+		call->end_time = event->time;
+		thread->context = call->parent;
+
+		if (!call->parent)
+			merge_context(call);
+		break;
+
+	case PROFILE_EVENT_DISCARD:
+		discard_context(thread);
+		break;
 	}
+}
 
-	profile_root_entry *r_entry = get_root_entry(context->name);
+/* root_mutex must be locked */
+static void aggregate_events(void)
+{
+	thread_buffer_lock();
+
+	for (size_t i = 0; i < threads.buffers.num; i++) {
+		profile_thread *thread =
+			(profile_thread*)threads.buffers.array[i];
+		bool exited = thread_buffer_exited(&thread->buf);
+		unsigned long tail = (unsigned long)thread->tail;
+		unsigned long head =
+			(unsigned long)os_atomic_load_long(&thread->head);
+
+		for (; tail != head; tail++)
+			replay_event(thread,
+				&thread->events[tail & PROFILE_EVENTS_MASK]);
+
+		os_atomic_set_long(&thread->tail, (long)tail);
+
+		/* nothing is written after the exit flag, so everything the
+		 * thread recorded has been replayed now; a call it never
+		 * ended can't be completed anymore */
+		if (exited) {
+			discard_context(thread);
+			thread_buffer_erase(&threads, i--);
+		}
+	}
 
-	mutex     = r_entry->mutex;
-	entry     = r_entry->entry;
-	prev_call = r_entry->prev_call;
+	thread_buffer_unlock();
+}
 
-	r_entry->prev_call = context;
+static pthread_mutex_t aggregate_thread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t aggregate_thread;
+static bool aggregate_thread_active = false;
+static volatile bool aggregate_thread_stop = false;
 
-	pthread_mutex_lock(mutex);
-	pthread_mutex_unlock(&root_mutex);
+static void *aggregate_thread_func(void *unused)
+{
+	os_set_thread_name("profiler: aggregate");
 
-	merge_call(entry, context, prev_call);
+	while (!os_atomic_load_bool(&aggregate_thread_stop)) {
+		os_event_timedwait(aggregate_event,
+				PROFILE_AGGREGATE_INTERVAL_MS);
 
-	pthread_mutex_unlock(mutex);
+		pthread_mutex_lock(&root_mutex);
+		aggregate_events();
+		pthread_mutex_unlock(&root_mutex);
+	}
 
-	free_call_context(prev_call);
+	UNUSED_PARAMETER(unused);
+	return NULL;
+}
+
+static void start_aggregate_thread(void)
+{
+	pthread_mutex_lock(&aggregate_thread_mutex);
+
+	if (aggregate_thread_active)
+		goto done;
+
+	/* only destroyed by profiler_free, profiled threads may signal it at
+	 * any time */
+	if (!aggregate_event && os_event_init(&aggregate_event,
+				OS_EVENT_TYPE_AUTO) != 0) {
+		blog(LOG_ERROR, "Failed to create profiler aggregate event");
+		aggregate_event = NULL;
+		goto done;
+	}
+
+	os_atomic_set_bool(&aggregate_thread_stop, false);
+
+	if (pthread_create(&aggregate_thread, NULL, aggregate_thread_func,
+				NULL) != 0) {
+		blog(LOG_ERROR, "Failed to create profiler aggregate thread");
+		goto done;
+	}
+
+	aggregate_thread_active = true;
+
+done:
+	pthread_mutex_unlock(&aggregate_thread_mutex);
+}
+
+static void stop_aggregate_thread(void)
+{
+	pthread_mutex_lock(&aggregate_thread_mutex);
+
+	if (aggregate_thread_active) {
+		os_atomic_set_bool(&aggregate_thread_stop, true);
+		os_event_signal(aggregate_event);
+		pthread_join(aggregate_thread, NULL);
+		aggregate_thread_active = false;
+	}
+
+	pthread_mutex_unlock(&aggregate_thread_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Profiling */
+
+void profiler_start(void)
+{
+	os_atomic_set_bool(&enabled, true);
+	start_aggregate_thread();
+}
+
+void profiler_stop(void)
+{
+	os_atomic_set_bool(&enabled, false);
+	stop_aggregate_thread();
+}
+
+void profile_reenable_thread(void)
+{
+	if (thread_enabled)
+		return;
+
+	thread_enabled = os_atomic_load_bool(&enabled);
+}
+
+void profile_register_root(const char *name,
+		uint64_t expected_time_between_calls)
+{
+	uint32_t id;
+
+	if (!os_atomic_load_bool(&enabled)) {
+		thread_enabled = false;
+		return;
+	}
+
+	id = get_name_id(name);
+
+	pthread_mutex_lock(&root_mutex);
+	get_root_entry(id)->entry->expected_time_between_calls =
+		(expected_time_between_calls + 500) / 1000;
+	pthread_mutex_unlock(&root_mutex);
 }
 
 void profile_start(const char *name)
@@ -370,72 +690,71 @@ void profile_start(const char *name)
 	if (!thread_enabled)
 		return;
 
-	profile_call new_call = {
-		.name = name,
-#ifdef TRACK_OVERHEAD
-		.overhead_start = os_gettime_ns(),
-#endif
-		.parent = thread_context,
-	};
+	if (!thread_depth) {
+		if (!os_atomic_load_bool(&enabled)) {
+			thread_enabled = false;
+			return;
+		}
 
-	profile_call *call = NULL;
+		get_thread_events();
 
-	if (new_call.parent) {
-		size_t idx = da_push_back(new_call.parent->children, &new_call);
-		call = &new_call.parent->children.array[idx];
-	} else {
-		call = bmalloc(sizeof(profile_call));
-		memcpy(call, &new_call, sizeof(profile_call));
+		if (thread_dropping && push_event(PROFILE_EVENT_DISCARD, 0, 0))
+			thread_dropping = false;
 	}
 
-	thread_context = call;
-	call->start_time = os_gettime_ns();
+	if (thread_depth++ >= PROFILE_MAX_DEPTH)
+		return;
+
+	thread_stack[thread_depth - 1] = name;
+
+	if (!thread_dropping && !push_event(PROFILE_EVENT_START,
+				get_name_id(name), os_gettime_ns()))
+		thread_dropping = true;
+}
+
+static inline void end_call(uint64_t end)
+{
+	thread_depth--;
+
+	if (!thread_dropping && !push_event(PROFILE_EVENT_END, 0, end))
+		thread_dropping = true;
 }
 
 void profile_end(const char *name)
 {
-	uint64_t end = os_gettime_ns();
 	if (!thread_enabled)
 		return;
 
-	profile_call *call = thread_context;
-	if (!call) {
+	if (!thread_depth) {
 		blog(LOG_ERROR, "Called profile end with no active profile");
 		return;
 	}
 
-	if (!call->name)
-		call->name = name;
+	uint64_t end = os_gettime_ns();
 
-	if (call->name != name) {
+	if (thread_depth > PROFILE_MAX_DEPTH) {
+		thread_depth--;
+		return;
+	}
+
+	const char *call_name = thread_stack[thread_depth - 1];
+	if (call_name != name) {
 		blog(LOG_ERROR, "Called profile end with mismatching name: "
 				"start(\"%s\"[%p]) <-> end(\"%s\"[%p])",
-				call->name, call->name, name, name);
+				call_name, call_name, name, name);
 
-		profile_call *parent = call->parent;
-		while (parent && parent->parent &&  parent->name != name)
-			parent = parent->parent;
+		size_t depth = thread_depth - 1;
+		while (depth > 0 && thread_stack[depth - 1] != name)
+			depth--;
 
-		if (!parent || parent->name != name)
+		if (!depth)
 			return;
 
-		while (call->name != name) {
-			profile_end(call->name);
-			call = call->parent;
-		}
+		while (thread_stack[thread_depth - 1] != name)
+			end_call(end);
 	}
 
-	thread_context = call->parent;
-
-	call->end_time = end;
-#ifdef TRACK_OVERHEAD
-	call->overhead_end = os_gettime_ns();
-#endif
-
-	if (call->parent)
-		return;
-
-	merge_context(call);
+	end_call(end);
 }
 
 static int profiler_time_entry_compare(const void *first, const void *second)
@@ -790,9 +1109,6 @@ static void free_profile_entry(profile_entry *entry)
 		free_profile_entry(&entry->children.array[i]);
 
 	free_hashmap(&entry->times);
-#ifdef TRACK_OVERHEAD
-	free_hashmap(&entry->overhead);
-#endif
 	free_hashmap(&entry->times_between_calls);
 	da_free(entry->children);
 }
@@ -800,28 +1116,39 @@ static void free_profile_entry(profile_entry *entry)
 void profiler_free(void)
 {
 	DARRAY(profile_root_entry) old_root_entries = {0};
+	struct thread_buffer_list old_threads = {0};
+
+	os_atomic_set_bool(&enabled, false);
+	stop_aggregate_thread();
 
 	pthread_mutex_lock(&root_mutex);
-	enabled = false;
 	da_move(old_root_entries, root_entries);
-	pthread_mutex_unlock(&root_mutex);
 
-	for (size_t i = 0; i < old_root_entries.num; i++) {
-		profile_root_entry *entry = &old_root_entries.array[i];
+	thread_buffer_lock();
+	for (size_t i = 0; i < threads.buffers.num; i++)
+		discard_context((profile_thread*)threads.buffers.array[i]);
+	da_move(old_threads.buffers, threads.buffers);
+	os_atomic_inc_long(&profiler_generation);
+	thread_buffer_unlock();
 
-		pthread_mutex_lock(entry->mutex);
-		pthread_mutex_unlock(entry->mutex);
+	pthread_mutex_unlock(&root_mutex);
 
-		pthread_mutex_destroy(entry->mutex);
-		bfree(entry->mutex);
-		entry->mutex = NULL;
+	/* threads inside a profiled call keep writing into their buffer until
+	 * the call returns, those buffers are freed when the threads exit */
+	thread_buffer_list_free(&old_threads);
 
-		free_call_context(entry->prev_call);
+	for (size_t i = 0; i < old_root_entries.num; i++) {
+		profile_root_entry *entry = &old_root_entries.array[i];
 
 		free_profile_entry(entry->entry);
 		bfree(entry->entry);
 	}
 
+	free_names();
+
+	os_event_destroy(aggregate_event);
+	aggregate_event = NULL;
+
 	da_free(old_root_entries);
 }
 
@@ -929,13 +1256,12 @@ profiler_snapshot_t *profile_snapshot_create(void)
 	profiler_snapshot_t *snap = bzalloc(sizeof(profiler_snapshot_t));
 
 	pthread_mutex_lock(&root_mutex);
+	aggregate_events();
+
 	da_reserve(snap->roots, root_entries.num);
-	for (size_t i = 0; i < root_entries.num; i++) {
-		pthread_mutex_lock(root_entries.array[i].mutex);
+	for (size_t i = 0; i < root_entries.num; i++)
 		add_entry_to_snapshot(root_entries.array[i].entry,
 				da_push_back_new(snap->roots));
-		pthread_mutex_unlock(root_entries.array[i].mutex);
-	}
 	pthread_mutex_unlock(&root_mutex);
 
 	for (size_t i = 0; i < snap->roots.num; i++)
@@ -1062,6 +1388,103 @@ bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
 	return true;
 }
 
+static void json_cat_string(struct dstr *json, const char *str)
+{
+	dstr_cat_ch(json, '"');
+
+	for (; str && *str; str++) {
+		unsigned char ch = (unsigned char)*str;
+
+		if (ch == '"' || ch == '\\') {
+			dstr_cat_ch(json, '\\');
+			dstr_cat_ch(json, (char)ch);
+		} else if (ch < 0x20) {
+			dstr_catf(json, "\\u%04x", ch);
+		} else {
+			dstr_cat_ch(json, (char)ch);
+		}
+	}
+
+	dstr_cat_ch(json, '"');
+}
+
+static void entry_dump_json(struct dstr *json,
+		profiler_snapshot_entry_t *entry)
+{
+	uint64_t percentile99 = 0;
+	uint64_t median = 0;
+	double percent_below_expected = 0.;
+
+	gather_stats(entry->expected_time_between_calls, &entry->times,
+			entry->overall_count, &percentile99, &median,
+			&percent_below_expected);
+
+	dstr_cat(json, "{\"name\":");
+	json_cat_string(json, entry->name);
+	dstr_catf(json, ",\"count\":%"PRIu64",\"min\":%"PRIu64","
+			"\"median\":%"PRIu64",\"max\":%"PRIu64","
+			"\"percentile99\":%"PRIu64,
+			entry->overall_count, entry->overall_count ?
+				entry->min_time : 0,
+			median, entry->max_time, percentile99);
+
+	if (entry->expected_time_between_calls) {
+		uint64_t median_between = 0;
+		double percent = 0., lower = 0., higher = 0.;
+
+		gather_stats_between(&entry->times_between_calls,
+				entry->overall_between_calls_count,
+				(uint64_t)(entry->expected_time_between_calls
+					* 0.98),
+				(uint64_t)(entry->expected_time_between_calls
+					* 1.02 + 0.5),
+				entry->min_time_between_calls,
+				entry->max_time_between_calls,
+				&median_between, &percent, &lower, &higher);
+
+		/* percent_below_expected is about the time spent in the call,
+		 * the rest about the time between calls */
+		dstr_catf(json, ",\"expected_time_between_calls\":%"PRIu64
+				",\"percent_below_expected\":%g"
+				",\"percent_within_bounds\":%g"
+				",\"percent_lower\":%g"
+				",\"percent_higher\":%g"
+				",\"min_time_between_calls\":%"PRIu64
+				",\"median_time_between_calls\":%"PRIu64
+				",\"max_time_between_calls\":%"PRIu64,
+				entry->expected_time_between_calls,
+				percent_below_expected,
+				percent, lower, higher,
+				entry->overall_between_calls_count ?
+					entry->min_time_between_calls : 0,
+				median_between,
+				entry->max_time_between_calls);
+	}
+
+	dstr_cat(json, ",\"children\":[");
+	for (size_t i = 0; i < entry->children.num; i++) {
+		if (i)
+			dstr_cat_ch(json, ',');
+		entry_dump_json(json, &entry->children.array[i]);
+	}
+	dstr_cat(json, "]}");
+}
+
+char *profiler_snapshot_dump_json(profiler_snapshot_t *snap)
+{
+	struct dstr json = {0};
+
+	dstr_cat(&json, "{\"roots\":[");
+	for (size_t i = 0; snap && i < snap->roots.num; i++) {
+		if (i)
+			dstr_cat_ch(&json, ',');
+		entry_dump_json(&json, &snap->roots.array[i]);
+	}
+	dstr_cat(&json, "]}");
+
+	return json.array;
+}
+
 size_t profiler_snapshot_num_roots(profiler_snapshot_t *snap)
 {
 	return snap ? snap->roots.num : 0;
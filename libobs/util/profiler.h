@@ -17,6 +17,9 @@ typedef struct profiler_time_entry profiler_time_entry_t;
 EXPORT void profile_register_root(const char *name,
 		uint64_t expected_time_between_calls);
 
+/** Start and end of a profiled call.  Neither takes a lock: the calls are
+ * recorded into a buffer of the calling thread and merged in the
+ * background. */
 EXPORT void profile_start(const char *name);
 EXPORT void profile_end(const char *name);
 
@@ -31,6 +34,8 @@ EXPORT void profiler_stop(void);
 EXPORT void profiler_print(profiler_snapshot_t *snap);
 EXPORT void profiler_print_time_between_calls(profiler_snapshot_t *snap);
 
+/** Frees all results.  Threads must not be inside a profiled call while
+ * this is called. */
 EXPORT void profiler_free(void);
 
 /* ------------------------------------------------------------------------- */
@@ -66,6 +71,9 @@ typedef DARRAY(profiler_time_entry_t) profiler_time_entries_t;
 typedef bool (*profiler_entry_enum_func)(void *context,
 		profiler_snapshot_entry_t *entry);
 
+/** Creates a snapshot of everything profiled so far.  Can be called at any
+ * time, also while profiling; calls that were still waiting in the
+ * per-thread event buffers are merged first. */
 EXPORT profiler_snapshot_t *profile_snapshot_create(void);
 EXPORT void profile_snapshot_free(profiler_snapshot_t *snap);
 
@@ -74,6 +82,11 @@ EXPORT bool profiler_snapshot_dump_csv(const profiler_snapshot_t *snap,
 EXPORT bool profiler_snapshot_dump_csv_gz(const profiler_snapshot_t *snap,
 		const char *filename);
 
+/** Returns a summary of the snapshot as JSON (times in microseconds), for
+ * stats docks or external tools polling the profiler while it runs.  Free
+ * the result with bfree. */
+EXPORT char *profiler_snapshot_dump_json(profiler_snapshot_t *snap);
+
 EXPORT size_t profiler_snapshot_num_roots(profiler_snapshot_t *snap);
 EXPORT void profiler_snapshot_enumerate_roots(profiler_snapshot_t *snap,
 		profiler_entry_enum_func func, void *context);
@@ -0,0 +1,128 @@
+#include "thread-buffer.h"
+#include "bmem.h"
+
+static pthread_mutex_t buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* the buffers each thread owns, chained through thread_next */
+static pthread_once_t thread_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t thread_key;
+
+static void thread_exit(void *data)
+{
+	struct thread_buffer *buf = data;
+
+	pthread_mutex_lock(&buffers_mutex);
+	while (buf) {
+		struct thread_buffer *next = buf->thread_next;
+
+		buf->thread_next = NULL;
+		if (buf->list)
+			os_atomic_set_bool(&buf->exited, true);
+		else
+			bfree(buf);
+
+		buf = next;
+	}
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+static void init_thread_key(void)
+{
+	pthread_key_create(&thread_key, thread_exit);
+}
+
+/* buffers_mutex must be locked */
+static void set_thread_owner(struct thread_buffer *buf)
+{
+	pthread_once(&thread_key_once, init_thread_key);
+
+	buf->thread_next = pthread_getspecific(thread_key);
+	buf->exited = false;
+	pthread_setspecific(thread_key, buf);
+}
+
+void thread_buffer_lock(void)
+{
+	pthread_mutex_lock(&buffers_mutex);
+}
+
+void thread_buffer_unlock(void)
+{
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+void thread_buffer_add(struct thread_buffer_list *list,
+		struct thread_buffer *buf)
+{
+	pthread_mutex_lock(&buffers_mutex);
+	buf->list = list;
+	set_thread_owner(buf);
+	da_push_back(list->buffers, &buf);
+	pthread_mutex_unlock(&buffers_mutex);
+}
+
+struct thread_buffer *thread_buffer_reuse(struct thread_buffer_list *list)
+{
+	struct thread_buffer *buf = NULL;
+
+	pthread_mutex_lock(&buffers_mutex);
+	for (size_t i = 0; i < list->buffers.num; i++) {
+		if (list->buffers.array[i]->exited) {
+			buf = list->buffers.array[i];
+			set_thread_owner(buf);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&buffers_mutex);
+
+	return buf;
+}
+
+void thread_buffer_erase(struct thread_buffer_list *list, size_t idx)
+{
+	bfree(list->buffers.array[idx]);
+	da_erase(list->buffers, idx);
+}
+
+/* buffers_mutex must be locked */
+static bool unlink_own_buffer(struct thread_buffer *buf)
+{
+	struct thread_buffer *cur;
+	struct thread_buffer *prev = NULL;
+
+	pthread_once(&thread_key_once, init_thread_key);
+	cur = pthread_getspecific(thread_key);
+
+	for (; cur; prev = cur, cur = cur->thread_next) {
+		if (cur != buf)
+			continue;
+
+		if (prev)
+			prev->thread_next = cur->thread_next;
+		else
+			pthread_setspecific(thread_key, cur->thread_next);
+		return true;
+	}
+
+	return false;
+}
+
+void thread_buffer_list_free(struct thread_buffer_list *list)
+{
+	pthread_mutex_lock(&buffers_mutex);
+
+	for (size_t i = 0; i < list->buffers.num; i++) {
+		struct thread_buffer *buf = list->buffers.array[i];
+
+		/* still in use by another thread, freed when it exits */
+		if (!buf->exited && !unlink_own_buffer(buf)) {
+			buf->list = NULL;
+			continue;
+		}
+
+		bfree(buf);
+	}
+
+	da_free(list->buffers);
+	pthread_mutex_unlock(&buffers_mutex);
+}
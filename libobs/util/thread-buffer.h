@@ -0,0 +1,67 @@
+#pragma once
+
+#include "c99defs.h"
+#include "darray.h"
+#include "threading.h"
+
+/*
+ * Per-thread buffers
+ *
+ *   Buffers that a single thread writes into without locking while other
+ * threads read them, like the profiler's event buffers and the frame trace
+ * rings.  The buffer list tracks when the thread owning a buffer exits, so
+ * its owner can free or reuse the buffer once it has read what is left in
+ * it.  Freeing a list while threads may still be writing into their buffers
+ * only retires the buffers of those threads, they are freed when the
+ * threads exit.
+ *
+ *   Buffers are allocated with bmalloc/bzalloc and start with a struct
+ * thread_buffer.  The list and the buffers in it are protected by
+ * thread_buffer_lock.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct thread_buffer_list;
+
+struct thread_buffer {
+	/* NULL once the list was freed while the thread was still alive */
+	struct thread_buffer_list *list;
+	struct thread_buffer      *thread_next;
+	volatile bool             exited;
+};
+
+struct thread_buffer_list {
+	DARRAY(struct thread_buffer*) buffers;
+};
+
+EXPORT void thread_buffer_lock(void);
+EXPORT void thread_buffer_unlock(void);
+
+/** Adds a buffer to the list, owned by the calling thread */
+EXPORT void thread_buffer_add(struct thread_buffer_list *list,
+		struct thread_buffer *buf);
+
+/** Gives the calling thread a buffer of the list whose thread exited, or
+ * returns NULL if there is none.  The buffer keeps its contents. */
+EXPORT struct thread_buffer *thread_buffer_reuse(
+		struct thread_buffer_list *list);
+
+/** Removes and frees a buffer whose thread exited.  The lock must be held. */
+EXPORT void thread_buffer_erase(struct thread_buffer_list *list, size_t idx);
+
+/** Frees the buffers of the list whose threads exited or that belong to the
+ * calling thread, and retires the rest until their threads exit.  The
+ * buffers can't be used through the list anymore after this. */
+EXPORT void thread_buffer_list_free(struct thread_buffer_list *list);
+
+static inline bool thread_buffer_exited(struct thread_buffer *buf)
+{
+	return os_atomic_load_bool(&buf->exited);
+}
+
+#ifdef __cplusplus
+}
+#endif
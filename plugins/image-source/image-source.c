@@ -20,6 +20,8 @@ struct image_source {
 
 	char         *file;
 	bool         persistent;
+	bool         defer_texture;
+	uint64_t     gif_cache_limit;
 	time_t       file_timestamp;
 	float        update_time_elapsed;
 	uint64_t     last_time;
@@ -54,16 +56,22 @@ static void image_source_load(struct image_source *context)
 	if (file && *file) {
 		debug("loading texture '%s'", file);
 		context->file_timestamp = get_modified_timestamp(file);
-		gs_image_file_init(&context->image, file);
+		gs_image_file_init_limit(&context->image, file,
+				context->gif_cache_limit);
 		context->update_time_elapsed = 0;
 
-		obs_enter_graphics();
-		gs_image_file_init_texture(&context->image);
-		obs_leave_graphics();
+		/* otherwise created when first drawn */
+		if (!context->defer_texture) {
+			obs_enter_graphics();
+			gs_image_file_init_texture(&context->image);
+			obs_leave_graphics();
+		}
 
 		if (!context->image.loaded)
 			warn("failed to load texture '%s'", file);
 	}
+
+	obs_source_video_changed(context->source);
 }
 
 static void image_source_unload(struct image_source *context)
@@ -71,6 +79,8 @@ static void image_source_unload(struct image_source *context)
 	obs_enter_graphics();
 	gs_image_file_free(&context->image);
 	obs_leave_graphics();
+
+	obs_source_video_changed(context->source);
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -78,11 +88,15 @@ static void image_source_update(void *data, obs_data_t *settings)
 	struct image_source *context = data;
 	const char *file = obs_data_get_string(settings, "file");
 	const bool unload = obs_data_get_bool(settings, "unload");
+	const long long gif_cache_mb =
+		obs_data_get_int(settings, "gif_cache_limit");
 
 	if (context->file)
 		bfree(context->file);
 	context->file = bstrdup(file);
 	context->persistent = !unload;
+	context->defer_texture = obs_data_get_bool(settings, "defer_texture");
+	context->gif_cache_limit = (uint64_t)gif_cache_mb * 1024 * 1024;
 
 	/* Load the image if the source is persistent or showing */
 	if (context->persistent || obs_source_showing(context->source))
@@ -94,6 +108,8 @@ static void image_source_update(void *data, obs_data_t *settings)
 static void image_source_defaults(obs_data_t *settings)
 {
 	obs_data_set_default_bool(settings, "unload", false);
+	obs_data_set_default_int(settings, "gif_cache_limit",
+			GS_IMAGE_FILE_GIF_CACHE_DEFAULT / (1024 * 1024));
 }
 
 static void image_source_show(void *data)
@@ -148,6 +164,8 @@ static void image_source_render(void *data, gs_effect_t *effect)
 {
 	struct image_source *context = data;
 
+	if (!context->image.texture)
+		gs_image_file_init_texture(&context->image);
 	if (!context->image.texture)
 		return;
 
@@ -190,6 +208,8 @@ static void image_source_tick(void *data, float seconds)
 				obs_enter_graphics();
 				gs_image_file_update_texture(&context->image);
 				obs_leave_graphics();
+
+				obs_source_video_changed(context->source);
 			}
 
 			context->active = false;
@@ -206,6 +226,8 @@ static void image_source_tick(void *data, float seconds)
 			obs_enter_graphics();
 			gs_image_file_update_texture(&context->image);
 			obs_leave_graphics();
+
+			obs_source_video_changed(context->source);
 		}
 	}
 
@@ -243,6 +265,9 @@ static obs_properties_t *image_source_properties(void *data)
 			OBS_PATH_FILE, image_filter, path.array);
 	obs_properties_add_bool(props,
 			"unload", obs_module_text("UnloadWhenNotShowing"));
+	obs_properties_add_int(props,
+			"gif_cache_limit", obs_module_text("GifCacheLimit"),
+			16, 4096, 16);
 	dstr_free(&path);
 
 	return props;
@@ -251,7 +276,7 @@ static obs_properties_t *image_source_properties(void *data)
 static struct obs_source_info image_source_info = {
 	.id             = "image_source",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_VIDEO,
+	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_STATIC_VIDEO,
 	.get_name       = image_source_get_name,
 	.create         = image_source_create,
 	.destroy        = image_source_destroy,
@@ -1,3 +1,4 @@
+#include <inttypes.h>
 #include <obs-module.h>
 #include <util/threading.h>
 #include <util/platform.h>
@@ -18,6 +19,7 @@
 #define S_LOOP                         "loop"
 #define S_HIDE                         "hide"
 #define S_FILES                        "files"
+#define S_MEM_BUDGET                   "mem_budget"
 #define S_BEHAVIOR                     "playback_behavior"
 #define S_BEHAVIOR_STOP_RESTART        "stop_restart"
 #define S_BEHAVIOR_PAUSE_UNPAUSE       "pause_unpause"
@@ -41,6 +43,7 @@
 #define T_LOOP                         T_("Loop")
 #define T_HIDE                         T_("HideWhenDone")
 #define T_FILES                        T_("Files")
+#define T_MEM_BUDGET                   T_("MemoryBudget")
 #define T_BEHAVIOR                     T_("PlaybackBehavior")
 #define T_BEHAVIOR_STOP_RESTART        T_("PlaybackBehavior.StopRestart")
 #define T_BEHAVIOR_PAUSE_UNPAUSE       T_("PlaybackBehavior.PauseUnpause")
@@ -59,7 +62,11 @@
 
 struct image_file_data {
 	char *path;
+
+	/* NULL unless the slide is resident */
 	obs_source_t *source;
+	uint64_t mem_usage;
+	bool failed;
 };
 
 enum behavior {
@@ -88,13 +95,48 @@ struct slideshow {
 
 	float elapsed;
 	size_t cur_item;
+	size_t random_next;
+
+	/* the first slide is picked once there is something to pick from,
+	 * and switching to a slide that isn't loaded yet waits for it */
+	bool start_pending;
+	bool transition_pending;
 
 	uint32_t cx;
 	uint32_t cy;
 
+	/* largest slide loaded so far, and the custom size setting */
+	uint32_t max_cx;
+	uint32_t max_cy;
+	bool size_changed;
+	bool use_auto_size;
+	bool aspect_only;
+	int custom_cx;
+	int custom_cy;
+
 	pthread_mutex_t mutex;
 	DARRAY(struct image_file_data) files;
 
+	/* slides are loaded by the load thread.  files is built incrementally
+	 * from pending_paths (the files setting), and slides still loaded from
+	 * before the last update are kept in reuse_files until the new list is
+	 * complete.  generation is bumped whenever files is replaced */
+	pthread_t load_thread;
+	bool load_thread_active;
+	os_event_t *load_event;
+	volatile bool stop_loading;
+	DARRAY(char*) pending_paths;
+	size_t pending_pos;
+	DARRAY(struct image_file_data) reuse_files;
+	uint64_t generation;
+	bool list_complete;
+
+	/* split between the resident slides, bounds the frame cache of
+	 * animated gifs */
+	uint64_t mem_budget;
+	uint64_t mem_usage;
+	bool over_budget;
+
 	enum behavior behavior;
 
 	obs_hotkey_id play_pause_hotkey;
@@ -116,33 +158,20 @@ static obs_source_t *get_transition(struct slideshow *ss)
 	return tr;
 }
 
-static obs_source_t *get_source(struct darray *array, const char *path)
-{
-	DARRAY(struct image_file_data) files;
-	obs_source_t *source = NULL;
-
-	files.da = *array;
-
-	for (size_t i = 0; i < files.num; i++) {
-		const char *cur_path = files.array[i].path;
-
-		if (strcmp(path, cur_path) == 0) {
-			source = files.array[i].source;
-			obs_source_addref(source);
-			break;
-		}
-	}
-
-	return source;
-}
-
-static obs_source_t *create_source_from_file(const char *file)
+/* the image is decoded right away, its texture is only created once the
+ * slide is drawn */
+static obs_source_t *create_source_from_file(const char *file,
+		uint64_t gif_cache_limit)
 {
 	obs_data_t *settings = obs_data_create();
 	obs_source_t *source;
+	long long gif_cache_mb = (long long)(gif_cache_limit / (1024 * 1024));
 
 	obs_data_set_string(settings, "file", file);
 	obs_data_set_bool(settings, "unload", false);
+	obs_data_set_bool(settings, "defer_texture", true);
+	obs_data_set_int(settings, "gif_cache_limit",
+			gif_cache_mb ? gif_cache_mb : 1);
 	source = obs_source_create_private("image_source", NULL, settings);
 
 	obs_data_release(settings);
@@ -162,6 +191,17 @@ static void free_files(struct darray *array)
 	da_free(files);
 }
 
+static void free_paths(struct darray *array)
+{
+	DARRAY(char*) paths;
+	paths.da = *array;
+
+	for (size_t i = 0; i < paths.num; i++)
+		bfree(paths.array[i]);
+
+	da_free(paths);
+}
+
 static inline size_t random_file(struct slideshow *ss)
 {
 	return (size_t)rand() % ss->files.num;
@@ -175,82 +215,475 @@ static const char *ss_getname(void *unused)
 	return obs_module_text("SlideShow");
 }
 
-static void add_file(struct slideshow *ss, struct darray *array,
-		const char *path, uint32_t *cx, uint32_t *cy)
+static bool valid_extension(const char *ext)
+{
+	if (!ext)
+		return false;
+	return astrcmpi(ext, ".bmp") == 0 ||
+	       astrcmpi(ext, ".tga") == 0 ||
+	       astrcmpi(ext, ".png") == 0 ||
+	       astrcmpi(ext, ".jpeg") == 0 ||
+	       astrcmpi(ext, ".jpg") == 0 ||
+	       astrcmpi(ext, ".gif") == 0;
+}
+
+static inline bool is_gif(const char *path)
 {
-	DARRAY(struct image_file_data) new_files;
-	struct image_file_data data;
-	obs_source_t *new_source;
+	const char *ext = os_get_path_extension(path);
+	return ext && astrcmpi(ext, ".gif") == 0;
+}
 
-	new_files.da = *array;
+static inline bool item_valid(struct slideshow *ss)
+{
+	return ss->files.num && ss->cur_item < ss->files.num;
+}
+
+/* ss->mutex must be held */
+static size_t get_next_item(struct slideshow *ss)
+{
+	if (!ss->randomize || ss->files.num < 2)
+		return (ss->cur_item + 1) % ss->files.num;
+
+	/* picked ahead of time so the slide can be loaded ahead of time */
+	while (ss->random_next >= ss->files.num ||
+	       ss->random_next == ss->cur_item)
+		ss->random_next = random_file(ss);
+
+	return ss->random_next;
+}
+
+/* ss->mutex must be held */
+static inline size_t get_prev_item(struct slideshow *ss)
+{
+	return ss->cur_item ? ss->cur_item - 1 : ss->files.num - 1;
+}
+
+/* ss->mutex must be held.  only the current, next and previous slides are
+ * kept loaded */
+static inline bool item_wanted(struct slideshow *ss, size_t idx)
+{
+	if (!item_valid(ss))
+		return false;
+
+	return idx == ss->cur_item ||
+	       idx == get_next_item(ss) ||
+	       idx == get_prev_item(ss);
+}
+
+/* ss->mutex must be held */
+static void set_cur_item(struct slideshow *ss, size_t idx)
+{
+	ss->cur_item = idx;
+	if (ss->randomize && idx == ss->random_next)
+		ss->random_next = SIZE_MAX;
+
+	os_event_signal(ss->load_event);
+}
+
+/* ------------------------------------------------------------------------- */
+/* slide loading */
+
+/* ss->mutex must be held */
+static bool find_unloaded_item(struct slideshow *ss, size_t *idx)
+{
+	size_t wanted[3];
+
+	if (!item_valid(ss))
+		return false;
+
+	wanted[0] = ss->cur_item;
+	wanted[1] = get_next_item(ss);
+	wanted[2] = get_prev_item(ss);
+
+	for (size_t i = 0; i < 3; i++) {
+		struct image_file_data *item = ss->files.array + wanted[i];
+
+		if (!item->source && !item->failed) {
+			*idx = wanted[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* releases the slides that left the current, next and previous slots */
+static void evict_slides(struct slideshow *ss)
+{
+	DARRAY(obs_source_t*) released;
+
+	da_init(released);
 
 	pthread_mutex_lock(&ss->mutex);
-	new_source = get_source(&ss->files.da, path);
+
+	for (size_t i = 0; i < ss->files.num; i++) {
+		struct image_file_data *item = ss->files.array + i;
+
+		if (!item->source || item_wanted(ss, i))
+			continue;
+
+		da_push_back(released, &item->source);
+		ss->mem_usage -= item->mem_usage;
+		item->source = NULL;
+		item->mem_usage = 0;
+	}
+
+	/* the slides in use are kept anyway, but say why memory is high */
+	if (ss->mem_usage > ss->mem_budget && !ss->over_budget)
+		warn("Current, next and previous slides use %"PRIu64" MB, "
+		     "more than the memory budget",
+		     ss->mem_usage / (1024 * 1024));
+	ss->over_budget = ss->mem_usage > ss->mem_budget;
+
 	pthread_mutex_unlock(&ss->mutex);
 
-	if (!new_source)
-		new_source = get_source(&new_files.da, path);
-	if (!new_source)
-		new_source = create_source_from_file(path);
+	for (size_t i = 0; i < released.num; i++)
+		obs_source_release(released.array[i]);
+	da_free(released);
+}
 
-	if (new_source) {
-		uint32_t new_cx = obs_source_get_width(new_source);
-		uint32_t new_cy = obs_source_get_height(new_source);
+/* the current, next and previous slides share the memory budget */
+#define RESIDENT_SLIDES 3
 
-		data.path = bstrdup(path);
-		data.source = new_source;
-		da_push_back(new_files, &data);
+/* ss->mutex must be held */
+static inline uint64_t get_gif_cache_limit(struct slideshow *ss)
+{
+	return ss->mem_budget / RESIDENT_SLIDES;
+}
 
-		if (new_cx > *cx) *cx = new_cx;
-		if (new_cy > *cy) *cy = new_cy;
+/* ss->mutex must be held.  animated gifs are charged the most their frame
+ * cache can hold, on top of the first frame */
+static void add_loaded_slide(struct slideshow *ss,
+		struct image_file_data *item, obs_source_t *source)
+{
+	uint32_t cx = obs_source_get_width(source);
+	uint32_t cy = obs_source_get_height(source);
+
+	item->source = source;
+	item->mem_usage = (uint64_t)cx * (uint64_t)cy * 4;
+	if (is_gif(item->path))
+		item->mem_usage += get_gif_cache_limit(ss);
+	ss->mem_usage += item->mem_usage;
+
+	if (cx > ss->max_cx || cy > ss->max_cy) {
+		if (cx > ss->max_cx) ss->max_cx = cx;
+		if (cy > ss->max_cy) ss->max_cy = cy;
+		ss->size_changed = true;
 	}
+}
+
+static void load_wanted_slides(struct slideshow *ss)
+{
+	for (;;) {
+		obs_source_t *source;
+		uint64_t generation;
+		uint64_t gif_cache_limit;
+		char *path;
+		size_t idx;
+		bool stale;
+
+		if (os_atomic_load_bool(&ss->stop_loading))
+			break;
 
-	*array = new_files.da;
+		pthread_mutex_lock(&ss->mutex);
+		if (!find_unloaded_item(ss, &idx)) {
+			pthread_mutex_unlock(&ss->mutex);
+			break;
+		}
+		path = bstrdup(ss->files.array[idx].path);
+		generation = ss->generation;
+		gif_cache_limit = get_gif_cache_limit(ss);
+		pthread_mutex_unlock(&ss->mutex);
+
+		/* decodes the image */
+		source = create_source_from_file(path, gif_cache_limit);
+		bfree(path);
+
+		pthread_mutex_lock(&ss->mutex);
+		stale = generation != ss->generation ||
+			ss->files.array[idx].source;
+		if (!stale) {
+			struct image_file_data *item = ss->files.array + idx;
+
+			if (source)
+				add_loaded_slide(ss, item, source);
+			else
+				item->failed = true;
+		}
+		pthread_mutex_unlock(&ss->mutex);
+
+		if (stale)
+			obs_source_release(source);
+	}
+
+	evict_slides(ss);
 }
 
-static bool valid_extension(const char *ext)
+/* ss->mutex must be held.  slides that were loaded before the last update
+ * are taken over instead of being loaded again */
+static void append_file(struct slideshow *ss, char *path)
 {
-	if (!ext)
-		return false;
-	return astrcmpi(ext, ".bmp") == 0 ||
-	       astrcmpi(ext, ".tga") == 0 ||
-	       astrcmpi(ext, ".png") == 0 ||
-	       astrcmpi(ext, ".jpeg") == 0 ||
-	       astrcmpi(ext, ".jpg") == 0 ||
-	       astrcmpi(ext, ".gif") == 0;
+	struct image_file_data data = {0};
+
+	data.path = path;
+
+	for (size_t i = 0; i < ss->reuse_files.num; i++) {
+		struct image_file_data *old = ss->reuse_files.array + i;
+
+		if (strcmp(old->path, path) == 0) {
+			add_loaded_slide(ss, &data, old->source);
+			bfree(old->path);
+			da_erase(ss->reuse_files, i);
+			break;
+		}
+	}
+
+	da_push_back(ss->files, &data);
 }
 
-static inline bool item_valid(struct slideshow *ss)
+/* returns false if the list was replaced in the meantime */
+static bool append_files(struct slideshow *ss, uint64_t generation,
+		struct darray *array)
 {
-	return ss->files.num && ss->cur_item < ss->files.num;
+	DARRAY(char*) paths;
+	bool current;
+
+	paths.da = *array;
+
+	pthread_mutex_lock(&ss->mutex);
+	current = generation == ss->generation;
+	if (current) {
+		for (size_t i = 0; i < paths.num; i++)
+			append_file(ss, paths.array[i]);
+		da_resize(paths, 0);
+	}
+	pthread_mutex_unlock(&ss->mutex);
+
+	*array = paths.da;
+
+	/* the first slides become visible as soon as they're listed */
+	if (current)
+		load_wanted_slides(ss);
+	return current;
+}
+
+/* files of a folder are added this many at a time, so a large folder starts
+ * playing right away */
+#define SCAN_BATCH_SIZE 64
+
+static bool scan_folder(struct slideshow *ss, uint64_t generation,
+		os_dir_t *dir, const char *path)
+{
+	DARRAY(char*) batch;
+	struct dstr dir_path = {0};
+	struct os_dirent *ent;
+	bool current = true;
+
+	da_init(batch);
+
+	while (current && (ent = os_readdir(dir)) != NULL) {
+		const char *ext;
+
+		if (os_atomic_load_bool(&ss->stop_loading)) {
+			current = false;
+			break;
+		}
+
+		if (ent->directory)
+			continue;
+
+		ext = os_get_path_extension(ent->d_name);
+		if (!valid_extension(ext))
+			continue;
+
+		dstr_copy(&dir_path, path);
+		dstr_cat_ch(&dir_path, '/');
+		dstr_cat(&dir_path, ent->d_name);
+		da_push_back(batch, &dir_path.array);
+		dstr_init(&dir_path);
+
+		if (batch.num == SCAN_BATCH_SIZE)
+			current = append_files(ss, generation, &batch.da);
+	}
+
+	if (current && batch.num)
+		current = append_files(ss, generation, &batch.da);
+
+	free_paths(&batch.da);
+	return current;
+}
+
+/* builds the file list from the files setting, one entry at a time */
+static void scan_files(struct slideshow *ss)
+{
+	DARRAY(struct image_file_data) reuse_files;
+
+	for (;;) {
+		uint64_t generation;
+		char *path;
+		os_dir_t *dir;
+		bool current;
+
+		if (os_atomic_load_bool(&ss->stop_loading))
+			return;
+
+		pthread_mutex_lock(&ss->mutex);
+		if (ss->pending_pos == ss->pending_paths.num) {
+			pthread_mutex_unlock(&ss->mutex);
+			break;
+		}
+		path = bstrdup(ss->pending_paths.array[ss->pending_pos++]);
+		generation = ss->generation;
+		pthread_mutex_unlock(&ss->mutex);
+
+		dir = os_opendir(path);
+		if (dir) {
+			current = scan_folder(ss, generation, dir, path);
+			os_closedir(dir);
+			bfree(path);
+		} else {
+			DARRAY(char*) single;
+
+			da_init(single);
+			da_push_back(single, &path);
+			current = append_files(ss, generation, &single.da);
+			free_paths(&single.da);
+		}
+
+		if (!current)
+			return;
+	}
+
+	/* slides from before the update that are no longer in the list */
+	pthread_mutex_lock(&ss->mutex);
+	reuse_files.da = ss->reuse_files.da;
+	da_init(ss->reuse_files);
+	ss->list_complete = true;
+	pthread_mutex_unlock(&ss->mutex);
+
+	free_files(&reuse_files.da);
+}
+
+static void *load_thread(void *data)
+{
+	struct slideshow *ss = data;
+
+	os_set_thread_name("slideshow: load thread");
+
+	while (os_event_wait(ss->load_event) == 0) {
+		if (os_atomic_load_bool(&ss->stop_loading))
+			break;
+
+		scan_files(ss);
+		load_wanted_slides(ss);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/* returns a reference to the current slide, or NULL if it has to be loaded
+ * first, in which case the switch happens once it is */
+static obs_source_t *get_cur_source(struct slideshow *ss, bool *pending)
+{
+	obs_source_t *source = NULL;
+
+	pthread_mutex_lock(&ss->mutex);
+	if (item_valid(ss)) {
+		struct image_file_data *item = ss->files.array + ss->cur_item;
+
+		source = item->source;
+		obs_source_addref(source);
+		ss->transition_pending = !source && !item->failed;
+	} else {
+		ss->transition_pending = false;
+	}
+	*pending = ss->transition_pending;
+	pthread_mutex_unlock(&ss->mutex);
+
+	if (*pending)
+		os_event_signal(ss->load_event);
+
+	return source;
 }
 
 static void do_transition(void *data, bool to_null)
 {
 	struct slideshow *ss = data;
-	bool valid = item_valid(ss);
+	obs_source_t *source = NULL;
+	bool pending = false;
+	bool valid;
+
+	pthread_mutex_lock(&ss->mutex);
+	valid = item_valid(ss);
+	pthread_mutex_unlock(&ss->mutex);
+
+	if (valid && (ss->use_cut || !to_null)) {
+		source = get_cur_source(ss, &pending);
+		if (pending)
+			return;
+	}
 
 	if (valid && ss->use_cut)
-		obs_transition_set(ss->transition,
-				ss->files.array[ss->cur_item].source);
+		obs_transition_set(ss->transition, source);
 
 	else if (valid && !to_null)
 		obs_transition_start(ss->transition,
 				OBS_TRANSITION_MODE_AUTO,
 				ss->tr_speed,
-				ss->files.array[ss->cur_item].source);
+				source);
 
 	else
 		obs_transition_start(ss->transition,
 				OBS_TRANSITION_MODE_AUTO,
 				ss->tr_speed,
 				NULL);
+
+	obs_source_release(source);
+}
+
+static void update_size(struct slideshow *ss)
+{
+	uint32_t cx, cy;
+
+	pthread_mutex_lock(&ss->mutex);
+	cx = ss->max_cx;
+	cy = ss->max_cy;
+	ss->size_changed = false;
+	pthread_mutex_unlock(&ss->mutex);
+
+	if (!ss->use_auto_size) {
+		double cx_f = (double)cx;
+		double cy_f = (double)cy;
+
+		double old_aspect = cy ? cx_f / cy_f : 0.0;
+		double new_aspect = (double)ss->custom_cx /
+			(double)ss->custom_cy;
+
+		if (ss->aspect_only) {
+			if (cy && fabs(old_aspect - new_aspect) > EPSILON) {
+				if (new_aspect > old_aspect)
+					cx = (uint32_t)(cy_f * new_aspect);
+				else
+					cy = (uint32_t)(cx_f / new_aspect);
+			}
+		} else {
+			cx = (uint32_t)ss->custom_cx;
+			cy = (uint32_t)ss->custom_cy;
+		}
+	}
+
+	ss->cx = cx;
+	ss->cy = cy;
+	obs_transition_set_size(ss->transition, cx, cy);
 }
 
 static void ss_update(void *data, obs_data_t *settings)
 {
-	DARRAY(struct image_file_data) new_files;
 	DARRAY(struct image_file_data) old_files;
+	DARRAY(char*) new_paths;
+	DARRAY(char*) old_paths;
 	obs_source_t *new_tr = NULL;
 	obs_source_t *old_tr = NULL;
 	struct slideshow *ss = data;
@@ -258,8 +691,6 @@ static void ss_update(void *data, obs_data_t *settings)
 	const char *tr_name;
 	uint32_t new_duration;
 	uint32_t new_speed;
-	uint32_t cx = 0;
-	uint32_t cy = 0;
 	size_t count;
 	const char *behavior;
 	const char *mode;
@@ -267,7 +698,7 @@ static void ss_update(void *data, obs_data_t *settings)
 	/* ------------------------------------- */
 	/* get settings data */
 
-	da_init(new_files);
+	da_init(new_paths);
 
 	behavior = obs_data_get_string(settings, S_BEHAVIOR);
 
@@ -302,48 +733,37 @@ static void ss_update(void *data, obs_data_t *settings)
 	new_duration = (uint32_t)obs_data_get_int(settings, S_SLIDE_TIME);
 	new_speed = (uint32_t)obs_data_get_int(settings, S_TR_SPEED);
 
+	/* only the paths are listed here, folders are read and images are
+	 * loaded by the load thread */
 	array = obs_data_get_array(settings, S_FILES);
 	count = obs_data_array_count(array);
 
-	/* ------------------------------------- */
-	/* create new list of sources */
-
 	for (size_t i = 0; i < count; i++) {
 		obs_data_t *item = obs_data_array_item(array, i);
-		const char *path = obs_data_get_string(item, "value");
-		os_dir_t *dir = os_opendir(path);
+		char *path = bstrdup(obs_data_get_string(item, "value"));
 
-		if (dir) {
-			struct dstr dir_path = {0};
-			struct os_dirent *ent;
-
-			for (;;) {
-				const char *ext;
-
-				ent = os_readdir(dir);
-				if (!ent)
-					break;
-				if (ent->directory)
-					continue;
-
-				ext = os_get_path_extension(ent->d_name);
-				if (!valid_extension(ext))
-					continue;
-
-				dstr_copy(&dir_path, path);
-				dstr_cat_ch(&dir_path, '/');
-				dstr_cat(&dir_path, ent->d_name);
-				add_file(ss, &new_files.da, dir_path.array,
-						&cx, &cy);
-			}
+		da_push_back(new_paths, &path);
+		obs_data_release(item);
+	}
 
-			dstr_free(&dir_path);
-			os_closedir(dir);
+	/* ------------------------- */
+
+	const char *res_str = obs_data_get_string(settings, S_CUSTOM_SIZE);
+	bool aspect_only = false, use_auto = true;
+	int cx_in = 0, cy_in = 0;
+
+	if (strcmp(res_str, T_CUSTOM_SIZE_AUTO) != 0) {
+		int ret = sscanf(res_str, "%dx%d", &cx_in, &cy_in);
+		if (ret == 2) {
+			aspect_only = false;
+			use_auto = false;
 		} else {
-			add_file(ss, &new_files.da, path, &cx, &cy);
+			ret = sscanf(res_str, "%d:%d", &cx_in, &cy_in);
+			if (ret == 2) {
+				aspect_only = true;
+				use_auto = false;
+			}
 		}
-
-		obs_data_release(item);
 	}
 
 	/* ------------------------------------- */
@@ -351,8 +771,37 @@ static void ss_update(void *data, obs_data_t *settings)
 
 	pthread_mutex_lock(&ss->mutex);
 
+	/* keep whatever is loaded around until the new list is built, in case
+	 * the same files are still in it */
 	old_files.da = ss->files.da;
-	ss->files.da = new_files.da;
+	da_init(ss->files);
+	for (size_t i = 0; i < old_files.num; i++) {
+		if (old_files.array[i].source) {
+			da_push_back(ss->reuse_files, &old_files.array[i]);
+			old_files.array[i].path = NULL;
+			old_files.array[i].source = NULL;
+		}
+	}
+
+	old_paths.da = ss->pending_paths.da;
+	ss->pending_paths.da = new_paths.da;
+	ss->pending_pos = 0;
+	ss->list_complete = false;
+	ss->generation++;
+
+	ss->mem_usage = 0;
+	ss->over_budget = false;
+	ss->mem_budget = (uint64_t)obs_data_get_int(settings, S_MEM_BUDGET) *
+		1024 * 1024;
+
+	ss->max_cx = 0;
+	ss->max_cy = 0;
+	ss->use_auto_size = use_auto;
+	ss->aspect_only = aspect_only;
+	ss->custom_cx = cx_in;
+	ss->custom_cy = cy_in;
+	ss->size_changed = true;
+
 	if (new_tr) {
 		old_tr = ss->transition;
 		ss->transition = new_tr;
@@ -367,72 +816,33 @@ static void ss_update(void *data, obs_data_t *settings)
 	ss->tr_name = tr_name;
 	ss->slide_time = (float)new_duration / 1000.0f;
 
+	ss->cur_item = 0;
+	ss->random_next = SIZE_MAX;
+	ss->elapsed = 0.0f;
+	ss->start_pending = true;
+	ss->transition_pending = false;
+
 	pthread_mutex_unlock(&ss->mutex);
 
+	os_event_signal(ss->load_event);
+
 	/* ------------------------------------- */
 	/* clean up and restart transition */
 
 	if (old_tr)
 		obs_source_release(old_tr);
 	free_files(&old_files.da);
+	free_paths(&old_paths.da);
 
 	/* ------------------------- */
 
-	const char *res_str = obs_data_get_string(settings, S_CUSTOM_SIZE);
-	bool aspect_only = false, use_auto = true;
-	int cx_in = 0, cy_in = 0;
-
-	if (strcmp(res_str, T_CUSTOM_SIZE_AUTO) != 0) {
-		int ret = sscanf(res_str, "%dx%d", &cx_in, &cy_in);
-		if (ret == 2) {
-			aspect_only = false;
-			use_auto = false;
-		} else {
-			ret = sscanf(res_str, "%d:%d", &cx_in, &cy_in);
-			if (ret == 2) {
-				aspect_only = true;
-				use_auto = false;
-			}
-		}
-	}
-
-	if (!use_auto) {
-		double cx_f = (double)cx;
-		double cy_f = (double)cy;
-
-		double old_aspect = cx_f / cy_f;
-		double new_aspect = (double)cx_in / (double)cy_in;
-
-		if (aspect_only) {
-			if (fabs(old_aspect - new_aspect) > EPSILON) {
-				if (new_aspect > old_aspect)
-					cx = (uint32_t)(cy_f * new_aspect);
-				else
-					cy = (uint32_t)(cx_f / new_aspect);
-			}
-		} else {
-			cx = (uint32_t)cx_in;
-			cy = (uint32_t)cy_in;
-		}
-	}
-
-	/* ------------------------- */
-
-	ss->cx = cx;
-	ss->cy = cy;
-	ss->cur_item = 0;
-	ss->elapsed = 0.0f;
-	obs_transition_set_size(ss->transition, cx, cy);
+	update_size(ss);
 	obs_transition_set_alignment(ss->transition, OBS_ALIGN_CENTER);
 	obs_transition_set_scale_type(ss->transition,
 			OBS_TRANSITION_SCALE_ASPECT);
 
-	if (ss->randomize && ss->files.num)
-		ss->cur_item = random_file(ss);
 	if (new_tr)
 		obs_source_add_active_child(ss->source, new_tr);
-	if (ss->files.num)
-		do_transition(ss, false);
 
 	obs_data_array_release(array);
 }
@@ -448,12 +858,20 @@ static void ss_play_pause(void *data)
 static void ss_restart(void *data)
 {
 	struct slideshow *ss = data;
+	obs_source_t *source;
+	bool pending;
 
 	ss->elapsed = 0.0f;
-	ss->cur_item = 0;
 
-	obs_transition_set(ss->transition,
-			ss->files.array[ss->cur_item].source);
+	pthread_mutex_lock(&ss->mutex);
+	set_cur_item(ss, 0);
+	pthread_mutex_unlock(&ss->mutex);
+
+	source = get_cur_source(ss, &pending);
+	if (source) {
+		obs_transition_set(ss->transition, source);
+		obs_source_release(source);
+	}
 
 	ss->stop = false;
 	ss->paused = false;
@@ -464,7 +882,10 @@ static void ss_stop(void *data)
 	struct slideshow *ss = data;
 
 	ss->elapsed = 0.0f;
-	ss->cur_item = 0;
+
+	pthread_mutex_lock(&ss->mutex);
+	set_cur_item(ss, 0);
+	pthread_mutex_unlock(&ss->mutex);
 
 	do_transition(ss, true);
 	ss->stop = true;
@@ -475,11 +896,14 @@ static void ss_next_slide(void *data)
 {
 	struct slideshow *ss = data;
 
-	if (!ss->files.num)
+	pthread_mutex_lock(&ss->mutex);
+	if (!ss->files.num) {
+		pthread_mutex_unlock(&ss->mutex);
 		return;
+	}
 
-	if (++ss->cur_item >= ss->files.num)
-		ss->cur_item = 0;
+	set_cur_item(ss, (ss->cur_item + 1) % ss->files.num);
+	pthread_mutex_unlock(&ss->mutex);
 
 	do_transition(ss, false);
 }
@@ -488,13 +912,14 @@ static void ss_previous_slide(void *data)
 {
 	struct slideshow *ss = data;
 
-	if (!ss->files.num)
+	pthread_mutex_lock(&ss->mutex);
+	if (!ss->files.num) {
+		pthread_mutex_unlock(&ss->mutex);
 		return;
+	}
 
-	if (ss->cur_item == 0)
-		ss->cur_item = ss->files.num - 1;
-	else
-		--ss->cur_item;
+	set_cur_item(ss, get_prev_item(ss));
+	pthread_mutex_unlock(&ss->mutex);
 
 	do_transition(ss, false);
 }
@@ -569,8 +994,17 @@ static void ss_destroy(void *data)
 {
 	struct slideshow *ss = data;
 
+	if (ss->load_thread_active) {
+		os_atomic_set_bool(&ss->stop_loading, true);
+		os_event_signal(ss->load_event);
+		pthread_join(ss->load_thread, NULL);
+	}
+
 	obs_source_release(ss->transition);
 	free_files(&ss->files.da);
+	free_files(&ss->reuse_files.da);
+	free_paths(&ss->pending_paths.da);
+	os_event_destroy(ss->load_event);
 	pthread_mutex_destroy(&ss->mutex);
 	bfree(ss);
 }
@@ -613,6 +1047,11 @@ static void *ss_create(obs_data_t *settings, obs_source_t *source)
 	pthread_mutex_init_value(&ss->mutex);
 	if (pthread_mutex_init(&ss->mutex, NULL) != 0)
 		goto error;
+	if (os_event_init(&ss->load_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto error;
+	if (pthread_create(&ss->load_thread, NULL, load_thread, ss) != 0)
+		goto error;
+	ss->load_thread_active = true;
 
 	obs_source_update(source, NULL);
 
@@ -637,16 +1076,50 @@ static void ss_video_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+/* applies what the load thread has made possible since the last tick */
+static void update_loaded_slides(struct slideshow *ss)
+{
+	bool size_changed, start, pending;
+
+	pthread_mutex_lock(&ss->mutex);
+
+	size_changed = ss->size_changed;
+
+	/* in random order, the first slide is picked from the whole list */
+	start = ss->start_pending && ss->files.num &&
+		(!ss->randomize || ss->list_complete);
+	if (start) {
+		set_cur_item(ss, ss->randomize ? random_file(ss) : 0);
+		ss->start_pending = false;
+	}
+
+	pending = start || ss->transition_pending;
+
+	pthread_mutex_unlock(&ss->mutex);
+
+	if (size_changed)
+		update_size(ss);
+	if (pending)
+		do_transition(ss, false);
+}
+
 static void ss_video_tick(void *data, float seconds)
 {
 	struct slideshow *ss = data;
+	bool last, has_files;
 
 	if (!ss->transition || !ss->slide_time)
 		return;
 
+	update_loaded_slides(ss);
+
 	if (ss->restart_on_activate && !ss->randomize && ss->use_cut) {
 		ss->elapsed = 0.0f;
-		ss->cur_item = 0;
+
+		pthread_mutex_lock(&ss->mutex);
+		set_cur_item(ss, 0);
+		pthread_mutex_unlock(&ss->mutex);
+
 		do_transition(ss, false);
 		ss->restart_on_activate = false;
 		ss->use_cut = false;
@@ -657,9 +1130,13 @@ static void ss_video_tick(void *data, float seconds)
 	if (ss->pause_on_deactivate || ss->manual || ss->stop || ss->paused)
 		return;
 
+	pthread_mutex_lock(&ss->mutex);
+	has_files = ss->files.num != 0;
+	pthread_mutex_unlock(&ss->mutex);
+
 	/* ----------------------------------------------------- */
 	/* fade to transparency when the file list becomes empty */
-	if (!ss->files.num) {
+	if (!has_files) {
 		obs_source_t* active_transition_source =
 			obs_transition_get_active_source(ss->transition);
 
@@ -676,7 +1153,19 @@ static void ss_video_tick(void *data, float seconds)
 	if (ss->elapsed > ss->slide_time) {
 		ss->elapsed -= ss->slide_time;
 
-		if (!ss->loop && ss->cur_item == ss->files.num - 1) {
+		pthread_mutex_lock(&ss->mutex);
+
+		/* the end of the list isn't known until it's fully read */
+		has_files = ss->files.num != 0;
+		last = !ss->loop && ss->list_complete &&
+			ss->cur_item == ss->files.num - 1;
+
+		if (has_files && !last)
+			set_cur_item(ss, get_next_item(ss));
+
+		pthread_mutex_unlock(&ss->mutex);
+
+		if (last) {
 			if (ss->hide)
 				do_transition(ss, true);
 			else
@@ -685,19 +1174,7 @@ static void ss_video_tick(void *data, float seconds)
 			return;
 		}
 
-		if (ss->randomize) {
-			size_t next = ss->cur_item;
-			if (ss->files.num > 1) {
-				while (next == ss->cur_item)
-					next = random_file(ss);
-			}
-			ss->cur_item = next;
-
-		} else if (++ss->cur_item >= ss->files.num) {
-			ss->cur_item = 0;
-		}
-
-		if (ss->files.num)
+		if (has_files)
 			do_transition(ss, false);
 	}
 }
@@ -786,6 +1263,7 @@ static void ss_defaults(obs_data_t *settings)
 			S_BEHAVIOR_ALWAYS_PLAY);
 	obs_data_set_default_string(settings, S_MODE, S_MODE_AUTO);
 	obs_data_set_default_bool(settings, S_LOOP, true);
+	obs_data_set_default_int(settings, S_MEM_BUDGET, 512);
 }
 
 static const char *file_filter =
@@ -846,6 +1324,8 @@ static obs_properties_t *ss_properties(void *data)
 	obs_properties_add_bool(ppts, S_LOOP, T_LOOP);
 	obs_properties_add_bool(ppts, S_HIDE, T_HIDE);
 	obs_properties_add_bool(ppts, S_RANDOMIZE, T_RANDOMIZE);
+	obs_properties_add_int(ppts, S_MEM_BUDGET, T_MEM_BUDGET,
+			32, 16384, 32);
 
 	p = obs_properties_add_list(ppts, S_CUSTOM_SIZE, T_CUSTOM_SIZE,
 			OBS_COMBO_TYPE_EDITABLE, OBS_COMBO_FORMAT_STRING);
@@ -977,7 +977,8 @@ struct obs_source_info v4l2_input = {
 	.id             = "v4l2_input",
 	.type           = OBS_SOURCE_TYPE_INPUT,
 	.output_flags   = OBS_SOURCE_ASYNC_VIDEO |
-	                  OBS_SOURCE_DO_NOT_DUPLICATE,
+	                  OBS_SOURCE_DO_NOT_DUPLICATE |
+	                  OBS_SOURCE_OPAQUE_VIDEO,
 	.get_name       = v4l2_getname,
 	.create         = v4l2_create,
 	.destroy        = v4l2_destroy,
@@ -35,6 +35,18 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+enum write_policy {
+	/* wait for the writer, stalls the encoder when the disk can't keep up */
+	WRITE_POLICY_BLOCK,
+	/* drop packets, video until the next keyframe that fits again */
+	WRITE_POLICY_DROP
+};
+
+struct write_item {
+	struct encoder_packet packet;
+	uint64_t              queued_ns;
+};
+
 struct ffmpeg_muxer {
 	obs_output_t      *output;
 	os_process_pipe_t *pipe;
@@ -60,6 +72,28 @@ struct ffmpeg_muxer {
 	pthread_t                     mux_thread;
 	bool                          mux_thread_joinable;
 	volatile bool                 muxing;
+
+	/* writer thread, keeps pipe writes off the encoder thread */
+	pthread_t         write_thread;
+	bool              write_thread_active;
+	pthread_mutex_t   write_mutex;
+	os_sem_t          *write_sem;
+	os_event_t        *write_space_event;
+	struct circlebuf  write_queue;
+	volatile bool     write_exit;
+	volatile bool     write_failed;
+	enum write_policy write_policy;
+	size_t            write_budget;
+	bool              drop_until_keyframe;
+
+	/* writer stats */
+	size_t            queue_bytes;
+	size_t            max_queue_bytes;
+	uint64_t          written_packets;
+	uint64_t          total_latency_ns;
+	uint64_t          max_latency_ns;
+	int               dropped_packets;
+	int               dropped_frames;
 };
 
 static const char *ffmpeg_mux_getname(void *type)
@@ -96,16 +130,39 @@ static void ffmpeg_mux_destroy(void *data)
 
 	os_process_pipe_destroy(stream->pipe);
 	dstr_free(&stream->path);
+
+	circlebuf_free(&stream->write_queue);
+	pthread_mutex_destroy(&stream->write_mutex);
+	os_sem_destroy(stream->write_sem);
+	os_event_destroy(stream->write_space_event);
 	bfree(stream);
 }
 
+static void get_write_stats(void *data, calldata_t *cd);
+
 static void *ffmpeg_mux_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
+	pthread_mutex_init_value(&stream->write_mutex);
+
+	if (pthread_mutex_init(&stream->write_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&stream->write_space_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	proc_handler_t *ph = obs_output_get_proc_handler(output);
+	proc_handler_add(ph, "void get_write_stats(out int queue_bytes, "
+			"out int max_queue_bytes, out int dropped_packets, "
+			"out int avg_latency_ms, out int max_latency_ms)",
+			get_write_stats, stream);
 
 	UNUSED_PARAMETER(settings);
 	return stream;
+
+fail:
+	ffmpeg_mux_destroy(stream);
+	return NULL;
 }
 
 #ifdef _WIN32
@@ -133,6 +190,260 @@ static inline bool active(struct ffmpeg_muxer *stream)
 	return os_atomic_load_bool(&stream->active);
 }
 
+static bool write_packet(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+	size_t ret;
+
+	struct ffm_packet_info info = {
+		.pts = packet->pts,
+		.dts = packet->dts,
+		.size = (uint32_t)packet->size,
+		.index = (int)packet->track_idx,
+		.type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO,
+		.keyframe = packet->keyframe
+	};
+
+	struct os_pipe_buf bufs[2] = {
+		{(const uint8_t*)&info, sizeof(info)},
+		{packet->data, packet->size}
+	};
+
+	ret = os_process_pipe_write_bufs(stream->pipe, bufs, 2);
+	if (ret != sizeof(info) + packet->size) {
+		warn("os_process_pipe_write for packet failed");
+		return false;
+	}
+
+	stream->total_bytes += packet->size;
+	return true;
+}
+
+/* ------------------------------------------------------------------------ */
+/* writer thread */
+
+static inline void free_write_queue(struct ffmpeg_muxer *stream)
+{
+	while (stream->write_queue.size) {
+		struct write_item item;
+		circlebuf_pop_front(&stream->write_queue, &item, sizeof(item));
+		obs_encoder_packet_release(&item.packet);
+	}
+
+	stream->queue_bytes = 0;
+}
+
+static void *write_thread(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	os_set_thread_name("ffmpeg-mux: write_thread");
+
+	while (os_sem_wait(stream->write_sem) == 0) {
+		struct write_item item;
+
+		pthread_mutex_lock(&stream->write_mutex);
+		if (!stream->write_queue.size) {
+			pthread_mutex_unlock(&stream->write_mutex);
+
+			/* only exits once everything queued is written */
+			if (os_atomic_load_bool(&stream->write_exit))
+				break;
+			continue;
+		}
+		circlebuf_pop_front(&stream->write_queue, &item, sizeof(item));
+		pthread_mutex_unlock(&stream->write_mutex);
+
+		bool success = write_packet(stream, &item.packet);
+		uint64_t latency = os_gettime_ns() - item.queued_ns;
+
+		if (success)
+			obs_output_packet_sent(stream->output, &item.packet);
+
+		pthread_mutex_lock(&stream->write_mutex);
+		stream->queue_bytes -= item.packet.size;
+		stream->written_packets++;
+		stream->total_latency_ns += latency;
+		if (latency > stream->max_latency_ns)
+			stream->max_latency_ns = latency;
+		pthread_mutex_unlock(&stream->write_mutex);
+
+		obs_encoder_packet_release(&item.packet);
+
+		if (!success) {
+			/* the encoder thread signals the failure */
+			os_atomic_set_bool(&stream->write_failed, true);
+
+			pthread_mutex_lock(&stream->write_mutex);
+			free_write_queue(stream);
+			pthread_mutex_unlock(&stream->write_mutex);
+
+			os_event_signal(stream->write_space_event);
+			break;
+		}
+
+		os_event_signal(stream->write_space_event);
+	}
+
+	return NULL;
+}
+
+static bool start_write_thread(struct ffmpeg_muxer *stream)
+{
+	obs_data_t *settings = obs_output_get_settings(stream->output);
+	const char *policy = obs_data_get_string(settings,
+			"write_queue_policy");
+
+	stream->write_budget = (size_t)obs_data_get_int(settings,
+			"write_queue_size_mb") * 1024 * 1024;
+	stream->write_policy = strcmp(policy, "drop") == 0 ?
+		WRITE_POLICY_DROP : WRITE_POLICY_BLOCK;
+	obs_data_release(settings);
+
+	stream->queue_bytes = 0;
+	stream->max_queue_bytes = 0;
+	stream->written_packets = 0;
+	stream->total_latency_ns = 0;
+	stream->max_latency_ns = 0;
+	stream->dropped_packets = 0;
+	stream->dropped_frames = 0;
+	stream->drop_until_keyframe = false;
+	os_atomic_set_bool(&stream->write_exit, false);
+	os_atomic_set_bool(&stream->write_failed, false);
+
+	os_sem_destroy(stream->write_sem);
+	if (os_sem_init(&stream->write_sem, 0) != 0)
+		return false;
+
+	stream->write_thread_active = pthread_create(&stream->write_thread,
+			NULL, write_thread, stream) == 0;
+	return stream->write_thread_active;
+}
+
+static void stop_write_thread(struct ffmpeg_muxer *stream)
+{
+	if (!stream->write_thread_active)
+		return;
+
+	os_atomic_set_bool(&stream->write_exit, true);
+	os_sem_post(stream->write_sem);
+	pthread_join(stream->write_thread, NULL);
+	stream->write_thread_active = false;
+
+	/* left over only if writing failed */
+	free_write_queue(stream);
+
+	info("Writer: %llu packets, %d dropped (%d video), "
+			"max queue %llu KiB, "
+			"avg latency %llu ms, max latency %llu ms",
+			(unsigned long long)stream->written_packets,
+			stream->dropped_packets, stream->dropped_frames,
+			(unsigned long long)stream->max_queue_bytes / 1024,
+			stream->written_packets ?
+				(unsigned long long)(stream->total_latency_ns /
+				stream->written_packets / 1000000) : 0ULL,
+			(unsigned long long)stream->max_latency_ns / 1000000);
+}
+
+/* takes ownership of the packet reference */
+static bool queue_packet(struct ffmpeg_muxer *stream,
+		struct encoder_packet *packet)
+{
+	bool is_video = packet->type == OBS_ENCODER_VIDEO;
+	struct write_item item = {
+		.packet = *packet,
+		.queued_ns = os_gettime_ns()
+	};
+
+	pthread_mutex_lock(&stream->write_mutex);
+
+	if (stream->write_policy == WRITE_POLICY_DROP) {
+		bool fits = stream->queue_bytes + packet->size <=
+			stream->write_budget;
+
+		/* inter frames are useless without the frames they refer to,
+		 * so once video is dropped, skip to the next keyframe */
+		if (is_video && stream->drop_until_keyframe &&
+		    !packet->keyframe)
+			fits = false;
+
+		if (!fits) {
+			if (is_video) {
+				stream->drop_until_keyframe = true;
+				stream->dropped_frames++;
+			}
+			stream->dropped_packets++;
+			pthread_mutex_unlock(&stream->write_mutex);
+			obs_encoder_packet_release(packet);
+			return true;
+		}
+
+		if (is_video)
+			stream->drop_until_keyframe = false;
+
+	} else {
+		/* an oversized packet is still queued once the queue drains */
+		while (stream->queue_bytes &&
+		       stream->queue_bytes + packet->size >
+				stream->write_budget &&
+		       !os_atomic_load_bool(&stream->write_failed)) {
+			pthread_mutex_unlock(&stream->write_mutex);
+			os_event_wait(stream->write_space_event);
+			pthread_mutex_lock(&stream->write_mutex);
+		}
+	}
+
+	circlebuf_push_back(&stream->write_queue, &item, sizeof(item));
+	stream->queue_bytes += packet->size;
+	if (stream->queue_bytes > stream->max_queue_bytes)
+		stream->max_queue_bytes = stream->queue_bytes;
+
+	pthread_mutex_unlock(&stream->write_mutex);
+
+	os_sem_post(stream->write_sem);
+	return true;
+}
+
+static void get_write_stats(void *data, calldata_t *cd)
+{
+	struct ffmpeg_muxer *stream = data;
+
+	pthread_mutex_lock(&stream->write_mutex);
+	calldata_set_int(cd, "queue_bytes", (long long)stream->queue_bytes);
+	calldata_set_int(cd, "max_queue_bytes",
+			(long long)stream->max_queue_bytes);
+	calldata_set_int(cd, "dropped_packets", stream->dropped_packets);
+	calldata_set_int(cd, "avg_latency_ms", stream->written_packets ?
+			(long long)(stream->total_latency_ns /
+			stream->written_packets / 1000000) : 0);
+	calldata_set_int(cd, "max_latency_ms",
+			(long long)(stream->max_latency_ns / 1000000));
+	pthread_mutex_unlock(&stream->write_mutex);
+}
+
+/* headers are written through the writer as well when it's running, so they
+ * stay ordered before the packets */
+static bool send_header_packet(struct ffmpeg_muxer *stream,
+		obs_encoder_t *encoder, struct encoder_packet *packet)
+{
+	struct encoder_packet copy = *packet;
+
+	if (!stream->write_thread_active)
+		return write_packet(stream, packet);
+
+	/* the extra data belongs to the encoder, queue a ref-counted copy */
+	copy.data = obs_encoder_packet_alloc(encoder, packet->size);
+	if (!copy.data)
+		return false;
+	if (packet->size)
+		memcpy(copy.data, packet->data, packet->size);
+
+	return queue_packet(stream, &copy);
+}
+
+/* ------------------------------------------------------------------------ */
+
 /* TODO: allow codecs other than h264 whenever we start using them */
 
 static void add_video_encoder_params(struct ffmpeg_muxer *stream,
@@ -311,6 +622,13 @@ static bool ffmpeg_mux_start(void *data)
 		return false;
 	}
 
+	if (!start_write_thread(stream)) {
+		warn("Failed to create writer thread");
+		os_process_pipe_destroy(stream->pipe);
+		stream->pipe = NULL;
+		return false;
+	}
+
 	/* write headers and start capture */
 	os_atomic_set_bool(&stream->active, true);
 	os_atomic_set_bool(&stream->capturing, true);
@@ -326,6 +644,9 @@ static int deactivate(struct ffmpeg_muxer *stream)
 	int ret = -1;
 
 	if (active(stream)) {
+		/* flush everything queued before closing the pipe */
+		stop_write_thread(stream);
+
 		ret = os_process_pipe_destroy(stream->pipe);
 		stream->pipe = NULL;
 
@@ -367,40 +688,6 @@ static void signal_failure(struct ffmpeg_muxer *stream)
 	os_atomic_set_bool(&stream->capturing, false);
 }
 
-static bool write_packet(struct ffmpeg_muxer *stream,
-		struct encoder_packet *packet)
-{
-	bool is_video = packet->type == OBS_ENCODER_VIDEO;
-	size_t ret;
-
-	struct ffm_packet_info info = {
-		.pts = packet->pts,
-		.dts = packet->dts,
-		.size = (uint32_t)packet->size,
-		.index = (int)packet->track_idx,
-		.type = is_video ? FFM_PACKET_VIDEO : FFM_PACKET_AUDIO,
-		.keyframe = packet->keyframe
-	};
-
-	ret = os_process_pipe_write(stream->pipe, (const uint8_t*)&info,
-			sizeof(info));
-	if (ret != sizeof(info)) {
-		warn("os_process_pipe_write for info structure failed");
-		signal_failure(stream);
-		return false;
-	}
-
-	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
-	if (ret != packet->size) {
-		warn("os_process_pipe_write for packet data failed");
-		signal_failure(stream);
-		return false;
-	}
-
-	stream->total_bytes += packet->size;
-	return true;
-}
-
 static bool send_audio_headers(struct ffmpeg_muxer *stream,
 		obs_encoder_t *aencoder, size_t idx)
 {
@@ -411,7 +698,7 @@ static bool send_audio_headers(struct ffmpeg_muxer *stream,
 	};
 
 	obs_encoder_get_extra_data(aencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return send_header_packet(stream, aencoder, &packet);
 }
 
 static bool send_video_headers(struct ffmpeg_muxer *stream)
@@ -424,7 +711,7 @@ static bool send_video_headers(struct ffmpeg_muxer *stream)
 	};
 
 	obs_encoder_get_extra_data(vencoder, &packet.data, &packet.size);
-	return write_packet(stream, &packet);
+	return send_header_packet(stream, vencoder, &packet);
 }
 
 static bool send_headers(struct ffmpeg_muxer *stream)
@@ -451,13 +738,21 @@ static bool send_headers(struct ffmpeg_muxer *stream)
 static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
+	struct encoder_packet pkt;
 
 	if (!active(stream))
 		return;
 
+	if (os_atomic_load_bool(&stream->write_failed)) {
+		signal_failure(stream);
+		return;
+	}
+
 	if (!stream->sent_headers) {
-		if (!send_headers(stream))
+		if (!send_headers(stream)) {
+			signal_failure(stream);
 			return;
+		}
 
 		stream->sent_headers = true;
 	}
@@ -469,7 +764,8 @@ static void ffmpeg_mux_data(void *data, struct encoder_packet *packet)
 		}
 	}
 
-	write_packet(stream, packet);
+	obs_encoder_packet_ref(&pkt, packet);
+	queue_packet(stream, &pkt);
 }
 
 static obs_properties_t *ffmpeg_mux_properties(void *unused)
@@ -490,6 +786,18 @@ static uint64_t ffmpeg_mux_total_bytes(void *data)
 	return stream->total_bytes;
 }
 
+static int ffmpeg_mux_dropped_frames(void *data)
+{
+	struct ffmpeg_muxer *stream = data;
+	return stream->dropped_frames;
+}
+
+static void ffmpeg_mux_defaults(obs_data_t *s)
+{
+	obs_data_set_default_int(s, "write_queue_size_mb", 64);
+	obs_data_set_default_string(s, "write_queue_policy", "block");
+}
+
 struct obs_output_info ffmpeg_muxer = {
 	.id             = "ffmpeg_muxer",
 	.flags          = OBS_OUTPUT_AV |
@@ -502,6 +810,8 @@ struct obs_output_info ffmpeg_muxer = {
 	.stop           = ffmpeg_mux_stop,
 	.encoded_packet = ffmpeg_mux_data,
 	.get_total_bytes= ffmpeg_mux_total_bytes,
+	.get_dropped_frames = ffmpeg_mux_dropped_frames,
+	.get_defaults   = ffmpeg_mux_defaults,
 	.get_properties = ffmpeg_mux_properties
 };
 
@@ -543,6 +853,7 @@ static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
 	UNUSED_PARAMETER(settings);
 	struct ffmpeg_muxer *stream = bzalloc(sizeof(*stream));
 	stream->output = output;
+	pthread_mutex_init_value(&stream->write_mutex);
 
 	stream->hotkey = obs_hotkey_register_output(output,
 			"ReplayBuffer.Save",
@@ -698,13 +1009,21 @@ static void *replay_buffer_mux_thread(void *data)
 
 	for (size_t i = 0; i < stream->mux_packets.num; i++) {
 		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
+		if (!write_packet(stream, pkt)) {
+			warn("Could not write replay buffer to '%s'",
+					stream->path.array);
+			goto error;
+		}
 		obs_encoder_packet_release(pkt);
 	}
 
 	info("Wrote replay buffer to '%s'", stream->path.array);
 
 error:
+	/* already released packets are zeroed, releasing them is a no-op */
+	for (size_t i = 0; i < stream->mux_packets.num; i++)
+		obs_encoder_packet_release(&stream->mux_packets.array[i]);
+
 	os_process_pipe_destroy(stream->pipe);
 	stream->pipe = NULL;
 	da_free(stream->mux_packets);
@@ -2,16 +2,33 @@
 #include "rtc_base/timeutils.h"
 #include "obs.h"
 #include "media-io/audio-io.h"
+#include "util/platform.h"
+#include "util/threading.h"
+
+#include <algorithm>
+#include <string.h>
 
 AudioDeviceModuleWrapper::AudioDeviceModuleWrapper() :
-	_initialized(false)
+	_initialized(false),
+	audioTransport(nullptr),
+	channels(2),
+	sampleRate(48000),
+	frameSize(0),
+	chunkFrames(0),
+	ringFrames(0),
+	writePos(0),
+	readPos(0),
+	pacing(false),
+	primed(false),
+	underruns(0),
+	overruns(0)
 {
-	pendingLength = 0;
 }
 
 
 AudioDeviceModuleWrapper::~AudioDeviceModuleWrapper()
 {
+	stopPacing();
 }
 
 
@@ -37,6 +54,7 @@ int32_t AudioDeviceModuleWrapper::Terminate()
 	if (!_initialized)
 		return 0;
 
+	stopPacing();
 	_initialized = false;
 	return 0;
 }
@@ -51,56 +69,151 @@ bool AudioDeviceModuleWrapper::Initialized() const
 }
 
 
-void AudioDeviceModuleWrapper::onIncomingData(uint8_t* data, size_t samples_per_channel)
+// ----------------------------------------------------------------------------
+//  Pacing
+// ----------------------------------------------------------------------------
+
+bool AudioDeviceModuleWrapper::startPacing(size_t channels, uint32_t sampleRate)
 {
-	_critSect.Enter();
-	if (!audioTransport)
-		return;
-	_critSect.Leave();
-
-	//Get audio
-	audio_t *audio = obs_get_audio();
-	//This info is set on the stream before starting capture
-	size_t channels = 2;
-	size_t sample_rate = 48000;
-	size_t sample_size = 2;
-	//Get chunk for 10ms
-	size_t chunk = (sample_rate / 100);
-
-	size_t i = 0;
-	uint32_t level;
-
-	//Check if we had pending
-	if (pendingLength)
-	{
-		//Copy the missing ones
-		i = chunk - pendingLength;
-		//Copy 
-		memcpy(pending + pendingLength*sample_size*channels, data, i*sample_size*channels);
-
-		//Add sent
-		audioTransport->RecordedDataIsAvailable(pending, chunk, sample_size*channels, channels, sample_rate, 0, 0, 0, 0, level);
-
-		//No pending
-		pendingLength = 0;
+	//WebRTC records mono or stereo in 10ms chunks
+	if (channels < 1 || channels > 2 || sampleRate < 8000 ||
+	    sampleRate > 48000 || sampleRate % 100) {
+		blog(LOG_ERROR, "webrtc: unsupported audio format %u channels "
+				"%u Hz", (unsigned)channels, sampleRate);
+		return false;
 	}
 
-	//Send all full chunks possible
-	while ( i + chunk < samples_per_channel)
-	{
-		//Send them
-		audioTransport->RecordedDataIsAvailable(data + i*sample_size*channels, chunk, sample_size*channels, channels, sample_rate, 0, 0, 0, 0, level);
-		//Inc sent
-		i += chunk;
-	}
+	stopPacing();
+
+	this->channels = channels;
+	this->sampleRate = sampleRate;
+	frameSize = channels * sizeof(int16_t);
+	chunkFrames = sampleRate / 100;
+
+	//Half a second of audio, rounded up to a power of two
+	ringFrames = 1;
+	while (ringFrames < sampleRate / 2)
+		ringFrames <<= 1;
+
+	ring.reset(new uint8_t[ringFrames * frameSize]);
+	chunk.reset(new uint8_t[chunkFrames * frameSize]);
+	writePos = 0;
+	readPos = 0;
+	underruns = 0;
+	overruns = 0;
+	primed = false;
+
+	pacing = true;
+	pacingThread = std::thread(&AudioDeviceModuleWrapper::pacingLoop, this);
+	return true;
+}
 
-	//If there are mising ones
-	if (i != samples_per_channel)
-	{
-		//Calcualte pending
-		pendingLength = samples_per_channel - i;
-		//Copy to pending buffer
-		memcpy(pending, data + i*sample_size*channels, pendingLength*sample_size*channels);
+void AudioDeviceModuleWrapper::stopPacing()
+{
+	if (!pacingThread.joinable())
+		return;
+
+	pacing = false;
+	pacingThread.join();
+
+	blog(LOG_INFO, "webrtc: audio pacing stopped, %llu underruns, "
+			"%llu samples dropped",
+			(unsigned long long)underruns.load(),
+			(unsigned long long)overruns.load());
+}
+
+size_t AudioDeviceModuleWrapper::ringAvailable() const
+{
+	return (size_t)(writePos.load(std::memory_order_acquire) -
+			readPos.load(std::memory_order_relaxed));
+}
+
+void AudioDeviceModuleWrapper::deliverChunk()
+{
+	uint64_t pos = readPos.load(std::memory_order_relaxed);
+	size_t offset = (size_t)(pos & (ringFrames - 1));
+	size_t first = std::min(chunkFrames, ringFrames - offset);
+	uint32_t level = 0;
+
+	memcpy(chunk.get(), ring.get() + offset * frameSize, first * frameSize);
+	if (first < chunkFrames)
+		memcpy(chunk.get() + first * frameSize, ring.get(),
+				(chunkFrames - first) * frameSize);
+
+	readPos.store(pos + chunkFrames, std::memory_order_release);
+
+	rtc::CritScope scope(&_critSect);
+	if (audioTransport)
+		audioTransport->RecordedDataIsAvailable(chunk.get(),
+				chunkFrames, frameSize, channels, sampleRate,
+				0, 0, 0, false, level);
+}
+
+void AudioDeviceModuleWrapper::pacingLoop()
+{
+	const uint64_t interval = 10000000;
+	uint64_t deadline = os_gettime_ns();
+
+	os_set_thread_name("webrtc: audio pacing");
+
+	while (pacing) {
+		deadline += interval;
+
+		//Don't try to catch up after a long stall, just resync
+		if (!os_sleepto_ns(deadline) &&
+		    os_gettime_ns() - deadline > interval * 10)
+			deadline = os_gettime_ns();
+
+		size_t available = ringAvailable();
+
+		//Wait for two chunks before (re)starting, so libobs audio
+		//packets not aligned to 10ms don't cause constant underruns
+		if (!primed) {
+			if (available < chunkFrames * 2)
+				continue;
+			primed = true;
+		}
+
+		if (available < chunkFrames) {
+			underruns++;
+			primed = false;
+			continue;
+		}
+
+		deliverChunk();
+		available -= chunkFrames;
+
+		//Drain the excess if too much latency built up
+		while (available > ringFrames / 4) {
+			deliverChunk();
+			available -= chunkFrames;
+		}
 	}
 }
 
+void AudioDeviceModuleWrapper::onIncomingData(uint8_t* data, size_t samples_per_channel)
+{
+	if (!pacing)
+		return;
+
+	uint64_t pos = writePos.load(std::memory_order_relaxed);
+	size_t space = ringFrames - (size_t)(pos -
+			readPos.load(std::memory_order_acquire));
+	size_t frames = samples_per_channel;
+
+	//Never wait for the consumer, drop what doesn't fit
+	if (frames > space) {
+		overruns += frames - space;
+		frames = space;
+	}
+
+	size_t offset = (size_t)(pos & (ringFrames - 1));
+	size_t first = std::min(frames, ringFrames - offset);
+
+	memcpy(ring.get() + offset * frameSize, data, first * frameSize);
+	if (first < frames)
+		memcpy(ring.get(), data + first * frameSize,
+				(frames - first) * frameSize);
+
+	writePos.store(pos + frames, std::memory_order_release);
+}
@@ -2,6 +2,9 @@
 #define _AUDIO_DEVICE_MODULE_WRAPPER_H_
 
 #include <stdio.h>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #include "modules/audio_device/audio_device_generic.h"
 #include "rtc_base/refcountedobject.h"
@@ -39,6 +42,7 @@ public:
 	// Full-duplex transportation of PCM audio
 	virtual int32_t RegisterAudioCallback(AudioTransport* audioTransport)
 	{
+		rtc::CritScope scope(&_critSect);
 		this->audioTransport = audioTransport;
 		return 0;
 	}
@@ -171,14 +175,50 @@ public:
 	virtual int32_t EnableBuiltInNS(bool enable) { return 0; }
 
 
+	// Starts delivering 16 bit interleaved audio of the given format to
+	// WebRTC in 10ms chunks from a dedicated pacing thread
+	bool startPacing(size_t channels, uint32_t sampleRate);
+	void stopPacing();
+
+	// Called from the libobs audio thread, never blocks nor allocates
 	void onIncomingData(uint8_t* data, size_t samples_per_channel);
 
+	// Ticks with not enough buffered audio to send a chunk
+	uint64_t getUnderruns() const { return underruns; }
+	// Samples per channel dropped because the ring buffer was full
+	uint64_t getOverruns() const { return overruns; }
+
+private:
+	size_t ringAvailable() const;
+	void pacingLoop();
+	void deliverChunk();
+
 public:
 	bool _initialized;
 	rtc::CriticalSection _critSect;
 	AudioTransport* audioTransport;
-	uint8_t pending[640 * 2 * 2];
-	size_t pendingLength;
+
+private:
+	//Audio format
+	size_t channels;
+	uint32_t sampleRate;
+	size_t frameSize;
+	size_t chunkFrames;
+
+	//Single producer (libobs audio thread), single consumer (pacing
+	//thread) ring buffer, positions are in frames and only ever grow
+	std::unique_ptr<uint8_t[]> ring;
+	size_t ringFrames;
+	std::atomic<uint64_t> writePos;
+	std::atomic<uint64_t> readPos;
+	std::unique_ptr<uint8_t[]> chunk;
+
+	std::thread pacingThread;
+	std::atomic<bool> pacing;
+	bool primed;
+
+	std::atomic<uint64_t> underruns;
+	std::atomic<uint64_t> overruns;
 };
 
 #endif
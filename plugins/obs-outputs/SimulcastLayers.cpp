@@ -0,0 +1,289 @@
+#include "SimulcastLayers.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <sstream>
+
+#include <util/threading.h>
+#include <libyuv.h>
+
+//Frames waiting to be scaled, each one is held in the libobs frame cache
+#define MAX_QUEUED_JOBS 1
+//Pooled I420 buffers per layer, in use by the WebRTC encoder or being filled
+#define MAX_LAYER_BUFFERS 3
+
+SimulcastLayers::SimulcastLayers() :
+	video(nullptr),
+	format(VIDEO_FORMAT_NV12),
+	width(0),
+	height(0),
+	running(false),
+	dropped(0)
+{
+}
+
+SimulcastLayers::~SimulcastLayers()
+{
+	stop();
+}
+
+bool SimulcastLayers::addLayer(uint8_t downscale, uint8_t downrate)
+{
+	if (!downscale || !downrate)
+		return false;
+
+	std::unique_ptr<Layer> layer(new Layer());
+	layer->downscale = downscale;
+	layer->downrate = downrate;
+	layer->width = 0;
+	layer->height = 0;
+	layer->capture = new VideoCapture();
+	layers.push_back(std::move(layer));
+	return true;
+}
+
+bool SimulcastLayers::addLayers(const std::string &config)
+{
+	std::istringstream list(config);
+	std::string item;
+	bool added = false;
+
+	while (std::getline(list, item, ',')) {
+		int downscale = 0;
+		int downrate = 1;
+
+		if (sscanf(item.c_str(), "%d:%d", &downscale, &downrate) < 1)
+			continue;
+		if (downscale < 1 || downscale > 255 ||
+		    downrate < 1 || downrate > 255)
+			continue;
+
+		added |= addLayer((uint8_t)downscale, (uint8_t)downrate);
+	}
+
+	return added;
+}
+
+void SimulcastLayers::clear()
+{
+	stop();
+	layers.clear();
+}
+
+void SimulcastLayers::start(video_t *video, enum video_format format,
+		int width, int height)
+{
+	stop();
+
+	this->video = video;
+	this->format = format;
+	this->width = width;
+	this->height = height;
+	dropped = 0;
+
+	for (auto &layer : layers) {
+		//Keep chroma planes aligned to full pixels
+		layer->width = std::max(2, (width / layer->downscale) & ~1);
+		layer->height = std::max(2, (height / layer->downscale) & ~1);
+		layer->pool.reset(new webrtc::I420BufferPool(false,
+				MAX_LAYER_BUFFERS));
+	}
+
+	if (layers.empty())
+		return;
+
+	running = true;
+	thread = std::thread(&SimulcastLayers::run, this);
+}
+
+void SimulcastLayers::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!running)
+			return;
+		running = false;
+	}
+
+	cv.notify_all();
+	thread.join();
+
+	for (auto &job : queue)
+		releaseJob(job);
+	queue.clear();
+}
+
+void SimulcastLayers::onVideoFrame(const video_data *frame,
+		const rtc::scoped_refptr<webrtc::VideoFrameBuffer> &buffer,
+		uint32_t picId, int64_t timestampUs)
+{
+	uint32_t layerMask = 0;
+
+	for (size_t i = 0; i < layers.size(); i++) {
+		if ((picId % layers[i]->downrate) == 0)
+			layerMask |= 1 << i;
+	}
+
+	if (!layerMask)
+		return;
+
+	std::unique_lock<std::mutex> lock(mutex);
+
+	if (!running)
+		return;
+
+	//Never block the video thread, drop the layer frames instead
+	if (queue.size() >= MAX_QUEUED_JOBS) {
+		dropped++;
+		return;
+	}
+
+	Job job;
+	job.frame = *frame;
+	job.layerMask = layerMask;
+	job.timestampUs = timestampUs;
+	job.held = video_output_ref_frame(video, frame);
+
+	//If the frame could not be held, scale from the converted main frame
+	if (!job.held) {
+		if (buffer->type() == webrtc::VideoFrameBuffer::Type::kNative) {
+			dropped++;
+			return;
+		}
+		job.i420 = buffer->ToI420();
+	}
+
+	queue.push_back(job);
+	lock.unlock();
+
+	cv.notify_one();
+}
+
+void SimulcastLayers::releaseJob(Job &job)
+{
+	if (job.held)
+		video_output_release_frame(video, &job.frame);
+	job.held = false;
+	job.i420 = nullptr;
+}
+
+void SimulcastLayers::run()
+{
+	os_set_thread_name("webrtc: simulcast layers");
+
+	for (;;) {
+		Job job;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.wait(lock, [this] {
+				return !running || !queue.empty();
+			});
+
+			if (!running)
+				break;
+
+			job = queue.front();
+			queue.erase(queue.begin());
+		}
+
+		process(job);
+		releaseJob(job);
+	}
+}
+
+void SimulcastLayers::process(Job &job)
+{
+	if (!job.i420 && format == VIDEO_FORMAT_NV12)
+		splitChroma(&job.frame);
+
+	for (size_t i = 0; i < layers.size(); i++) {
+		Layer &layer = *layers[i];
+
+		if ((job.layerMask & (1 << i)) == 0)
+			continue;
+		if (!layer.capture->CaptureStarted())
+			continue;
+
+		//All buffers are still in use by the encoder
+		rtc::scoped_refptr<webrtc::I420Buffer> dst =
+			layer.pool->CreateBuffer(layer.width, layer.height);
+		if (!dst) {
+			dropped++;
+			continue;
+		}
+
+		scaleLayer(job, layer, dst.get());
+
+		layer.capture->IncomingVideoFrame(webrtc::VideoFrame(dst,
+				webrtc::kVideoRotation_0, job.timestampUs));
+	}
+}
+
+//NV12 chroma is split into separate U and V planes once per frame, so every
+//layer is scaled by the SIMD I420 box scaler of libyuv
+void SimulcastLayers::splitChroma(const video_data *frame)
+{
+	int chromaWidth = (width + 1) / 2;
+	int chromaHeight = (height + 1) / 2;
+	size_t size = (size_t)chromaWidth * chromaHeight;
+
+	if (chromaU.size() != size) {
+		chromaU.resize(size);
+		chromaV.resize(size);
+	}
+
+	libyuv::SplitUVPlane(frame->data[1], frame->linesize[1],
+		chromaU.data(), chromaWidth,
+		chromaV.data(), chromaWidth,
+		chromaWidth, chromaHeight);
+}
+
+void SimulcastLayers::scaleLayer(const Job &job, Layer &layer,
+		webrtc::I420Buffer *dst)
+{
+	if (job.i420) {
+		const webrtc::I420BufferInterface *src = job.i420.get();
+
+		libyuv::I420Scale(
+			src->DataY(), src->StrideY(),
+			src->DataU(), src->StrideU(),
+			src->DataV(), src->StrideV(),
+			src->width(), src->height(),
+			dst->MutableDataY(), dst->StrideY(),
+			dst->MutableDataU(), dst->StrideU(),
+			dst->MutableDataV(), dst->StrideV(),
+			layer.width, layer.height,
+			libyuv::kFilterBox);
+		return;
+	}
+
+	const video_data *frame = &job.frame;
+
+	if (format == VIDEO_FORMAT_I420) {
+		libyuv::I420Scale(
+			frame->data[0], frame->linesize[0],
+			frame->data[1], frame->linesize[1],
+			frame->data[2], frame->linesize[2],
+			width, height,
+			dst->MutableDataY(), dst->StrideY(),
+			dst->MutableDataU(), dst->StrideU(),
+			dst->MutableDataV(), dst->StrideV(),
+			layer.width, layer.height,
+			libyuv::kFilterBox);
+		return;
+	}
+
+	int chromaWidth = (width + 1) / 2;
+
+	libyuv::I420Scale(
+		frame->data[0], frame->linesize[0],
+		chromaU.data(), chromaWidth,
+		chromaV.data(), chromaWidth,
+		width, height,
+		dst->MutableDataY(), dst->StrideY(),
+		dst->MutableDataU(), dst->StrideU(),
+		dst->MutableDataV(), dst->StrideV(),
+		layer.width, layer.height,
+		libyuv::kFilterBox);
+}
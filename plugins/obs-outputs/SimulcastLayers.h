@@ -0,0 +1,99 @@
+#ifndef _SIMULCAST_LAYERS_H_
+#define _SIMULCAST_LAYERS_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "obs.h"
+#include "media-io/video-io.h"
+
+#include "VideoCapture.h"
+
+#include "api/video/video_frame_buffer.h"
+#include "common_video/include/i420_buffer_pool.h"
+#include "rtc_base/scoped_ref_ptr.h"
+
+// Produces the downscaled simulcast/thumbnail layers of a WebRTC stream.
+//
+// Each layer has its own scale and frame rate divider. Layers are scaled with
+// the box filter of libyuv from the NV12 (or I420) frame into pooled I420
+// buffers, on a worker thread so the video-io callback only has to queue the
+// frame. The source frame is held in the libobs frame cache until scaled.
+class SimulcastLayers
+{
+public:
+	SimulcastLayers();
+	~SimulcastLayers();
+
+	bool addLayer(uint8_t downscale, uint8_t downrate);
+	// Parses a "scale:rate[,scale:rate...]" list, e.g. "2:1,4:3"
+	bool addLayers(const std::string &config);
+	void clear();
+
+	size_t size() const { return layers.size(); }
+	rtc::scoped_refptr<VideoCapture> getCapture(size_t idx) const
+	{
+		return layers[idx]->capture;
+	}
+
+	void start(video_t *video, enum video_format format,
+			int width, int height);
+	void stop();
+
+	void onVideoFrame(const video_data *frame,
+			const rtc::scoped_refptr<webrtc::VideoFrameBuffer> &buffer,
+			uint32_t picId, int64_t timestampUs);
+
+	uint32_t getDroppedFrames() const { return dropped; }
+
+private:
+	struct Layer {
+		uint8_t downscale;
+		uint8_t downrate;
+		int width;
+		int height;
+		rtc::scoped_refptr<VideoCapture> capture;
+		std::unique_ptr<webrtc::I420BufferPool> pool;
+	};
+
+	struct Job {
+		video_data frame;
+		bool held;
+		rtc::scoped_refptr<webrtc::I420BufferInterface> i420;
+		uint32_t layerMask;
+		int64_t timestampUs;
+	};
+
+	void run();
+	void process(Job &job);
+	void releaseJob(Job &job);
+	void splitChroma(const video_data *frame);
+	void scaleLayer(const Job &job, Layer &layer,
+			webrtc::I420Buffer *dst);
+
+	std::vector<std::unique_ptr<Layer>> layers;
+
+	video_t *video;
+	enum video_format format;
+	int width;
+	int height;
+
+	//Deinterleaved NV12 chroma of the current job, only used by the
+	//worker thread
+	std::vector<uint8_t> chromaU;
+	std::vector<uint8_t> chromaV;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::vector<Job> queue;
+	bool running;
+	std::atomic<uint32_t> dropped;
+};
+
+#endif
@@ -2,6 +2,7 @@
 #define _VIDEO_CAPTURE_
 
 #include "modules/video_capture/video_capture_impl.h"
+#include "rtc_base/criticalsection.h"
 #include "rtc_base/refcountedobject.h"
 class VideoCapture : public rtc::RefCountedObject<webrtc::videocapturemodule::VideoCaptureImpl>
 {
@@ -9,6 +10,28 @@ public:
 	VideoCapture() 
 	{
 		started = false;
+		sink = nullptr;
+	}
+	void RegisterCaptureDataCallback(rtc::VideoSinkInterface<webrtc::VideoFrame>* dataCallback) override
+	{
+		rtc::CritScope scope(&sinkLock);
+		sink = dataCallback;
+		VideoCaptureImpl::RegisterCaptureDataCallback(dataCallback);
+	}
+	void DeRegisterCaptureDataCallback() override
+	{
+		rtc::CritScope scope(&sinkLock);
+		sink = nullptr;
+		VideoCaptureImpl::DeRegisterCaptureDataCallback();
+	}
+	//Deliver an already built frame (e.g. wrapping a native buffer)
+	//directly to the sink, bypassing the copy and conversion done by
+	//IncomingFrame
+	void IncomingVideoFrame(const webrtc::VideoFrame& frame)
+	{
+		rtc::CritScope scope(&sinkLock);
+		if (sink)
+			sink->OnFrame(frame);
 	}
 	int32_t StartCapture(const webrtc::VideoCaptureCapability& capability) override
 	{
@@ -31,6 +54,8 @@ public:
 	}
 private:
 	bool started;
+	rtc::CriticalSection sinkLock;
+	rtc::VideoSinkInterface<webrtc::VideoFrame>* sink;
 };
 
 
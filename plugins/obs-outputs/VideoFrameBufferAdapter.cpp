@@ -0,0 +1,120 @@
+#include "VideoFrameBufferAdapter.h"
+
+#include <libyuv.h>
+
+rtc::scoped_refptr<webrtc::VideoFrameBuffer> VideoFrameBufferAdapter::Create(
+		video_t *video, const video_data *frame,
+		enum video_format format, int width, int height,
+		const HeldCounter &held)
+{
+	{
+		rtc::CritScope scope(&held->lock);
+
+		//Only hold the frame if there is room left and it is still in
+		//the cache
+		if (!held->closed &&
+		    held->frames.size() < kMaxHeldFrames &&
+		    video_output_ref_frame(video, frame)) {
+			VideoFrameBufferAdapter *buffer =
+				new rtc::RefCountedObject<VideoFrameBufferAdapter>(
+						video, frame, format, width,
+						height, held);
+			held->frames.insert(buffer);
+			return buffer;
+		}
+	}
+
+	//Fallback to converting it right away
+	return ConvertToI420(frame, format, width, height);
+}
+
+void VideoFrameBufferAdapter::HeldFrames::Open()
+{
+	rtc::CritScope scope(&lock);
+	closed = false;
+}
+
+void VideoFrameBufferAdapter::HeldFrames::Drain()
+{
+	rtc::CritScope scope(&lock);
+	closed = true;
+
+	//Converting removes the buffer from the set
+	std::set<VideoFrameBufferAdapter*> held = frames;
+	for (VideoFrameBufferAdapter *buffer : held)
+		buffer->ConvertAndRelease();
+}
+
+VideoFrameBufferAdapter::VideoFrameBufferAdapter(video_t *video,
+		const video_data *frame, enum video_format format,
+		int width, int height, const HeldCounter &held) :
+	video(video),
+	frame(*frame),
+	format(format),
+	frameWidth(width),
+	frameHeight(height),
+	held(held),
+	holding(true)
+{
+}
+
+VideoFrameBufferAdapter::~VideoFrameBufferAdapter()
+{
+	rtc::CritScope scope(&held->lock);
+	ReleaseFrame();
+}
+
+void VideoFrameBufferAdapter::ReleaseFrame()
+{
+	if (!holding)
+		return;
+
+	video_output_release_frame(video, &frame);
+	held->frames.erase(this);
+	holding = false;
+}
+
+void VideoFrameBufferAdapter::ConvertAndRelease()
+{
+	//Convert only once, and give the frame back to libobs as soon as done
+	if (!converted) {
+		converted = ConvertToI420(&frame, format, frameWidth,
+				frameHeight);
+		ReleaseFrame();
+	}
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface> VideoFrameBufferAdapter::ToI420()
+{
+	rtc::CritScope scope(&held->lock);
+	ConvertAndRelease();
+	return converted;
+}
+
+rtc::scoped_refptr<webrtc::I420Buffer> VideoFrameBufferAdapter::ConvertToI420(
+		const video_data *frame, enum video_format format,
+		int width, int height)
+{
+	rtc::scoped_refptr<webrtc::I420Buffer> buffer =
+		webrtc::I420Buffer::Create(width, height);
+
+	if (format == VIDEO_FORMAT_I420)
+		libyuv::I420Copy(
+			frame->data[0], frame->linesize[0],
+			frame->data[1], frame->linesize[1],
+			frame->data[2], frame->linesize[2],
+			buffer->MutableDataY(), buffer->StrideY(),
+			buffer->MutableDataU(), buffer->StrideU(),
+			buffer->MutableDataV(), buffer->StrideV(),
+			width, height);
+	else
+		libyuv::NV12ToI420(
+			frame->data[0], frame->linesize[0],
+			frame->data[1], frame->linesize[1],
+			buffer->MutableDataY(), buffer->StrideY(),
+			buffer->MutableDataU(), buffer->StrideU(),
+			buffer->MutableDataV(), buffer->StrideV(),
+			width, height);
+
+	return buffer;
+}
@@ -0,0 +1,90 @@
+#ifndef _VIDEO_FRAME_BUFFER_ADAPTER_H_
+#define _VIDEO_FRAME_BUFFER_ADAPTER_H_
+
+#include <memory>
+#include <set>
+
+#include "obs.h"
+#include "media-io/video-io.h"
+
+#include "api/video/video_frame_buffer.h"
+#include "api/video/i420_buffer.h"
+#include "rtc_base/criticalsection.h"
+#include "rtc_base/refcountedobject.h"
+#include "rtc_base/scoped_ref_ptr.h"
+
+// Wraps the planes of a libobs video frame as a native WebRTC frame buffer.
+//
+// The frame stays in the libobs frame cache (see video_output_ref_frame)
+// until WebRTC either converts it to I420 or drops the buffer, so frames are
+// handed to WebRTC without being copied first. NV12 and I420 frames with any
+// linesize are supported.
+//
+// WebRTC can keep a buffer for as long as it likes, so the frames a stream
+// holds are tracked in its HeldFrames, and the stream converts and releases
+// all of them with Drain() when it stops, before the video output can go away.
+class VideoFrameBufferAdapter : public webrtc::VideoFrameBuffer
+{
+public:
+	// Number of frames a stream may keep held in the frame cache at once.
+	// Frames beyond that are converted immediately, so a slow WebRTC encoder
+	// cannot starve the cache shared with the other outputs.
+	static const size_t kMaxHeldFrames = 2;
+
+	class HeldFrames {
+	public:
+		// Allows holding frames again after Drain()
+		void Open();
+		// Converts every frame still held and gives it back to libobs,
+		// frames received afterwards are converted right away
+		void Drain();
+
+	private:
+		friend class VideoFrameBufferAdapter;
+
+		// Also protects the held state of the buffers
+		rtc::CriticalSection lock;
+		std::set<VideoFrameBufferAdapter*> frames;
+		bool closed = false;
+	};
+
+	typedef std::shared_ptr<HeldFrames> HeldCounter;
+
+	// Creates a buffer for a frame received in a raw video callback. Returns
+	// a held native buffer if possible, or an already converted I420 buffer.
+	static rtc::scoped_refptr<webrtc::VideoFrameBuffer> Create(
+			video_t *video, const video_data *frame,
+			enum video_format format, int width, int height,
+			const HeldCounter &held);
+
+	Type type() const override { return Type::kNative; }
+	int width() const override { return frameWidth; }
+	int height() const override { return frameHeight; }
+	rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+
+	static rtc::scoped_refptr<webrtc::I420Buffer> ConvertToI420(
+			const video_data *frame, enum video_format format,
+			int width, int height);
+
+protected:
+	VideoFrameBufferAdapter(video_t *video, const video_data *frame,
+			enum video_format format, int width, int height,
+			const HeldCounter &held);
+	~VideoFrameBufferAdapter() override;
+
+private:
+	// Must be called with the lock of the held frames
+	void ConvertAndRelease();
+	void ReleaseFrame();
+
+	video_t *video;
+	video_data frame;
+	enum video_format format;
+	int frameWidth;
+	int frameHeight;
+	HeldCounter held;
+	bool holding;
+	rtc::scoped_refptr<webrtc::I420Buffer> converted;
+};
+
+#endif
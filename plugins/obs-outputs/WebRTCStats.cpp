@@ -0,0 +1,298 @@
+#include "WebRTCStats.h"
+
+#include <algorithm>
+
+#include "api/stats/rtcstats_objects.h"
+#include "api/statstypes.h"
+#include "rtc_base/location.h"
+#include "rtc_base/refcountedobject.h"
+#include "rtc_base/timeutils.h"
+
+//Message id of the poll timer
+#define MSG_POLL_STATS 1
+//Frames that may be legitimately waiting in the encoder
+#define MAX_FRAMES_IN_FLIGHT 3
+
+void WebRTCStats::Values::reset()
+{
+	bytesSent = 0;
+	packetsSent = 0;
+	packetsLost = 0;
+	nackCount = 0;
+	pliCount = 0;
+	framesEncoded = 0;
+	framesCaptured = 0;
+	framesDropped = 0;
+	sendBitrate = 0;
+	availableBitrate = 0;
+	rttMs = 0;
+	lossRate = 0.0f;
+	avgEncodeMs = 0;
+	cpuLimited = false;
+	bandwidthLimited = false;
+	lastTimeMs = 0;
+	lastBytesSent = 0;
+	lastPacketsSent = 0;
+	lastPacketsLost = 0;
+}
+
+//Standard stats: bytes, NACK/PLI counts, frames encoded, RTT and bandwidth
+class RTCStatsCallback : public webrtc::RTCStatsCollectorCallback
+{
+public:
+	explicit RTCStatsCallback(const std::shared_ptr<WebRTCStats::Values> &values) :
+		values(values)
+	{
+	}
+
+	void OnStatsDelivered(
+			const rtc::scoped_refptr<const webrtc::RTCStatsReport> &report) override
+	{
+		uint64_t bytesSent = 0;
+		uint32_t packetsSent = 0;
+		uint32_t nackCount = 0;
+		uint32_t pliCount = 0;
+		uint32_t framesEncoded = 0;
+		uint32_t videoFramesEncoded = 0;
+		uint32_t videoSsrc = 0;
+		bool haveVideoSsrc = false;
+
+		//The outbound stream of the main video track, the layers are
+		//separate tracks with frames of their own
+		std::string trackStatsId;
+		for (const webrtc::RTCMediaStreamTrackStats *track :
+		     report->GetStatsOfType<webrtc::RTCMediaStreamTrackStats>()) {
+			if (track->track_identifier.is_defined() &&
+			    *track->track_identifier == values->videoTrackId) {
+				trackStatsId = track->id();
+				break;
+			}
+		}
+
+		for (const webrtc::RTCOutboundRTPStreamStats *out :
+		     report->GetStatsOfType<webrtc::RTCOutboundRTPStreamStats>()) {
+			if (!trackStatsId.empty() && out->track_id.is_defined() &&
+			    *out->track_id == trackStatsId &&
+			    out->ssrc.is_defined()) {
+				videoSsrc = *out->ssrc;
+				haveVideoSsrc = true;
+				break;
+			}
+		}
+
+		for (const webrtc::RTCStats &stats : *report) {
+			if (stats.type() == webrtc::RTCOutboundRTPStreamStats::kType) {
+				const auto &out = stats.cast_to<
+					webrtc::RTCOutboundRTPStreamStats>();
+
+				if (out.bytes_sent.is_defined())
+					bytesSent += *out.bytes_sent;
+				if (out.packets_sent.is_defined())
+					packetsSent += *out.packets_sent;
+				if (out.nack_count.is_defined())
+					nackCount += *out.nack_count;
+				if (out.pli_count.is_defined())
+					pliCount += *out.pli_count;
+				if (out.frames_encoded.is_defined()) {
+					framesEncoded += *out.frames_encoded;
+					if (haveVideoSsrc && out.ssrc.is_defined() &&
+					    *out.ssrc == videoSsrc)
+						videoFramesEncoded +=
+							*out.frames_encoded;
+				}
+
+			} else if (stats.type() ==
+					webrtc::RTCIceCandidatePairStats::kType) {
+				const auto &pair = stats.cast_to<
+					webrtc::RTCIceCandidatePairStats>();
+
+				if (!pair.nominated.is_defined() || !*pair.nominated)
+					continue;
+				if (pair.current_round_trip_time.is_defined())
+					values->rttMs = (uint32_t)(
+						*pair.current_round_trip_time * 1000.0);
+				if (pair.available_outgoing_bitrate.is_defined())
+					values->availableBitrate = (uint32_t)
+						*pair.available_outgoing_bitrate;
+			}
+		}
+
+		int64_t timeMs = report->timestamp_us() / 1000;
+		int64_t elapsedMs = timeMs - values->lastTimeMs;
+
+		if (values->lastTimeMs && elapsedMs > 0 &&
+		    bytesSent >= values->lastBytesSent)
+			values->sendBitrate = (uint32_t)(
+				(bytesSent - values->lastBytesSent) * 8000 /
+				(uint64_t)elapsedMs);
+
+		values->lastTimeMs = timeMs;
+		values->lastBytesSent = bytesSent;
+
+		values->bytesSent = bytesSent;
+		values->packetsSent = packetsSent;
+		values->nackCount = nackCount;
+		values->pliCount = pliCount;
+		values->framesEncoded = framesEncoded;
+
+		//Anything captured for the main track but not encoded, beyond
+		//what the encoder may still be working on, was dropped.  Frames
+		//of the layers don't count, they are captured separately
+		if (!haveVideoSsrc)
+			return;
+
+		uint32_t captured = values->framesCaptured;
+		if (captured > videoFramesEncoded + MAX_FRAMES_IN_FLIGHT)
+			values->framesDropped = std::max(values->framesDropped.load(),
+				captured - videoFramesEncoded - MAX_FRAMES_IN_FLIGHT);
+	}
+
+private:
+	std::shared_ptr<WebRTCStats::Values> values;
+};
+
+static int64_t GetIntValue(const webrtc::StatsReport *report,
+		webrtc::StatsReport::StatsValueName name)
+{
+	const webrtc::StatsReport::Value *value = report->FindValue(name);
+	if (!value)
+		return 0;
+
+	switch (value->type()) {
+	case webrtc::StatsReport::Value::kInt:   return value->int_val();
+	case webrtc::StatsReport::Value::kInt64: return value->int64_val();
+	case webrtc::StatsReport::Value::kFloat: return (int64_t)value->float_val();
+	default:                                 return 0;
+	}
+}
+
+static bool GetBoolValue(const webrtc::StatsReport *report,
+		webrtc::StatsReport::StatsValueName name)
+{
+	const webrtc::StatsReport::Value *value = report->FindValue(name);
+	return value && value->type() == webrtc::StatsReport::Value::kBool &&
+		value->bool_val();
+}
+
+//Sender side loss, encode time and quality limitations are only reported by
+//the legacy stats at this WebRTC version
+class LegacyStatsObserver : public webrtc::StatsObserver
+{
+public:
+	explicit LegacyStatsObserver(const std::shared_ptr<WebRTCStats::Values> &values) :
+		values(values)
+	{
+	}
+
+	void OnComplete(const webrtc::StatsReports &reports) override
+	{
+		uint32_t packetsSent = 0;
+		uint32_t packetsLost = 0;
+
+		for (const webrtc::StatsReport *report : reports) {
+			//Only the ssrc reports of sent streams have bytes sent
+			if (report->type() != webrtc::StatsReport::kStatsReportTypeSsrc ||
+			    !report->FindValue(webrtc::StatsReport::kStatsValueNameBytesSent))
+				continue;
+
+			packetsSent += (uint32_t)GetIntValue(report,
+				webrtc::StatsReport::kStatsValueNamePacketsSent);
+			packetsLost += (uint32_t)GetIntValue(report,
+				webrtc::StatsReport::kStatsValueNamePacketsLost);
+
+			//Only video streams report encode time
+			if (!report->FindValue(webrtc::StatsReport::kStatsValueNameAvgEncodeMs))
+				continue;
+
+			values->avgEncodeMs = (uint32_t)GetIntValue(report,
+				webrtc::StatsReport::kStatsValueNameAvgEncodeMs);
+			values->cpuLimited = GetBoolValue(report,
+				webrtc::StatsReport::kStatsValueNameCpuLimitedResolution);
+			values->bandwidthLimited = GetBoolValue(report,
+				webrtc::StatsReport::kStatsValueNameBandwidthLimitedResolution);
+		}
+
+		uint32_t sent = packetsSent - values->lastPacketsSent;
+		uint32_t lost = packetsLost - values->lastPacketsLost;
+
+		if (packetsSent >= values->lastPacketsSent &&
+		    packetsLost >= values->lastPacketsLost && sent + lost)
+			values->lossRate = (float)lost / (float)(sent + lost);
+
+		values->lastPacketsSent = packetsSent;
+		values->lastPacketsLost = packetsLost;
+		values->packetsLost = packetsLost;
+	}
+
+private:
+	std::shared_ptr<WebRTCStats::Values> values;
+};
+
+WebRTCStats::WebRTCStats() :
+	signaling(nullptr),
+	values(std::make_shared<Values>())
+{
+}
+
+WebRTCStats::~WebRTCStats()
+{
+	stop();
+}
+
+void WebRTCStats::start(rtc::Thread *signaling,
+		rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc,
+		const std::string &videoTrackId)
+{
+	stop();
+
+	//Polling only ever happens on the signaling thread
+	signaling->Invoke<void>(RTC_FROM_HERE, [&]() {
+		this->signaling = signaling;
+		this->pc = pc;
+		values->reset();
+		values->videoTrackId = videoTrackId;
+		signaling->PostDelayed(RTC_FROM_HERE, kIntervalMs, this,
+				MSG_POLL_STATS);
+	});
+}
+
+void WebRTCStats::stop()
+{
+	if (!signaling)
+		return;
+
+	signaling->Invoke<void>(RTC_FROM_HERE, [&]() {
+		signaling->Clear(this);
+		pc = nullptr;
+	});
+	signaling = nullptr;
+}
+
+void WebRTCStats::OnMessage(rtc::Message *msg)
+{
+	if (msg->message_id != MSG_POLL_STATS || !pc)
+		return;
+
+	poll();
+	signaling->PostDelayed(RTC_FROM_HERE, kIntervalMs, this, MSG_POLL_STATS);
+}
+
+void WebRTCStats::poll()
+{
+	//Both return right away, results are delivered later on this thread
+	pc->GetStats(new rtc::RefCountedObject<RTCStatsCallback>(values));
+	pc->GetStats(new rtc::RefCountedObject<LegacyStatsObserver>(values),
+			nullptr,
+			webrtc::PeerConnectionInterface::kStatsOutputLevelStandard);
+}
+
+float WebRTCStats::getCongestion() const
+{
+	//10% loss or more is full congestion
+	float congestion = std::min(1.0f, values->lossRate.load() * 10.0f);
+
+	if (values->bandwidthLimited)
+		congestion = std::max(congestion, 0.5f);
+
+	return congestion;
+}
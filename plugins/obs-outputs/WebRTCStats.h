@@ -0,0 +1,99 @@
+#ifndef _WEBRTC_STATS_H_
+#define _WEBRTC_STATS_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "api/peerconnectioninterface.h"
+#include "api/stats/rtcstatscollectorcallback.h"
+#include "rtc_base/messagehandler.h"
+#include "rtc_base/scoped_ref_ptr.h"
+#include "rtc_base/thread.h"
+
+// Periodically polls the transport statistics of a peer connection.
+//
+// Stats are requested on the signaling thread every kIntervalMs and the
+// results are cached in atomics, so the getters can be called from any thread
+// (e.g. the libobs output info callbacks) without ever blocking on WebRTC.
+class WebRTCStats : public rtc::MessageHandler
+{
+public:
+	static const int kIntervalMs = 1000;
+
+	struct Values {
+		//Totals since the stream started
+		std::atomic<uint64_t> bytesSent;
+		std::atomic<uint32_t> packetsSent;
+		std::atomic<uint32_t> packetsLost;
+		std::atomic<uint32_t> nackCount;
+		std::atomic<uint32_t> pliCount;
+		std::atomic<uint32_t> framesEncoded;
+		std::atomic<uint32_t> framesCaptured;
+		std::atomic<uint32_t> framesDropped;
+		//Values over the last interval
+		std::atomic<uint32_t> sendBitrate;
+		std::atomic<uint32_t> availableBitrate;
+		std::atomic<uint32_t> rttMs;
+		std::atomic<float> lossRate;
+		std::atomic<uint32_t> avgEncodeMs;
+		std::atomic<bool> cpuLimited;
+		std::atomic<bool> bandwidthLimited;
+
+		//Only used on the signaling thread
+		std::string videoTrackId;
+		//Previous totals, only used on the signaling thread
+		int64_t lastTimeMs;
+		uint64_t lastBytesSent;
+		uint32_t lastPacketsSent;
+		uint32_t lastPacketsLost;
+
+		Values() { reset(); }
+		void reset();
+	};
+
+	WebRTCStats();
+	~WebRTCStats() override;
+
+	// videoTrackId is the id of the main video track, dropped frames are
+	// only counted for it
+	void start(rtc::Thread *signaling,
+			rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc,
+			const std::string &videoTrackId);
+	void stop();
+
+	// Called for every video frame passed to WebRTC
+	void onFrameCaptured() { values->framesCaptured++; }
+
+	uint64_t getBytesSent() const { return values->bytesSent; }
+	uint32_t getSendBitrate() const { return values->sendBitrate; }
+	uint32_t getAvailableBitrate() const { return values->availableBitrate; }
+	uint32_t getRtt() const { return values->rttMs; }
+	float getLossRate() const { return values->lossRate; }
+	uint32_t getPacketsLost() const { return values->packetsLost; }
+	uint32_t getNackCount() const { return values->nackCount; }
+	uint32_t getPliCount() const { return values->pliCount; }
+	uint32_t getFramesEncoded() const { return values->framesEncoded; }
+	// Frames passed to WebRTC that were never encoded
+	uint32_t getFramesDropped() const { return values->framesDropped; }
+	uint32_t getAvgEncodeMs() const { return values->avgEncodeMs; }
+	bool isCpuLimited() const { return values->cpuLimited; }
+	bool isBandwidthLimited() const { return values->bandwidthLimited; }
+
+	// Congestion estimate between 0 and 1, from the packet loss of the last
+	// interval and whether the encoder is limited by the available bandwidth
+	float getCongestion() const;
+
+	// rtc::MessageHandler
+	void OnMessage(rtc::Message *msg) override;
+
+private:
+	void poll();
+
+	rtc::Thread *signaling;
+	rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+	//Shared with the stats callbacks, which may outlive this object
+	std::shared_ptr<Values> values;
+};
+
+#endif
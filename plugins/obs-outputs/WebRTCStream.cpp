@@ -17,6 +17,7 @@
 #include <rtc_base/bitrateallocationstrategy.h>
 #include "rtc_base/checks.h"
 #include "rtc_base/criticalsection.h"
+#include "rtc_base/timeutils.h"
 
 //#include "pc/peerconnectionwrapper.h"
 #include "pc/rtcstatscollector.h"
@@ -40,9 +41,6 @@ CustomLogger logger;
 WebRTCStream::WebRTCStream(obs_output_t * output)
 {
     picId = 0;
-    thumbnail = false;
-    thumbnailDownrate = 1;
-    thumbnailDownscale = 1;
 
     rtc::LogMessage::ConfigureLogging("info");
 
@@ -82,11 +80,18 @@ WebRTCStream::WebRTCStream(obs_output_t * output)
     
     //Create capture module with out custome one
     videoCapture = new VideoCapture();
-    thumbnailCapture = new VideoCapture();
-
-    //bitrate and dropped frame
-    bitrate = 0;
-    dropped_frame = 0;
+    heldFrames = std::make_shared<VideoFrameBufferAdapter::HeldFrames>();
+    videoFormat = VIDEO_FORMAT_NV12;
+    audioChannels = 2;
+    audioSampleRate = 48000;
+
+    //Expose the detailed transport stats to the frontend
+    proc_handler_t *ph = obs_output_get_proc_handler(output);
+    proc_handler_add(ph, "void get_transport_stats(out int send_bitrate, "
+        "out int available_bitrate, out int rtt, out float loss, "
+        "out int nack_count, out int pli_count, out int encode_ms, "
+        "out bool cpu_limited, out bool bandwidth_limited)",
+        getTransportStats, this);
 }
 
 WebRTCStream::~WebRTCStream()
@@ -97,7 +102,7 @@ WebRTCStream::~WebRTCStream()
     pc = NULL;
     factory = NULL;
     videoCapture = NULL;
-    thumbnailCapture = NULL;
+    layers.clear();
 
     //Stop all thread
     if (!network->IsCurrent())   network->Stop();
@@ -118,6 +123,9 @@ bool WebRTCStream::start(Type type)
     if (!service)
         return false;
 
+    //Frames can be held again until stopped
+    heldFrames->Open();
+
     // WebSocket URL sanity check
     if (!obs_service_get_url(service))
         return false;
@@ -221,21 +229,26 @@ bool WebRTCStream::start(Type type)
     //Add stream to track
     stream->AddTrack(video_track);
 
-    //If doing thumnails
-    if (thumbnail)
+    //Add a track for each downscaled layer
+    for (size_t i = 0; i < layers.size(); i++)
     {
       //Create capturer
-      VideoCapturer* thumbnailCapturer = new VideoCapturer(this);
+      VideoCapturer* layerCapturer = new VideoCapturer(this);
       //Init it
-      thumbnailCapturer->Init(thumbnailCapture);
+      layerCapturer->Init(layers.getCapture(i));
 
-      //Create thumbnail source
-      rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> thumbnailSource = factory->CreateVideoSource(thumbnailCapturer, NULL);
+      //Create layer source
+      rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> layerSource = factory->CreateVideoSource(layerCapturer, NULL);
 
-      //Add thumbnail
-      rtc::scoped_refptr<webrtc::VideoTrackInterface> thumbnail_track = factory->CreateVideoTrack("thumbnail", thumbnailSource);
+      //First one keeps the legacy thumbnail name
+      std::string name = "thumbnail";
+      if (i)
+        name += std::to_string(i);
+
+      //Add layer
+      rtc::scoped_refptr<webrtc::VideoTrackInterface> layer_track = factory->CreateVideoTrack(name, layerSource);
       //Add stream to track
-      stream->AddTrack(thumbnail_track);
+      stream->AddTrack(layer_track);
     }
     
     //Add the stream to the peer connection
@@ -327,6 +340,19 @@ bool WebRTCStream::stop()
     if (!pc.get())
       //Exit
       return false;
+    //Stop scaling layers, releasing any frame still held
+    layers.stop();
+    //Give back the frames WebRTC still holds, the video output may be
+    //closed once the output stopped
+    heldFrames->Drain();
+    //Stop polling stats
+    stats.stop();
+    info("Transport stats: %llu bytes sent, %u packets lost, %u NACKs, "
+        "%u PLIs, %u frames encoded, %d frames dropped, "
+        "%d layer frames dropped",
+        (unsigned long long)stats.getBytesSent(), stats.getPacketsLost(),
+        stats.getNackCount(), stats.getPliCount(), stats.getFramesEncoded(),
+        getDroppedFrames(), getLayerDroppedFrames());
     //Get pointer
     auto old = pc.release();
     //Close PC
@@ -343,6 +369,8 @@ bool WebRTCStream::stop()
     }
     //Send end event
     obs_output_end_data_capture(output);
+    //No more audio will be pushed
+    adm.stopPacing();
     return true;
 }
 
@@ -393,12 +421,39 @@ void WebRTCStream::onOpened(const std::string &sdp)
 
     //Set audio data format
     audio_convert_info conversion;
-    //Int 16bits, 48khz mono
+    //Int 16bits, at the configured rate and channels
     conversion.format = AUDIO_FORMAT_16BIT;
-    conversion.samples_per_sec = 48000;
-    conversion.speakers = SPEAKERS_STEREO;
+    conversion.samples_per_sec = audioSampleRate;
+    conversion.speakers = audioChannels == 1 ? SPEAKERS_MONO : SPEAKERS_STEREO;
     //Set it
     obs_output_set_audio_conversion(output, &conversion);
+    //Audio is handed to WebRTC every 10ms from the adm pacing thread
+    if (!adm.startPacing(audioChannels, audioSampleRate))
+    {
+        obs_output_signal_stop(output, OBS_OUTPUT_ERROR);
+        return;
+    }
+
+    //Frames are passed to WebRTC as NV12 or I420, convert anything else
+    video_t *video = obs_output_video(output);
+    videoFormat = video_output_get_format(video);
+    if (videoFormat != VIDEO_FORMAT_NV12 && videoFormat != VIDEO_FORMAT_I420) {
+        const struct video_output_info *voi = video_output_get_info(video);
+        video_scale_info videoConversion = {};
+        videoConversion.format = VIDEO_FORMAT_NV12;
+        videoConversion.range = voi->range;
+        videoConversion.colorspace = voi->colorspace;
+        obs_output_set_video_conversion(output, &videoConversion);
+        videoFormat = VIDEO_FORMAT_NV12;
+    }
+
+    //Start polling the transport stats
+    stats.start(signaling.get(), pc,
+        video_track ? video_track->id() : std::string());
+
+    //Start scaling the downscaled layers
+    layers.start(video, videoFormat, obs_output_get_width(output),
+        obs_output_get_height(output));
 
     //Start
     obs_output_begin_data_capture(output, 0);
@@ -432,58 +487,21 @@ void WebRTCStream::onVideoFrame(video_data *frame)
     videoCaptureCapability.width = obs_output_get_width(output);
     videoCaptureCapability.height = obs_output_get_height(output);
     videoCaptureCapability.videoType = webrtc::VideoType::kNV12;    
-    //Calc size
-    uint32_t size = videoCaptureCapability.width*videoCaptureCapability.height * 3 / 2;
+    //Wrap the frame planes without copying them, the frame is kept in the
+    //libobs cache until WebRTC is done with it
+    video_t *video = obs_output_video(output);
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer =
+        VideoFrameBufferAdapter::Create(video, frame, videoFormat,
+            videoCaptureCapability.width, videoCaptureCapability.height,
+            heldFrames);
     //Pass it
-    videoCapture->IncomingFrame(frame->data[0], size, videoCaptureCapability);
+    int64_t timestamp = rtc::TimeMicros();
+    stats.onFrameCaptured();
+    videoCapture->IncomingVideoFrame(webrtc::VideoFrame(buffer,
+        webrtc::kVideoRotation_0, timestamp));
 
-    //If we are doing thumbnails and we are not skiping this frame
-    if (thumbnail && thumbnailCapture && ((picId % thumbnailDownrate)==0))
-    {
-	
-       //Calculate size
-       thumbnailCaptureCapability.width = obs_output_get_width(output) / thumbnailDownscale;
-       thumbnailCaptureCapability.height = obs_output_get_height(output) / thumbnailDownscale;
-       thumbnailCaptureCapability.videoType = webrtc::VideoType::kI420;
-       //Calc size of the downscaled version
-       uint32_t donwscaledSize = thumbnailCaptureCapability.width*thumbnailCaptureCapability.height*3/2;
-       //Create new image for the I420 conversion and the downscaling
-       uint8_t* downscaled = (uint8_t*)malloc(size+donwscaledSize);
-
-       //Get planar pointers
-       uint8_t *dest_y = (uint8_t *)downscaled;
-       uint8_t *dest_u = (uint8_t *)dest_y + videoCaptureCapability.width*videoCaptureCapability.height;
-       uint8_t *dest_v = (uint8_t *)dest_y + videoCaptureCapability.width*videoCaptureCapability.height * 5 / 4;
-       uint8_t *resc_y = (uint8_t *)downscaled + size;
-       uint8_t *resc_u = (uint8_t *)resc_y + thumbnailCaptureCapability.width*thumbnailCaptureCapability.height;
-       uint8_t *resc_v = (uint8_t *)resc_y + thumbnailCaptureCapability.width*thumbnailCaptureCapability.height * 5 / 4;
-
-       //Convert first to I420
-       libyuv::NV12ToI420(
-	       (uint8_t *)frame->data[0], frame->linesize[0],
-	       (uint8_t *)frame->data[1], frame->linesize[1],
-	       dest_y, videoCaptureCapability.width,
-	       dest_u, videoCaptureCapability.width/2,
-	       dest_v, videoCaptureCapability.width/2,
-	       videoCaptureCapability.width, videoCaptureCapability.height);
-
-       //Rescale
-       libyuv::I420Scale(
-	       dest_y, videoCaptureCapability.width,
-	       dest_u, videoCaptureCapability.width / 2,
-	       dest_v, videoCaptureCapability.width / 2,
-	       videoCaptureCapability.width, videoCaptureCapability.height,
-	       resc_y, thumbnailCaptureCapability.width,
-	       resc_u, thumbnailCaptureCapability.width / 2,
-	       resc_v, thumbnailCaptureCapability.width / 2,
-	       thumbnailCaptureCapability.width, thumbnailCaptureCapability.height,
-	       libyuv::kFilterNone
-       );
-       //Pass it
-       thumbnailCapture->IncomingFrame(resc_y, donwscaledSize, thumbnailCaptureCapability);
-       //Free downscaled version
-       free(downscaled);
-    }
+    //Queue the downscaled layers due for this frame
+    layers.onVideoFrame(frame, buffer, picId, timestamp);
 
     //Increase number of pictures
     picId++;
@@ -497,18 +515,39 @@ void WebRTCStream::onAudioFrame(audio_data *frame)
     adm.onIncomingData(frame->data[0], frame->frames);
 }
 
-//bitrate and dropped_frame
-// Disable for now
-uint64_t WebRTCStream::getBitrate() {
-   /* rtc::scoped_refptr<webrtc::MockStatsObserver> observerVideo (new rtc::RefCountedObject<webrtc::MockStatsObserver> ());
-	rtc::scoped_refptr<webrtc::MockStatsObserver> observerAudio (new rtc::RefCountedObject<webrtc::MockStatsObserver> ());
+//Stats, cached by the stats poller so these never block on WebRTC
+uint64_t WebRTCStream::getTotalBytes()
+{
+    return stats.getBytesSent();
+}
 
-    pc->GetStats (observerVideo, video_track, webrtc::PeerConnectionInterface::kStatsOutputLevelStandard);
-	pc->GetStats (observerAudio, audio_track, webrtc::PeerConnectionInterface::kStatsOutputLevelStandard);
-	
-	std::this_thread::sleep_for(std::chrono::milliseconds(2));
-    
-	bitrate = observerVideo->BytesSent() + observerAudio->BytesSent();
-   */
-    return uint64_t(0);
+int WebRTCStream::getDroppedFrames()
+{
+    return (int)stats.getFramesDropped();
+}
+
+int WebRTCStream::getLayerDroppedFrames()
+{
+    return (int)layers.getDroppedFrames();
+}
+
+float WebRTCStream::getCongestion()
+{
+    return stats.getCongestion();
+}
+
+void WebRTCStream::getTransportStats(void *data, calldata_t *cd)
+{
+    WebRTCStream *stream = (WebRTCStream *)data;
+    const WebRTCStats &stats = stream->stats;
+
+    calldata_set_int(cd, "send_bitrate", stats.getSendBitrate());
+    calldata_set_int(cd, "available_bitrate", stats.getAvailableBitrate());
+    calldata_set_int(cd, "rtt", stats.getRtt());
+    calldata_set_float(cd, "loss", stats.getLossRate());
+    calldata_set_int(cd, "nack_count", stats.getNackCount());
+    calldata_set_int(cd, "pli_count", stats.getPliCount());
+    calldata_set_int(cd, "encode_ms", stats.getAvgEncodeMs());
+    calldata_set_bool(cd, "cpu_limited", stats.isCpuLimited());
+    calldata_set_bool(cd, "bandwidth_limited", stats.isBandwidthLimited());
 }
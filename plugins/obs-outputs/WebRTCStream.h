@@ -13,6 +13,9 @@
 #include "WebsocketClient.h"
 #include "VideoCapture.h"
 #include "VideoCapturer.h"
+#include "VideoFrameBufferAdapter.h"
+#include "SimulcastLayers.h"
+#include "WebRTCStats.h"
 #include "AudioDeviceModuleWrapper.h"
 
 #include <rtc_base/platform_file.h>
@@ -56,11 +59,20 @@ public:
   void onAudioFrame(audio_data *frame);
   bool enableThumbnail(uint8_t downscale, uint8_t downrate)
   {
-    if (!downscale || !downrate)
+    return layers.addLayer(downscale, downrate);
+  }
+  //Adds the layers of a "scale:rate[,scale:rate...]" list
+  bool enableSimulcastLayers(const char *config)
+  {
+    if (!config || !*config)
       return false;
-    thumbnailDownscale = downscale;
-    thumbnailDownrate = downrate;
-    return (thumbnail = true);
+    return layers.addLayers(config);
+  }
+  //Audio format sent to WebRTC, 16 bits mono or stereo
+  void setAudioFormat(size_t channels, uint32_t sampleRate)
+  {
+    audioChannels = channels;
+    audioSampleRate = sampleRate;
   }
   void setCodec(const std::string& codec)
   {
@@ -111,8 +123,12 @@ public:
     delete(info);
   }
 
-  //bitrate
-  uint64_t getBitrate();
+  //Output info stats
+  uint64_t getTotalBytes();
+  int getDroppedFrames();
+  //Frames the downscaled layers skipped, not counted as dropped frames
+  int getLayerDroppedFrames();
+  float getCongestion();
 
 private:
   //Connection properties
@@ -123,29 +139,30 @@ private:
   std::string codec;
   std::string milliId;
   std::string milliToken;
-  bool        thumbnail;
 
   //tracks
   rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track;
   rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track;
 
-  //bitrate and dropped frames
-  uint64_t bitrate;
-  int dropped_frame;
+  //Transport stats, polled on the signaling thread
+  WebRTCStats stats;
+  static void getTransportStats(void *data, calldata_t *cd);
 
   //Websocket client
   WebsocketClient* client;
   //Audio Wrapper
   AudioDeviceModuleWrapper adm;
+  size_t audioChannels;
+  uint32_t audioSampleRate;
   //Video Wrappers
   webrtc::VideoCaptureCapability videoCaptureCapability;
   rtc::scoped_refptr<VideoCapture> videoCapture;
-  //Thumbnail wrapper
-  webrtc::VideoCaptureCapability thumbnailCaptureCapability;
-  rtc::scoped_refptr<VideoCapture> thumbnailCapture;
+  //Frames currently held in the libobs frame cache by WebRTC
+  VideoFrameBufferAdapter::HeldCounter heldFrames;
+  enum video_format videoFormat;
+  //Thumbnail and other downscaled simulcast layers
+  SimulcastLayers layers;
   uint32_t picId;
-  uint8_t thumbnailDownscale;
-  uint8_t thumbnailDownrate;
   //Peerconnection
   rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> factory;
   rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
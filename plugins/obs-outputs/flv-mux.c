@@ -186,16 +186,22 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, int32_t dts_offset,
+static inline uint8_t *write_wb24(uint8_t *out, uint32_t val)
+{
+	*(out++) = (uint8_t)(val >> 16);
+	*(out++) = (uint8_t)(val >> 8);
+	*(out++) = (uint8_t)val;
+	return out;
+}
+
+static size_t flv_video_header(uint8_t *header, int32_t dts_offset,
 		struct encoder_packet *packet, bool is_header)
 {
 	int64_t offset  = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	uint8_t *out    = header;
 
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
+	*(out++) = RTMP_PACKET_TYPE_VIDEO;
 
 #ifdef DEBUG_TIMESTAMPS
 	blog(LOG_DEBUG, "Video: %lu", time_ms);
@@ -206,30 +212,26 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 5);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
+	out = write_wb24(out, (uint32_t)packet->size + VIDEO_HEADER_SIZE);
+	out = write_wb24(out, time_ms);
+	*(out++) = (time_ms >> 24) & 0x7F;
+	out = write_wb24(out, 0);
 
 	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
+	*(out++) = packet->keyframe ? 0x17 : 0x27;
+	*(out++) = is_header ? 0 : 1;
+	out = write_wb24(out, get_ms_time(packet, offset));
 
-	/* write tag size (starting byte doesn't count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) - 1);
+	return out - header;
 }
 
-static void flv_audio(struct serializer *s, int32_t dts_offset,
+static size_t flv_audio_header(uint8_t *header, int32_t dts_offset,
 		struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	uint8_t *out    = header;
 
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
+	*(out++) = RTMP_PACKET_TYPE_AUDIO;
 
 #ifdef DEBUG_TIMESTAMPS
 	blog(LOG_DEBUG, "Audio: %lu", time_ms);
@@ -240,14 +242,42 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 2);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
+	out = write_wb24(out, (uint32_t)packet->size + 2);
+	out = write_wb24(out, time_ms);
+	*(out++) = (time_ms >> 24) & 0x7F;
+	out = write_wb24(out, 0);
 
 	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
+	*(out++) = 0xaf;
+	*(out++) = is_header ? 0 : 1;
+
+	return out - header;
+}
+
+size_t flv_packet_mux_header(struct encoder_packet *packet, int32_t dts_offset,
+		uint8_t *header, bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return 0;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		return flv_video_header(header, dts_offset, packet, is_header);
+	else
+		return flv_audio_header(header, dts_offset, packet, is_header);
+}
+
+static void flv_tag(struct serializer *s, int32_t dts_offset,
+		struct encoder_packet *packet, bool is_header)
+{
+	uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+	size_t header_size;
+
+	header_size = flv_packet_mux_header(packet, dts_offset, header,
+			is_header);
+	if (!header_size)
+		return;
+
+	s_write(s, header, header_size);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
@@ -262,10 +292,7 @@ void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 
 	array_output_serializer_init(&s, &data);
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, dts_offset, packet, is_header);
-	else
-		flv_audio(&s, dts_offset, packet, is_header);
+	flv_tag(&s, dts_offset, packet, is_header);
 
 	*output = data.bytes.array;
 	*size   = data.bytes.num;
@@ -18,6 +18,9 @@
 
 #define MILLISECOND_DEN   1000
 
+/* tag header (11 bytes) plus the largest codec header (5 bytes for video) */
+#define FLV_TAG_HEADER_MAX_SIZE 16
+
 static int32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 {
 	return (int32_t)(val * MILLISECOND_DEN / packet->timebase_den);
@@ -28,4 +31,13 @@ extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
-uint8_t **output, size_t *size, bool is_header);
\ No newline at end of file
+uint8_t **output, size_t *size, bool is_header);
+
+/**
+ * Writes only the FLV tag header for a packet, so the payload can be sent
+ * directly from the packet data without being copied into a muxed buffer.
+ * The trailing tag size is not written.  Returns the header size, or 0 if the
+ * packet is empty.
+ */
+extern size_t flv_packet_mux_header(struct encoder_packet *packet,
+		int32_t dts_offset, uint8_t *header, bool is_header);
@@ -47,6 +47,11 @@ extern "C" void *janus_stream_create(obs_data_t *settings, obs_output_t *output)
   WebRTCStream* stream = new WebRTCStream(output);
   //Don't allow it to be deleted
   stream->AddRef();
+  //Optional downscaled simulcast layers
+  stream->enableSimulcastLayers(obs_data_get_string(settings, OPT_SIMULCAST_LAYERS));
+  //Audio format sent to WebRTC
+  stream->setAudioFormat((size_t)obs_data_get_int(settings, OPT_AUDIO_CHANNELS),
+      (uint32_t)obs_data_get_int(settings, OPT_AUDIO_SAMPLE_RATE));
   //Return it
   return (void*)stream;
 }
@@ -97,6 +102,9 @@ extern "C" void janus_stream_defaults(obs_data_t *defaults)
   obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
   obs_data_set_default_bool(defaults, OPT_NEWSOCKETLOOP_ENABLED, false);
   obs_data_set_default_bool(defaults, OPT_LOWLATENCY_ENABLED, false);
+  obs_data_set_default_string(defaults, OPT_SIMULCAST_LAYERS, "");
+  obs_data_set_default_int(defaults, OPT_AUDIO_CHANNELS, 2);
+  obs_data_set_default_int(defaults, OPT_AUDIO_SAMPLE_RATE, 48000);
 }
 
 extern "C" obs_properties_t *janus_stream_properties(void *unused)
@@ -122,17 +130,21 @@ extern "C" uint64_t janus_stream_total_bytes_sent(void *data)
 {
   //Get stream
   WebRTCStream* stream = (WebRTCStream*) data;
-  return stream->getBitrate();
+  return stream->getTotalBytes();
 }
 
 extern "C" int janus_stream_dropped_frames(void *data)
 {
-  return 0;
+  //Get stream
+  WebRTCStream* stream = (WebRTCStream*)data;
+  return stream->getDroppedFrames();
 }
 
 extern "C" float janus_stream_congestion(void *data)
 {
-  return 0.0f;
+  //Get stream
+  WebRTCStream* stream = (WebRTCStream*)data;
+  return stream->getCongestion();
 }
 
 extern "C" {
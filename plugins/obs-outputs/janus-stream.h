@@ -30,6 +30,9 @@
 #define OPT_BIND_IP "bind_ip"
 #define OPT_NEWSOCKETLOOP_ENABLED "new_socket_loop_enabled"
 #define OPT_LOWLATENCY_ENABLED "low_latency_mode_enabled"
+#define OPT_SIMULCAST_LAYERS "simulcast_layers"
+#define OPT_AUDIO_CHANNELS "audio_channels"
+#define OPT_AUDIO_SAMPLE_RATE "audio_sample_rate"
 
 #ifdef TEST_FRAMEDROPS
 
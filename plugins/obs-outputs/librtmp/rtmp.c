@@ -32,6 +32,10 @@
 #include "rtmp_sys.h"
 #include "log.h"
 
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
 #ifdef CRYPTO
 
 #ifdef __APPLE__
@@ -144,8 +148,20 @@ static void HandleCtrl(RTMP *r, const RTMPPacket *packet);
 static void HandleServerBW(RTMP *r, const RTMPPacket *packet);
 static void HandleClientBW(RTMP *r, const RTMPPacket *packet);
 
+typedef struct RTMPVec
+{
+    const char *base;
+    int len;
+} RTMPVec;
+
+/* a chunk header and a chunk spanning at most two body parts */
+#define RTMP_MAX_WRITE_VECS 3
+
 static int ReadN(RTMP *r, char *buffer, int n);
 static int WriteN(RTMP *r, const char *buffer, int n);
+static int WriteV(RTMP *r, const RTMPVec *vec, int cnt);
+static int SendPacket(RTMP *r, RTMPPacket *packet, const RTMPVec *body,
+                      int queue);
 
 static void DecodeTEA(AVal *key, AVal *text);
 
@@ -1456,6 +1472,128 @@ WriteN(RTMP *r, const char *buffer, int n)
     return n == 0;
 }
 
+#ifdef _WIN32
+typedef WSABUF RTMPSockVec;
+#define SOCKVEC_BASE(v) ((v)->buf)
+#define SOCKVEC_LEN(v) ((v)->len)
+#else
+typedef struct iovec RTMPSockVec;
+#define SOCKVEC_BASE(v) ((v)->iov_base)
+#define SOCKVEC_LEN(v) ((v)->iov_len)
+#endif
+
+static int
+WriteVSocket(RTMP *r, const RTMPVec *vec, int cnt)
+{
+    RTMPSockVec bufs[RTMP_MAX_WRITE_VECS];
+    int first = 0, num = 0, total = 0, i;
+
+    for (i = 0; i < cnt; i++)
+    {
+        if (!vec[i].len)
+            continue;
+        SOCKVEC_BASE(&bufs[num]) = (char *)vec[i].base;
+        SOCKVEC_LEN(&bufs[num]) = vec[i].len;
+        total += vec[i].len;
+        num++;
+    }
+
+    while (first < num)
+    {
+        int nBytes;
+
+#if defined(RTMP_NETSTACK_DUMP)
+        for (i = first; i < num; i++)
+            fwrite(SOCKVEC_BASE(&bufs[i]), 1, SOCKVEC_LEN(&bufs[i]),
+                   netstackdump);
+#endif
+
+#ifdef _WIN32
+        DWORD sent = 0;
+        nBytes = WSASend(r->m_sb.sb_socket, bufs + first, num - first, &sent,
+                         0, NULL, NULL) == 0 ? (int)sent : -1;
+#else
+        nBytes = (int)writev(r->m_sb.sb_socket, bufs + first, num - first);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d (%d bytes)", __FUNCTION__,
+                     sockerr, total);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        while (first < num && nBytes >= (int)SOCKVEC_LEN(&bufs[first]))
+            nBytes -= (int)SOCKVEC_LEN(&bufs[first++]);
+
+        if (first < num)
+        {
+            SOCKVEC_BASE(&bufs[first]) = (char *)SOCKVEC_BASE(&bufs[first]) + nBytes;
+            SOCKVEC_LEN(&bufs[first]) -= nBytes;
+        }
+    }
+
+    return TRUE;
+}
+
+/* writes several buffers as if they were one.  on a plain socket they are
+ * gathered by the kernel, so they never have to be copied together first */
+static int
+WriteV(RTMP *r, const RTMPVec *vec, int cnt)
+{
+    int direct = !(r->Link.protocol & RTMP_FEATURE_HTTP) &&
+                 !(r->m_bCustomSend && r->m_customSendFunc);
+    int i;
+
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut || r->m_sb.sb_ssl)
+        direct = FALSE;
+#endif
+
+    if (direct)
+        return WriteVSocket(r, vec, cnt);
+
+    /* every write is its own request over HTTP */
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+    {
+        int total = 0, wrote;
+        char *buf, *ptr;
+
+        for (i = 0; i < cnt; i++)
+            total += vec[i].len;
+
+        buf = ptr = malloc(total);
+        if (!buf)
+            return FALSE;
+
+        for (i = 0; i < cnt; i++)
+        {
+            memcpy(ptr, vec[i].base, vec[i].len);
+            ptr += vec[i].len;
+        }
+
+        wrote = WriteN(r, buf, total);
+        free(buf);
+        return wrote;
+    }
+
+    for (i = 0; i < cnt; i++)
+    {
+        if (vec[i].len && !WriteN(r, vec[i].base, vec[i].len))
+            return FALSE;
+    }
+    return TRUE;
+}
+
 #define SAVC(x)	static const AVal av_##x = AVC(#x)
 
 SAVC(app);
@@ -3934,6 +4072,14 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
 
 int
 RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    return SendPacket(r, packet, NULL, queue);
+}
+
+/* body, if set, holds the packet body in up to two parts that are sent from
+ * where they are instead of from packet->m_body */
+static int
+SendPacket(RTMP *r, RTMPPacket *packet, const RTMPVec *body, int queue)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
@@ -3944,6 +4090,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     char *buffer, *tbuf = NULL, *toff = NULL;
     int nChunkSize;
     int tlen;
+    int part = 0, partOff = 0;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4081,31 +4228,69 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             nChunkSize = nSize;
 
         RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)header, hSize);
-        RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)buffer, nChunkSize);
-        if (tbuf)
+        if (body)
         {
-            memcpy(toff, header, nChunkSize + hSize);
-            toff += nChunkSize + hSize;
+            RTMPVec vec[RTMP_MAX_WRITE_VECS];
+            int nVec = 1, left = nChunkSize, i;
+
+            vec[0].base = header;
+            vec[0].len = hSize;
+            while (left)
+            {
+                int num = body[part].len - partOff;
+                if (num > left)
+                    num = left;
+                vec[nVec].base = body[part].base + partOff;
+                vec[nVec++].len = num;
+                left -= num;
+                partOff += num;
+                if (partOff == body[part].len)
+                {
+                    part++;
+                    partOff = 0;
+                }
+            }
+
+            if (tbuf)
+            {
+                for (i = 0; i < nVec; i++)
+                {
+                    memcpy(toff, vec[i].base, vec[i].len);
+                    toff += vec[i].len;
+                }
+            }
+            else
+            {
+                wrote = WriteV(r, vec, nVec);
+                if (!wrote)
+                    return FALSE;
+            }
         }
         else
         {
-            wrote = WriteN(r, header, nChunkSize + hSize);
-            if (!wrote)
-                return FALSE;
+            RTMP_LogHexString(RTMP_LOGDEBUG2, (uint8_t *)buffer, nChunkSize);
+            if (tbuf)
+            {
+                memcpy(toff, header, nChunkSize + hSize);
+                toff += nChunkSize + hSize;
+            }
+            else
+            {
+                wrote = WriteN(r, header, nChunkSize + hSize);
+                if (!wrote)
+                    return FALSE;
+            }
+            buffer += nChunkSize;
         }
         nSize -= nChunkSize;
-        buffer += nChunkSize;
         hSize = 0;
 
         if (nSize > 0)
         {
-            header = buffer - 1;
-            hSize = 1;
-            if (cSize)
-            {
-                header -= cSize;
-                hSize += cSize;
-            }
+            /* an external body has no room in front of its chunks, so
+             * their headers are written from hbuf instead */
+            hSize = 1 + cSize;
+            header = body ? hbuf : buffer - hSize;
             *header = (0xc0 | c);
             if (cSize)
             {
@@ -4126,7 +4311,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     }
 
     /* we invoked a remote method */
-    if (packet->m_packetType == RTMP_PACKET_TYPE_INVOKE)
+    if (packet->m_packetType == RTMP_PACKET_TYPE_INVOKE && packet->m_body)
     {
         AVal method;
         char *ptr;
@@ -5254,3 +5439,62 @@ RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
     }
     return size+s2;
 }
+
+/* sends one FLV tag without copying its body into a packet: header holds the
+ * 11 byte tag header plus any leading part of the body, data the rest of it.
+ * the trailing tag size is not passed in */
+int
+RTMP_WriteTag(RTMP *r, const char *header, int headerSize, const char *data,
+              int size, int streamIdx)
+{
+    RTMPPacket pkt = {0};
+    RTMPVec body[2];
+    int nBody = 0;
+
+    if (headerSize < 11)
+        return -1;
+
+    pkt.m_packetType = header[0];
+
+    /* metadata needs @setDataFrame put in front of it */
+    if (pkt.m_packetType == RTMP_PACKET_TYPE_INFO)
+    {
+        if (RTMP_Write(r, header, headerSize, streamIdx) < 0)
+            return -1;
+        return RTMP_Write(r, data, size, streamIdx);
+    }
+
+    pkt.m_nChannel = 0x04;	/* source channel */
+    pkt.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    pkt.m_nBodySize = AMF_DecodeInt24(header + 1);
+    pkt.m_nTimeStamp = AMF_DecodeInt24(header + 4);
+    pkt.m_nTimeStamp |= (uint8_t)header[7] << 24;
+
+    if (pkt.m_nBodySize != (uint32_t)(headerSize - 11 + size))
+    {
+        RTMP_Log(RTMP_LOGERROR, "%s, FLV tag size mismatch", __FUNCTION__);
+        return -1;
+    }
+
+    if ((pkt.m_packetType == RTMP_PACKET_TYPE_AUDIO
+            || pkt.m_packetType == RTMP_PACKET_TYPE_VIDEO) &&
+            !pkt.m_nTimeStamp)
+        pkt.m_headerType = RTMP_PACKET_SIZE_LARGE;
+    else
+        pkt.m_headerType = RTMP_PACKET_SIZE_MEDIUM;
+
+    if (headerSize > 11)
+    {
+        body[nBody].base = header + 11;
+        body[nBody++].len = headerSize - 11;
+    }
+    if (size > 0)
+    {
+        body[nBody].base = data;
+        body[nBody++].len = size;
+    }
+
+    if (!SendPacket(r, &pkt, nBody ? body : NULL, FALSE))
+        return -1;
+    return headerSize + size;
+}
@@ -0,0 +1,434 @@
+#ifdef __linux__
+#include "rtmp-stream.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* the send thread queues data under write_buf_mutex at any time, so the
+ * buffer is emptied and the socket closed under it too */
+static void fatal_sock_shutdown(struct rtmp_stream *stream)
+{
+	pthread_mutex_lock(&stream->write_buf_mutex);
+	close(stream->rtmp.m_sb.sb_socket);
+	stream->rtmp.m_sb.sb_socket = -1;
+	stream->write_buf_len = 0;
+	stream->write_buf_head = 0;
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	os_event_signal(stream->buffer_space_available_event);
+}
+
+/* rtmp_stream_start sets the socket non-blocking, but librtmp also sets a
+ * 30 second receive timeout on it, so make sure nothing here can ever wait
+ * on it even if that changes */
+static bool set_nonblocking(struct rtmp_stream *stream)
+{
+	int flags = fcntl(stream->rtmp.m_sb.sb_socket, F_GETFL, 0);
+
+	if (flags == -1)
+		return false;
+	if (flags & O_NONBLOCK)
+		return true;
+
+	return fcntl(stream->rtmp.m_sb.sb_socket, F_SETFL,
+			flags | O_NONBLOCK) == 0;
+}
+
+void socket_thread_linux_wake(struct rtmp_stream *stream)
+{
+	uint64_t val = 1;
+	ssize_t ret;
+
+	if (stream->wake_fd == -1)
+		return;
+
+	do {
+		ret = write(stream->wake_fd, &val, sizeof(val));
+	} while (ret == -1 && errno == EINTR);
+
+	/* EAGAIN means the counter is full, the thread is woken either way */
+	if (ret == -1 && errno != EAGAIN)
+		blog(LOG_ERROR, "socket_thread_linux: Failed to signal wake "
+				"event, errno %d", errno);
+}
+
+/* resets the wake event, EAGAIN just means it wasn't signaled */
+static bool clear_wake_event(struct rtmp_stream *stream)
+{
+	uint64_t val;
+	ssize_t ret;
+
+	do {
+		ret = read(stream->wake_fd, &val, sizeof(val));
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret == -1 && errno != EAGAIN) {
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to wake "
+				"event read failure, errno %d", errno);
+		return false;
+	}
+
+	return true;
+}
+
+static bool set_write_interest(int epoll_fd, struct rtmp_stream *stream,
+		bool want_write)
+{
+	struct epoll_event ev = {0};
+
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	if (want_write)
+		ev.events |= EPOLLOUT;
+	ev.data.fd = stream->rtmp.m_sb.sb_socket;
+
+	return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, stream->rtmp.m_sb.sb_socket,
+			&ev) == 0;
+}
+
+static bool socket_event(struct rtmp_stream *stream, uint32_t events,
+		bool *can_write, uint64_t last_send_time)
+{
+	if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+		int err_code = 0;
+		socklen_t size = sizeof(err_code);
+
+		getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_ERROR,
+				&err_code, &size);
+
+		if (last_send_time) {
+			uint32_t diff =
+				(os_gettime_ns() / 1000000) - last_send_time;
+
+			blog(LOG_ERROR, "socket_thread_linux: Received "
+					"hangup, %u ms since last send "
+					"(buffer: %d / %d)",
+					diff,
+					(int)stream->write_buf_len,
+					(int)stream->write_buf_size);
+		}
+
+		if (os_event_try(stream->stop_event) != EAGAIN)
+			blog(LOG_ERROR, "socket_thread_linux: Aborting due "
+					"to hangup during shutdown, "
+					"%d bytes lost, error %d",
+					(int)stream->write_buf_len, err_code);
+		else
+			blog(LOG_ERROR, "socket_thread_linux: Aborting due "
+					"to hangup, error %d", err_code);
+
+		fatal_sock_shutdown(stream);
+		return false;
+	}
+
+	if (events & EPOLLOUT)
+		*can_write = true;
+
+	if (events & EPOLLIN) {
+		char discard[16384];
+
+		for (;;) {
+			ssize_t ret = recv(stream->rtmp.m_sb.sb_socket,
+					discard, sizeof(discard),
+					MSG_DONTWAIT);
+			if (ret > 0)
+				continue;
+			if (ret == -1 && (errno == EAGAIN ||
+			                  errno == EWOULDBLOCK))
+				break;
+			if (ret == -1 && errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR, "socket_thread_linux: "
+					"Socket error, recv() returned "
+					"%d, errno %d",
+					(int)ret, ret ? errno : 0);
+			fatal_sock_shutdown(stream);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/* Linux has no ideal send backlog notification, so estimate it from the
+ * congestion window and grow the send buffer to match, like Windows does.
+ * Setting SO_SNDBUF turns off the kernel's own auto-tuning for the socket,
+ * so it's only done once the kernel fell behind. */
+static void ideal_send_backlog_check(struct rtmp_stream *stream,
+		int *sndbuf_size)
+{
+	struct tcp_info tcp_info;
+	socklen_t size = sizeof(tcp_info);
+	int cur_tcp_bufsize = *sndbuf_size;
+	int ideal_send_backlog;
+
+	if (getsockopt(stream->rtmp.m_sb.sb_socket, IPPROTO_TCP, TCP_INFO,
+				&tcp_info, &size) != 0)
+		return;
+
+	ideal_send_backlog = (int)(tcp_info.tcpi_snd_cwnd *
+			tcp_info.tcpi_snd_mss * 2);
+	if (ideal_send_backlog > (int)stream->write_buf_size)
+		ideal_send_backlog = (int)stream->write_buf_size;
+
+	/* once set, the kernel reports twice the requested size */
+	if (!cur_tcp_bufsize) {
+		size = sizeof(cur_tcp_bufsize);
+		if (getsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET,
+					SO_SNDBUF, &cur_tcp_bufsize,
+					&size) != 0) {
+			blog(LOG_ERROR, "socket_thread_linux: getsockopt() "
+					"failed, errno %d", errno);
+			return;
+		}
+	}
+
+	if (cur_tcp_bufsize < ideal_send_backlog) {
+		setsockopt(stream->rtmp.m_sb.sb_socket, SOL_SOCKET, SO_SNDBUF,
+				&ideal_send_backlog,
+				sizeof(ideal_send_backlog));
+		*sndbuf_size = ideal_send_backlog;
+
+		blog(LOG_INFO, "socket_thread_linux: Increasing send buffer "
+				"to ISB %d (buffer: %d / %d)",
+				ideal_send_backlog,
+				(int)stream->write_buf_len,
+				(int)stream->write_buf_size);
+	}
+}
+
+enum data_ret {
+	RET_BREAK,
+	RET_FATAL,
+	RET_CONTINUE
+};
+
+static enum data_ret write_data(struct rtmp_stream *stream, bool *can_write,
+		uint64_t *last_send_time, size_t latency_packet_size,
+		int delay_time)
+{
+	struct iovec iov[2];
+	struct msghdr msg = {0};
+	size_t send_len;
+	ssize_t ret;
+
+	pthread_mutex_lock(&stream->write_buf_mutex);
+
+	if (!stream->write_buf_len) {
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+		return RET_BREAK;
+	}
+
+	send_len = stream->write_buf_len;
+	if (stream->low_latency_mode && send_len > latency_packet_size)
+		send_len = latency_packet_size;
+
+	/* everything queued goes out in a single call, even when it wraps
+	 * around the end of the ring buffer */
+	iov[0].iov_base = stream->write_buf + stream->write_buf_head;
+	iov[0].iov_len = stream->write_buf_size - stream->write_buf_head;
+
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 1;
+
+	if (iov[0].iov_len >= send_len) {
+		iov[0].iov_len = send_len;
+	} else {
+		iov[1].iov_base = stream->write_buf;
+		iov[1].iov_len = send_len - iov[0].iov_len;
+		msg.msg_iovlen = 2;
+	}
+
+	pthread_mutex_unlock(&stream->write_buf_mutex);
+
+	/* the queued data is only ever appended to while sending, so it can
+	 * be sent without holding the lock.  when the socket is full this
+	 * returns EAGAIN and the thread waits for EPOLLOUT */
+	do {
+		ret = sendmsg(stream->rtmp.m_sb.sb_socket, &msg,
+				MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret > 0) {
+		pthread_mutex_lock(&stream->write_buf_mutex);
+		stream->write_buf_head = (stream->write_buf_head + ret) %
+			stream->write_buf_size;
+		stream->write_buf_len -= ret;
+		if (!stream->write_buf_len)
+			stream->write_buf_head = 0;
+		pthread_mutex_unlock(&stream->write_buf_mutex);
+
+		*last_send_time = os_gettime_ns() / 1000000;
+
+		os_event_signal(stream->buffer_space_available_event);
+
+	} else if (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		*can_write = false;
+		return RET_BREAK;
+
+	} else {
+		/* connection closed, or connection was aborted /
+		 * socket closed / etc, that's a fatal error. */
+		blog(LOG_ERROR, "socket_thread_linux: "
+				"Socket error, sendmsg() returned %d, "
+				"errno %d",
+				(int)ret, ret ? errno : 0);
+
+		fatal_sock_shutdown(stream);
+		return RET_FATAL;
+	}
+
+	if (delay_time)
+		os_sleep_ms(delay_time);
+
+	return RET_CONTINUE;
+}
+
+#define LATENCY_FACTOR 20
+#define SEND_BACKLOG_CHECK_MS 1000
+
+static inline void socket_thread_linux_internal(struct rtmp_stream *stream)
+{
+	bool can_write = true;
+	bool want_write = false;
+
+	int delay_time;
+	size_t latency_packet_size;
+	uint64_t last_send_time = 0;
+	uint64_t last_backlog_check = 0;
+	int sndbuf_size = 0;
+
+	struct epoll_event ev = {0};
+	int epoll_fd;
+
+	if (!set_nonblocking(stream)) {
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to "
+				"failure to set the socket non-blocking, "
+				"errno %d", errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd == -1) {
+		blog(LOG_ERROR, "socket_thread_linux: Aborting due to "
+				"epoll_create1 failure, errno %d", errno);
+		fatal_sock_shutdown(stream);
+		return;
+	}
+
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.fd = stream->rtmp.m_sb.sb_socket;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream->rtmp.m_sb.sb_socket, &ev);
+
+	ev.events = EPOLLIN;
+	ev.data.fd = stream->wake_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stream->wake_fd, &ev);
+
+	if (stream->low_latency_mode) {
+		delay_time = 1000 / LATENCY_FACTOR;
+		latency_packet_size = stream->write_buf_size / (LATENCY_FACTOR - 2);
+	} else {
+		latency_packet_size = stream->write_buf_size;
+		delay_time = 0;
+	}
+
+	if (stream->disable_send_window_optimization)
+		blog(LOG_INFO, "socket_thread_linux: Send window "
+				"optimization disabled by user.");
+
+	for (;;) {
+		struct epoll_event events[2];
+		int count;
+
+		if (os_event_try(stream->send_thread_signaled_exit) != EAGAIN) {
+			pthread_mutex_lock(&stream->write_buf_mutex);
+			if (stream->write_buf_len == 0) {
+				pthread_mutex_unlock(&stream->write_buf_mutex);
+				os_event_reset(stream->send_thread_signaled_exit);
+				break;
+			}
+
+			pthread_mutex_unlock(&stream->write_buf_mutex);
+		}
+
+		/* only wait for the socket to be writable after it filled up,
+		 * level triggered EPOLLOUT would otherwise never block */
+		if (want_write != !can_write) {
+			want_write = !can_write;
+			set_write_interest(epoll_fd, stream, want_write);
+		}
+
+		count = epoll_wait(epoll_fd, events, 2,
+				SEND_BACKLOG_CHECK_MS);
+		if (count == -1) {
+			if (errno == EINTR)
+				continue;
+
+			blog(LOG_ERROR, "socket_thread_linux: Aborting due "
+					"to epoll_wait failure, errno %d",
+					errno);
+			fatal_sock_shutdown(stream);
+			break;
+		}
+
+		for (int i = 0; i < count; i++) {
+			if (events[i].data.fd == stream->wake_fd) {
+				if (!clear_wake_event(stream)) {
+					fatal_sock_shutdown(stream);
+					close(epoll_fd);
+					return;
+				}
+
+			} else if (!socket_event(stream, events[i].events,
+					&can_write, last_send_time)) {
+				close(epoll_fd);
+				return;
+			}
+		}
+
+		if (!stream->disable_send_window_optimization) {
+			uint64_t now = os_gettime_ns() / 1000000;
+			if (now - last_backlog_check >= SEND_BACKLOG_CHECK_MS) {
+				ideal_send_backlog_check(stream, &sndbuf_size);
+				last_backlog_check = now;
+			}
+		}
+
+		/* drain until empty or the socket would block, new data only
+		 * wakes this thread when it's queued into an empty buffer */
+		while (can_write) {
+			enum data_ret ret = write_data(
+					stream,
+					&can_write,
+					&last_send_time,
+					latency_packet_size,
+					delay_time);
+
+			if (ret == RET_BREAK)
+				break;
+			if (ret == RET_FATAL) {
+				close(epoll_fd);
+				return;
+			}
+		}
+	}
+
+	close(epoll_fd);
+	blog(LOG_INFO, "socket_thread_linux: Normal exit");
+}
+
+void *socket_thread_linux(void *data)
+{
+	struct rtmp_stream *stream = data;
+
+	os_set_thread_name("rtmp-stream: socket_thread_linux");
+	socket_thread_linux_internal(stream);
+	return NULL;
+}
+#endif
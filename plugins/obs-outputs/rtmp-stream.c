@@ -158,6 +158,9 @@ static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
     warn("Failed to initialize socket exit event");
     goto fail;
   }
+#ifdef __linux__
+  stream->wake_fd = -1;
+#endif
 
   UNUSED_PARAMETER(settings);
   return stream;
@@ -317,47 +320,93 @@ retry_send:
     goto retry_send;
   }
 
-  memcpy(stream->write_buf + stream->write_buf_len, data, len);
+  /* the buffer is a ring, the socket thread may send from the middle of it
+   * and then queued data wraps around the end */
+  size_t tail = (stream->write_buf_head + stream->write_buf_len) %
+    stream->write_buf_size;
+  size_t first = stream->write_buf_size - tail;
+  bool was_empty = stream->write_buf_len == 0;
+
+  if (first > (size_t)len)
+    first = (size_t)len;
+
+  memcpy(stream->write_buf + tail, data, first);
+  if (first < (size_t)len)
+    memcpy(stream->write_buf, data + first, len - first);
   stream->write_buf_len += len;
 
   pthread_mutex_unlock(&stream->write_buf_mutex);
 
   os_event_signal (stream->buffer_has_data_event);
+#ifdef __linux__
+  /* the socket thread drains everything it can before waiting again, so
+   * it only needs waking up when data is queued into an empty buffer */
+  if (was_empty)
+    socket_thread_linux_wake(stream);
+#else
+  UNUSED_PARAMETER(was_empty);
+#endif
 
   return len;
 }
 
-static int send_packet(struct rtmp_stream *stream,
-    struct encoder_packet *packet, bool is_header, size_t idx)
+#define RECV_CHECK_INTERVAL_NS 100000000ULL
+
+/* the server only sends acknowledgements and pings, which the socket buffer
+ * easily holds for a while, so they don't need to be looked for with every
+ * packet sent */
+static bool check_recv_data(struct rtmp_stream *stream)
 {
-  uint8_t *data;
-  size_t  size;
-  int     recv_size = 0;
-  int     ret = 0;
+  uint64_t now = os_gettime_ns();
+  int      recv_size = 0;
+  int      ret;
+
+  if (now - stream->last_recv_check_ns < RECV_CHECK_INTERVAL_NS)
+    return true;
+  stream->last_recv_check_ns = now;
 
-  if (!stream->new_socket_loop) {
 #ifdef _WIN32
-    ret = ioctlsocket(stream->rtmp.m_sb.sb_socket, FIONREAD,
-        (u_long*)&recv_size);
+  ret = ioctlsocket(stream->rtmp.m_sb.sb_socket, FIONREAD,
+      (u_long*)&recv_size);
 #else
-    ret = ioctl(stream->rtmp.m_sb.sb_socket, FIONREAD, &recv_size);
+  ret = ioctl(stream->rtmp.m_sb.sb_socket, FIONREAD, &recv_size);
 #endif
 
-    if (ret >= 0 && recv_size > 0) {
-      if (!discard_recv_data(stream, (size_t)recv_size))
-        return -1;
-    }
-  }
+  if (ret >= 0 && recv_size > 0)
+    return discard_recv_data(stream, (size_t)recv_size);
+  return true;
+}
 
-  flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-      &data, &size, is_header);
+static int send_packet(struct rtmp_stream *stream,
+    struct encoder_packet *packet, bool is_header, size_t idx)
+{
+  uint8_t header[FLV_TAG_HEADER_MAX_SIZE];
+  size_t  header_size;
+  size_t  size;
+  int     ret = 0;
+
+  if (!stream->new_socket_loop && !check_recv_data(stream))
+    return -1;
+
+  /* the tag header and the payload are handed to librtmp separately and
+   * the payload is sent from the packet's own buffer, so it is never copied
+   * into an FLV or RTMP packet buffer.  the trailing tag size does not need
+   * sending, but is still counted so the byte totals match the muxed
+   * stream */
+  header_size = flv_packet_mux_header(packet,
+      is_header ? 0 : stream->start_dts_offset, header, is_header);
+  size = header_size ? header_size + packet->size + 4 : 0;
 
 #ifdef TEST_FRAMEDROPS
   droptest_cap_data_rate(stream, size);
 #endif
 
-  ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
-  bfree(data);
+  if (header_size)
+    ret = RTMP_WriteTag(&stream->rtmp, (char*)header, (int)header_size,
+        (char*)packet->data, (int)packet->size, (int)idx);
+
+  if (!is_header && ret >= 0)
+    obs_output_packet_sent(stream->output, packet);
 
   if (is_header)
     bfree(packet->data);
@@ -486,9 +535,16 @@ static void *send_thread(void *data)
   if (stream->new_socket_loop) {
     os_event_signal(stream->send_thread_signaled_exit);
     os_event_signal(stream->buffer_has_data_event);
+#ifdef __linux__
+    socket_thread_linux_wake(stream);
+#endif
     pthread_join(stream->socket_thread, NULL);
     stream->socket_thread_active = false;
     stream->rtmp.m_bCustomSend = false;
+#ifdef __linux__
+    close(stream->wake_fd);
+    stream->wake_fd = -1;
+#endif
   }
 
   set_output_error(stream);
@@ -694,10 +750,22 @@ static int init_send(struct rtmp_stream *stream)
 
     stream->write_buf_size = ideal_buffer_size;
     stream->write_buf = bmalloc(ideal_buffer_size);
+    stream->write_buf_head = 0;
+    stream->write_buf_len = 0;
 
 #ifdef _WIN32
     ret = pthread_create(&stream->socket_thread, NULL,
         socket_thread_windows, stream);
+#elif defined(__linux__)
+    stream->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (stream->wake_fd == -1) {
+      RTMP_Close(&stream->rtmp);
+      warn("Failed to create socket thread wake event");
+      return OBS_OUTPUT_ERROR;
+    }
+
+    ret = pthread_create(&stream->socket_thread, NULL,
+        socket_thread_linux, stream);
 #else
     warn("New socket loop not supported on this platform");
     return OBS_OUTPUT_ERROR;
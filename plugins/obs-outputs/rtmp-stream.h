@@ -16,6 +16,11 @@
 #include <sys/ioctl.h>
 #endif
 
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
 #define do_log(level, format, ...) \
 	blog(level, "[rtmp stream: '%s'] " format, \
 			obs_output_get_name(stream->output), ##__VA_ARGS__)
@@ -92,11 +97,13 @@ struct rtmp_stream {
 	RTMP             rtmp;
 
 	bool             new_socket_loop;
+	uint64_t         last_recv_check_ns;
 	bool             low_latency_mode;
 	bool             disable_send_window_optimization;
 	bool             socket_thread_active;
 	pthread_t        socket_thread;
 	uint8_t          *write_buf;
+	size_t           write_buf_head;
 	size_t           write_buf_len;
 	size_t           write_buf_size;
 	pthread_mutex_t  write_buf_mutex;
@@ -104,8 +111,14 @@ struct rtmp_stream {
 	os_event_t       *buffer_has_data_event;
 	os_event_t       *socket_available_event;
 	os_event_t       *send_thread_signaled_exit;
+#ifdef __linux__
+	int              wake_fd;
+#endif
 };
 
 #ifdef _WIN32
 void *socket_thread_windows(void *data);
+#elif defined(__linux__)
+void *socket_thread_linux(void *data);
+void socket_thread_linux_wake(struct rtmp_stream *stream);
 #endif
\ No newline at end of file
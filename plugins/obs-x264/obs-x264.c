@@ -45,8 +45,6 @@ struct obs_x264 {
 	x264_param_t           params;
 	x264_t                 *context;
 
-	DARRAY(uint8_t)        packet_data;
-
 	uint8_t                *extra_data;
 	uint8_t                *sei;
 
@@ -86,7 +84,6 @@ static void obs_x264_destroy(void *data)
 	if (obsx264) {
 		os_end_high_performance(obsx264->performance_token);
 		clear_data(obsx264);
-		da_free(obsx264->packet_data);
 		bfree(obsx264);
 	}
 }
@@ -652,18 +649,26 @@ static void parse_packet(struct obs_x264 *obsx264,
 		struct encoder_packet *packet, x264_nal_t *nals,
 		int nal_count, x264_picture_t *pic_out)
 {
+	size_t size = 0;
+	uint8_t *data;
+
 	if (!nal_count) return;
 
-	da_resize(obsx264->packet_data, 0);
+	for (int i = 0; i < nal_count; i++)
+		size += nals[i].i_payload;
+
+	/* write straight into a pooled packet buffer, which libobs then
+	 * passes on to outputs without copying */
+	data = obs_encoder_packet_alloc(obsx264->encoder, size);
+	packet->data = data;
+	packet->size = size;
 
 	for (int i = 0; i < nal_count; i++) {
 		x264_nal_t *nal = nals+i;
-		da_push_back_array(obsx264->packet_data, nal->p_payload,
-				nal->i_payload);
+		memcpy(data, nal->p_payload, nal->i_payload);
+		data += nal->i_payload;
 	}
 
-	packet->data          = obsx264->packet_data.array;
-	packet->size          = obsx264->packet_data.num;
 	packet->type          = OBS_ENCODER_VIDEO;
 	packet->pts           = pic_out->i_pts;
 	packet->dts           = pic_out->i_dts;
@@ -769,6 +774,7 @@ struct obs_encoder_info obs_x264_encoder = {
 	.id             = "obs_x264",
 	.type           = OBS_ENCODER_VIDEO,
 	.codec          = "h264",
+	.caps           = OBS_ENCODER_CAP_REFCOUNTED_PACKETS,
 	.get_name       = obs_x264_getname,
 	.create         = obs_x264_create,
 	.destroy        = obs_x264_destroy,
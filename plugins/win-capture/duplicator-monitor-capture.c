@@ -309,7 +309,8 @@ struct obs_source_info duplicator_capture_info = {
 	.id             = "monitor_capture",
 	.type           = OBS_SOURCE_TYPE_INPUT,
 	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
-	                  OBS_SOURCE_DO_NOT_DUPLICATE,
+	                  OBS_SOURCE_DO_NOT_DUPLICATE |
+	                  OBS_SOURCE_OPAQUE_VIDEO,
 	.get_name       = duplicator_capture_getname,
 	.create         = duplicator_capture_create,
 	.destroy        = duplicator_capture_destroy,
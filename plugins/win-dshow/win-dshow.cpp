@@ -1908,7 +1908,8 @@ void RegisterDShowSource()
 	info.output_flags    = OBS_SOURCE_VIDEO |
 	                       OBS_SOURCE_AUDIO |
 	                       OBS_SOURCE_ASYNC |
-	                       OBS_SOURCE_DO_NOT_DUPLICATE;
+	                       OBS_SOURCE_DO_NOT_DUPLICATE |
+	                       OBS_SOURCE_OPAQUE_VIDEO;
 	info.show            = ShowDShowInput;
 	info.hide            = HideDShowInput;
 	info.get_name        = GetDShowInputName;
@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <util/platform.h>
+#include <media-io/audio-kernels.h>
+
+/* one tick of stereo audio at the default AUDIO_OUTPUT_FRAMES, plus a few
+ * samples to exercise the scalar tail of the vector kernels */
+#define SAMPLES 2051
+#define ITERATIONS 200000
+
+/* the vector kernels round like the scalar ones, this only allows for the
+ * compiler contracting the scalar multiply-add */
+#define TOLERANCE 1e-6f
+
+enum kernel {
+	KERNEL_MIX,
+	KERNEL_MIX_MUL,
+	KERNEL_SCALE,
+	KERNEL_MUL,
+	KERNEL_CLAMP,
+
+	KERNEL_COUNT
+};
+
+static const char *kernel_names[KERNEL_COUNT] = {
+	"mix",
+	"mix_mul",
+	"scale",
+	"mul",
+	"clamp"
+};
+
+static float dst[SAMPLES];
+static float src[SAMPLES];
+static float mul[SAMPLES];
+static float inv_mul[SAMPLES];
+static float expected[KERNEL_COUNT][SAMPLES];
+
+static void fill_buffers(void)
+{
+	for (size_t i = 0; i < SAMPLES; i++) {
+		dst[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+		src[i] = (float)rand() / (float)RAND_MAX * 2.0f - 1.0f;
+		mul[i] = (float)rand() / (float)RAND_MAX * 0.5f + 0.5f;
+		inv_mul[i] = 1.0f / mul[i];
+	}
+}
+
+static void run_kernel(enum kernel kernel)
+{
+	switch (kernel) {
+	case KERNEL_MIX:
+		audio_mix(dst, src, SAMPLES);
+		break;
+	case KERNEL_MIX_MUL:
+		audio_mix_mul(dst, src, mul, SAMPLES);
+		break;
+	/* these two undo themselves so the values never turn denormal */
+	case KERNEL_SCALE:
+		audio_scale(dst, 0.5f, SAMPLES);
+		audio_scale(dst, 2.0f, SAMPLES);
+		break;
+	case KERNEL_MUL:
+		audio_mul(dst, mul, SAMPLES);
+		audio_mul(dst, inv_mul, SAMPLES);
+		break;
+	case KERNEL_CLAMP:
+		audio_clamp(dst, SAMPLES);
+		break;
+	case KERNEL_COUNT:
+		break;
+	}
+}
+
+/* mixed values grow by at most 1.0 per iteration, which stays far from
+ * anything slow for floats, so nothing needs to be clamped while timing */
+static double bench_kernel(enum kernel kernel)
+{
+	size_t calls = (kernel == KERNEL_SCALE || kernel == KERNEL_MUL) ? 2 : 1;
+	uint64_t start, end;
+
+	fill_buffers();
+	for (size_t i = 0; i < ITERATIONS / 100; i++)
+		run_kernel(kernel);
+
+	fill_buffers();
+	start = os_gettime_ns();
+	for (size_t i = 0; i < ITERATIONS; i++)
+		run_kernel(kernel);
+	end = os_gettime_ns();
+
+	return (double)(end - start) /
+		((double)ITERATIONS * (double)(SAMPLES * calls));
+}
+
+static void run_once(enum kernel kernel, float *out)
+{
+	srand(1);
+	fill_buffers();
+	run_kernel(kernel);
+	memcpy(out, dst, sizeof(dst));
+}
+
+static bool check_kernel(enum kernel kernel)
+{
+	float out[SAMPLES];
+
+	run_once(kernel, out);
+
+	for (size_t i = 0; i < SAMPLES; i++) {
+		float diff = fabsf(out[i] - expected[kernel][i]);
+		if (diff > TOLERANCE * fmaxf(1.0f, fabsf(expected[kernel][i]))) {
+			printf("\n%s differs from scalar at %zu: %g != %g\n",
+					kernel_names[kernel], i, out[i],
+					expected[kernel][i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(void)
+{
+	int ret = 0;
+
+	audio_kernels_set_impl(AUDIO_KERNEL_SCALAR);
+	for (size_t k = 0; k < KERNEL_COUNT; k++)
+		run_once((enum kernel)k, expected[k]);
+
+	printf("%-8s", "");
+	for (size_t k = 0; k < KERNEL_COUNT; k++)
+		printf("%10s", kernel_names[k]);
+	printf("   (ns/sample)\n");
+
+	for (int impl = 0; impl < AUDIO_KERNEL_IMPL_COUNT; impl++) {
+		if (!audio_kernels_set_impl((enum audio_kernel_impl)impl))
+			continue;
+
+		printf("%-8s", audio_kernels_impl_name(
+					(enum audio_kernel_impl)impl));
+		for (size_t k = 0; k < KERNEL_COUNT; k++) {
+			if (!check_kernel((enum kernel)k)) {
+				ret = 1;
+				break;
+			}
+			printf("%10.4f", bench_kernel((enum kernel)k));
+		}
+		printf("\n");
+	}
+
+	return ret;
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+
+#include <util/platform.h>
+#include <util/threading.h>
+#include <obs.h>
+
+/* the canvas is taller than the main video, and the item checked is below
+ * the bottom of the main video, under an opaque item that covers the whole
+ * main video height.  sizing the scene's item caches or culling from the
+ * main base size would leave the item out of the canvas */
+#define MAIN_CX 640
+#define MAIN_CY 360
+#define CANVAS_CX 360
+#define CANVAS_CY 640
+
+#define LOW_Y 440
+#define CHECK_X 100
+#define CHECK_Y 540
+
+/* frames to wait for, the item caches are only used once the scene looked
+ * the same for two frames */
+#define WAIT_FRAMES 10
+#define TIMEOUT_MS 5000
+
+struct solid {
+	uint32_t color;
+	uint32_t cx;
+	uint32_t cy;
+};
+
+static os_event_t *done_event;
+static volatile long frames;
+static volatile bool passed;
+
+static const char *solid_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Solid Color (Test)";
+}
+
+static void *solid_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct solid *solid = bzalloc(sizeof(struct solid));
+	solid->color = (uint32_t)obs_data_get_int(settings, "color");
+	solid->cx    = (uint32_t)obs_data_get_int(settings, "width");
+	solid->cy    = (uint32_t)obs_data_get_int(settings, "height");
+
+	UNUSED_PARAMETER(source);
+	return solid;
+}
+
+static void solid_destroy(void *data)
+{
+	bfree(data);
+}
+
+static void solid_render(void *data, gs_effect_t *effect)
+{
+	struct solid *solid = data;
+	gs_effect_t *solid_effect = obs_get_base_effect(OBS_EFFECT_SOLID);
+	gs_eparam_t *color = gs_effect_get_param_by_name(solid_effect,
+			"color");
+	struct vec4 colorf;
+
+	vec4_from_rgba(&colorf, solid->color);
+	gs_effect_set_vec4(color, &colorf);
+
+	while (gs_effect_loop(solid_effect, "Solid"))
+		gs_draw_sprite(NULL, 0, solid->cx, solid->cy);
+
+	UNUSED_PARAMETER(effect);
+}
+
+static uint32_t solid_getwidth(void *data)
+{
+	return ((struct solid*)data)->cx;
+}
+
+static uint32_t solid_getheight(void *data)
+{
+	return ((struct solid*)data)->cy;
+}
+
+static struct obs_source_info solid_info = {
+	.id             = "canvas_test_solid",
+	.type           = OBS_SOURCE_TYPE_INPUT,
+	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_STATIC_VIDEO |
+	                  OBS_SOURCE_OPAQUE_VIDEO,
+	.get_name       = solid_getname,
+	.create         = solid_create,
+	.destroy        = solid_destroy,
+	.video_render   = solid_render,
+	.get_width      = solid_getwidth,
+	.get_height     = solid_getheight
+};
+
+static obs_sceneitem_t *add_solid(obs_scene_t *scene, const char *name,
+		uint32_t color, uint32_t cx, uint32_t cy, float x, float y)
+{
+	obs_data_t *settings = obs_data_create();
+	obs_source_t *source;
+	obs_sceneitem_t *item;
+	struct vec2 pos;
+
+	obs_data_set_int(settings, "color", color);
+	obs_data_set_int(settings, "width", cx);
+	obs_data_set_int(settings, "height", cy);
+
+	source = obs_source_create("canvas_test_solid", name, settings, NULL);
+	item = obs_scene_add(scene, source);
+
+	vec2_set(&pos, x, y);
+	obs_sceneitem_set_pos(item, &pos);
+
+	obs_source_release(source);
+	obs_data_release(settings);
+	return item;
+}
+
+static void receive_frame(void *param, struct video_data *frame)
+{
+	const uint8_t *pixel = frame->data[0] +
+		CHECK_Y * frame->linesize[0] + CHECK_X * 4;
+
+	if (os_atomic_inc_long(&frames) != WAIT_FRAMES)
+		return;
+
+	/* red, not the blue of the item above or the black background */
+	os_atomic_set_bool(&passed,
+			pixel[0] > 200 && pixel[1] < 50 && pixel[2] < 50);
+	os_event_signal(done_event);
+
+	UNUSED_PARAMETER(param);
+}
+
+static bool reset_video(void)
+{
+	struct obs_video_info ovi = {0};
+
+	ovi.graphics_module = "libobs-opengl";
+	ovi.fps_num         = 30;
+	ovi.fps_den         = 1;
+	ovi.base_width      = MAIN_CX;
+	ovi.base_height     = MAIN_CY;
+	ovi.output_width    = MAIN_CX;
+	ovi.output_height   = MAIN_CY;
+	ovi.output_format   = VIDEO_FORMAT_RGBA;
+	ovi.gpu_conversion  = true;
+	ovi.colorspace      = VIDEO_CS_709;
+	ovi.range           = VIDEO_RANGE_FULL;
+	ovi.scale_type      = OBS_SCALE_BICUBIC;
+
+	return obs_reset_video(&ovi) == OBS_VIDEO_SUCCESS;
+}
+
+int main(void)
+{
+	struct obs_canvas_info info = {0};
+	obs_canvas_t *canvas = NULL;
+	obs_scene_t *scene = NULL;
+	int ret = 1;
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return 1;
+
+	/* no graphics available, nothing to test */
+	if (!reset_video()) {
+		printf("canvas-test: couldn't initialize video, skipped\n");
+		obs_shutdown();
+		return 0;
+	}
+
+	obs_register_source(&solid_info);
+	os_event_init(&done_event, OS_EVENT_TYPE_MANUAL);
+
+	info.base_width    = CANVAS_CX;
+	info.base_height   = CANVAS_CY;
+	info.output_width  = CANVAS_CX;
+	info.output_height = CANVAS_CY;
+	info.output_format = VIDEO_FORMAT_RGBA;
+
+	canvas = obs_canvas_create("canvas-test", &info);
+	if (!canvas) {
+		printf("canvas-test: couldn't create canvas\n");
+		goto fail;
+	}
+
+	/* two items so they are cached as one run, then the occluder */
+	scene = obs_scene_create("canvas-test");
+	add_solid(scene, "low 1", 0xFF0000FF, 200, 200, 0.0f, (float)LOW_Y);
+	add_solid(scene, "low 2", 0xFF0000FF, 100, 100, 200.0f, (float)LOW_Y);
+	add_solid(scene, "top", 0xFFFF0000, CANVAS_CX, MAIN_CY, 0.0f, 0.0f);
+
+	obs_view_set_source(obs_canvas_get_view(canvas), 0,
+			obs_scene_get_source(scene));
+
+	video_output_connect(obs_canvas_get_video(canvas), NULL,
+			receive_frame, NULL);
+
+	if (os_event_timedwait(done_event, TIMEOUT_MS) != 0) {
+		printf("canvas-test: no canvas frames received\n");
+	} else if (!os_atomic_load_bool(&passed)) {
+		printf("canvas-test: item below the main video height is "
+				"missing from the canvas\n");
+	} else {
+		printf("canvas-test: passed\n");
+		ret = 0;
+	}
+
+	video_output_disconnect(obs_canvas_get_video(canvas), receive_frame,
+			NULL);
+	obs_view_set_source(obs_canvas_get_view(canvas), 0, NULL);
+
+fail:
+	obs_scene_release(scene);
+	if (canvas)
+		obs_canvas_destroy(canvas);
+	os_event_destroy(done_event);
+	obs_shutdown();
+	return ret;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <obs-data.h>
+
+/* roughly what a large scene collection looks like: every source has the
+ * usual top level keys, a settings object and a few filters */
+#define NUM_SOURCES 5000
+#define NUM_SETTINGS 24
+#define NUM_FILTERS 2
+
+static void add_settings(struct dstr *json, int source_idx, int count)
+{
+	dstr_cat(json, "{");
+	for (int i = 0; i < count; i++)
+		dstr_catf(json, "%s\"setting_%02d\":%d", i ? "," : "", i,
+				source_idx + i);
+	dstr_cat(json, "}");
+}
+
+static void add_source(struct dstr *json, int idx)
+{
+	dstr_catf(json, "{\"name\":\"Source %d\",\"id\":\"image_source\","
+			"\"flags\":0,\"volume\":1.0,\"balance\":0.5,"
+			"\"mixers\":255,\"sync\":0,\"muted\":false,"
+			"\"enabled\":true,\"deinterlace_mode\":0,"
+			"\"deinterlace_field_order\":0,"
+			"\"monitoring_type\":0,\"push-to-mute\":false,"
+			"\"push-to-mute-delay\":0,\"push-to-talk\":false,"
+			"\"push-to-talk-delay\":0,\"private_settings\":{},"
+			"\"hotkeys\":{},\"settings\":", idx);
+	add_settings(json, idx, NUM_SETTINGS);
+
+	dstr_cat(json, ",\"filters\":[");
+	for (int i = 0; i < NUM_FILTERS; i++) {
+		dstr_catf(json, "%s{\"name\":\"Filter %d\","
+				"\"id\":\"crop_filter\",\"enabled\":true,"
+				"\"settings\":", i ? "," : "", i);
+		add_settings(json, i, NUM_SETTINGS / 4);
+		dstr_cat(json, "}");
+	}
+	dstr_cat(json, "]}");
+}
+
+static void build_collection(struct dstr *json)
+{
+	dstr_cat(json, "{\"current_scene\":\"Scene\",\"sources\":[");
+	for (int i = 0; i < NUM_SOURCES; i++) {
+		if (i)
+			dstr_cat(json, ",");
+		add_source(json, i);
+	}
+
+	/* a flat object with one key per source, the worst case for lookups */
+	dstr_cat(json, "],\"source_order\":{");
+	for (int i = 0; i < NUM_SOURCES; i++)
+		dstr_catf(json, "%s\"Source %d\":%d", i ? "," : "", i, i);
+	dstr_cat(json, "}}");
+}
+
+/* reads the source like obs_load_source does */
+static long long load_source(obs_data_t *source_data)
+{
+	obs_data_t *settings = obs_data_get_obj(source_data, "settings");
+	obs_data_array_t *filters = obs_data_get_array(source_data, "filters");
+	long long sum = 0;
+	char key[32];
+
+	sum += (long long)strlen(obs_data_get_string(source_data, "name"));
+	sum += (long long)strlen(obs_data_get_string(source_data, "id"));
+	sum += obs_data_get_int(source_data, "flags");
+	sum += (long long)obs_data_get_double(source_data, "volume");
+	sum += (long long)obs_data_get_double(source_data, "balance");
+	sum += obs_data_get_int(source_data, "mixers");
+	sum += obs_data_get_int(source_data, "sync");
+	sum += obs_data_get_bool(source_data, "muted");
+	sum += obs_data_get_bool(source_data, "enabled");
+	sum += obs_data_get_int(source_data, "deinterlace_mode");
+	sum += obs_data_get_int(source_data, "deinterlace_field_order");
+	sum += obs_data_get_int(source_data, "monitoring_type");
+	sum += obs_data_get_bool(source_data, "push-to-mute");
+	sum += obs_data_get_int(source_data, "push-to-mute-delay");
+	sum += obs_data_get_bool(source_data, "push-to-talk");
+	sum += obs_data_get_int(source_data, "push-to-talk-delay");
+
+	for (int i = 0; i < NUM_SETTINGS; i++) {
+		snprintf(key, sizeof(key), "setting_%02d", i);
+		sum += obs_data_get_int(settings, key);
+	}
+
+	for (size_t i = 0; i < obs_data_array_count(filters); i++) {
+		obs_data_t *filter = obs_data_array_item(filters, i);
+		sum += (long long)strlen(obs_data_get_string(filter, "name"));
+		sum += obs_data_get_bool(filter, "enabled");
+		obs_data_release(filter);
+	}
+
+	obs_data_array_release(filters);
+	obs_data_release(settings);
+	return sum;
+}
+
+static inline double ms_since(uint64_t start)
+{
+	return (double)(os_gettime_ns() - start) / 1000000.0;
+}
+
+int main(void)
+{
+	struct dstr json = {0};
+	obs_data_t *data;
+	obs_data_t *order;
+	obs_data_array_t *sources;
+	long long sum = 0;
+	uint64_t start;
+	char name[32];
+
+	/* saved collections have their keys sorted, run the generated json
+	 * through obs_data once to get the same */
+	build_collection(&json);
+	data = obs_data_create_from_json(json.array);
+	dstr_copy(&json, obs_data_get_json(data));
+	obs_data_release(data);
+
+	printf("collection: %d sources, %.1f MiB of json\n", NUM_SOURCES,
+			(double)json.len / (1024.0 * 1024.0));
+
+	start = os_gettime_ns();
+	data = obs_data_create_from_json(json.array);
+	printf("parse:        %8.2f ms\n", ms_since(start));
+
+	start = os_gettime_ns();
+	sources = obs_data_get_array(data, "sources");
+	for (size_t i = 0; i < obs_data_array_count(sources); i++) {
+		obs_data_t *source_data = obs_data_array_item(sources, i);
+		sum += load_source(source_data);
+		obs_data_release(source_data);
+	}
+	obs_data_array_release(sources);
+	printf("load sources: %8.2f ms\n", ms_since(start));
+
+	start = os_gettime_ns();
+	order = obs_data_get_obj(data, "source_order");
+	for (int i = 0; i < NUM_SOURCES; i++) {
+		snprintf(name, sizeof(name), "Source %d", i);
+		sum += obs_data_get_int(order, name);
+	}
+	obs_data_release(order);
+	printf("flat lookups: %8.2f ms (%d keys)\n", ms_since(start),
+			NUM_SOURCES);
+
+	start = os_gettime_ns();
+	obs_data_get_json(data);
+	printf("save:         %8.2f ms\n", ms_since(start));
+
+	obs_data_release(data);
+	dstr_free(&json);
+
+	/* keeps the reads from being optimized out */
+	return sum == -1;
+}
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <util/platform.h>
+#include <util/threading.h>
+#include <callback/signal.h>
+
+/* emitters call a signal with a few callbacks connected while another thread
+ * keeps connecting and disconnecting one, like sources being added and
+ * removed while the audio and video threads are signalling */
+#define CALLBACKS 4
+#define DURATION_MS 1000
+#define MAX_EMITTERS 8
+
+static signal_handler_t *handler;
+static volatile bool running;
+static volatile long calls;
+
+struct emitter {
+	pthread_t thread;
+	long      emissions;
+};
+
+static void callback(void *data, calldata_t *params)
+{
+	os_atomic_inc_long(&calls);
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(params);
+}
+
+static void churn_callback(void *data, calldata_t *params)
+{
+	UNUSED_PARAMETER(data);
+	UNUSED_PARAMETER(params);
+}
+
+static void *emit_thread(void *data)
+{
+	struct emitter *emitter = data;
+	calldata_t params = {0};
+
+	while (os_atomic_load_bool(&running)) {
+		signal_handler_signal(handler, "update", &params);
+		emitter->emissions++;
+	}
+
+	calldata_free(&params);
+	return NULL;
+}
+
+static void *churn_thread(void *data)
+{
+	while (os_atomic_load_bool(&running)) {
+		signal_handler_connect(handler, "update", churn_callback, data);
+		signal_handler_disconnect(handler, "update", churn_callback,
+				data);
+	}
+
+	return NULL;
+}
+
+static double bench(size_t num_emitters, bool churn)
+{
+	struct emitter emitters[MAX_EMITTERS] = {0};
+	pthread_t churner;
+	long total = 0;
+
+	os_atomic_set_bool(&running, true);
+
+	for (size_t i = 0; i < num_emitters; i++)
+		pthread_create(&emitters[i].thread, NULL, emit_thread,
+				&emitters[i]);
+	if (churn)
+		pthread_create(&churner, NULL, churn_thread, NULL);
+
+	os_sleep_ms(DURATION_MS);
+	os_atomic_set_bool(&running, false);
+
+	for (size_t i = 0; i < num_emitters; i++) {
+		pthread_join(emitters[i].thread, NULL);
+		total += emitters[i].emissions;
+	}
+	if (churn)
+		pthread_join(churner, NULL);
+
+	return (double)total / ((double)DURATION_MS / 1000.0);
+}
+
+int main(void)
+{
+	handler = signal_handler_create();
+	signal_handler_add(handler, "void update()");
+
+	for (size_t i = 0; i < CALLBACKS; i++)
+		signal_handler_connect(handler, "update", callback,
+				(void*)(uintptr_t)(i + 1));
+
+	printf("%-10s%16s%16s   (emissions/sec)\n", "emitters", "idle",
+			"churn");
+
+	for (size_t emitters = 1; emitters <= MAX_EMITTERS; emitters *= 2) {
+		printf("%-10zu", emitters);
+		printf("%16.0f", bench(emitters, false));
+		printf("%16.0f\n", bench(emitters, true));
+	}
+
+	signal_handler_destroy(handler);
+	return 0;
+}